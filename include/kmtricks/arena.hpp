@@ -0,0 +1,176 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+
+#include <spdlog/spdlog.h>
+
+#include <kmtricks/exceptions.hpp>
+
+namespace km {
+
+enum class PAGES
+{
+  NONE,
+  THP,
+  HUGETLB
+};
+
+inline PAGES str_to_pages(const std::string& s)
+{
+  if (s == "thp")
+    return PAGES::THP;
+  else if (s == "hugetlb")
+    return PAGES::HUGETLB;
+  return PAGES::NONE;
+}
+
+// Bump allocator of counting tasks, with the interface of gatb's MemAllocator. Each worker
+// thread owns one, which keeps its largest mapping from one task to the next instead of
+// mapping and zeroing a fresh region per partition. Memory is not cleared between tasks.
+class CountArena
+{
+  static constexpr uint64_t huge_page_size = 2 << 20;
+
+public:
+  CountArena() = default;
+  CountArena(const CountArena&) = delete;
+  CountArena& operator=(const CountArena&) = delete;
+
+  ~CountArena()
+  {
+    if (m_mapped)
+      spdlog::debug("[arena] - high-water mark: {} MB, mapped: {} MB",
+                    high_water() >> 20, m_mapped >> 20);
+    unmap();
+  }
+
+  // Arena of the calling thread, released when the thread exits.
+  static CountArena& local()
+  {
+    thread_local CountArena arena;
+    return arena;
+  }
+
+  // Backing of the mappings created from now on.
+  static void set_pages(PAGES pages)
+  {
+    s_pages = pages;
+  }
+
+  // Releases previous allocations and makes room for size bytes.
+  void reserve(uint64_t size)
+  {
+    free_all();
+    // room for align() calls
+    size += 1024;
+    if (size > m_mapped)
+      map(size);
+    m_capacity = size;
+  }
+
+  char* pool_malloc(uint64_t size, const char* message = "")
+  {
+    uint64_t used = m_used.fetch_add(size);
+    if (size > m_capacity - std::min(used, m_capacity))
+    {
+      m_used -= size;
+      throw MemoryError(fmt::format("Arena allocation failed for {} bytes ({}), {} used of {}",
+                                    size, message, used, m_capacity));
+    }
+    return m_buffer + used;
+  }
+
+  void align(uint8_t align_bytes)
+  {
+    uint64_t used = m_used;
+    uintptr_t current = reinterpret_cast<uintptr_t>(m_buffer) + used;
+    uintptr_t aligned = (current + align_bytes - 1) & ~static_cast<uintptr_t>(align_bytes - 1);
+    m_used = used + (aligned - current);
+  }
+
+  uint64_t getCapacity() const { return m_capacity; }
+
+  uint64_t getUsedSpace() const { return m_used; }
+
+  void free_all()
+  {
+    m_high_water = std::max<uint64_t>(m_high_water, m_used);
+    m_used = 0;
+  }
+
+  uint64_t high_water() const
+  {
+    return std::max<uint64_t>(m_high_water, m_used);
+  }
+
+private:
+  void map(uint64_t size)
+  {
+    unmap();
+    size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (s_pages == PAGES::HUGETLB)
+    {
+      p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED)
+        spdlog::debug("[arena] - no huge pages available for {} MB, fallback to default pages",
+                      size >> 20);
+    }
+#endif
+    if (p == MAP_FAILED)
+      p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw MemoryError(fmt::format("Unable to map {} bytes: {}", size, std::strerror(errno)));
+
+#ifdef MADV_HUGEPAGE
+    if (s_pages == PAGES::THP)
+      ::madvise(p, size, MADV_HUGEPAGE);
+#endif
+    m_buffer = static_cast<char*>(p);
+    m_mapped = size;
+  }
+
+  void unmap()
+  {
+    if (m_buffer)
+      ::munmap(m_buffer, m_mapped);
+    m_buffer = nullptr;
+    m_mapped = 0;
+  }
+
+private:
+  inline static std::atomic<PAGES> s_pages {PAGES::NONE};
+
+  char* m_buffer {nullptr};
+  uint64_t m_mapped {0};
+  uint64_t m_capacity {0};
+  std::atomic<uint64_t> m_used {0};
+  uint64_t m_high_water {0};
+};
+
+};
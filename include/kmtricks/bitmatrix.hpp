@@ -21,15 +21,22 @@
 #include <exception>
 #include <fstream>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 #ifdef ARCH_ARM64
   #include <sse2neon.h>
 #else
   #include <emmintrin.h>
+  #ifdef __AVX2__
+    #include <immintrin.h>
+  #endif
 #endif
 #include <iostream>
 #include <cassert>
 #include <iomanip>
 
+#include <kmtricks/task_pool.hpp>
+
 using namespace std;
 
 namespace km
@@ -288,4 +295,100 @@ inline void __sse_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols)
     OUT(rr, cc + i) = _mm_movemask_epi8(tmp.x);
 }
 
+// Strided version of __sse_trans: bit j of input row i (LSB first) becomes bit i of output
+// row j. in_stride and out_stride are row sizes in bytes, nrows and ncols (in bits) are
+// multiples of 8. Blocks of 32 rows use AVX2 when available.
+inline void __strided_trans(uint8_t const *inp, size_t in_stride,
+                            uint8_t *out, size_t out_stride,
+                            size_t nrows, size_t ncols)
+{
+  assert(nrows % 8 == 0 && ncols % 8 == 0);
+  size_t r = 0;
+
+#ifdef __AVX2__
+  for ( ; r + 32 <= nrows; r += 32 )
+  {
+    for ( size_t cb = 0; cb < ncols / 8; cb++ )
+    {
+      alignas(32) uint8_t b[32];
+      for ( size_t i = 0; i < 32; i++ )
+        b[i] = inp[(r + i) * in_stride + cb];
+      __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i*>(b));
+      for ( int i = 7; i >= 0; i--, x = _mm256_slli_epi64(x, 1) )
+      {
+        uint32_t m = _mm256_movemask_epi8(x);
+        memcpy(&out[(cb * 8 + i) * out_stride + r / 8], &m, sizeof(m));
+      }
+    }
+  }
+#endif
+
+  for ( ; r + 16 <= nrows; r += 16 )
+  {
+    for ( size_t cb = 0; cb < ncols / 8; cb++ )
+    {
+      union { __m128i x; uint8_t b[16]; } tmp;
+      for ( size_t i = 0; i < 16; i++ )
+        tmp.b[i] = inp[(r + i) * in_stride + cb];
+      for ( int i = 7; i >= 0; i--, tmp.x = _mm_slli_epi64(tmp.x, 1) )
+      {
+        uint16_t m = _mm_movemask_epi8(tmp.x);
+        memcpy(&out[(cb * 8 + i) * out_stride + r / 8], &m, sizeof(m));
+      }
+    }
+  }
+
+  for ( ; r < nrows; r += 8 )
+  {
+    for ( size_t cb = 0; cb < ncols / 8; cb++ )
+    {
+      union { __m128i x; uint8_t b[16]; } tmp;
+      tmp.x = _mm_setzero_si128();
+      for ( size_t i = 0; i < 8; i++ )
+        tmp.b[i] = inp[(r + i) * in_stride + cb];
+      for ( int i = 7; i >= 0; i--, tmp.x = _mm_slli_epi64(tmp.x, 1) )
+        out[(cb * 8 + i) * out_stride + r / 8] = _mm_movemask_epi8(tmp.x);
+    }
+  }
+}
+
+// Transposes a nrows x ncols bit matrix by tiles of tile_rows x tile_bytes*8 bits, which
+// keeps both sides of a tile in cache. Column stripes are given to this thread and up to
+// nb_threads - 1 idle pool workers, and fn(first_col, last_col) is called by each of them
+// once its stripe is done.
+template<typename Fn>
+inline void __tiled_trans(uint8_t const *inp, size_t in_stride,
+                          uint8_t *out, size_t out_stride,
+                          size_t nrows, size_t ncols,
+                          size_t nb_threads, Fn&& fn,
+                          size_t tile_rows = 1024, size_t tile_bytes = 64)
+{
+  size_t nb_bytes = ncols / 8;
+  IdleWorkers::Lease lease(nb_threads > 1 ? nb_threads - 1 : 0);
+  size_t nb_stripes = lease.size() + 1;
+  size_t stripe = (nb_bytes + nb_stripes - 1) / nb_stripes;
+  stripe = std::max<size_t>((stripe + tile_bytes - 1) / tile_bytes * tile_bytes, tile_bytes);
+
+  auto work = [&](size_t first, size_t last) {
+    for ( size_t cb = first; cb < last; cb += tile_bytes )
+    {
+      size_t w = std::min(tile_bytes, last - cb);
+      for ( size_t r = 0; r < nrows; r += tile_rows )
+      {
+        size_t h = std::min(tile_rows, nrows - r);
+        __strided_trans(inp + r * in_stride + cb, in_stride,
+                        out + cb * 8 * out_stride + r / 8, out_stride, h, w * 8);
+      }
+    }
+    fn(first * 8, last * 8);
+  };
+
+  lease.run([&](size_t t, size_t) {
+    size_t first = t * stripe;
+    if ( t && first >= nb_bytes )
+      return;
+    work(first, std::min(first + stripe, nb_bytes));
+  });
+}
+
 }; // end of namespace km
@@ -87,7 +87,8 @@ struct main_repart
                                           1,
                                           opt->nb_parts);
     ConfigTask<MAX_K> config_task(opt->fof, props, opt->bloom_size, opt->nb_parts,
-                                   opt->bam_exclude_refs, opt->bam_include_flags, opt->bam_exclude_flags);
+                                   opt->bam_exclude_refs, opt->bam_include_flags, opt->bam_exclude_flags,
+                                   str_to_hasher(opt->hasher));
     config_task.exec();
 
     RepartTask<MAX_K> repart_task(opt->fof, opt->bam_exclude_refs, opt->bam_include_flags, opt->bam_exclude_flags, "", opt->static_repart);
@@ -132,7 +133,11 @@ struct main_superk
                                         p, config._nb_partitions));
     }
 
-    SuperKTask<MAX_K> superk_task(opt->id, opt->lz4, opt->restrict_to_list); superk_task.exec();
+    SuperKTask<MAX_K> superk_task(opt->id, opt->lz4, opt->restrict_to_list, opt->nb_threads,
+                                  opt->superk_container, false, opt->superk_dedup);
+    // workers lent to the task, which runs on this thread
+    TaskPool helpers(opt->nb_threads > 2 ? opt->nb_threads - 2 : 0);
+    superk_task.exec();
   }
 };
 
@@ -157,6 +162,8 @@ struct main_count
 
     TaskPool pool(opt->nb_threads);
     HashWindow hw(KmDir::get().m_hash_win);
+    uint64_t memory = get_count_task_memory(opt->count_memory, opt->nb_threads);
+    CountArena::set_pages(str_to_pages(opt->huge_pages));
 
     hist_t hist = opt->hist ? std::make_shared<KHist>(KmDir::get().m_fof.get_i(opt->id),
                                           config._kmerSize, 1, 255) : nullptr;
@@ -176,14 +183,16 @@ struct main_count
           spdlog::debug("[push] - CountTask - S={}, P={}", opt->id, i);
           pool.add_task(std::make_shared<CountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
             path, config, superk_storage, pinfo, i, KmDir::get().m_fof.get_i(opt->id),
-            config._kmerSize, opt->c_ab_min, opt->lz4, get_hist_clone(hist), opt->clear));
+            config._kmerSize, opt->c_ab_min, opt->lz4, get_hist_clone(hist), opt->clear, memory,
+            opt->drop_singletons));
         }
         else if (opt->format == "kff")
         {
           spdlog::debug("[push] - KffCountTask - S={}, P={}", opt->id, i);
           pool.add_task(std::make_shared<KffCountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
             path, config, superk_storage, pinfo, i, KmDir::get().m_fof.get_i(opt->id),
-            config._kmerSize, opt->c_ab_min, get_hist_clone(hist), opt->clear));
+            config._kmerSize, opt->c_ab_min, get_hist_clone(hist), opt->clear, memory,
+            opt->drop_singletons));
         }
       }
       else if (opt->format == "hash" || opt->format == "vector")
@@ -197,18 +206,20 @@ struct main_count
           pool.add_task(std::make_shared<HashCountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
                 path, config, superk_storage, pinfo, i, KmDir::get().m_fof.get_i(opt->id),
                 hw.get_window_size_bits(), config._kmerSize, opt->c_ab_min, opt->lz4,
-                get_hist_clone(hist), opt->clear));
+                get_hist_clone(hist), opt->clear, memory, hw.hasher(), opt->drop_singletons));
         }
         else
         {
           spdlog::debug("[push] - HashVecCountTask - S={}, P={}", opt->id, i);
           pool.add_task(std::make_shared<HashVecCountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
             path, config, superk_storage, pinfo, i, KmDir::get().m_fof.get_i(opt->id),
-            hw.get_window_size_bits(), config._kmerSize, opt->c_ab_min, opt->lz4, get_hist_clone(hist), opt->clear));
+            hw.get_window_size_bits(), config._kmerSize, opt->c_ab_min, opt->lz4, get_hist_clone(hist), opt->clear, memory,
+            hw.hasher(), opt->drop_singletons));
         }
       }
     }
     pool.join_all();
+    SingletonStats::get().report();
 
     if (opt->hist)
     {
@@ -249,6 +260,20 @@ struct main_merge
     TaskPool pool(opt->nb_threads);
 
     std::vector<uint32_t> ab_vec(KmDir::get().m_fof.size(), opt->m_ab_min);
+    uint32_t nb_splits = get_merge_splits(opt->nb_threads,
+                                          opt->partition_id != -1 ? 1 : config._nb_partitions);
+    size_t nb_concurrent = std::min<size_t>(opt->nb_threads,
+                                            opt->partition_id != -1 ? 1 : config._nb_partitions);
+    size_t stream_bytes = opt->count_format == COUNT_FORMAT::KMER ?
+      KmerMerger<MAX_K, DMAX_C>::stream_footprint(opt->lz4) :
+      HashMerger<DMAX_C, 32768, HashMergeReader<DMAX_C>>::stream_footprint();
+    // two read-ahead blocks per input, see MergeInput
+    stream_bytes += 2 * opt->read_ahead * 1024;
+    uint32_t group_size = get_merge_group_size(nb_concurrent * nb_splits, stream_bytes,
+                                               opt->merge_memory);
+    MergeBufferPool::get().set_capacity(nb_concurrent * nb_splits);
+    spdlog::debug("Merge inputs: {} per merge, ~{} KB per stream, {} concurrent merges",
+                  group_size, stream_bytes >> 10, nb_concurrent * nb_splits);
     for (size_t i=0; i<config._nb_partitions; i++)
     {
       if (opt->partition_id != -1)
@@ -258,13 +283,15 @@ struct main_merge
       {
         spdlog::debug("[push] - KmerMergeTask - P={}", i);
         pool.add_task(std::make_shared<KmerMergeTask<MAX_K, DMAX_C>>(
-          i, ab_vec, config._kmerSize, opt->r_min, opt->save_if, opt->lz4, opt->mode, opt->format));
+          i, ab_vec, config._kmerSize, opt->r_min, opt->save_if, opt->lz4, opt->mode, opt->format,
+          false, nb_splits, opt->read_ahead * 1024, group_size));
       }
       else
       {
         spdlog::debug("[push] - HashMergeTask - P={}", i);
         pool.add_task(std::make_shared<HashMergeTask<DMAX_C>>(
-          i, ab_vec, opt->r_min, opt->save_if, opt->lz4, opt->mode, opt->format, hw, false, 0));
+          i, ab_vec, opt->r_min, opt->save_if, opt->lz4, opt->mode, opt->format, hw, false, 0,
+          nb_splits, opt->read_ahead * 1024, group_size, opt->bf_rle));
       }
     }
     pool.join_all();
@@ -326,6 +353,40 @@ struct main_dump
         mhr.template write_as_text<DMAX_C>(out);
       }
     }
+    else if (km_file == KM_FILE::MATRIX_BLOCK)
+    {
+      MatrixBlockReader mbr(opt->input);
+      auto dump = [&mbr](std::ostream& out) {
+        if (mbr.infos().kmer_size)
+          mbr.template write_as_text<MAX_K, DMAX_C>(out);
+        else
+          mbr.template write_as_text<DMAX_C>(out);
+      };
+      if (opt->output == "stdout")
+        dump(std::cout);
+      else
+      {
+        std::ofstream out(opt->output); check_fstream_good(opt->output, out);
+        dump(out);
+      }
+    }
+    else if (km_file == KM_FILE::MATRIX_SPARSE)
+    {
+      SparseMatrixReader smr(opt->input);
+      auto dump = [&smr](std::ostream& out) {
+        if (smr.infos().kmer_size)
+          smr.template write_as_text<MAX_K, DMAX_C>(out);
+        else
+          smr.template write_as_text<DMAX_C>(out);
+      };
+      if (opt->output == "stdout")
+        dump(std::cout);
+      else
+      {
+        std::ofstream out(opt->output); check_fstream_good(opt->output, out);
+        dump(out);
+      }
+    }
     else if (km_file == KM_FILE::PAMATRIX)
     {
       PAMatrixReader pr(opt->input);
@@ -465,6 +526,16 @@ struct main_agg
       return ret;
     };
 
+    auto find_matrix_paths = [&](COUNT_FORMAT cformat, bool& block) {
+      std::vector<std::string> paths = KmDir::get().get_matrix_paths(
+        config._nb_partitions, MODE::COUNT, FORMAT::BIN, cformat, opt->lz4_in);
+      block = paths.empty();
+      if (block)
+        paths = KmDir::get().get_matrix_paths(
+          config._nb_partitions, MODE::COUNT, FORMAT::BLOCK, cformat, false);
+      return check_paths(paths);
+    };
+
     if (opt->count == "kmer")
     {
       std::vector<std::string> paths = KmDir::get().get_count_part_paths(
@@ -512,50 +583,63 @@ struct main_agg
     }
     else if (opt->matrix == "kmer")
     {
-      std::vector<std::string> paths = KmDir::get().get_matrix_paths(config._nb_partitions,
-                                                                    MODE::COUNT, FORMAT::BIN,
-                                                                    COUNT_FORMAT::KMER, opt->lz4_in);
-      paths = check_paths(paths);
+      // count matrices are either bin or block matrices
+      bool block = false;
+      std::vector<std::string> paths = find_matrix_paths(COUNT_FORMAT::KMER, block);
 
-      if (opt->sorted)
-      {
-        MatrixFileMerger<MAX_K, DMAX_C> mfm(paths, config._kmerSize);
-        if (opt->format == "text")
+      auto aggregate = [&](auto reader) {
+        using reader_t = typename decltype(reader)::type;
+        if (opt->sorted)
         {
-          if (opt->no_count)
-            opt->output == "stdout" ? mfm.write_kmers(std::cout) : mfm.write_kmers(opt->output);
+          MatrixFileMerger<MAX_K, DMAX_C, reader_t> mfm(paths, config._kmerSize);
+          if (opt->format == "text")
+          {
+            if (opt->no_count)
+              opt->output == "stdout" ? mfm.write_kmers(std::cout) : mfm.write_kmers(opt->output);
+            else
+              opt->output == "stdout" ? mfm.write_as_text(std::cout) : mfm.write_as_text(opt->output);
+          }
           else
-            opt->output == "stdout" ? mfm.write_as_text(std::cout) : mfm.write_as_text(opt->output);
+            mfm.write_as_bin(opt->output, opt->lz4);
         }
         else
-          mfm.write_as_bin(opt->output, opt->lz4);
-      }
-      else
-      {
-        MatrixFileAggregator<MAX_K, DMAX_C> mfa(paths, config._kmerSize);
-        if (opt->format == "text")
         {
-          if (opt->no_count)
-            opt->output == "stdout" ? mfa.write_kmers(std::cout) : mfa.write_kmers(opt->output);
+          MatrixFileAggregator<MAX_K, DMAX_C, reader_t> mfa(paths, config._kmerSize);
+          if (opt->format == "text")
+          {
+            if (opt->no_count)
+              opt->output == "stdout" ? mfa.write_kmers(std::cout) : mfa.write_kmers(opt->output);
+            else
+              opt->output == "stdout" ? mfa.write_as_text(std::cout) : mfa.write_as_text(opt->output);
+          }
           else
-            opt->output == "stdout" ? mfa.write_as_text(std::cout) : mfa.write_as_text(opt->output);
+            mfa.write_as_bin(opt->output, opt->lz4);
         }
-        else
-          mfa.write_as_bin(opt->output, opt->lz4);
-      }
+      };
+
+      if (block)
+        aggregate(type_tag<MatrixBlockReader<8192>>{});
+      else
+        aggregate(type_tag<MatrixReader<8192>>{});
     }
     else if (opt->matrix == "hash")
     {
-      std::vector<std::string> paths = KmDir::get().get_matrix_paths(config._nb_partitions,
-                                                                    MODE::COUNT, FORMAT::BIN,
-                                                                    COUNT_FORMAT::HASH, opt->lz4_in);
-      paths = check_paths(paths);
+      bool block = false;
+      std::vector<std::string> paths = find_matrix_paths(COUNT_FORMAT::HASH, block);
 
-      MatrixHashFileAggregator<DMAX_C> mhfa(paths);
-      if (opt->format == "text")
-        opt->output == "stdout" ? mhfa.write_as_text(std::cout) : mhfa.write_as_text(opt->output);
+      auto aggregate = [&](auto reader) {
+        using reader_t = typename decltype(reader)::type;
+        MatrixHashFileAggregator<DMAX_C, reader_t> mhfa(paths);
+        if (opt->format == "text")
+          opt->output == "stdout" ? mhfa.write_as_text(std::cout) : mhfa.write_as_text(opt->output);
+        else
+          mhfa.write_as_bin(opt->output, opt->lz4);
+      };
+
+      if (block)
+        aggregate(type_tag<MatrixBlockReader<8192>>{});
       else
-        mhfa.write_as_bin(opt->output, opt->lz4);
+        aggregate(type_tag<MatrixHashReader<8192>>{});
     }
     else if (opt->pa_matrix == "kmer")
     {
@@ -661,8 +745,12 @@ struct main_filter
 
     spdlog::info("Key = {}", sid);
     spdlog::info("Compute super-k-mers (process {} partition(s))...", partitions.size());
-    SuperKTask<MAX_K> superk_task(sid, true, partitions);
-    superk_task.exec();
+    {
+      // workers lent to the task, which runs on this thread
+      TaskPool helpers(opt->nb_threads > 2 ? opt->nb_threads - 2 : 0);
+      SuperKTask<MAX_K> superk_task(sid, true, partitions, opt->nb_threads);
+      superk_task.exec();
+    }
 
     sk_storage_t superk_storage = std::make_shared<SuperKStorageReader>(
       KmDir::get().get_superk_path(sid));
@@ -42,6 +42,14 @@ struct all_options : km_options
   double m_ab_min_f {0.0};
   bool m_ab_float = {false};
   uint32_t save_if {0};
+  uint32_t read_ahead {0};
+  uint32_t merge_memory {0};
+  uint32_t count_memory {0};
+  uint32_t superk_memory {0};
+  uint32_t superk_dedup {0};
+  std::string huge_pages {"none"};
+  bool drop_singletons {false};
+  bool bf_rle {false};
 
   uint32_t minim_type {0};
   uint32_t minim_size {0};
@@ -49,9 +57,11 @@ struct all_options : km_options
   uint32_t nb_parts {0};
 
   uint64_t bloom_size {0};
+  std::string hasher {"xxhash"};
 
   bool keep_tmp {false};
   bool lz4 {false};
+  bool superk_container {false};
   bool kff {false};
   bool hist {false};
   bool static_repart {false};
@@ -95,13 +105,23 @@ struct all_options : km_options
     RECORD(ss, m_ab_min_f);
     RECORD(ss, m_ab_float);
     RECORD(ss, save_if);
+    RECORD(ss, read_ahead);
+    RECORD(ss, merge_memory);
+    RECORD(ss, count_memory);
+    RECORD(ss, superk_memory);
+    RECORD(ss, superk_dedup);
+    RECORD(ss, huge_pages);
+    RECORD(ss, drop_singletons);
+    RECORD(ss, bf_rle);
     RECORD(ss, minim_size);
     RECORD(ss, minim_type);
     RECORD(ss, repart_type);
     RECORD(ss, nb_parts);
     RECORD(ss, bloom_size);
+    RECORD(ss, hasher);
     RECORD(ss, keep_tmp);
     RECORD(ss, lz4);
+    RECORD(ss, superk_container);
     RECORD(ss, kff);
     RECORD(ss, hist);
     RECORD(ss, static_repart);
@@ -134,7 +154,7 @@ struct all_options : km_options
     {
       throw PipelineError("--kff-output/--kff-sk-output available only in k-mer mode.");
     }
-    if (mode == MODE::BF)
+    if (mode == MODE::BF || mode == MODE::BFT)
     {
       if ((restrict_to != 1.0) || !restrict_to_list.empty())
       {
@@ -96,6 +96,7 @@ enum class MODE
   PA,
   BF,
   BFC,
+  BFT,
   UNKNOWN,
 };
 
@@ -113,6 +114,8 @@ inline MODE str_to_mode(const std::string& s)
     return MODE::BF;
   else if (s == "bfc")
     return MODE::BFC;
+  else if (s == "bft")
+    return MODE::BFT;
   else
     return MODE::UNKNOWN;
 }
@@ -131,6 +134,8 @@ inline std::string mode_to_str(MODE mode)
     return "bf";
   else if (mode == MODE::BFC)
     return "bfc";
+  else if (mode == MODE::BFT)
+    return "bft";
   else
     return "unknown";
 }
@@ -139,19 +144,34 @@ enum class HASHER
 {
   XOR,
   XXHASH,
+  NTHASH,
   UNKNOWN
 };
 
 inline HASHER str_to_hasher(const std::string& s)
 {
-  if (s == "XOR")
+  if (s == "XOR" || s == "xor")
     return HASHER::XOR;
-  else if (s == "XXHASH")
+  else if (s == "XXHASH" || s == "xxhash")
     return HASHER::XXHASH;
+  else if (s == "NTHASH" || s == "nthash")
+    return HASHER::NTHASH;
   else
     return HASHER::UNKNOWN;
 }
 
+inline std::string hasher_to_str(HASHER hasher)
+{
+  if (hasher == HASHER::XOR)
+    return "xor";
+  else if (hasher == HASHER::XXHASH)
+    return "xxhash";
+  else if (hasher == HASHER::NTHASH)
+    return "nthash";
+  else
+    return "unknown";
+}
+
 enum class OUT_FORMAT
 {
   RAW,
@@ -215,6 +235,8 @@ enum class FORMAT
 {
   BIN,
   TEXT,
+  BLOCK,
+  SPARSE,
   UNKNOWN
 };
 
@@ -224,6 +246,10 @@ inline FORMAT str_to_format2(const std::string& s)
     return FORMAT::TEXT;
   else if (s == "bin")
     return FORMAT::BIN;
+  else if (s == "block")
+    return FORMAT::BLOCK;
+  else if (s == "sparse")
+    return FORMAT::SPARSE;
   else
     return FORMAT::UNKNOWN;
 }
@@ -234,6 +260,10 @@ inline std::string format_to_str2(FORMAT format)
     return "text";
   else if (format == FORMAT::BIN)
     return "bin";
+  else if (format == FORMAT::BLOCK)
+    return "block";
+  else if (format == FORMAT::SPARSE)
+    return "sparse";
   else
     return "unknown";
 }
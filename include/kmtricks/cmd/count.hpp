@@ -40,6 +40,9 @@ struct count_options : km_options
   bool lz4;
   bool kff;
   bool hist;
+  uint32_t count_memory {0};
+  std::string huge_pages {"none"};
+  bool drop_singletons {false};
 
   std::string format;
 
@@ -55,6 +58,9 @@ struct count_options : km_options
     RECORD(ss, lz4);
     RECORD(ss, kff);
     RECORD(ss, hist);
+    RECORD(ss, count_memory);
+    RECORD(ss, huge_pages);
+    RECORD(ss, drop_singletons);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
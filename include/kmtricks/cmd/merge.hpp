@@ -38,6 +38,9 @@ struct merge_options : km_options
   uint32_t r_min;
   int32_t partition_id;
   uint32_t save_if;
+  uint32_t read_ahead {0};
+  uint32_t merge_memory {0};
+  bool bf_rle {false};
   std::vector<uint32_t> m_ab_min_vec;
 
   bool clear;
@@ -56,6 +59,9 @@ struct merge_options : km_options
     RECORD(ss, r_min);
     RECORD(ss, partition_id);
     RECORD(ss, save_if);
+    RECORD(ss, read_ahead);
+    RECORD(ss, merge_memory);
+    RECORD(ss, bf_rle);
     RECORD(ss, clear);
     RECORD(ss, lz4);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
@@ -38,6 +38,7 @@ struct repart_options : km_options
   uint32_t repart_type;
   uint32_t nb_parts;
   uint64_t bloom_size;
+  std::string hasher {"xxhash"};
   std::string bam_exclude_refs;
   uint32_t bam_include_flags {0};
   uint32_t bam_exclude_flags {0};
@@ -54,6 +55,7 @@ struct repart_options : km_options
     RECORD(ss, minim_type);
     RECORD(ss, repart_type);
     RECORD(ss, nb_parts);
+    RECORD(ss, hasher);
     RECORD(ss, static_repart);
     RECORD(ss, bam_exclude_refs);
     RECORD(ss, bam_include_flags);
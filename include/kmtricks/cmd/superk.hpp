@@ -32,6 +32,8 @@ struct superk_options : km_options
 {
   std::string id;
   bool lz4;
+  bool superk_container {false};
+  uint32_t superk_dedup {0};
   std::vector<uint32_t> restrict_to_list;
 
   std::string display()
@@ -40,6 +42,8 @@ struct superk_options : km_options
     ss << this->global_display();
     RECORD(ss, id);
     RECORD(ss, lz4);
+    RECORD(ss, superk_container);
+    RECORD(ss, superk_dedup);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
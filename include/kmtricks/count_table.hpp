@@ -0,0 +1,135 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include <kmtricks/io/sorted_runs.hpp>
+
+namespace km {
+
+// Mixes a key, an integer or a gatb k-mer, to 64 bits whose high bits are well distributed.
+template<typename K>
+inline uint64_t mix_key(const K& key)
+{
+  constexpr uint64_t golden = 0x9e3779b97f4a7c15ULL;
+  if constexpr (std::is_integral_v<K>)
+    return static_cast<uint64_t>(key) * golden;
+  else
+  {
+    const uint64_t* words = key.get_data();
+    uint64_t h = 0;
+    for (size_t i = 0; i < sizeof(K) / sizeof(uint64_t); i++)
+      h = (h ^ words[i]) * golden;
+    return h;
+  }
+}
+
+// Open-addressing table of (key, count) records over memory owned by the caller, for keys
+// which are either integers or gatb k-mers. Empty slots have a null count. Keys are added
+// until the load reaches 3/4, they are then extracted in key order and the table cleared.
+template<typename K>
+class CountTable
+{
+  using record_t = KeyCount<K>;
+
+public:
+  CountTable(void* memory, size_t bytes)
+    : m_records(static_cast<record_t*>(memory))
+  {
+    size_t capacity = bytes / sizeof(record_t);
+    while (m_bits < 63 && (uint64_t{2} << m_bits) <= capacity)
+      m_bits++;
+    m_capacity = capacity ? uint64_t{1} << m_bits : 0;
+    m_max_size = m_capacity / 4 * 3;
+    clear();
+  }
+
+  // Bytes of a table which holds distinct keys without being cleared.
+  static uint64_t memory(uint64_t distinct)
+  {
+    uint64_t capacity = 1;
+    while (capacity / 4 * 3 < distinct)
+      capacity <<= 1;
+    return capacity * sizeof(record_t);
+  }
+
+  // Counts key count times, false when the key is new and the table is full.
+  bool add(const K& key, uint32_t count = 1)
+  {
+    uint64_t mask = m_capacity - 1;
+    for (uint64_t i = slot(key); ; i = (i + 1) & mask)
+    {
+      record_t& r = m_records[i];
+      if (!r.count)
+      {
+        if (m_size >= m_max_size)
+          return false;
+        r.key = key;
+        r.count = count;
+        m_size++;
+        return true;
+      }
+      if (r.key == key)
+      {
+        r.count += std::min(count, std::numeric_limits<uint32_t>::max() - r.count);
+        return true;
+      }
+    }
+  }
+
+  // Moves the records to the front, in key order. The table must be cleared afterwards.
+  const record_t* sort()
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < m_capacity; i++)
+      if (m_records[i].count)
+        m_records[n++] = m_records[i];
+    std::sort(m_records, m_records + n,
+              [](const record_t& a, const record_t& b) { return a.key < b.key; });
+    return m_records;
+  }
+
+  void clear()
+  {
+    std::memset(static_cast<void*>(m_records), 0, m_capacity * sizeof(record_t));
+    m_size = 0;
+  }
+
+  size_t size() const { return m_size; }
+
+  size_t capacity() const { return m_capacity; }
+
+private:
+  uint64_t slot(const K& key) const
+  {
+    return m_bits ? mix_key(key) >> (64 - m_bits) : 0;
+  }
+
+private:
+  record_t* m_records;
+  uint64_t m_capacity {0};
+  uint64_t m_max_size {0};
+  uint64_t m_size {0};
+  size_t m_bits {0};
+};
+
+};
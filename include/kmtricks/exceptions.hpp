@@ -52,5 +52,6 @@ km_EXCEPTION(PipelineError);
 km_EXCEPTION(ConfigError);
 km_EXCEPTION(KSizeError);
 km_EXCEPTION(PluginError);
+km_EXCEPTION(MemoryError);
 
 };
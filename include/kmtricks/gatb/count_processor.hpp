@@ -107,6 +107,9 @@ public:
 
   void finish() override { m_writer->write(m_vec); m_writer->flush(); }
 
+  // Bits of the partition window, for counters which set them without counts.
+  std::vector<uint8_t>& bits() { return m_vec; }
+
 private:
   uint32_t m_kmer_size;
   uint32_t m_abundance_min;
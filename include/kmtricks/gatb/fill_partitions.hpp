@@ -18,6 +18,9 @@
 
 #pragma once
 #define NONCANONICAL
+#include <mutex>
+#include <atomic>
+#include <memory>
 #include <gatb/gatb_core.hpp>
 
 #include <gatb/kmer/impl/Sequence2SuperKmer.hpp>
@@ -50,7 +53,7 @@ public:
       m_extern_pinfo(pinfo),
       m_local_pinfo(nb_partitions, model.getMmersModel().getKmerSize()),
       m_repartition(repartition),
-      m_superk_files(superk)
+      m_superk_buffer(superk)
   {
     m_mask_radix.setVal(static_cast<uint64_t>(255));
     m_mask_radix = m_mask_radix << ((this->_kmersize - 4) * 2);
@@ -61,7 +64,7 @@ public:
     if ((superKmer.minimizer % this->_nbPass) == this->_pass && superKmer.isValid())
     {
       size_t p = m_repartition(superKmer.minimizer);
-      superKmer.save(p, m_superk_files);
+      superKmer.save(p, &m_superk_buffer);
       m_local_pinfo.incSuperKmer_per_minimBin(superKmer.minimizer, superKmer.size());
 
       Type radix_kxmer_forward, radix_kxmer;
@@ -106,6 +109,7 @@ public:
 
   virtual ~KmFillPartitions()
   {
+    m_superk_buffer.flush();
     m_extern_pinfo.add_sync(m_local_pinfo);
   }
 
@@ -121,7 +125,98 @@ private:
   PartiInfo<5>  m_local_pinfo;
   Type m_mask_radix;
   Repartitor& m_repartition;
-  SuperKStorageWriter* m_superk_files;
+  SuperKBuffer m_superk_buffer;
+};
+
+// Sequences of the files of a sample, read by several threads. Each file has its own
+// iterator, shared by groups of sequences. Threads start on different files and move to the
+// next unfinished one once theirs is done, so that files are parsed in parallel and that a
+// single file still feeds all the threads.
+class SampleSequences
+{
+  struct Source
+  {
+    std::string path;
+    std::mutex mutex;
+    std::atomic<bool> done {false};
+    IBank* bank {nullptr};
+    Iterator<Sequence>* it {nullptr};
+  };
+
+public:
+  SampleSequences(const std::vector<std::string>& paths, size_t group_size = 1000)
+    : m_group_size(group_size)
+  {
+    for (auto& path : paths)
+    {
+      m_sources.push_back(std::make_unique<Source>());
+      m_sources.back()->path = path;
+    }
+  }
+
+  ~SampleSequences()
+  {
+    for (auto& source : m_sources)
+      close(*source);
+  }
+
+  size_t size() const { return m_sources.size(); }
+
+  // Next group of sequences, from the file at cursor or the following ones. False once all
+  // the files are done.
+  bool next(std::vector<Sequence>& seqs, size_t& cursor)
+  {
+    for (size_t n = 0; n < m_sources.size(); n++, cursor = (cursor + 1) % m_sources.size())
+    {
+      Source& source = *m_sources[cursor];
+      if (source.done)
+        continue;
+
+      std::lock_guard<std::mutex> lock(source.mutex);
+      if (source.done)
+        continue;
+      if (!source.it)
+        open(source);
+      seqs.resize(m_group_size);
+      if (!source.it->get(seqs))
+      {
+        source.done = true;
+        close(source);
+      }
+      if (!seqs.empty())
+        return true;
+    }
+    return false;
+  }
+
+private:
+  // Files are opened on first use, to keep few of them open at once.
+  static void open(Source& source)
+  {
+    source.bank = Bank::open(source.path);
+    source.bank->use();
+    source.it = source.bank->iterator();
+    source.it->use();
+  }
+
+  static void close(Source& source)
+  {
+    if (source.it)
+    {
+      source.it->finalize();
+      source.it->forget();
+      source.it = nullptr;
+    }
+    if (source.bank)
+    {
+      source.bank->forget();
+      source.bank = nullptr;
+    }
+  }
+
+private:
+  size_t m_group_size;
+  std::vector<std::unique_ptr<Source>> m_sources;
 };
 
 
@@ -19,12 +19,22 @@
 #include <gatb/bank/api/IBank.hpp>
 #include <gatb/kmer/api/ICountProcessor.hpp>
 #include <gatb/tools/designpattern/api/ICommand.hpp>
-#include <gatb/tools/collections/impl/Hash16.hpp>
 #include <gatb/tools/misc/api/Abundance.hpp>
 #include <robin_hood.h>
+#include <cassert>
+#include <cstring>
 
 #include <kmtricks/gatb/count_processor.hpp>
+#include <kmtricks/gatb/superk_decoder.hpp>
 #include <kmtricks/superk.hpp>
+#include <kmtricks/radix_sort.hpp>
+#include <kmtricks/io/sorted_runs.hpp>
+#include <kmtricks/count_table.hpp>
+#include <kmtricks/singleton_filter.hpp>
+#include <kmtricks/task_pool.hpp>
+#include <kmtricks/arena.hpp>
+#include <kmtricks/nthash.hpp>
+#include <kmtricks/cmd/cmd_common.hpp>
 
 #include <spdlog/spdlog.h>
 
@@ -73,7 +83,7 @@ public:
   IPartitionCounter(CountProcessor *processor,
                     size_t kmer_size,
                     PartiInfo<5>* pinfo,
-                    MemAllocator& pool,
+                    CountArena& pool,
                     Storage *superk_storage,
                     uint32_t part)
       : m_processor(processor), m_kmer_size(kmer_size), m_pinfo(pinfo), m_pool(pool),
@@ -107,13 +117,241 @@ protected:
     m_processor = processor;
   }
 
+  // Idle workers to borrow, large partitions only. A task cannot use more than the pools have.
+  size_t helpers() const
+  {
+    return m_pinfo->getNbKmer(m_part) >= parallel_threshold ? IdleWorkers::get().workers() : 0;
+  }
+
+  // Runs fn(t, n) on this thread and the leased workers.
+  template<typename Fn>
+  void run_parallel(IdleWorkers::Lease& lease, Fn&& fn)
+  {
+    if (lease.size())
+      spdlog::debug("[parallel] - P={}, {} threads", m_part, lease.size() + 1);
+    lease.run(std::forward<Fn>(fn));
+  }
+
+  void open_partition()
+  {
+    if constexpr(std::is_same_v<Storage, SuperKmerBinFiles>)
+      m_superk_storage->openFile("r", m_part);
+    else
+      m_superk_storage->openFile(m_part);
+  }
+
+  void close_partition()
+  {
+    m_superk_storage->closeFile(m_part);
+  }
+
+  // Number of values of value_size bytes which fit in the rest of the pool, once aligned.
+  size_t sort_buffer_size(size_t value_size)
+  {
+    m_pool.align(16);
+    if (m_pool.getUsedSpace() >= m_pool.getCapacity())
+      return 0;
+    return (m_pool.getCapacity() - m_pool.getUsedSpace()) / value_size;
+  }
+
+public:
+  // For partitions which do not fit in the pool, or whose singletons are dropped: keys are
+  // counted by sorted runs, spilled to files named after prefix when they do not fit.
+  void spill_to(const std::string& prefix)
+  {
+    m_spill_prefix = prefix;
+  }
+
+  // For partitions with few distinct keys: keys are counted in a table which takes the whole
+  // pool, runs are spilled to files named after prefix each time it fills.
+  void count_in_table(const std::string& prefix)
+  {
+    m_spill_prefix = prefix;
+    m_table = true;
+  }
+
+  // For partitions whose keys seen once are thrown away by the processor: they are dropped
+  // before counting, using a sketch of bytes bytes from the pool.
+  void drop_singletons(uint64_t bytes)
+  {
+    m_filter_bytes = bytes;
+  }
+
+protected:
+  bool spilled() const
+  {
+    return !m_spill_prefix.empty();
+  }
+
+  bool filtered() const
+  {
+    return m_filter_bytes;
+  }
+
+  // Empty when singletons are kept, it is taken from the pool before anything else.
+  SingletonFilter singleton_filter()
+  {
+    if (!m_filter_bytes)
+      return SingletonFilter();
+    size_t bytes = std::max<size_t>(m_filter_bytes, SingletonFilter::block_bytes);
+    m_pool.align(SingletonFilter::block_bytes);
+    return SingletonFilter(m_pool.pool_malloc(bytes, "singleton filter"), bytes);
+  }
+
+  // decode(emit) for keys which are not singletons, the partition is decoded twice when
+  // filter is set: once to fill it, once to emit the keys it reports as repeated.
+  template<typename K, typename Decode, typename Emit>
+  void decode_kept(SingletonFilter& filter, Decode& decode, Emit&& emit)
+  {
+    if (!filter)
+    {
+      decode(emit);
+      return;
+    }
+
+    // probes are made lag keys after their prefetch, keys seen several times at once are
+    // added twice
+    constexpr size_t lag = 16;
+    K keys[lag];
+    uint64_t hashes[lag];
+    uint32_t counts[lag];
+    size_t n = 0;
+    auto add = [&](size_t i) {
+      filter.add(hashes[i]);
+      if (counts[i] > 1)
+        filter.add(hashes[i]);
+    };
+    decode([&](const K& key, uint32_t count) {
+      uint64_t h = SingletonFilter::hash(key);
+      filter.prefetch(h);
+      size_t i = n++ % lag;
+      if (n > lag)
+        add(i);
+      hashes[i] = h;
+      counts[i] = count;
+    });
+    for (size_t i = n > lag ? n - lag : 0; i < n; i++)
+      add(i % lag);
+
+    uint64_t seen = 0, removed = 0;
+    auto keep = [&](size_t i) {
+      if (filter.repeated(hashes[i]))
+        emit(keys[i], counts[i]);
+      else
+        removed++;
+    };
+    decode([&](const K& key, uint32_t count) {
+      uint64_t h = SingletonFilter::hash(key);
+      filter.prefetch(h);
+      size_t i = seen++ % lag;
+      if (seen > lag)
+        keep(i);
+      keys[i] = key;
+      hashes[i] = h;
+      counts[i] = count;
+    });
+    for (size_t i = seen > lag ? seen - lag : 0; i < seen; i++)
+      keep(i % lag);
+    spdlog::debug("[singletons] - P={}, {} of {} removed", m_part, removed, seen);
+    SingletonStats::get().add(seen, removed);
+  }
+
+  bool tabled() const
+  {
+    return m_table;
+  }
+
+  // Counts keys by chunks of half the pool, the other half being the sort buffer. Each chunk
+  // is sorted and written as a run, runs are then merged. decode(emit) calls emit(key, 1)
+  // for each occurrence of a key of the partition, from the start at each call,
+  // sort(data, size, buffer, buffer_size) sorts a chunk and insert(key, count) receives the
+  // counts in key order.
+  template<typename K, typename Decode, typename Sort, typename Insert>
+  void count_spilled(Decode&& decode, Sort&& sort, Insert&& insert)
+  {
+    SingletonFilter filter = singleton_filter();
+    size_t capacity = std::max<size_t>(sort_buffer_size(sizeof(K)) / 2, 1);
+    K* keys = (K*)m_pool.pool_malloc(2 * capacity * sizeof(K), "spilled keys");
+    K* buffer = keys + capacity;
+
+    SortedRuns<K> runs(m_spill_prefix, keys, 2 * capacity * sizeof(K));
+    size_t size = 0;
+    decode_kept<K>(filter, decode, [&](const K& key, uint32_t count) {
+      // partitions with multiplicity records are counted in a table, see plan_count
+      assert(count == 1);
+      (void)count;
+      keys[size++] = key;
+      if (size == capacity)
+      {
+        sort(keys, size, buffer, capacity);
+        runs.add(keys, size);
+        size = 0;
+      }
+    });
+    sort(keys, size, buffer, capacity);
+
+    if (!runs.size())
+    {
+      // everything fits after all
+      for (size_t i = 0, j = 0; i < size; i = j)
+      {
+        for (j = i + 1; j < size && keys[j] == keys[i]; j++);
+        insert(keys[i], static_cast<uint32_t>(j - i));
+      }
+      return;
+    }
+
+    runs.add(keys, size);
+    spdlog::debug("[spill] - P={}, {} runs", m_part, runs.size());
+    runs.merge(insert);
+  }
+
+  // Counts keys in a table over the rest of the pool. When it is full, its records are
+  // written as a sorted run and it is cleared, runs are then merged. decode and insert are
+  // those of count_spilled, except that emit(key, count) may be given keys seen count times.
+  template<typename K, typename Decode, typename Insert>
+  void count_tabled(Decode&& decode, Insert&& insert)
+  {
+    SingletonFilter filter = singleton_filter();
+    size_t bytes = sort_buffer_size(1);
+    void* memory = m_pool.pool_malloc(bytes, "count table");
+    CountTable<K> table(memory, bytes);
+    SortedRuns<K> runs(m_spill_prefix, memory, bytes);
+
+    decode_kept<K>(filter, decode, [&](const K& key, uint32_t count) {
+      if (table.add(key, count))
+        return;
+      runs.add(table.sort(), table.size());
+      table.clear();
+      if (!table.add(key, count))
+        throw MemoryError(fmt::format("Count table of {} bytes is too small", bytes));
+    });
+
+    const KeyCount<K>* records = table.sort();
+    if (!runs.size())
+    {
+      for (size_t i = 0; i < table.size(); i++)
+        insert(records[i].key, records[i].count);
+      return;
+    }
+
+    runs.add(records, table.size());
+    spdlog::debug("[table] - P={}, {} runs", m_part, runs.size());
+    runs.merge(insert);
+  }
+
 protected:
+  static constexpr size_t parallel_threshold = 1 << 20;
+
   CountProcessor *m_processor;
   size_t m_kmer_size;
   PartiInfo<5>* m_pinfo;
-  MemAllocator& m_pool;
+  CountArena& m_pool;
   Storage *m_superk_storage;
   uint32_t m_part;
+  std::string m_spill_prefix;
+  bool m_table {false};
+  uint64_t m_filter_bytes {0};
 };
 
 template <typename Storage, size_t span>
@@ -140,59 +378,26 @@ public:
 
   void execute()
   {
-    uint nbbreak = 0;
     unsigned int nb_bytes_read;
+    SuperkDecoder<span, true> decoder(m_kmer_size);
     while (m_superk_storage->readBlock(&m_buffer, &m_buffer_size, &nb_bytes_read, m_file_id))
     {
       //decode block and iterate through its superkmers
-      unsigned char *ptr = m_buffer;
-      u_int8_t nbK; //number of kmers in the superkmer
-      int nbsuperkmer_read = 0;
-      u_int8_t newbyte = 0;
+      const uint8_t *ptr = m_buffer;
 
       while (ptr < (m_buffer + nb_bytes_read)) //decode whole block
       {
-        //decode a superkmer
-        nbK = *ptr;
-        ptr++;
-        //int nb_bytes_superk = (_kmerSize + nbK -1 +3) /4  ;
-
-        int rem_size = m_kmer_size;
-
-        Type Tnewbyte;
-        int nbr = 0;
-        m_seedk.setVal(0);
-        while (rem_size >= 4)
-        {
-          newbyte = *ptr;
-          ptr++;
-          Tnewbyte.setVal(newbyte);
-
-          m_seedk = m_seedk | (Tnewbyte << (8 * nbr));
-          rem_size -= 4;
-          nbr++;
-        }
-
-        int uid = 4; //uid = nb nt used in current newbyte
-
-        //reste du seed kmer
-        if (rem_size > 0)
-        {
-          newbyte = *ptr;
-          ptr++;
-          Tnewbyte.setVal(newbyte);
-
-          m_seedk = (m_seedk | (Tnewbyte << (8 * nbr)));
-          uid = rem_size;
-        }
-        m_seedk = m_seedk & m_kmer_mask;
-
-        ///////////////////////// seedk should be ready here , now parse kx-mers ////////////////////////////////
-
-        u_int8_t rem = nbK;
-        Type temp = m_seedk;
-        Type rev_temp = revcomp(temp, m_kmer_size);
-        Type newnt;
+        ptr = decoder.decode(ptr);
+        size_t nbK = decoder.size();
+        if (nbK == 0)
+          continue;
+        // partitions with multiplicity records are counted in a table, see plan_count
+        assert(decoder.count() == 1);
+        const Type* forward = decoder.forward();
+        const Type* reverse = decoder.reverse();
+
+        Type temp = forward[0];
+        Type rev_temp = reverse[0];
         Type mink, prev_mink;
         prev_mink.setVal(0);
         uint64_t idx;
@@ -209,12 +414,13 @@ public:
 
         u_int8_t rid;
 
-        for (int ii = 0; ii < nbK; ii++, rem--)
+        for (size_t ii = 0; ii < nbK; ii++)
         {
+          temp = forward[ii];
+          rev_temp = reverse[ii];
           bool which = (temp < rev_temp);
           mink = which ? temp : rev_temp;
 
-          nbbreak++;
           if (which != prev_which || kx_size >= m_kx) // kxmer_size = 1
           {
             //output kxmer size kx_size,radix_kxmer
@@ -252,29 +458,6 @@ public:
 
           prev_which = which;
           prev_mink = mink;
-
-          if (rem < 2)
-            break; //no more kmers in this superkmer, the last one has just been eaten
-
-          //////////////////////////////now decode next kmer of this superkmer //////////////////////////////////////////////
-
-          if (uid >= 4) //read next byte
-          {
-            newbyte = *ptr;
-            ptr++;
-            Tnewbyte.setVal(newbyte);
-            uid = 0;
-          }
-
-          newnt = (Tnewbyte >> (2 * uid)) & 3;
-          uid++;
-
-          temp = ((temp << 2) | newnt) & m_kmer_mask;
-
-          newnt.setVal(comp_NT[newnt.getVal()]);
-          rev_temp = ((rev_temp >> 2) | (newnt << m_shift)) & m_kmer_mask;
-
-          ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
         }
 
         //record last kxmer prev_mink et monk ?
@@ -297,13 +480,6 @@ public:
 
         m_radix_kmers[IX(kx_size, rid)][idx] = kinsert << ((4 - kx_size) * 2); // [kx_size][rid]
         //cout << "went okay " << idx << endl;
-
-        //////////////////////////////////////////////////////////
-        //ptr+=nb_bytes_superk;
-
-        //now go to next superk of this block, ptr should point to beginning of next superk
-        nbsuperkmer_read++;
-        /////////
       }
     }
 
@@ -336,7 +512,18 @@ struct IHasher
 {
   typedef typename ::Kmer<span>::Type Type;
   static constexpr size_t slot {(span + 31) / 32};
-  virtual uint64_t operator()(Type& kmer) = 0;
+  virtual uint64_t operator()(const Type& kmer) = 0;
+
+  // Hashes the n consecutive k-mers of a super-k-mer. Forward k-mers are only given to
+  // rolling hashers.
+  virtual void operator()(const Type* forward, const Type* canonical, size_t n, uint64_t* out)
+  {
+    (void)forward;
+    for (size_t i = 0; i < n; i++)
+      out[i] = (*this)(canonical[i]);
+  }
+
+  virtual bool rolling() const { return false; }
   virtual ~IHasher() = default;
 };
 
@@ -351,7 +538,7 @@ public:
     : m_kmer_size(kmer_size), m_win(win), m_p(p), m_len(((kmer_size+31)/32)*8)
   {}
   typedef typename ::Kmer<span>::Type Type;
-  uint64_t operator()(Type &kmer)
+  uint64_t operator()(const Type &kmer)
   {
     return (XXH64(kmer.get_data(), m_len, 0) % m_win) + (m_win * m_p);
   }
@@ -362,111 +549,116 @@ private:
   uint64_t m_len;
 };
 
-template <typename Storage, size_t span>
-class ReadSuperkHash
+// Canonical ntHash, rolled along super-k-mers.
+template <size_t span>
+struct KmNtHash : public IHasher<span>
 {
   typedef typename ::Kmer<span>::Type Type;
 
-public:
-  ReadSuperkHash(Storage *superk_storage,
-                 int file_id,
-                 int kmer_size,
-                 uint64_t *r_idx,
-                 uint64_t *array,
-                 uint64_t window)
-      : superk_storage(superk_storage), file_id(file_id), buffer(0), buffer_size(0),
-        kmer_size(kmer_size), r_idx(r_idx), array(array), win_size(window)
+  KmNtHash(size_t kmer_size, uint64_t win, uint64_t p)
+    : m_kmer_size(kmer_size), m_win(win), m_p(p), m_shift(2 * (kmer_size - 1)), m_hash(kmer_size)
+  {}
+
+  uint64_t operator()(const Type& kmer)
   {
-    Type un;
-    un.setVal(1);
-    kmer_mask = (un << (kmer_size * 2)) - 1;
-    shift = 2 * (kmer_size - 1);
-    hasher = std::make_unique<KmXXHash<span>>(kmer_size, win_size, file_id);
+    m_hash.init(kmer.get_data());
+    return to_window(m_hash.value());
   }
 
-  void execute()
+  void operator()(const Type* forward, const Type*, size_t n, uint64_t* out)
   {
-    uint nbbreak = 0;
-    uint32_t nb_bytes_read;
-    while (superk_storage->readBlock(&buffer, &buffer_size, &nb_bytes_read, file_id))
+    if (!n)
+      return;
+    m_hash.init(forward[0].get_data());
+    out[0] = to_window(m_hash.value());
+    for (size_t i = 1; i < n; i++)
     {
-      unsigned char *ptr = buffer;
-      uint8_t nbK;
-      int nbsuperkmer_read = 0;
-      uint8_t newbyte = 0;
-      while (ptr < (buffer + nb_bytes_read))
-      {
-        nbK = *ptr;
-        ptr++;
-        int rem_size = kmer_size;
-        Type Tnewbyte;
-        int nbr = 0;
-        seedk.setVal(0);
-        while (rem_size >= 4)
-        {
-          newbyte = *ptr;
-          ptr++;
-          Tnewbyte.setVal(newbyte);
-          seedk = seedk | (Tnewbyte << (8 * nbr));
-          rem_size -= 4;
-          nbr++;
-        }
-        int uid = 4;
-        if (rem_size > 0)
-        {
-          newbyte = *ptr;
-          ptr++;
-          Tnewbyte.setVal(newbyte);
-          seedk = (seedk | (Tnewbyte << (8 * nbr)));
-          uid = rem_size;
-        }
-        seedk = seedk & kmer_mask;
+      m_hash.roll(nt(forward[i - 1], m_shift), nt(forward[i], 0));
+      out[i] = to_window(m_hash.value());
+    }
+  }
 
-        uint8_t rem = nbK;
-        Type temp = seedk;
-        Type rev_temp = revcomp(temp, kmer_size);
-        Type mink, newnt;
-        uint64_t idx;
+  bool rolling() const { return true; }
 
-        bool which = (temp < rev_temp);
-        mink = which ? temp : rev_temp;
+private:
+  // nucleotides never straddle two words
+  static uint8_t nt(const Type& kmer, size_t shift)
+  {
+    return (kmer.get_data()[shift >> 6] >> (shift & 63)) & 3;
+  }
 
-        idx = *r_idx;
-        array[idx] = (*hasher.get())(mink);
-        ++*r_idx;
+  uint64_t to_window(uint64_t h) const
+  {
+    return NtHash::reduce(h, m_win) + (m_win * m_p);
+  }
 
-        for (int i = 0; i < nbK; i++, rem--)
-        {
-          nbbreak++;
-          if (rem < 2)
-            break;
+private:
+  size_t m_kmer_size;
+  uint64_t m_win;
+  uint64_t m_p;
+  size_t m_shift;
+  NtHash m_hash;
+};
 
-          if (uid >= 4)
-          {
-            newbyte = *ptr;
-            ptr++;
-            Tnewbyte.setVal(newbyte);
-            uid = 0;
-          }
+template <size_t span>
+hasher_t<span> make_hasher(HASHER type, size_t kmer_size, uint64_t win, uint64_t p)
+{
+  if (type == HASHER::NTHASH)
+    return std::make_unique<KmNtHash<span>>(kmer_size, win, p);
+  return std::make_unique<KmXXHash<span>>(kmer_size, win, p);
+}
 
-          newnt = (Tnewbyte >> (2 * uid)) & 3;
-          uid++;
-          temp = ((temp << 2) | newnt) & kmer_mask;
-          newnt.setVal(comp_NT[newnt.getVal()]);
-          rev_temp = ((rev_temp >> 2) | (newnt << shift)) & kmer_mask;
+// Decodes the canonical k-mers of a super-k-mer partition, block by block.
+template <typename Storage, size_t span>
+class ReadSuperkCanonical
+{
+  typedef typename ::Kmer<span>::Type Type;
 
-          which = (temp < rev_temp);
-          mink = which ? temp : rev_temp;
-          idx = *r_idx;
+public:
+  ReadSuperkCanonical(Storage *superk_storage, int file_id, int kmer_size)
+      : superk_storage(superk_storage), file_id(file_id), buffer(0), buffer_size(0),
+        kmer_size(kmer_size)
+  {
+  }
+
+  ~ReadSuperkCanonical()
+  {
+    if (buffer != 0)
+      free(buffer);
+  }
 
-          array[idx] = (*hasher.get())(mink);
-          ++*r_idx;
+  // Calls on_kmer(kmer, count) for each k-mer seen count times, and on_block() after each
+  // block.
+  template<typename KmerFn, typename BlockFn>
+  void execute(KmerFn&& on_kmer, BlockFn&& on_block)
+  {
+    execute_superk<false>(
+      [&](const Type*, const Type* kmers, size_t n, uint32_t count) {
+        for (size_t i = 0; i < n; i++)
+        {
+          Type mink = kmers[i];
+          on_kmer(mink, count);
         }
-        nbsuperkmer_read++;
+      }, on_block);
+  }
+
+  // Calls on_superk(forward, canonical, n, count) for each super-k-mer of n k-mers seen count
+  // times, forward k-mers are only decoded when oriented is set.
+  template<bool oriented, typename SuperkFn, typename BlockFn>
+  void execute_superk(SuperkFn&& on_superk, BlockFn&& on_block)
+  {
+    uint32_t nb_bytes_read;
+    SuperkDecoder<span, oriented> decoder(kmer_size);
+    while (superk_storage->readBlock(&buffer, &buffer_size, &nb_bytes_read, file_id))
+    {
+      const uint8_t *ptr = buffer;
+      while (ptr < (buffer + nb_bytes_read))
+      {
+        ptr = decoder.decode(ptr);
+        on_superk(decoder.forward(), decoder.canonical(), decoder.size(), decoder.count());
       }
+      on_block();
     }
-    if (buffer != 0)
-      free(buffer);
   }
 
 private:
@@ -475,23 +667,173 @@ private:
   unsigned char *buffer;
   unsigned int buffer_size;
   int kmer_size;
+};
+
+template <typename Storage, size_t span>
+class ReadSuperkHash
+{
+  typedef typename ::Kmer<span>::Type Type;
+
+public:
+  // Receives the hashes of each block instead of the array, with the number of times they
+  // are seen.
+  using sink_t = std::function<void(const uint64_t*, size_t, uint32_t)>;
+
+  ReadSuperkHash(Storage *superk_storage,
+                 int file_id,
+                 int kmer_size,
+                 uint64_t *r_idx,
+                 uint64_t *array,
+                 uint64_t window,
+                 HASHER hasher_type = HASHER::XXHASH)
+      : ReadSuperkHash(superk_storage, file_id, kmer_size, window, hasher_type)
+  {
+    this->r_idx = r_idx;
+    this->array = array;
+  }
+
+  ReadSuperkHash(Storage *superk_storage,
+                 int file_id,
+                 int kmer_size,
+                 uint64_t window,
+                 sink_t sink,
+                 HASHER hasher_type = HASHER::XXHASH)
+      : ReadSuperkHash(superk_storage, file_id, kmer_size, window, hasher_type)
+  {
+    this->sink = sink;
+  }
+
+private:
+  ReadSuperkHash(Storage *superk_storage,
+                 int file_id,
+                 int kmer_size,
+                 uint64_t window,
+                 HASHER hasher_type)
+      : reader(superk_storage, file_id, kmer_size), r_idx(nullptr), array(nullptr), win_size(window)
+  {
+    hasher = make_hasher<span>(hasher_type, kmer_size, win_size, file_id);
+  }
+
+public:
+  void execute()
+  {
+    if (hasher->rolling())
+      execute_superk<true>();
+    else
+      execute_superk<false>();
+  }
+
+private:
+  // Super-k-mers are hashed as a whole, rolling hashers need their forward k-mers. Hashes of
+  // repeated super-k-mers are given to the sink at once with their count.
+  template<bool oriented>
+  void execute_superk()
+  {
+    reader.template execute_superk<oriented>(
+      [this](const Type* forward, const Type* canonical, size_t n, uint32_t count) {
+        if (count == 1)
+        {
+          size_t size = hashes.size();
+          hashes.resize(size + n);
+          (*hasher.get())(forward, canonical, n, hashes.data() + size);
+          return;
+        }
+        // partitions with multiplicity records are not counted in an array, see plan_count
+        assert(sink);
+        repeated.resize(n);
+        (*hasher.get())(forward, canonical, n, repeated.data());
+        sink(repeated.data(), n, count);
+      },
+      [this]() { flush(); });
+  }
 
+  void flush()
+  {
+    if (sink)
+    {
+      sink(hashes.data(), hashes.size(), 1);
+    }
+    else
+    {
+      // one slot reservation per block, readers can run concurrently
+      uint64_t idx = __sync_fetch_and_add(r_idx, hashes.size());
+      std::copy(hashes.begin(), hashes.end(), array + idx);
+    }
+    hashes.clear();
+  }
+
+private:
+  ReadSuperkCanonical<Storage, span> reader;
   uint64_t *r_idx;
-  Type seedk;
-  Type kmer_mask;
-  size_t shift;
   uint64_t *array;
   uint64_t win_size;
   hasher_t<span> hasher;
+  std::vector<uint64_t> hashes;
+  std::vector<uint64_t> repeated;
+  sink_t sink;
 };
 
+// Number of distinct k-mers of a partition of nb_kmers k-mers, estimated from the k-mers of
+// its first blocks, about 1/8 of them up to 256K. With f1 and f2 the numbers of k-mers seen
+// once and twice in a sample of n k-mers, k-mer counts being Poisson of mean 2 * f2 / f1 in
+// the sample gives n * f1 / (2 * f2) distinct k-mers. Errors, which are seen once, lead to
+// overestimates. The partition is closed afterwards.
+template <typename Storage, size_t span>
+uint64_t estimate_distinct(Storage* superk_storage, int part, size_t kmer_size, uint64_t nb_kmers)
+{
+  typedef typename ::Kmer<span>::Type Type;
+  uint64_t target = std::min<uint64_t>(nb_kmers / 8, 1 << 18);
+
+  if constexpr(std::is_same_v<Storage, SuperKmerBinFiles>)
+    superk_storage->openFile("r", part);
+  else
+    superk_storage->openFile(part);
+
+  robin_hood::unordered_flat_map<uint64_t, uint32_t> counts;
+  counts.reserve(target);
+  SuperkDecoder<span> decoder(kmer_size);
+  unsigned char* buffer = nullptr;
+  unsigned int buffer_size = 0, nb_bytes_read = 0;
+  uint64_t n = 0;
+  while (n < target && superk_storage->readBlock(&buffer, &buffer_size, &nb_bytes_read, part))
+  {
+    const uint8_t* ptr = buffer;
+    while (ptr < buffer + nb_bytes_read)
+    {
+      ptr = decoder.decode(ptr);
+      const Type* kmers = decoder.canonical();
+      for (size_t i = 0; i < decoder.size(); i++)
+        counts[XXH64(kmers[i].get_data(), sizeof(Type), 0)] += decoder.count();
+      n += decoder.size() * decoder.count();
+    }
+  }
+  free(buffer);
+  superk_storage->closeFile(part);
+
+  uint64_t f1 = 0, f2 = 0;
+  for (auto& c : counts)
+  {
+    f1 += c.second == 1;
+    f2 += c.second == 2;
+  }
+
+  uint64_t distinct = counts.size();
+  if (n < nb_kmers && f1)
+    distinct = f2 ? std::max<uint64_t>(distinct, n * f1 / (2 * f2)) : nb_kmers;
+  return std::min<uint64_t>(distinct, nb_kmers);
+}
+
+// Buckets which fit in buffer are radix sorted on their key_bytes low-order bytes, others and
+// large k-mers use std::sort.
 template <size_t span>
 class KmerSort
 {
 public:
   typedef typename ::Kmer<span>::Type Type;
-  KmerSort(Type **kmer_vector, int begin, int end, uint64_t* radix_size)
-    : begin(begin), end(end), m_kmer_vector(kmer_vector), m_radix_size(radix_size)
+  KmerSort(Type **kmer_vector, int begin, int end, uint64_t* radix_size,
+           size_t key_bytes = sizeof(Type), Type* buffer = nullptr, size_t buffer_size = 0)
+    : begin(begin), end(end), m_kmer_vector(kmer_vector), m_radix_size(radix_size),
+      m_key_bytes(key_bytes), m_buffer(buffer), m_buffer_size(buffer_size)
   {
   }
 
@@ -502,7 +844,10 @@ public:
       if (m_radix_size[ii] > 0)
       {
         Type *kmers = m_kmer_vector[ii];
-        std::sort(&kmers[0], &kmers[m_radix_size[ii]]);
+        if (m_radix_size[ii] <= m_buffer_size && m_key_bytes <= radix_sort_max_bytes)
+          lsd_radix_sort(kmers, m_radix_size[ii], m_buffer, m_key_bytes);
+        else
+          std::sort(&kmers[0], &kmers[m_radix_size[ii]]);
       }
     }
   }
@@ -512,24 +857,36 @@ private:
   int end;
   Type **m_kmer_vector;
   uint64_t* m_radix_size;
+  size_t m_key_bytes;
+  Type* m_buffer;
+  size_t m_buffer_size;
 };
 
 class HashSort
 {
 public:
-  HashSort(uint64_t* hash_vector, size_t array_size)
-      : m_hash_vector(hash_vector), m_size(array_size)
+  HashSort(uint64_t* hash_vector, size_t array_size,
+           uint64_t* buffer = nullptr, size_t buffer_size = 0, IdleWorkers::Lease* lease = nullptr)
+      : m_hash_vector(hash_vector), m_size(array_size),
+        m_buffer(buffer), m_buffer_size(buffer_size), m_lease(lease)
   {
   }
 
   void execute()
   {
-    std::sort(&m_hash_vector[0], &m_hash_vector[m_size]);
+    if (m_lease)
+      radix_sort_hashes(m_hash_vector, m_size, m_buffer, m_buffer_size,
+                        [this](auto&& fn) { m_lease->run(fn); });
+    else
+      radix_sort_hashes(m_hash_vector, m_size, m_buffer, m_buffer_size);
   }
 
 private:
   uint64_t* m_hash_vector;
   size_t m_size;
+  uint64_t* m_buffer;
+  size_t m_buffer_size;
+  IdleWorkers::Lease* m_lease;
 };
 
 template <size_t span>
@@ -623,7 +980,7 @@ public:
                   PartiInfo<5>* pinfo,
                   int parti,
                   size_t kmer_size,
-                  MemAllocator &pool,
+                  CountArena &pool,
                   Storage *superk_storage)
       : IPartitionCounter<CountProcessor, Storage, span>(processor,
                                                 kmer_size,
@@ -636,6 +993,17 @@ public:
 
   void execute()
   {
+    if (this->tabled())
+    {
+      executeTable();
+      return;
+    }
+    if (this->spilled())
+    {
+      executeSpill();
+      return;
+    }
+
     radix_kmers = (Type **)MALLOC(256 * (KX + 1) * sizeof(Type *));
     radix_sizes = (uint64_t *)MALLOC(256 * (KX + 1) * sizeof(uint64_t));
     r_idx = (uint64_t *)CALLOC(256 * (KX + 1), sizeof(uint64_t));
@@ -650,6 +1018,37 @@ public:
   }
 
 private:
+  // Canonical k-mers instead of kx-mers, sorted by runs.
+  void executeSpill()
+  {
+    size_t key_bytes = (2 * this->m_kmer_size + 7) / 8;
+    this->template count_spilled<Type>(
+      [this](auto&& emit) { decode(emit); },
+      [&](Type* data, size_t size, Type* buffer, size_t) {
+        if (key_bytes <= radix_sort_max_bytes)
+          lsd_radix_sort(data, size, buffer, key_bytes);
+        else
+          std::sort(data, data + size);
+      },
+      [this](const Type& kmer, uint32_t count) { this->insert(kmer, count); });
+  }
+
+  void executeTable()
+  {
+    this->template count_tabled<Type>(
+      [this](auto&& emit) { decode(emit); },
+      [this](const Type& kmer, uint32_t count) { this->insert(kmer, count); });
+  }
+
+  template<typename Emit>
+  void decode(Emit&& emit)
+  {
+    this->open_partition();
+    ReadSuperkCanonical<Storage, span> reader(this->m_superk_storage, this->m_part, this->m_kmer_size);
+    reader.execute(emit, [](){});
+    this->close_partition();
+  }
+
   void executeRead()
   {
     if constexpr(std::is_same_v<Storage, SuperKmerBinFiles>)
@@ -660,7 +1059,6 @@ private:
     uint64_t sum_nbxmer = 0;
 
     {
-      LocalSynchronizer synchro(this->m_pool.getSynchro());
       this->m_pool.align(16);
 
       for (size_t xx = 0; xx < (KX + 1); xx++)
@@ -675,20 +1073,37 @@ private:
         }
       }
 
-      ReadSuperk<Storage, span> read_cmd(this->m_superk_storage, this->m_part, this->m_kmer_size,
-                                r_idx, radix_kmers, radix_sizes);
-      read_cmd.execute();
+      // blocks are shared between readers, k-mers are appended to the buckets atomically
+      IdleWorkers::Lease lease(this->helpers());
+      this->run_parallel(lease, [&](size_t, size_t) {
+        ReadSuperk<Storage, span> read_cmd(this->m_superk_storage, this->m_part, this->m_kmer_size,
+                                           r_idx, radix_kmers, radix_sizes);
+        read_cmd.execute();
+      });
     }
     this->m_superk_storage->closeFile(this->m_part);
   }
 
   void executeSort()
   {
-    for (size_t xx = 0; xx < (KX + 1); xx++)
-    {
-      KmerSort<span> sort_cmd(radix_kmers + IX(xx, 0), 0, 255, radix_sizes + IX(xx, 0));
-      sort_cmd.execute();
-    }
+    // radix sort scatter buffer, from what remains in the pool
+    size_t buffer_size = this->sort_buffer_size(sizeof(Type));
+    Type* buffer = (Type*)this->m_pool.pool_malloc(buffer_size * sizeof(Type), "sort buffer");
+
+    // kx-mers hold up to KX nucleotides after the k-mer
+    size_t key_bytes = (2 * (this->m_kmer_size + KX) + 7) / 8;
+
+    // threads pick buckets one by one, each with its share of the buffer
+    IdleWorkers::Lease lease(this->helpers());
+    std::atomic<size_t> next {0};
+    this->run_parallel(lease, [&](size_t t, size_t n) {
+      size_t size = buffer_size / n;
+      for (size_t b = next++; b < 256 * (KX + 1); b = next++)
+      {
+        KmerSort<span> sort_cmd(radix_kmers, b, b, radix_sizes, key_bytes, buffer + t * size, size);
+        sort_cmd.execute();
+      }
+    });
   }
 
   void executeDump()
@@ -919,20 +1334,34 @@ public:
                   PartiInfo<5>* pinfo,
                   int parti,
                   size_t kmer_size,
-                  MemAllocator &pool,
+                  CountArena &pool,
                   Storage *superk_storage,
-                  uint64_t window)
+                  uint64_t window,
+                  HASHER hasher = HASHER::XXHASH)
       : IPartitionCounter<CountProcessor, Storage, span>(processor,
                                                 kmer_size,
                                                 pinfo,
                                                 pool,
                                                 superk_storage,
-                                                parti), r_idx(0), window(window)
+                                                parti), r_idx(0), window(window), hasher(hasher)
   {
   }
 
   void execute()
   {
+    if (this->tabled())
+    {
+      executeTable();
+      this->m_processor->finish();
+      return;
+    }
+    if (this->spilled())
+    {
+      executeSpill();
+      this->m_processor->finish();
+      return;
+    }
+
     r_idx = (uint64_t *)CALLOC(256 * (KX + 1), sizeof(uint64_t));
 
     executeRead();
@@ -943,6 +1372,36 @@ public:
   }
 
 private:
+  void executeSpill()
+  {
+    this->template count_spilled<uint64_t>(
+      [this](auto&& emit) { decode(emit); },
+      [](uint64_t* data, size_t size, uint64_t* buffer, size_t buffer_size) {
+        radix_sort_hashes(data, size, buffer, buffer_size);
+      },
+      [this](uint64_t hash, uint32_t count) { this->insert_hash(hash, count); });
+  }
+
+  void executeTable()
+  {
+    this->template count_tabled<uint64_t>(
+      [this](auto&& emit) { decode(emit); },
+      [this](uint64_t hash, uint32_t count) { this->insert_hash(hash, count); });
+  }
+
+  template<typename Emit>
+  void decode(Emit&& emit)
+  {
+    this->open_partition();
+    ReadSuperkHash<Storage, span> read_cmd(this->m_superk_storage, this->m_part, this->m_kmer_size,
+                                           window, [&](const uint64_t* hashes, size_t size, uint32_t count) {
+      for (size_t i = 0; i < size; i++)
+        emit(hashes[i], count);
+    }, hasher);
+    read_cmd.execute();
+    this->close_partition();
+  }
+
   void executeRead()
   {
     if constexpr(std::is_same_v<Storage, SuperKmerBinFiles>)
@@ -950,21 +1409,27 @@ private:
     else
       this->m_superk_storage->openFile(this->m_part);
 
-    LocalSynchronizer synchro(this->m_pool.getSynchro());
     this->m_pool.align(16);
 
     size_t nb_kmers = this->m_pinfo->getNbKmer(this->m_part);
     array = (uint64_t*) this->m_pool.pool_malloc(nb_kmers*sizeof(uint64_t), std::to_string(this->m_part).c_str());
-    ReadSuperkHash<Storage, span> read_cmd(this->m_superk_storage, this->m_part,
-                                  this->m_kmer_size, r_idx, array, window);
-    read_cmd.execute();
+    IdleWorkers::Lease lease(this->helpers());
+    this->run_parallel(lease, [&](size_t, size_t) {
+      ReadSuperkHash<Storage, span> read_cmd(this->m_superk_storage, this->m_part,
+                                             this->m_kmer_size, r_idx, array, window, hasher);
+      read_cmd.execute();
+    });
 
     this->m_superk_storage->closeFile(this->m_part);
   }
 
   void executeSort()
   {
-    HashSort sort_cmd(array, *r_idx);
+    size_t buffer_size = this->sort_buffer_size(sizeof(uint64_t));
+    uint64_t* buffer = (uint64_t*)this->m_pool.pool_malloc(buffer_size * sizeof(uint64_t), "sort buffer");
+
+    IdleWorkers::Lease lease(this->helpers());
+    HashSort sort_cmd(array, *r_idx, buffer, buffer_size, &lease);
     sort_cmd.execute();
   }
 
@@ -993,315 +1458,104 @@ private:
   uint64_t* r_idx;
   uint64_t* array;
   uint64_t window;
+  HASHER hasher;
   std::vector<size_t> nb_items_per_bank_per_part;
 };
 
-
-template<typename count_type = uint16_t> struct AbundanceH
+// Presence-only counting of a hash partition, when abundance_min <= 2 and no histogram is
+// needed. Decoded hashes set the bits of the partition window directly, so there is neither
+// hash array nor sort. With abundance_min = 2, a first bitmap taken from the pool records the
+// hashes seen once, see required_memory().
+template <typename Storage, size_t span>
+class HashBitCounter : public IPartitionCounter<HashVecProcessor<span>, Storage, span>
 {
-  AbundanceH (const uint64_t val, const uint16_t ab) : value(val), abundance(ab) {}
-  AbundanceH (const uint64_t val) : value(val), abundance(0) {}
-  AbundanceH() : value(0), abundance(0) {}
+public:
+  typedef HashVecProcessor<span> CountProcessor;
 
-  AbundanceH& operator=(const AbundanceH a)
+public:
+  HashBitCounter(CountProcessor *processor,
+                 PartiInfo<5>* pinfo,
+                 int parti,
+                 size_t kmer_size,
+                 CountArena &pool,
+                 Storage *superk_storage,
+                 uint64_t window,
+                 uint32_t abundance_min,
+                 HASHER hasher = HASHER::XXHASH)
+      : IPartitionCounter<CountProcessor, Storage, span>(processor,
+                                                kmer_size,
+                                                pinfo,
+                                                pool,
+                                                superk_storage,
+                                                parti), window(window), abundance_min(abundance_min),
+                                                hasher(hasher)
   {
-    if (&a != this)
-    {
-      value = a.value;
-      abundance = a.abundance;
-    }
-    return *this;
   }
 
-  const count_type& getAbundance() const { return abundance; }
-  const uint64_t& getValue() const { return value; }
-
-  bool operator==(const AbundanceH& other) const
+  // Bytes of the pool used by a partition.
+  static uint64_t required_memory(uint64_t window, uint32_t abundance_min)
   {
-    return value == other.value && abundance == other.abundance;
+    return abundance_min > 1 ? NBYTES(window) : 0;
   }
 
-  uint64_t value;
-  count_type abundance;
-};
-
-template <typename Storage, size_t span>
-class HashPartCounterByHash : public IPartitionCounter<IHashProcessor<span>, Storage, span>
-{
-public:
-  typedef typename ::Kmer<span>::Type Type;
-  typedef typename ::Kmer<span>::Count Count;
-  typedef IHashProcessor<span> CountProcessor;
-
-  HashPartCounterByHash(CountProcessor* processor,
-                  PartiInfo<5>* pinfo,
-                  int parti,
-                  size_t kmer_size,
-                  MemAllocator& pool,
-                  Storage* superk_storage,
-                  uint64_t window)
-    : IPartitionCounter<IHashProcessor<span>, Storage, span>(
-      processor, kmer_size, pinfo, pool, superk_storage, parti), m_window(window)
-    {
-
-    }
-
   void execute()
   {
-    typedef typename gatb::core::tools::collections::impl::Hash16<uint64_t>::cell cell_t;
-    this->m_superk_storage->openFile(this->m_part);
-    Hash16<uint64_t> hash16(m_hash_memory / (1ULL << 20));
-    typedef AbundanceH<uint16_t> abundance_t;
-
-    CounterBuilder solidCounter;
-
-    std::vector<std::string> tmp_count_filenames;
-    int ks = this->m_kmer_size;
-    Type un; un.setVal(1);
-
-    Type kmerMask = (un << (ks*2)) - un;
-    size_t shift = 2*(ks-1);
-
-    Type _seedk;
-
-    int _fileId = this->m_part;
-    unsigned char * _buffer = 0 ;
-    unsigned int _buffer_size = 0;
+    if constexpr(std::is_same_v<Storage, SuperKmerBinFiles>)
+      this->m_superk_storage->openFile("r", this->m_part);
+    else
+      this->m_superk_storage->openFile(this->m_part);
 
-    hasher_t<span> hasher = std::make_unique<KmXXHash<span>>(this->m_kmer_size, m_window, this->m_part);
-    unsigned int nb_bytes_read;
-    while (this->m_superk_storage->readBlock(&_buffer, &_buffer_size, &nb_bytes_read, _fileId))
+    std::vector<uint8_t>& seen = this->m_processor->bits();
+    uint8_t* once = nullptr;
+    if (abundance_min > 1)
     {
-      unsigned char* ptr = _buffer;
-      uint8_t nbK;
-      uint8_t newbyte = 0;
-      while (ptr < (_buffer + nb_bytes_read))
-      {
-        nbK = *ptr; ptr++;
-        int rem_size = this->m_kmer_size;
-        Type Tnewbyte;
-        int nbr = 0;
-        _seedk.setVal(0);
-
-        while (rem_size >= 4)
-        {
-          newbyte = *ptr; ptr++;
-          Tnewbyte.setVal(newbyte);
-          _seedk = _seedk | (Tnewbyte << (8 * nbr));
-          rem_size -= 4; nbr++;
-        }
-
-        int uid = 4;
-
-        if (rem_size > 0)
-        {
-          newbyte = *ptr; ptr++;
-          Tnewbyte.setVal(newbyte);
-          _seedk = (_seedk | (Tnewbyte << (8 * nbr)));
-          uid = rem_size;
-        }
-        _seedk = _seedk & kmerMask;
-
-        uint8_t rem = nbK;
-        Type temp = _seedk;
-        Type rev_temp = revcomp(temp, this->m_kmer_size);
-        Type newnt;
-        Type mink;
-
-        for (int ii=0; ii<nbK; ii++, rem--)
-        {
-          mink = std::min(rev_temp, temp);
-          hash16.insert((*hasher.get())(mink));
-
-          if (rem < 2) break;
-
-          if (uid >= 4)
-          {
-            newbyte = *ptr; ptr++;
-            Tnewbyte.setVal(newbyte);
-            uid = 0;
-          }
-
-          newnt = (Tnewbyte >> (2 * uid)) & 3; uid++;
-          temp = ((temp << 2) | newnt) & kmerMask;
-          newnt.setVal(comp_NT[newnt.getVal()]);
-          rev_temp = ((rev_temp >> 2) | (newnt << shift)) & kmerMask;
-        }
-      }
-
-      if (hash16.getByteSize() > m_hash_memory)
-      {
-        Iterator<cell_t>* itKmerAbundancePartial = hash16.iterator(true);
-        LOCAL(itKmerAbundancePartial);
-
-        std::string fname = this->m_superk_storage->getFileName(this->m_part);
-        fname += gatb::core::tools::misc::impl::Stringify::format("_subpart_%i", tmp_count_filenames.size());
-        tmp_count_filenames.push_back(fname);
-        BagFile<abundance_t>* bagf = new BagFile<abundance_t>(fname); LOCAL(bagf);
-        Bag<abundance_t>* currentbag = new BagCache<abundance_t>(bagf, 10000); LOCAL(currentbag);
-
-        for (itKmerAbundancePartial->first(); !itKmerAbundancePartial->isDone(); itKmerAbundancePartial->next())
-        {
-          cell_t& cell = itKmerAbundancePartial->item();
-          currentbag->insert(abundance_t(cell.graine, cell.val));
-        }
-
-        currentbag->flush();
-        hash16.clear();
-      }
+      // the pool is not cleared between tasks
+      once = reinterpret_cast<uint8_t*>(this->m_pool.pool_malloc(seen.size(), "once bitmap"));
+      std::memset(once, 0, seen.size());
     }
+    uint64_t lower = window * this->m_part;
 
-    if (_buffer != 0)
-      free(_buffer);
-
-    Iterator<cell_t>* itKmerAbundance = hash16.iterator(true); LOCAL(itKmerAbundance);
-
-    if (tmp_count_filenames.size() != 0)
-    {
-      TempCountFileMerger<span> tempCountFileMerger(10, 10);
-      tmp_count_filenames = tempCountFileMerger.mergeFiles(tmp_count_filenames);
-      std::vector<Iterator<abundance_t>*> tmpCountIterators;
-
-      for (uint ii=0; ii<tmp_count_filenames.size(); ii++)
+    IdleWorkers::Lease lease(this->helpers());
+    bool concurrent = lease.size() > 0;
+    // hashes seen several times at once are present
+    auto sink = [&](const uint64_t* hashes, size_t n, uint32_t count) {
+      for (size_t i = 0; i < n; i++)
       {
-        std::string fname = tmp_count_filenames[ii];
-        tmpCountIterators.push_back(new IteratorFile<abundance_t>(fname));
-      }
-      typedef std::pair<int, uint64_t> ptcf;
-      struct ptcfcomp { bool operator() (ptcf l, ptcf r) { return ((r.second) < (l.second)); }};
-      std::priority_queue<ptcf, std::vector<ptcf>, ptcfcomp> pq;
-
-      itKmerAbundance->first();
-      for (uint ii=0; ii<tmpCountIterators.size(); ii++)
-      {
-        tmpCountIterators[ii]->first();
-      }
-
-      if (!itKmerAbundance->isDone())
-      {
-        pq.push(ptcf(-1, itKmerAbundance->item().graine));
-      }
-
-      for (uint ii=0; ii<tmpCountIterators.size(); ii++)
-      {
-        if (!tmpCountIterators[ii]->isDone())
-        {
-          abundance_t& ab = tmpCountIterators[ii]->item();
-          pq.push(ptcf(ii, ab.value));
-        }
-      }
-
-      ptcf best_elem;
-      int best_p;
-      int current_ab = 0;
-      int previous_ab = 0;
-      uint64_t current, previous;
-
-      if (pq.size() != 0)
-      {
-        best_elem = pq.top(); pq.pop();
-        best_p = best_elem.first;
-        if (best_p == -1)
-        {
-          previous_ab = itKmerAbundance->item().val;
-        }
-        else
+        uint64_t b = hashes[i] - lower;
+        uint8_t mask = BITMASK(b);
+        if (once && count == 1)
         {
-          previous_ab = tmpCountIterators[best_p]->item().abundance;
-        }
-
-        previous = best_elem.second;
-
-        if (best_p == -1)
-        {
-          itKmerAbundance->next();
-          if (!itKmerAbundance->isDone())
-          {
-            pq.push(ptcf(-1, itKmerAbundance->item().graine));
-          }
-        }
-        else
-        {
-          tmpCountIterators[best_p]->next();
-          if (!tmpCountIterators[best_p]->isDone())
-          {
-            pq.push(ptcf(best_p, tmpCountIterators[best_p]->item().value));
-          }
-        }
-
-        while (pq.size() != 0)
-        {
-          best_elem = pq.top(); pq.pop();
-          best_p = best_elem.first;
-
-          if (best_p == -1)
-          {
-            current_ab = itKmerAbundance->item().val;
-          }
-          else
-          {
-            current_ab = tmpCountIterators[best_p]->item().abundance;
-          }
-          current = best_elem.second;
-
-          if (best_p == -1)
-          {
-            itKmerAbundance->next();
-            if (!itKmerAbundance->isDone())
-            {
-              pq.push(ptcf(-1, itKmerAbundance->item().graine));
-            }
-          }
+          uint8_t* o = &once[BITSLOT(b)];
+          uint8_t prev = *o;
+          if (concurrent)
+            prev = __sync_fetch_and_or(o, mask);
           else
-          {
-            tmpCountIterators[best_p]->next();
-            if (!tmpCountIterators[best_p]->isDone())
-            {
-              pq.push(ptcf(best_p, tmpCountIterators[best_p]->item().value));
-            }
-          }
-
-          if (current != previous)
-          {
-            solidCounter.set(previous_ab);
-            this->insert_hash(previous, solidCounter.get()[0]);
-            previous = current;
-            previous_ab = current_ab;
-          }
-          else
-          {
-            previous_ab += current_ab;
-          }
+            *o |= mask;
+          if (!(prev & mask))
+            continue;
         }
-        solidCounter.set(previous_ab);
-        this->insert_hash(previous, solidCounter.get()[0]);
+        uint8_t* s = &seen[BITSLOT(b)];
+        if (concurrent)
+          __sync_fetch_and_or(s, mask);
+        else
+          *s |= mask;
       }
+    };
+
+    this->run_parallel(lease, [&](size_t, size_t) {
+      ReadSuperkHash<Storage, span> read_cmd(this->m_superk_storage, this->m_part,
+                                             this->m_kmer_size, window, sink, hasher);
+      read_cmd.execute();
+    });
 
-      for (uint ii=0; ii<tmpCountIterators.size(); ii++)
-      {
-        delete tmpCountIterators[ii];
-      }
-      for (uint ii=0; ii<tmp_count_filenames.size(); ii++)
-      {
-        std::string fname = tmp_count_filenames[ii];
-        gatb::core::system::impl::System::file().remove(fname);
-      }
-    }
-    else
-    {
-      for (itKmerAbundance->first(); !itKmerAbundance->isDone(); itKmerAbundance->next())
-      {
-        cell_t& cell = itKmerAbundance->item();
-        solidCounter.set(cell.val);
-        this->insert_hash(cell.graine, solidCounter.get()[0]);
-      }
-    }
     this->m_superk_storage->closeFile(this->m_part);
+    this->m_processor->finish();
   }
 
 private:
-  uint64_t m_hash_memory;
-  uint64_t m_window;
+  uint64_t window;
+  uint32_t abundance_min;
+  HASHER hasher;
 };
 
 };
@@ -0,0 +1,251 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#ifdef __AVX2__
+  #include <immintrin.h>
+#endif
+
+#include <gatb/gatb_core.hpp>
+
+namespace km {
+
+namespace detail {
+
+constexpr std::array<uint32_t, 256> make_nt_table()
+{
+  std::array<uint32_t, 256> table {};
+  for (uint32_t b = 0; b < 256; b++)
+    table[b] = (b & 3) | (((b >> 2) & 3) << 8) | (((b >> 4) & 3) << 16) | (((b >> 6) & 3) << 24);
+  return table;
+}
+
+constexpr std::array<uint32_t, 256> nt_table = make_nt_table();
+
+// Native integer holding a k-mer of precision words, void when there is none.
+template<size_t precision> struct kmer_word { using type = void; };
+template<> struct kmer_word<1> { using type = uint64_t; };
+template<> struct kmer_word<2> { using type = __uint128_t; };
+
+};
+
+// Unpacks nb 2-bit nucleotides, four per byte from the low bits, to one byte each.
+inline void unpack_nucleotides(const uint8_t* src, size_t nb, uint8_t* dst)
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256i mask = _mm256_set1_epi8(3);
+  for ( ; i + 128 <= nb; i += 128, src += 32)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    __m256i a0 = _mm256_and_si256(v, mask);
+    __m256i a1 = _mm256_and_si256(_mm256_srli_epi16(v, 2), mask);
+    __m256i a2 = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+    __m256i a3 = _mm256_and_si256(_mm256_srli_epi16(v, 6), mask);
+
+    // byte b gives a0[b] a1[b] a2[b] a3[b], interleaving works within 128-bit lanes
+    __m256i lo01 = _mm256_unpacklo_epi8(a0, a1);
+    __m256i hi01 = _mm256_unpackhi_epi8(a0, a1);
+    __m256i lo23 = _mm256_unpacklo_epi8(a2, a3);
+    __m256i hi23 = _mm256_unpackhi_epi8(a2, a3);
+    __m256i q0 = _mm256_unpacklo_epi16(lo01, lo23);
+    __m256i q1 = _mm256_unpackhi_epi16(lo01, lo23);
+    __m256i q2 = _mm256_unpacklo_epi16(hi01, hi23);
+    __m256i q3 = _mm256_unpackhi_epi16(hi01, hi23);
+
+    __m256i* out = reinterpret_cast<__m256i*>(dst + i);
+    _mm256_storeu_si256(out,     _mm256_permute2x128_si256(q0, q1, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(q2, q3, 0x20));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(q0, q1, 0x31));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(q2, q3, 0x31));
+  }
+#endif
+  for ( ; i + 4 <= nb; i += 4, src++)
+    std::memcpy(dst + i, &detail::nt_table[*src], 4);
+  for (size_t j = 0; i < nb; i++, j++)
+    dst[i] = (*src >> (2 * j)) & 3;
+}
+
+// Decodes super-k-mers one at a time into batches of canonical k-mers, and of forward and
+// reverse-complement k-mers when oriented is set. A super-k-mer is its number of k-mers, then
+// the seed k-mer packed as an integer and the following nucleotides, four per byte. A null
+// byte and a 32-bit multiplicity come first when it stands for several occurrences. Spans of
+// one or two words use native integers, larger ones the gatb Type.
+template<size_t span, bool oriented = false>
+class SuperkDecoder
+{
+  using Type = typename ::Kmer<span>::Type;
+  using native_t = typename detail::kmer_word<(span + 31) / 32>::type;
+  using word_t = std::conditional_t<std::is_void_v<native_t>, Type, native_t>;
+
+public:
+  SuperkDecoder(size_t kmer_size)
+    : m_kmer_size(kmer_size), m_nts(256 + 4),
+      m_forward(oriented ? 256 : 0), m_reverse(oriented ? 256 : 0), m_canonical(256)
+  {
+    m_mask = (from_int(1) << (2 * kmer_size)) - from_int(1);
+    m_shift = 2 * (kmer_size - 1);
+  }
+
+  // Decodes the super-k-mer at ptr, returns the first byte after it.
+  const uint8_t* decode(const uint8_t* ptr)
+  {
+    m_count = 1;
+    if (*ptr == 0)
+    {
+      std::memcpy(&m_count, ptr + 1, sizeof(m_count));
+      ptr += 1 + sizeof(m_count);
+    }
+    size_t size = *ptr++;
+    size_t nb_nt = m_kmer_size + std::max<size_t>(size, 1) - 1;
+    m_size = size;
+
+    // locals, the staging bytes may alias anything
+    const word_t mask = m_mask;
+    const size_t shift = m_shift;
+    Type* forward = m_forward.data();
+    Type* reverse = m_reverse.data();
+    Type* canonical = m_canonical.data();
+
+    word_t fw = seed(ptr);
+    word_t rv = revcomp_word(fw);
+    if constexpr (oriented)
+    {
+      forward[0] = to_type(fw);
+      reverse[0] = to_type(rv);
+    }
+    canonical[0] = to_type(fw < rv ? fw : rv);
+
+    if (size > 1)
+    {
+      // nucleotides after the seed, from the byte holding the first one
+      size_t offset = m_kmer_size % 4;
+      uint8_t* nts = m_nts.data();
+      unpack_nucleotides(ptr + m_kmer_size / 4, offset + size - 1, nts);
+      nts += offset;
+      for (size_t i = 1; i < size; i++)
+      {
+        uint8_t nt = nts[i - 1];
+        fw = ((fw << 2) | from_int(nt)) & mask;
+        rv = (rv >> 2) | (from_int(nt ^ 2) << shift);
+        if constexpr (oriented)
+        {
+          forward[i] = to_type(fw);
+          reverse[i] = to_type(rv);
+        }
+        canonical[i] = to_type(fw < rv ? fw : rv);
+      }
+    }
+    return ptr + (nb_nt + 3) / 4;
+  }
+
+  size_t size() const { return m_size; }
+
+  // Occurrences of the last super-k-mer.
+  uint32_t count() const { return m_count; }
+
+  const Type* forward() const { return m_forward.data(); }
+  const Type* reverse() const { return m_reverse.data(); }
+  const Type* canonical() const { return m_canonical.data(); }
+
+private:
+  static word_t from_int(uint64_t v)
+  {
+    if constexpr (std::is_same_v<word_t, Type>)
+    {
+      Type t;
+      t.setVal(v);
+      return t;
+    }
+    else
+      return v;
+  }
+
+  static Type to_type(const word_t& w)
+  {
+    if constexpr (std::is_same_v<word_t, Type>)
+      return w;
+    else
+    {
+      static_assert(sizeof(Type) == sizeof(word_t), "unexpected k-mer layout");
+      Type t;
+      std::memcpy(static_cast<void*>(&t), &w, sizeof(Type));
+      return t;
+    }
+  }
+
+  // The seed is packed as a little-endian integer.
+  word_t seed(const uint8_t* ptr) const
+  {
+    if constexpr (std::is_same_v<word_t, Type>)
+    {
+      word_t w = from_int(0);
+      for (size_t i = (m_kmer_size + 3) / 4; i-- > 0; )
+        w = (w << 8) | from_int(ptr[i]);
+      return w & m_mask;
+    }
+    else
+    {
+      word_t w = 0;
+      std::memcpy(&w, ptr, (m_kmer_size + 3) / 4);
+      return w & m_mask;
+    }
+  }
+
+  static uint64_t reverse_nts(uint64_t x)
+  {
+    x = __builtin_bswap64(x);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    return x;
+  }
+
+  // Complement is nt ^ 2.
+  word_t revcomp_word(const word_t& w) const
+  {
+    if constexpr (std::is_same_v<word_t, uint64_t>)
+      return reverse_nts(w ^ 0xAAAAAAAAAAAAAAAAULL) >> (64 - 2 * m_kmer_size);
+    else if constexpr (std::is_same_v<word_t, __uint128_t>)
+    {
+      __uint128_t c = w ^ ((__uint128_t(0xAAAAAAAAAAAAAAAAULL) << 64) | 0xAAAAAAAAAAAAAAAAULL);
+      __uint128_t r = (__uint128_t(reverse_nts(uint64_t(c))) << 64) | reverse_nts(uint64_t(c >> 64));
+      return r >> (128 - 2 * m_kmer_size);
+    }
+    else
+      return revcomp(w, m_kmer_size);
+  }
+
+private:
+  size_t m_kmer_size;
+  size_t m_shift;
+  word_t m_mask;
+  size_t m_size {0};
+  uint32_t m_count {1};
+  std::vector<uint8_t> m_nts;
+  std::vector<Type> m_forward;
+  std::vector<Type> m_reverse;
+  std::vector<Type> m_canonical;
+};
+
+};
@@ -21,6 +21,7 @@
 #include <cmath>
 
 #include <kmtricks/utils.hpp>
+#include <kmtricks/cmd/cmd_common.hpp>
 
 namespace km {
 
@@ -28,8 +29,9 @@ class HashWindow
 {
 public:
   HashWindow() {}
-  HashWindow(uint64_t bloom_size, uint64_t nb_partitions, uint32_t minimizer_size)
-    : m_nb_partitions(nb_partitions), m_minim_size(minimizer_size)
+  HashWindow(uint64_t bloom_size, uint64_t nb_partitions, uint32_t minimizer_size,
+             HASHER hasher = HASHER::XXHASH)
+    : m_nb_partitions(nb_partitions), m_minim_size(minimizer_size), m_hasher(hasher)
   {
     m_window_size_bits = ROUND_UP(
       static_cast<uint64_t>(
@@ -47,6 +49,11 @@ public:
     in.read(reinterpret_cast<char*>(&m_window_size_bits), sizeof(m_window_size_bits));
     in.read(reinterpret_cast<char*>(&m_window_size_bytes), sizeof(m_window_size_bytes));
     in.read(reinterpret_cast<char*>(&m_minim_size), sizeof(m_minim_size));
+
+    // absent from runs created before hashers were selectable
+    uint8_t hasher = 0;
+    if (in.read(reinterpret_cast<char*>(&hasher), sizeof(hasher)))
+      m_hasher = static_cast<HASHER>(hasher);
   }
 
   void serialize(const std::string& path)
@@ -57,6 +64,8 @@ public:
     out.write(reinterpret_cast<char*>(&m_window_size_bits), sizeof(m_window_size_bits));
     out.write(reinterpret_cast<char*>(&m_window_size_bytes), sizeof(m_window_size_bytes));
     out.write(reinterpret_cast<char*>(&m_minim_size), sizeof(m_minim_size));
+    uint8_t hasher = static_cast<uint8_t>(m_hasher);
+    out.write(reinterpret_cast<char*>(&hasher), sizeof(hasher));
   }
 
   uint64_t get_window_size_bytes() const
@@ -89,12 +98,18 @@ public:
     return m_minim_size;
   }
 
+  HASHER hasher() const
+  {
+    return m_hasher;
+  }
+
 private:
   uint64_t m_bloom_size {0};
   uint64_t m_nb_partitions {0};
   uint64_t m_window_size_bits {0};
   uint64_t m_window_size_bytes {0};
   uint32_t m_minim_size {0};
+  HASHER m_hasher {HASHER::XXHASH};
 };
 
 };
\ No newline at end of file
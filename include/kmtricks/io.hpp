@@ -23,6 +23,7 @@
 #include <kmtricks/io/kmer_file.hpp>
 #include <kmtricks/io/matrix_file.hpp>
 #include <kmtricks/io/pa_matrix_file.hpp>
+#include <kmtricks/io/sparse_matrix_file.hpp>
 #include <kmtricks/io/vector_file.hpp>
 #include <kmtricks/io/vector_matrix_file.hpp>
 #include <kmtricks/io/hist_file.hpp>
\ No newline at end of file
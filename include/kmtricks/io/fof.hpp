@@ -88,6 +88,13 @@ public:
     return bc::utils::join(std::get<1>(m_data[m_map.at(id)]), ",");
   }
 
+  const std::vector<std::string>& get_paths(const std::string& id)
+  {
+    if (!m_map.count(id))
+      throw IDError(fmt::format("Unknown id: {}", id));
+    return std::get<1>(m_data[m_map.at(id)]);
+  }
+
   void copy(const std::string& path)
   {
     fs::copy_file(m_path, path);
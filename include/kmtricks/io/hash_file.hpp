@@ -18,6 +18,7 @@
 
 #pragma once
 #include <kmtricks/io/io_common.hpp>
+#include <kmtricks/io/merge_input.hpp>
 #include <kmtricks/utils.hpp>
 #include <ic.h>
 
@@ -150,11 +151,12 @@ class HashReader : public IFile<HashFileHeader, std::istream, buf_size>
   using count_type = typename selectC<MAX_C>::type;
 
 public:
-  HashReader(const std::string& path)
+  HashReader(const std::string& path, size_t read_ahead = 0)
     : IFile<HashFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary)
   {
     this->m_header.deserialize(this->m_first_layer.get());
     this->m_header.sanity_check();
+    this->set_read_ahead(read_ahead);
 
     this->template set_second_layer<icstream>(false);
   }
@@ -231,6 +233,118 @@ private:
 template<size_t MAX_C, size_t buf_size = 32768>
 using hr_t = std::shared_ptr<HashReader<MAX_C, buf_size>>;
 
+// HashReader for merges, see MergeInput. Compressed blocks are staged in a buffer of the
+// MergeBufferPool, only decoded blocks are kept by the stream.
+template<size_t MAX_C>
+class HashMergeReader : public MergeInput<HashFileHeader>
+{
+  using count_type = typename selectC<MAX_C>::type;
+
+public:
+  HashMergeReader(const std::string& path, size_t read_ahead = 0)
+    : MergeInput<HashFileHeader>(path, false, 4096, read_ahead)
+  {}
+
+  bool load()
+  {
+    if (!this->read_bytes(&m_in_buffer, sizeof(m_in_buffer)))
+      return false;
+
+    if (m_dest.size() < m_in_buffer)
+    {
+      m_dest.resize(m_in_buffer);
+      m_dest_c.resize(m_in_buffer);
+    }
+
+    if (this->m_header.compressed)
+    {
+      size_t hash_bytes = 0;
+      size_t count_bytes = 0;
+
+      MergeBufferPool::Buffer staging(MergeBufferPool::get());
+      std::vector<unsigned char> large;
+      unsigned char* src = reinterpret_cast<unsigned char*>(staging.data());
+
+      this->read_bytes(&hash_bytes, sizeof(hash_bytes));
+      if (hash_bytes > staging.size() / 2)
+      {
+        large.resize(hash_bytes);
+        src = large.data();
+      }
+      this->read_bytes(src, hash_bytes);
+      p4nd1dec64(src, m_in_buffer, m_dest.data());
+
+      this->read_bytes(&count_bytes, sizeof(count_bytes));
+      if (count_bytes > staging.size() / 2)
+      {
+        large.resize(count_bytes);
+        src = large.data();
+      }
+      else
+      {
+        src = reinterpret_cast<unsigned char*>(staging.data()) + staging.size() / 2;
+      }
+      this->read_bytes(src, count_bytes);
+
+      if constexpr(sizeof(count_type) == 1)
+        p4nzdec8(src, m_in_buffer, m_dest_c.data());
+      else if constexpr(sizeof(count_type) == 2)
+        p4nzdec16(src, m_in_buffer, m_dest_c.data());
+      else
+        p4nzdec32(src, m_in_buffer, m_dest_c.data());
+    }
+    else
+    {
+      this->read_bytes(m_dest.data(), m_in_buffer * sizeof(uint64_t));
+      this->read_bytes(m_dest_c.data(), m_in_buffer * sizeof(count_type));
+    }
+    m_index = 0;
+    return true;
+  }
+
+  bool read(uint64_t& hash, count_type& count)
+  {
+    if (m_in_buffer == 0)
+      if (!load())
+        return false;
+
+    hash = m_dest[m_index];
+    count = m_dest_c[m_index];
+
+    m_in_buffer--;
+    m_index++;
+
+    return true;
+  }
+
+  size_t footprint() const
+  {
+    return MergeInput<HashFileHeader>::footprint()
+      + m_dest.capacity() * sizeof(uint64_t) + m_dest_c.capacity() * sizeof(count_type);
+  }
+
+  size_t peak_footprint() const
+  {
+    return MergeInput<HashFileHeader>::peak_footprint()
+      + m_dest.capacity() * sizeof(uint64_t) + m_dest_c.capacity() * sizeof(count_type);
+  }
+
+  // Blocks written by HashWriter<MAX_C, 32768> hold 4096 hashes.
+  static size_t stream_footprint()
+  {
+    return sizeof(HashMergeReader) + 4096 + 4096 * (sizeof(uint64_t) + sizeof(count_type));
+  }
+
+private:
+  std::vector<uint64_t> m_dest;
+  std::vector<count_type> m_dest_c;
+  size_t m_index {0};
+  size_t m_in_buffer {0};
+};
+
+template<size_t MAX_C>
+using hmr_t = std::shared_ptr<HashMergeReader<MAX_C>>;
+
 template<size_t MAX_C>
 class HashFileAggregator
 {
@@ -22,8 +22,10 @@
 #include <array>
 #include <memory>
 #include <map>
+#include <sstream>
 
 #include <kmtricks/io/lz4_stream.hpp>
+#include <kmtricks/io/read_ahead.hpp>
 #include <kmtricks/exceptions.hpp>
 #include <kmtricks/utils.hpp>
 
@@ -38,10 +40,13 @@ enum class KM_FILE
   HASH,
   MATRIX,
   MATRIX_HASH,
+  MATRIX_BLOCK,
+  MATRIX_SPARSE,
   PAMATRIX,
   PAMATRIX_HASH,
   VECTOR,
   BITMATRIX,
+  BITMATRIX_RLE,
   KFF,
   HIST,
   SUPERK
@@ -55,9 +60,12 @@ const std::map<KM_FILE, uint64_t> MAGICS = {
   {KM_FILE::PAMATRIX, 0x6b5f74616d6170},
   {KM_FILE::VECTOR, 0x726f74636576},
   {KM_FILE::BITMATRIX, 0x74616d746962},
+  {KM_FILE::BITMATRIX_RLE, 0x656c72746962},
   {KM_FILE::HIST, 0x747369686b},
   {KM_FILE::SUPERK, 0x6b7265707573},
   {KM_FILE::MATRIX_HASH, 0x685f78697274616d},
+  {KM_FILE::MATRIX_BLOCK, 0x625f78697274616d},
+  {KM_FILE::MATRIX_SPARSE, 0x735f78697274616d},
   {KM_FILE::PAMATRIX_HASH, 0x685f74616d6170}
 };
 
@@ -80,6 +88,10 @@ inline KM_FILE get_km_file_type(const std::string& path)
     return KM_FILE::MATRIX;
   else if (km_file == MAGICS.at(KM_FILE::MATRIX_HASH))
     return KM_FILE::MATRIX_HASH;
+  else if (km_file == MAGICS.at(KM_FILE::MATRIX_BLOCK))
+    return KM_FILE::MATRIX_BLOCK;
+  else if (km_file == MAGICS.at(KM_FILE::MATRIX_SPARSE))
+    return KM_FILE::MATRIX_SPARSE;
   else if (km_file == MAGICS.at(KM_FILE::PAMATRIX))
     return KM_FILE::PAMATRIX;
   else if (km_file == MAGICS.at(KM_FILE::PAMATRIX_HASH))
@@ -88,6 +100,8 @@ inline KM_FILE get_km_file_type(const std::string& path)
     return KM_FILE::VECTOR;
   else if (km_file == MAGICS.at(KM_FILE::BITMATRIX))
     return KM_FILE::BITMATRIX;
+  else if (km_file == MAGICS.at(KM_FILE::BITMATRIX_RLE))
+    return KM_FILE::BITMATRIX_RLE;
   else if (km_file == MAGICS.at(KM_FILE::HIST))
     return KM_FILE::HIST;
   else if (km_file == MAGICS.at(KM_FILE::SUPERK))
@@ -106,6 +120,10 @@ inline std::string km_file_to_str(KM_FILE f)
     return "count matrix";
   else if (f == KM_FILE::MATRIX_HASH)
     return "hash matrix";
+  else if (f == KM_FILE::MATRIX_BLOCK)
+    return "block count matrix";
+  else if (f == KM_FILE::MATRIX_SPARSE)
+    return "sparse matrix";
   else if (f == KM_FILE::PAMATRIX)
     return "pa matrix";
   else if (f == KM_FILE::PAMATRIX_HASH)
@@ -114,6 +132,8 @@ inline std::string km_file_to_str(KM_FILE f)
     return "bit vector";
   else if (f == KM_FILE::BITMATRIX)
     return "bit matrix";
+  else if (f == KM_FILE::BITMATRIX_RLE)
+    return "rle bit matrix";
   else if (f == KM_FILE::HIST)
     return "histogram";
   else if (f == KM_FILE::SUPERK)
@@ -157,6 +177,15 @@ public:
   bool compressed;
 };
 
+template<typename header_t>
+inline size_t get_header_size()
+{
+  std::stringstream ss;
+  header_t header;
+  header.serialize(&ss);
+  return ss.str().size();
+}
+
 template<typename header_t,
          typename stream,
          size_t   buf_size>
@@ -212,6 +241,16 @@ public:
 
 protected:
 
+  // Replaces the fstream layer by a double-buffered read-ahead stream starting at the
+  // current position, must be called before set_second_layer.
+  void set_read_ahead(size_t block_size)
+  {
+    if (!block_size)
+      return;
+    uint64_t offset = this->m_first_layer->tellg();
+    this->m_first_layer = std::make_unique<ReadAheadStream>(m_path, offset, block_size);
+  }
+
   template<typename compression_stream_t>
   void set_second_layer(bool compress)
   {
@@ -18,6 +18,7 @@
 
 #pragma once
 #include <kmtricks/io/io_common.hpp>
+#include <kmtricks/io/merge_input.hpp>
 #include <kmtricks/kmer.hpp>
 #include <kmtricks/utils.hpp>
 
@@ -116,11 +117,12 @@ class KmerReader : public IFile<KmerFileHeader, std::istream, buf_size>
 {
   using icstream = lz4_stream::basic_istream<buf_size>;
 public:
-  KmerReader(const std::string& path)
+  KmerReader(const std::string& path, size_t read_ahead = 0)
     : IFile<KmerFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary)
   {
     this->m_header.deserialize(this->m_first_layer.get());
     this->m_header.sanity_check();
+    this->set_read_ahead(read_ahead);
     this->template set_second_layer<icstream>(this->m_header.compressed);
   }
 
@@ -162,6 +164,31 @@ public:
 template<size_t buf_size>
 using kr_t = std::shared_ptr<KmerReader<buf_size>>;
 
+// KmerReader for merges, see MergeInput.
+class KmerMergeReader : public MergeInput<KmerFileHeader>
+{
+public:
+  KmerMergeReader(const std::string& path, size_t read_ahead = 0)
+    : MergeInput<KmerFileHeader>(path, true, 8192, read_ahead)
+  {}
+
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, typename selectC<MAX_C>::type& count)
+  {
+    if (!this->read_bytes(kmer.get_data64_unsafe(), this->m_header.kmer_slots*8))
+      return false;
+    return this->read_bytes(&count, this->m_header.count_slots);
+  }
+
+  static size_t stream_footprint(bool lz4)
+  {
+    return sizeof(KmerMergeReader) + 8192 + (lz4 ? lz4_context_footprint() : 0);
+  }
+
+};
+
+using kmr_t = std::shared_ptr<KmerMergeReader>;
+
 
 template<size_t MAX_K, size_t MAX_C>
 class KmerFileMerger
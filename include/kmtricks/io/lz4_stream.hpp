@@ -6,10 +6,12 @@
 #define LZ4_STREAM
 
 // LZ4 Headers
+#include <lz4.h>
 #include <lz4frame.h>
 
 // Standard headers
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <functional>
 #include <iostream>
@@ -19,6 +21,12 @@
 #include <string>
 #include <cstring>
 #include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+
+#include <kmtricks/task_pool.hpp>
 
 /** \defgroup Stream
  *
@@ -31,6 +39,91 @@ using namespace std;
  *  lz4_stream namespace
  */
 namespace lz4_stream {
+
+/**
+ * @brief Compresses independent LZ4 blocks as jobs of the idle workers of the task pools.
+ *
+ * It has no thread of its own: a block is compressed by a worker which has nothing else to
+ * run, or by its producer when no worker is idle or when the bytes of the blocks in flight,
+ * submitted and not yet written by their stream, would exceed the bound over all the streams.
+ */
+class CompressionPool
+{
+public:
+  static CompressionPool& get() {
+    static CompressionPool singleton;
+    return singleton;
+  }
+
+  /**
+   * @brief Reserves bytes for a block in flight, fails when over the bound of the pool.
+   */
+  bool try_reserve(size_t bytes) {
+    size_t current = in_flight_bytes_.load();
+    size_t bound = max_in_flight_bytes();
+    do {
+      if (current + bytes > bound)
+        return false;
+    } while (!in_flight_bytes_.compare_exchange_weak(current, current + bytes));
+    return true;
+  }
+
+  void release(size_t bytes) {
+    in_flight_bytes_ -= bytes;
+  }
+
+  /**
+   * @brief Bytes reserved for a block of size bytes: the block and its compressed copy.
+   */
+  static size_t footprint(size_t size) {
+    return size + 4 + LZ4_compressBound(static_cast<int>(size));
+  }
+
+  /**
+   * @brief Compresses a block on an idle worker, or here when there is none. The result is
+   * a block of an LZ4 frame: its size on 4 bytes, with the high bit set when stored
+   * uncompressed, followed by its data.
+   */
+  std::future<std::vector<char>> submit(std::vector<char>&& src) {
+    auto task = std::make_shared<std::packaged_task<std::vector<char>()>>(
+      [src = std::move(src)]() { return compress_block(src); });
+    std::future<std::vector<char>> ret = task->get_future();
+    if (!km::IdleWorkers::get().try_post([task]() { (*task)(); }))
+      (*task)();
+    return ret;
+  }
+
+  static std::vector<char> compress_block(const std::vector<char>& src) {
+    int bound = LZ4_compressBound(static_cast<int>(src.size()));
+    std::vector<char> dest(4 + bound);
+    int size = LZ4_compress_default(src.data(), dest.data() + 4,
+                                    static_cast<int>(src.size()), bound);
+    uint32_t header = size;
+    if (size <= 0 || static_cast<size_t>(size) >= src.size()) {
+      std::memcpy(dest.data() + 4, src.data(), src.size());
+      size = static_cast<int>(src.size());
+      header = size | 0x80000000U;
+    }
+    for (size_t i = 0; i < 4; i++)
+      dest[i] = static_cast<char>((header >> (8 * i)) & 0xFF);
+    dest.resize(4 + size);
+    return dest;
+  }
+
+private:
+  CompressionPool() = default;
+
+  // enough blocks of 64 KiB to keep the workers busy
+  static constexpr size_t blocks_per_worker = 4;
+
+  size_t max_in_flight_bytes() const {
+    return std::max<size_t>(km::IdleWorkers::get().workers(), 1) * blocks_per_worker
+      * footprint(64 << 10);
+  }
+
+  std::atomic<size_t> in_flight_bytes_ {0};
+};
+
 /**
  * @brief An output stream that will LZ4 compress the input data.
  * \ingroup Stream
@@ -38,6 +131,10 @@ namespace lz4_stream {
  * An output stream that will wrap another output stream and LZ4
  * compress its input data to that stream.
  *
+ * The frame is made of independent blocks of block_size bytes, compressed by the
+ * CompressionPool while the stream is filled and written in order to the sink, so that
+ * compression overlaps with the producer when pool workers are idle. Independent blocks can also be decompressed in
+ * parallel. SrcBufSize is unused and kept for compatibility.
  */
 template <size_t SrcBufSize = 256>
 class basic_ostream : public std::ostream
@@ -74,17 +171,21 @@ public:
 private:
   class output_buffer : public std::streambuf {
   public:
+    // LZ4F_max64KB, as the default frame
+    static constexpr size_t block_size = 64 << 10;
+    // blocks submitted and not yet written to the sink, at most about 0.5 MiB per stream
+    // with their compressed copies, and within the bound of the CompressionPool over all
+    // streams: a block which does not fit is compressed and written by its producer
+    static constexpr size_t max_in_flight = 4;
+
     output_buffer(const output_buffer &) = delete;
     output_buffer& operator= (const output_buffer &) = delete;
 
     explicit output_buffer(std::ostream &sink)
       : sink_(sink),
-      // original author has a todo here: "No need to recalculate the dest_buf_ size on each construction"
-        dest_buf_(LZ4F_compressBound(src_buf_.size(), nullptr)),
         ctx_(nullptr),
         closed_(false) {
-      char* base = &src_buf_.front();
-      setp(base, base + src_buf_.size() - 1);
+      new_block();
 
       size_t ret = LZ4F_createCompressionContext(&ctx_, LZ4F_VERSION);
       if (LZ4F_isError(ret) != 0) {
@@ -102,7 +203,9 @@ private:
       if (closed_) {
         return;
       }
-      sync();
+      submit();
+      while (!in_flight_.empty())
+        write_front();
       write_footer();
       LZ4F_freeCompressionContext(ctx_);
       closed_ = true;
@@ -114,54 +217,94 @@ private:
 
       *pptr() = static_cast<basic_ostream::char_type>(ch);
       pbump(1);
-      compress_and_write();
+      submit();
 
       return ch;
     }
 
+    // writes the blocks in flight, blocks are only cut when full or on close as
+    // LZ4F_compressUpdate did
     int_type sync() override {
-      compress_and_write();
-      return 0;
+      while (!in_flight_.empty())
+        write_front();
+      return sink_.good() ? 0 : -1;
+    }
+
+    void new_block() {
+      block_.resize(block_size);
+      char* base = &block_.front();
+      setp(base, base + block_.size() - 1);
     }
 
-    void compress_and_write() {
+    void submit() {
       // original author has a todo here: "Throw exception instead or set badbit"
       assert(!closed_);
-      int orig_size = static_cast<int>(pptr() - pbase());
-      pbump(-orig_size);
-      size_t ret = LZ4F_compressUpdate(ctx_, &dest_buf_.front(), dest_buf_.capacity(),
-                                       pbase(), orig_size, nullptr);
-      if (LZ4F_isError(ret) != 0) {
-        throw std::runtime_error(std::string("LZ4 compression failed: ")
-                                 + LZ4F_getErrorName(ret));
+      size_t size = static_cast<size_t>(pptr() - pbase());
+      if (size == 0)
+        return;
+      // the blocks of this stream are written until the pool has room for this one
+      CompressionPool& pool = CompressionPool::get();
+      size_t footprint = CompressionPool::footprint(size);
+      while (!in_flight_.empty() && !pool.try_reserve(footprint))
+        write_front();
+
+      block_.resize(size);
+      if (in_flight_.empty() && !pool.try_reserve(footprint)) {
+        // nothing of this stream is left to write before it
+        std::vector<char> compressed = CompressionPool::compress_block(block_);
+        sink_.write(compressed.data(), compressed.size());
+        new_block();
+        return;
       }
-      sink_.write(&dest_buf_.front(), ret);
+      in_flight_.push_back({pool.submit(std::move(block_)), footprint});
+      block_ = std::vector<char>();
+      new_block();
+
+      while (!in_flight_.empty() &&
+             (in_flight_.size() > max_in_flight ||
+              in_flight_.front().first.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+        write_front();
+    }
+
+    void write_front() {
+      std::vector<char> compressed = in_flight_.front().first.get();
+      CompressionPool::get().release(in_flight_.front().second);
+      in_flight_.pop_front();
+      sink_.write(compressed.data(), compressed.size());
     }
 
     void write_header() {
       // original author has a todo here: "Throw exception instead or set badbit"
       assert(!closed_);
-      size_t ret = LZ4F_compressBegin(ctx_, &dest_buf_.front(), dest_buf_.capacity(), nullptr);
+      LZ4F_preferences_t prefs;
+      std::memset(&prefs, 0, sizeof(prefs));
+      prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+      prefs.frameInfo.blockMode = LZ4F_blockIndependent;
+      std::vector<char> header(LZ4F_HEADER_SIZE_MAX);
+      size_t ret = LZ4F_compressBegin(ctx_, header.data(), header.size(), &prefs);
       if (LZ4F_isError(ret) != 0) {
         throw std::runtime_error(std::string("Failed to start LZ4 compression: ")
                                  + LZ4F_getErrorName(ret));
       }
-      sink_.write(&dest_buf_.front(), ret);
+      sink_.write(header.data(), ret);
     }
 
     void write_footer() {
       assert(!closed_);
-      size_t ret = LZ4F_compressEnd(ctx_, &dest_buf_.front(), dest_buf_.capacity(), nullptr);
+      // nothing was given to the context, only the end mark is written
+      char footer[16];
+      size_t ret = LZ4F_compressEnd(ctx_, footer, sizeof(footer), nullptr);
       if (LZ4F_isError(ret) != 0) {
         throw std::runtime_error(std::string("Failed to end LZ4 compression: ")
                                  + LZ4F_getErrorName(ret));
       }
-      sink_.write(&dest_buf_.front(), ret);
+      sink_.write(footer, ret);
     }
 
     std::ostream& sink_;
-    std::array<char, SrcBufSize> src_buf_;
-    std::vector<char> dest_buf_;
+    std::vector<char> block_;
+    // compressed blocks to come and the bytes reserved for them in the pool
+    std::deque<std::pair<std::future<std::vector<char>>, size_t>> in_flight_;
     LZ4F_compressionContext_t ctx_;
     bool closed_;
   };
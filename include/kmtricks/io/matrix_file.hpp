@@ -17,9 +17,12 @@
  *****************************************************************************/
 
 #pragma once
+#include <algorithm>
+#include <cstring>
 #include <kmtricks/io/io_common.hpp>
 #include <kmtricks/kmer.hpp>
 #include <kmtricks/utils.hpp>
+#include <ic.h>
 
 namespace km {
 
@@ -132,12 +135,13 @@ class MatrixReader : public IFile<MatrixFileHeader, std::istream, buf_size>
 {
   using icstream = lz4_stream::basic_istream<buf_size>;
 public:
-  MatrixReader(const std::string& path, bool kasm = false)
+  MatrixReader(const std::string& path, bool kasm = false, size_t read_ahead = 0)
     : IFile<MatrixFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary)
   {
     this->m_header.deserialize(this->m_first_layer.get(), kasm);
     this->m_header.sanity_check();
 
+    this->set_read_ahead(read_ahead);
     this->template set_second_layer<icstream>(this->m_header.compressed);
   }
 
@@ -165,6 +169,18 @@ public:
     return true;
   }
 
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, typename selectC<MAX_C>::type* counts, std::size_t n)
+  {
+    this->m_second_layer->read(reinterpret_cast<char*>(kmer.get_data64_unsafe()),
+                                this->m_header.kmer_slots*8);
+    this->m_second_layer->read(reinterpret_cast<char*>(counts),
+                                n*(requiredC<MAX_C>::value/8));
+    if (!this->m_second_layer->gcount())
+      return false;
+    return true;
+  }
+
   template<size_t MAX_K, size_t MAX_C>
   void write_as_text(std::ostream& stream)
   {
@@ -269,12 +285,13 @@ class MatrixHashReader : public IFile<MatrixHashFileHeader, std::istream, buf_si
 {
   using icstream = lz4_stream::basic_istream<buf_size>;
 public:
-  MatrixHashReader(const std::string& path)
+  MatrixHashReader(const std::string& path, size_t read_ahead = 0)
     : IFile<MatrixHashFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary)
   {
     this->m_header.deserialize(this->m_first_layer.get());
     this->m_header.sanity_check();
 
+    this->set_read_ahead(read_ahead);
     this->template set_second_layer<icstream>(this->m_header.compressed);
   }
 
@@ -289,6 +306,17 @@ public:
     return true;
   }
 
+  template<size_t MAX_C>
+  bool read(uint64_t& hash, typename selectC<MAX_C>::type* counts, std::size_t n)
+  {
+    this->m_second_layer->read(reinterpret_cast<char*>(&hash), sizeof(hash));
+    this->m_second_layer->read(reinterpret_cast<char*>(counts),
+                                n*(requiredC<MAX_C>::value/8));
+    if (!this->m_second_layer->gcount())
+      return false;
+    return true;
+  }
+
   template<size_t MAX_C>
   void write_as_text(std::ostream& stream)
   {
@@ -304,12 +332,538 @@ public:
   }
 };
 
+// Block-columnar count matrix. Rows are grouped by blocks of block_rows rows, each block stores
+// its keys and then each sample column separately:
+//   [uint32 rows][uint64 bytes][keys][for each sample: uint8 encoding, uint32 bytes, payload]
+// Keys are k-mers (kmer_size > 0) or hashes (kmer_size = 0). Sorted single-word keys are
+// delta-encoded with p4nd1enc64, multi-word k-mers are stored word by word with p4nzenc64.
+// A column is either empty, bit-packed with PFor or, when it is mostly null, stored as the
+// positions and values of its non-null counts. The file ends with a block index, the offset and
+// the first key of each block, followed by [uint64 nb_blocks][uint64 index offset].
+class MatrixBlockFileHeader : public KmHeader
+{
+public:
+  MatrixBlockFileHeader() {};
+
+  void serialize(std::ostream* stream)
+  {
+    _serialize(stream);
+    stream->write(reinterpret_cast<char*>(&matrix_magic), sizeof(matrix_magic));
+    stream->write(reinterpret_cast<char*>(&kmer_size), sizeof(kmer_size));
+    stream->write(reinterpret_cast<char*>(&kmer_slots), sizeof(kmer_slots));
+    stream->write(reinterpret_cast<char*>(&count_slots), sizeof(count_slots));
+    stream->write(reinterpret_cast<char*>(&nb_counts), sizeof(nb_counts));
+    stream->write(reinterpret_cast<char*>(&id), sizeof(id));
+    stream->write(reinterpret_cast<char*>(&partition), sizeof(partition));
+    stream->write(reinterpret_cast<char*>(&block_rows), sizeof(block_rows));
+  }
+
+  void deserialize(std::istream* stream)
+  {
+    _deserialize(stream);
+    stream->read(reinterpret_cast<char*>(&matrix_magic), sizeof(matrix_magic));
+    stream->read(reinterpret_cast<char*>(&kmer_size), sizeof(kmer_size));
+    stream->read(reinterpret_cast<char*>(&kmer_slots), sizeof(kmer_slots));
+    stream->read(reinterpret_cast<char*>(&count_slots), sizeof(count_slots));
+    stream->read(reinterpret_cast<char*>(&nb_counts), sizeof(nb_counts));
+    stream->read(reinterpret_cast<char*>(&id), sizeof(id));
+    stream->read(reinterpret_cast<char*>(&partition), sizeof(partition));
+    stream->read(reinterpret_cast<char*>(&block_rows), sizeof(block_rows));
+  }
+
+  void sanity_check()
+  {
+    _sanity_check();
+    if (matrix_magic != MAGICS.at(KM_FILE::MATRIX_BLOCK))
+      throw IOError("Invalid file format.");
+  }
+
+public:
+  uint64_t matrix_magic {MAGICS.at(KM_FILE::MATRIX_BLOCK)};
+  uint32_t kmer_size;
+  uint32_t kmer_slots;
+  uint32_t count_slots;
+  uint32_t nb_counts;
+  uint32_t id;
+  uint32_t partition;
+  uint32_t block_rows;
+};
+
+enum class BLOCK_COLUMN : uint8_t
+{
+  EMPTY,
+  PFOR,
+  SPARSE
+};
+
+// Rows per block, such that a decoded block holds about 4MB of counts.
+inline uint32_t get_block_rows(uint32_t nb_counts)
+{
+  uint64_t rows = (uint64_t{4} << 20) / (std::max<uint32_t>(nb_counts, 1) * sizeof(uint32_t));
+  return std::clamp<uint64_t>(rows / 64 * 64, 64, 8192);
+}
+
+// TurboPFor codecs may read and write past the end of their buffers.
+constexpr size_t BLOCK_PADDING = 1024;
+
+template<size_t buf_size = 8192>
+class MatrixBlockWriter : public IFile<MatrixBlockFileHeader, std::ostream, buf_size>
+{
+  using ocstream = lz4_stream::basic_ostream<buf_size>;
+public:
+  MatrixBlockWriter(const std::string& path,
+                    uint32_t kmer_size,
+                    uint32_t count_size,
+                    uint32_t nb_counts,
+                    uint32_t id,
+                    uint32_t partition,
+                    uint32_t block_rows = 0)
+    : IFile<MatrixBlockFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary)
+  {
+    this->m_header.compressed = false;
+    this->m_header.kmer_size = kmer_size;
+    this->m_header.kmer_slots = kmer_size ? (kmer_size + 31) / 32 : 1;
+    this->m_header.count_slots = count_size;
+    this->m_header.nb_counts = nb_counts;
+    this->m_header.id = id;
+    this->m_header.partition = partition;
+    this->m_header.block_rows = block_rows ? block_rows : get_block_rows(nb_counts);
+
+    this->m_header.serialize(this->m_first_layer.get());
+    m_offset = this->m_first_layer->tellp();
+
+    this->template set_second_layer<ocstream>(false);
+
+    size_t rows = this->m_header.block_rows;
+    m_keys.resize(rows * this->m_header.kmer_slots);
+    m_columns.resize(rows * nb_counts);
+    m_positions.resize(rows);
+    m_values.resize(rows);
+    m_dest.resize(rows * sizeof(uint64_t) * (this->m_header.kmer_slots + 1) + BLOCK_PADDING);
+  }
+
+  ~MatrixBlockWriter()
+  {
+    close();
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  void write(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    push(kmer.get_data64(), counts);
+  }
+
+  template<size_t MAX_C>
+  void write(uint64_t hash, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    push(&hash, counts);
+  }
+
+  // Writes the last block and the block index.
+  void close()
+  {
+    if (m_closed)
+      return;
+    m_closed = true;
+    flush_block();
+
+    uint64_t index_offset = m_offset;
+    uint32_t slots = this->m_header.kmer_slots;
+    for (size_t b=0; b<m_offsets.size(); b++)
+    {
+      this->m_second_layer->write(reinterpret_cast<char*>(&m_offsets[b]), sizeof(uint64_t));
+      this->m_second_layer->write(reinterpret_cast<char*>(&m_first_keys[b * slots]),
+                                  slots * sizeof(uint64_t));
+    }
+    uint64_t nb_blocks = m_offsets.size();
+    this->m_second_layer->write(reinterpret_cast<char*>(&nb_blocks), sizeof(nb_blocks));
+    this->m_second_layer->write(reinterpret_cast<char*>(&index_offset), sizeof(index_offset));
+    this->m_second_layer->flush();
+  }
+
+private:
+  template<typename count_type>
+  void push(const uint64_t* key, const std::vector<count_type>& counts)
+  {
+    size_t rows = this->m_header.block_rows;
+    for (size_t w=0; w<this->m_header.kmer_slots; w++)
+      m_keys[w * rows + m_rows] = key[w];
+    for (size_t s=0; s<this->m_header.nb_counts; s++)
+      m_columns[s * rows + m_rows] = counts[s];
+    if (++m_rows == rows)
+      flush_block();
+  }
+
+  void put(const void* data, size_t size)
+  {
+    this->m_second_layer->write(reinterpret_cast<const char*>(data), size);
+    m_offset += size;
+  }
+
+  void flush_block()
+  {
+    if (!m_rows)
+      return;
+
+    uint32_t rows = this->m_header.block_rows;
+    uint32_t slots = this->m_header.kmer_slots;
+    m_offsets.push_back(m_offset);
+    for (size_t w=0; w<slots; w++)
+      m_first_keys.push_back(m_keys[w * rows]);
+
+    put(&m_rows, sizeof(m_rows));
+    uint64_t key_bytes = 0;
+    if (slots == 1)
+      key_bytes = p4nd1enc64(m_keys.data(), m_rows, m_dest.data());
+    else
+      for (size_t w=0; w<slots; w++)
+        key_bytes += p4nzenc64(m_keys.data() + w * rows, m_rows, m_dest.data() + key_bytes);
+    put(&key_bytes, sizeof(key_bytes));
+    put(m_dest.data(), key_bytes);
+
+    for (size_t s=0; s<this->m_header.nb_counts; s++)
+      write_column(m_columns.data() + s * rows);
+
+    std::fill(m_columns.begin(), m_columns.end(), 0);
+    m_rows = 0;
+  }
+
+  void write_column(uint32_t* column)
+  {
+    uint32_t nnz = 0;
+    for (uint32_t i=0; i<m_rows; i++)
+    {
+      if (column[i])
+      {
+        m_positions[nnz] = i;
+        m_values[nnz++] = column[i];
+      }
+    }
+
+    BLOCK_COLUMN encoding = BLOCK_COLUMN::EMPTY;
+    uint32_t bytes = 0;
+    if (nnz)
+    {
+      encoding = BLOCK_COLUMN::PFOR;
+      bytes = p4nenc32(column, m_rows, m_dest.data());
+
+      if (nnz <= m_rows / 4)
+      {
+        unsigned char* sparse = m_dest.data() + bytes;
+        uint32_t sparse_bytes = sizeof(nnz);
+        std::memcpy(sparse, &nnz, sizeof(nnz));
+        sparse_bytes += p4nd1enc32(m_positions.data(), nnz, sparse + sparse_bytes);
+        sparse_bytes += p4nenc32(m_values.data(), nnz, sparse + sparse_bytes);
+        if (sparse_bytes < bytes)
+        {
+          encoding = BLOCK_COLUMN::SPARSE;
+          std::memmove(m_dest.data(), sparse, sparse_bytes);
+          bytes = sparse_bytes;
+        }
+      }
+    }
+
+    put(&encoding, sizeof(encoding));
+    put(&bytes, sizeof(bytes));
+    put(m_dest.data(), bytes);
+  }
+
+private:
+  std::vector<uint64_t> m_keys;
+  std::vector<uint32_t> m_columns;
+  std::vector<uint32_t> m_positions;
+  std::vector<uint32_t> m_values;
+  std::vector<unsigned char> m_dest;
+  uint32_t m_rows {0};
+
+  uint64_t m_offset {0};
+  std::vector<uint64_t> m_offsets;
+  std::vector<uint64_t> m_first_keys;
+  bool m_closed {false};
+};
+
+template<size_t buf_size = 8192>
+class MatrixBlockReader : public IFile<MatrixBlockFileHeader, std::istream, buf_size>
+{
+  using icstream = lz4_stream::basic_istream<buf_size>;
+public:
+  MatrixBlockReader(const std::string& path)
+    : IFile<MatrixBlockFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary)
+  {
+    this->m_header.deserialize(this->m_first_layer.get());
+    this->m_header.sanity_check();
+    uint64_t data_offset = this->m_first_layer->tellg();
+
+    uint64_t nb_blocks = 0;
+    uint64_t index_offset = 0;
+    this->m_first_layer->seekg(-2 * static_cast<int64_t>(sizeof(uint64_t)), std::ios::end);
+    this->m_first_layer->read(reinterpret_cast<char*>(&nb_blocks), sizeof(nb_blocks));
+    this->m_first_layer->read(reinterpret_cast<char*>(&index_offset), sizeof(index_offset));
+    if (!this->m_first_layer->good())
+      throw IOError(fmt::format("{}: truncated block matrix.", path));
+
+    uint32_t slots = this->m_header.kmer_slots;
+    m_offsets.resize(nb_blocks);
+    m_first_keys.resize(nb_blocks * slots);
+    this->m_first_layer->seekg(index_offset);
+    for (size_t b=0; b<nb_blocks; b++)
+    {
+      this->m_first_layer->read(reinterpret_cast<char*>(&m_offsets[b]), sizeof(uint64_t));
+      this->m_first_layer->read(reinterpret_cast<char*>(&m_first_keys[b * slots]),
+                                slots * sizeof(uint64_t));
+    }
+    this->m_first_layer->seekg(data_offset);
+
+    this->template set_second_layer<icstream>(false);
+
+    size_t rows = this->m_header.block_rows;
+    m_keys.resize(rows * slots + BLOCK_PADDING);
+    m_columns.resize(rows * this->m_header.nb_counts + BLOCK_PADDING);
+    m_positions.resize(rows + BLOCK_PADDING);
+    m_values.resize(rows + BLOCK_PADDING);
+    m_key.resize(slots);
+  }
+
+  size_t nb_blocks() const
+  {
+    return m_offsets.size();
+  }
+
+  // Positions the reader on the first row of block b.
+  void seek_block(size_t b)
+  {
+    m_block = b;
+    m_rows = m_row = 0;
+    if (b < m_offsets.size())
+    {
+      this->m_second_layer->clear();
+      this->m_second_layer->seekg(m_offsets[b]);
+    }
+  }
+
+  // Positions the reader on the first row whose k-mer is not less than kmer.
+  template<size_t MAX_K>
+  void seek(const Kmer<MAX_K>& kmer)
+  {
+    Kmer<MAX_K> key; key.set_k(this->m_header.kmer_size);
+    seek_key([&](size_t b) {
+      key.set64_p(&m_first_keys[b * this->m_header.kmer_slots]);
+      return kmer < key;
+    }, [&]() {
+      key.set64_p(row_key(m_row));
+      return key < kmer;
+    });
+  }
+
+  // Positions the reader on the first row whose hash is not less than hash.
+  void seek(uint64_t hash)
+  {
+    seek_key([&](size_t b) { return hash < m_first_keys[b]; },
+             [&]() { return m_keys[m_row] < hash; });
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    return read<MAX_K, MAX_C>(kmer, counts.data(), counts.size());
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, typename selectC<MAX_C>::type* counts, std::size_t n)
+  {
+    if (!next_row())
+      return false;
+    kmer.set64_p(row_key(m_row));
+    row_counts(counts, n);
+    m_row++;
+    return true;
+  }
+
+  template<size_t MAX_C>
+  bool read(uint64_t& hash, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    if (!next_row())
+      return false;
+    hash = m_keys[m_row];
+    row_counts(counts.data(), counts.size());
+    m_row++;
+    return true;
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  void write_as_text(std::ostream& stream)
+  {
+    Kmer<MAX_K> kmer; kmer.set_k(this->m_header.kmer_size);
+    std::vector<typename selectC<MAX_C>::type> counts(this->m_header.nb_counts);
+    while (read<MAX_K, MAX_C>(kmer, counts))
+    {
+      stream << kmer.to_string();
+      for (auto& c : counts)
+        stream << " " << std::to_string(c);
+      stream << "\n";
+    }
+  }
+
+  template<size_t MAX_C>
+  void write_as_text(std::ostream& stream)
+  {
+    uint64_t hash;
+    std::vector<typename selectC<MAX_C>::type> counts(this->m_header.nb_counts);
+    while (read<MAX_C>(hash, counts))
+    {
+      stream << std::to_string(hash);
+      for (auto& c : counts)
+        stream << " " << std::to_string(c);
+      stream << "\n";
+    }
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  void write_kmers(std::ostream& stream)
+  {
+    Kmer<MAX_K> kmer; kmer.set_k(this->m_header.kmer_size);
+    std::vector<typename selectC<MAX_C>::type> counts(this->m_header.nb_counts);
+    while (read<MAX_K, MAX_C>(kmer, counts))
+    {
+      stream << kmer.to_string() << '\n';
+    }
+  }
+
+private:
+  // The row key, as Kmer::set64_p expects it.
+  const uint64_t* row_key(size_t row)
+  {
+    uint32_t slots = this->m_header.kmer_slots;
+    if (slots == 1)
+      return &m_keys[row];
+    for (size_t w=0; w<slots; w++)
+      m_key[w] = m_keys[w * this->m_header.block_rows + row];
+    return m_key.data();
+  }
+
+  template<typename count_type>
+  void row_counts(count_type* counts, size_t n)
+  {
+    size_t rows = this->m_header.block_rows;
+    n = std::min<size_t>(n, this->m_header.nb_counts);
+    for (size_t s=0; s<n; s++)
+      counts[s] = m_columns[s * rows + m_row];
+  }
+
+  // first_after(b) is true if the key is before the first key of block b, row_before() is
+  // true if the current row is before the key.
+  template<typename FirstAfter, typename RowBefore>
+  void seek_key(FirstAfter&& first_after, RowBefore&& row_before)
+  {
+    size_t lo = 0, hi = m_offsets.size();
+    while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (first_after(mid))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    seek_block(lo ? lo - 1 : 0);
+    while (next_row() && row_before())
+      m_row++;
+  }
+
+  bool next_row()
+  {
+    while (m_row == m_rows)
+    {
+      if (m_block >= m_offsets.size() || !load_block())
+        return false;
+    }
+    return true;
+  }
+
+  template<typename T>
+  void get(T* data, size_t size)
+  {
+    this->m_second_layer->read(reinterpret_cast<char*>(data), size);
+    if (static_cast<size_t>(this->m_second_layer->gcount()) != size)
+      throw IOError(fmt::format("{}: truncated block matrix.", this->m_path));
+  }
+
+  bool load_block()
+  {
+    uint32_t rows = this->m_header.block_rows;
+    uint32_t slots = this->m_header.kmer_slots;
+
+    get(&m_rows, sizeof(m_rows));
+    m_row = 0;
+    m_block++;
+
+    uint64_t key_bytes = 0;
+    get(&key_bytes, sizeof(key_bytes));
+    read_src(key_bytes);
+    if (slots == 1)
+      p4nd1dec64(m_src.data(), m_rows, m_keys.data());
+    else
+      for (size_t w=0, used=0; w<slots; w++)
+        used += p4nzdec64(m_src.data() + used, m_rows, m_keys.data() + w * rows);
+
+    for (size_t s=0; s<this->m_header.nb_counts; s++)
+    {
+      BLOCK_COLUMN encoding;
+      uint32_t bytes = 0;
+      get(&encoding, sizeof(encoding));
+      get(&bytes, sizeof(bytes));
+      read_src(bytes);
+
+      uint32_t* column = m_columns.data() + s * rows;
+      if (encoding == BLOCK_COLUMN::EMPTY)
+        std::fill(column, column + m_rows, 0);
+      else if (encoding == BLOCK_COLUMN::PFOR)
+        p4ndec32(m_src.data(), m_rows, column);
+      else if (encoding == BLOCK_COLUMN::SPARSE)
+      {
+        uint32_t nnz = 0;
+        std::memcpy(&nnz, m_src.data(), sizeof(nnz));
+        size_t used = sizeof(nnz);
+        used += p4nd1dec32(m_src.data() + used, nnz, m_positions.data());
+        p4ndec32(m_src.data() + used, nnz, m_values.data());
+        std::fill(column, column + m_rows, 0);
+        for (uint32_t i=0; i<nnz; i++)
+          column[m_positions[i]] = m_values[i];
+      }
+      else
+        throw IOError(fmt::format("{}: invalid column encoding.", this->m_path));
+    }
+    return m_rows > 0;
+  }
+
+  void read_src(size_t bytes)
+  {
+    if (m_src.size() < bytes + BLOCK_PADDING)
+      m_src.resize(bytes + BLOCK_PADDING);
+    get(m_src.data(), bytes);
+  }
+
+private:
+  std::vector<uint64_t> m_offsets;
+  std::vector<uint64_t> m_first_keys;
+
+  std::vector<uint64_t> m_keys;
+  std::vector<uint32_t> m_columns;
+  std::vector<uint32_t> m_positions;
+  std::vector<uint32_t> m_values;
+  std::vector<unsigned char> m_src;
+  std::vector<uint64_t> m_key;
+
+  size_t m_block {0};
+  uint32_t m_rows {0};
+  uint32_t m_row {0};
+};
+
 template<size_t buf_size = 8192>
 using mr_t = std::shared_ptr<MatrixReader<buf_size>>;
 template<size_t buf_size = 8192>
 using mhr_t = std::shared_ptr<MatrixHashReader<buf_size>>;
 
-template<size_t MAX_K, size_t MAX_C>
+template<size_t MAX_K, size_t MAX_C, typename Reader = MatrixReader<8192>>
 class MatrixFileMerger
 {
   using count_type = typename selectC<MAX_C>::type;
@@ -342,7 +896,7 @@ public:
   void init_stream()
   {
     for (auto& path: m_paths)
-      m_input_streams.push_back(std::make_shared<MatrixReader<8192>>(path));
+      m_input_streams.push_back(std::make_shared<Reader>(path));
     m_size = m_paths.size();
   }
 
@@ -444,7 +998,7 @@ private:
 private:
   std::vector<std::string> m_paths;
 
-  std::vector<mr_t<8192>> m_input_streams;
+  std::vector<std::shared_ptr<Reader>> m_input_streams;
   std::vector<element> m_elements;
 
   uint32_t m_size;
@@ -459,7 +1013,7 @@ private:
   bool m_finish {false};
 };
 
-template<size_t MAX_K, size_t MAX_C>
+template<size_t MAX_K, size_t MAX_C, typename Reader = MatrixReader<8192>>
 class MatrixFileAggregator
 {
 public:
@@ -471,13 +1025,13 @@ public:
 
   void write_as_bin(const std::string& path, bool compressed)
   {
-    size_t size = MatrixReader<8192>(m_paths[0]).infos().nb_counts;
+    size_t size = Reader(m_paths[0]).infos().nb_counts;
     MatrixWriter<8192> kw(path, m_kmer_size, requiredC<MAX_C>::value/8, size, 0, -1, compressed);
     Kmer<MAX_K> k; k.set_k(m_kmer_size);
     std::vector<typename selectC<MAX_C>::type> counts(size);
     for (auto& p : m_paths)
     {
-      MatrixReader<8192> kr(p);
+      Reader kr(p);
       while (kr.template read<MAX_K, MAX_C>(k, counts))
         kw.template write<MAX_K, MAX_C>(k, counts);
     }
@@ -487,7 +1041,7 @@ public:
   {
     for (auto& p : m_paths)
     {
-      MatrixReader<8192> kr(p);
+      Reader kr(p);
       kr.template write_as_text<MAX_K, MAX_C>(out);
     }
   }
@@ -502,7 +1056,7 @@ public:
   {
     for (auto& p : m_paths)
     {
-      MatrixReader<8192> kr(p);
+      Reader kr(p);
       kr.template write_kmers<MAX_K, MAX_C>(out);
     }
   }
@@ -520,7 +1074,7 @@ private:
 };
 
 
-template<size_t MAX_C>
+template<size_t MAX_C, typename Reader = MatrixHashReader<8192>>
 class MatrixHashFileAggregator
 {
 public:
@@ -532,13 +1086,13 @@ public:
 
   void write_as_bin(const std::string& path, bool compressed)
   {
-    size_t size = MatrixHashReader<8192>(m_paths[0]).infos().nb_counts;
+    size_t size = Reader(m_paths[0]).infos().nb_counts;
     MatrixHashWriter<8192> kw(path, requiredC<MAX_C>::value/8, size, 0, -1, compressed);
     uint64_t hash;
     std::vector<typename selectC<MAX_C>::type> counts(size);
     for (auto& p : m_paths)
     {
-      MatrixHashReader<8192> kr(p);
+      Reader kr(p);
       while (kr.template read<MAX_C>(hash, counts))
         kw.template write<MAX_C>(hash, counts);
     }
@@ -548,7 +1102,7 @@ public:
   {
     for (auto& p : m_paths)
     {
-      MatrixHashReader<8192> kr(p);
+      Reader kr(p);
       kr.template write_as_text<MAX_C>(out);
     }
   }
@@ -0,0 +1,340 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <lz4frame.h>
+
+#include <kmtricks/exceptions.hpp>
+#include <kmtricks/io/read_ahead.hpp>
+
+namespace km {
+
+// Fixed-size staging buffers shared by all merge inputs. A stream only holds a buffer
+// while it refills, so a few buffers serve any number of streams. At most capacity
+// buffers are allocated, acquire() waits when all of them are in use.
+class MergeBufferPool
+{
+public:
+  static constexpr size_t block_size = (64 << 10) + 512;
+
+  class Buffer
+  {
+  public:
+    Buffer(MergeBufferPool& pool) : m_pool(pool), m_data(pool.acquire()) {}
+    ~Buffer() { m_pool.release(m_data); }
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    char* data() { return m_data; }
+    size_t size() const { return block_size; }
+
+  private:
+    MergeBufferPool& m_pool;
+    char* m_data;
+  };
+
+  MergeBufferPool(size_t capacity = std::max(1u, std::thread::hardware_concurrency()))
+    : m_capacity(capacity) {}
+
+  static MergeBufferPool& get()
+  {
+    static MergeBufferPool singleton;
+    return singleton;
+  }
+
+  void set_capacity(size_t capacity)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_capacity = std::max<size_t>(capacity, 1);
+    while (!m_free.empty() && m_buffers.size() > m_capacity)
+    {
+      char* b = m_free.back(); m_free.pop_back();
+      m_buffers.erase(std::find_if(m_buffers.begin(), m_buffers.end(),
+                                   [b](auto& p){ return p.get() == b; }));
+    }
+    m_condition.notify_all();
+  }
+
+  char* acquire()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]{ return !m_free.empty() || m_buffers.size() < m_capacity; });
+    if (m_free.empty())
+    {
+      m_buffers.push_back(std::make_unique<char[]>(block_size));
+      return m_buffers.back().get();
+    }
+    char* b = m_free.back();
+    m_free.pop_back();
+    return b;
+  }
+
+  void release(char* b)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_free.push_back(b);
+    }
+    m_condition.notify_one();
+  }
+
+  // Bytes currently allocated by the pool.
+  size_t footprint()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_buffers.size() * block_size;
+  }
+
+private:
+  size_t m_capacity;
+  std::vector<std::unique_ptr<char[]>> m_buffers;
+  std::vector<char*> m_free;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+};
+
+// Memory allocated by a LZ4F decompression context once the frame header is known:
+// a block buffer, an output buffer and 128KB of history for linked blocks.
+inline size_t lz4_context_footprint(size_t max_block_size = 64 << 10, bool linked = true)
+{
+  return 256 + (max_block_size + 4) + max_block_size + (linked ? (128 << 10) : 0);
+}
+
+// Sequential reader over the payload of a kmtricks file, used by merges which keep
+// thousands of files open. It owns a small buffer, reads with pread and borrows a
+// staging buffer from the MergeBufferPool to refill. With a read-ahead window, reads are
+// served from two blocks of this size which the ReadAheadPool reads in advance. When lz4_layer is set and the header
+// says the file is compressed, the payload is a LZ4 frame whose context is created on the
+// first refill and released as soon as the stream is exhausted.
+template<typename header_t>
+class MergeInput
+{
+public:
+  MergeInput(const std::string& path, bool lz4_layer, size_t buffer_size, size_t read_ahead)
+    : m_path(path), m_read_ahead(read_ahead)
+  {
+    {
+      std::ifstream in(path, std::ios::in | std::ios::binary);
+      if (!in.good())
+        throw IOError("Unable to open " + path);
+      m_header.deserialize(&in);
+      m_header.sanity_check();
+      m_pos = in.tellg();
+    }
+    m_lz4 = lz4_layer && m_header.compressed;
+
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+      throw IOError("Unable to open " + path + ": " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(m_fd, &st) < 0)
+      throw IOError("Unable to stat " + path + ": " + std::strerror(errno));
+    m_end = st.st_size;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    m_buffer.resize(buffer_size);
+    if (m_read_ahead)
+      m_blocks = std::make_unique<ReadAheadBlocks>(m_fd, m_pos, m_read_ahead);
+  }
+
+  ~MergeInput()
+  {
+    free_context();
+    m_blocks.reset();
+    if (m_fd >= 0)
+      ::close(m_fd);
+  }
+
+  MergeInput(const MergeInput&) = delete;
+  MergeInput& operator=(const MergeInput&) = delete;
+
+  const header_t& infos() const
+  {
+    return m_header;
+  }
+
+  // Bytes held by this stream, including the LZ4F context when it exists.
+  size_t footprint() const
+  {
+    return sizeof(*this) + m_buffer.capacity() + m_ctx_bytes
+      + (m_blocks ? m_blocks->footprint() : 0);
+  }
+
+  size_t peak_footprint() const
+  {
+    return std::max(m_peak, footprint());
+  }
+
+protected:
+  bool read_bytes(void* dst, size_t size)
+  {
+    char* out = static_cast<char*>(dst);
+    while (size)
+    {
+      if (m_begin == m_size)
+      {
+        if (!m_lz4 && size >= m_buffer.size())
+        {
+          size_t n = pread_full(out, size, m_pos);
+          m_pos += n;
+          return n == size;
+        }
+        if (!refill())
+          return false;
+      }
+      size_t n = std::min(size, m_size - m_begin);
+      std::memcpy(out, m_buffer.data() + m_begin, n);
+      m_begin += n; out += n; size -= n;
+    }
+    return true;
+  }
+
+  bool refill()
+  {
+    m_begin = m_size = 0;
+
+    if (!m_lz4)
+    {
+      m_size = pread_full(m_buffer.data(), m_buffer.size(), m_pos);
+      m_pos += m_size;
+      return m_size;
+    }
+
+    if (!m_ctx && m_pos == m_end)
+      return false;
+    create_context();
+
+    MergeBufferPool::Buffer staging(MergeBufferPool::get());
+    while (!m_size)
+    {
+      // the hint is the size of the next compressed block, input which is not consumed
+      // is read again on the next refill
+      size_t want = std::min<uint64_t>(m_hint ? m_hint : staging.size(), m_end - m_pos);
+      size_t src_size = pread_full(staging.data(), std::min(want, staging.size()), m_pos);
+      size_t dst_size = m_buffer.size();
+      m_hint = LZ4F_decompress(m_ctx, m_buffer.data(), &dst_size,
+                               staging.data(), &src_size, nullptr);
+      if (LZ4F_isError(m_hint))
+        throw IOError(m_path + ": LZ4 decompression failed: " + LZ4F_getErrorName(m_hint));
+      m_pos += src_size;
+      m_size = dst_size;
+      if (!m_size && m_pos == m_end)
+      {
+        free_context();
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  size_t pread_full(char* dst, size_t size, uint64_t offset)
+  {
+    if (m_blocks)
+      return m_blocks->read(dst, size, offset);
+    size_t done = 0;
+    while (done < size)
+    {
+      ssize_t n = ::pread(m_fd, dst + done, size - done, offset + done);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw IOError("Unable to read " + m_path + ": " + std::strerror(errno));
+      }
+      if (n == 0)
+        break;
+      done += n;
+    }
+    return done;
+  }
+
+  void create_context()
+  {
+    if (m_ctx)
+      return;
+    size_t ret = LZ4F_createDecompressionContext(&m_ctx, LZ4F_VERSION);
+    if (LZ4F_isError(ret))
+      throw IOError(std::string("Failed to create LZ4 decompression context: ")
+                    + LZ4F_getErrorName(ret));
+
+    // FLG and BD bytes of the frame descriptor give the block size and mode.
+    unsigned char desc[6] = {0};
+    size_t block_size = 64 << 10;
+    bool linked = true;
+    if (pread_full(reinterpret_cast<char*>(desc), sizeof(desc), m_pos) == sizeof(desc))
+    {
+      linked = !(desc[4] & 0x20);
+      uint32_t id = (desc[5] >> 4) & 0x7;
+      if (id >= 4)
+        block_size = size_t{1} << (8 + 2 * id);
+    }
+    m_ctx_bytes = lz4_context_footprint(block_size, linked);
+    m_peak = std::max(m_peak, footprint());
+  }
+
+  void free_context()
+  {
+    if (!m_ctx)
+      return;
+    m_peak = std::max(m_peak, footprint());
+    LZ4F_freeDecompressionContext(m_ctx);
+    m_ctx = nullptr;
+    m_ctx_bytes = 0;
+  }
+
+protected:
+  header_t m_header;
+
+private:
+  std::string m_path;
+  bool m_lz4 {false};
+  size_t m_read_ahead;
+  int m_fd {-1};
+  uint64_t m_pos {0};
+  uint64_t m_end {0};
+  std::unique_ptr<ReadAheadBlocks> m_blocks;
+
+  std::vector<char> m_buffer;
+  size_t m_begin {0};
+  size_t m_size {0};
+
+  LZ4F_dctx* m_ctx {nullptr};
+  size_t m_hint {0};
+  size_t m_ctx_bytes {0};
+  size_t m_peak {0};
+};
+
+};
@@ -0,0 +1,320 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <queue>
+#include <thread>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <istream>
+#include <streambuf>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <kmtricks/exceptions.hpp>
+
+namespace km {
+
+// Small pool of I/O threads shared by all read-ahead streams.
+class ReadAheadPool
+{
+  using job_t = std::packaged_task<int64_t()>;
+public:
+  ReadAheadPool(size_t nb_threads = 4)
+  {
+    for (size_t i=0; i<nb_threads; i++)
+      m_pool.push_back(std::thread(&ReadAheadPool::worker, this));
+  }
+
+  ~ReadAheadPool()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto& t : m_pool)
+      if (t.joinable())
+        t.join();
+  }
+
+  static ReadAheadPool& get()
+  {
+    static ReadAheadPool singleton;
+    return singleton;
+  }
+
+  std::future<int64_t> submit(std::function<int64_t()> fn)
+  {
+    job_t job(std::move(fn));
+    std::future<int64_t> ret = job.get_future();
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_queue.push(std::move(job));
+    }
+    m_condition.notify_one();
+    return ret;
+  }
+
+private:
+  void worker()
+  {
+    while (true)
+    {
+      job_t job;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]{return this->m_stop || !this->m_queue.empty();});
+        if (m_stop && m_queue.empty())
+          return;
+        job = std::move(m_queue.front());
+        m_queue.pop();
+      }
+      job();
+    }
+  }
+
+private:
+  std::vector<std::thread> m_pool;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::queue<job_t> m_queue;
+  bool m_stop {false};
+};
+
+// Reads up to size bytes at offset, less at the end of the file. Returns the number of
+// bytes read, or -errno.
+inline int64_t pread_block(int fd, char* data, size_t size, uint64_t offset)
+{
+  size_t done = 0;
+  while (done < size)
+  {
+    ssize_t n = ::pread(fd, data + done, size - done, offset + done);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -static_cast<int64_t>(errno);
+    }
+    if (n == 0)
+      break;
+    done += n;
+  }
+  return done;
+}
+
+// Double-buffered input: while one block is consumed, the next one is read by the
+// ReadAheadPool, so reads only ever copy from memory that is already loaded.
+class ReadAheadBuffer : public std::streambuf
+{
+public:
+  ReadAheadBuffer(const std::string& path, uint64_t offset, size_t block_size)
+    : m_offset(offset)
+  {
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+      throw IOError("Unable to open " + path + ": " + std::strerror(errno));
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    for (size_t i=0; i<2; i++)
+    {
+      m_buffers[i].resize(block_size);
+      request(i);
+    }
+    setg(nullptr, nullptr, nullptr);
+  }
+
+  ~ReadAheadBuffer()
+  {
+    for (auto& f : m_pending)
+      if (f.valid())
+        f.wait();
+    ::close(m_fd);
+  }
+
+  ReadAheadBuffer(const ReadAheadBuffer&) = delete;
+  ReadAheadBuffer& operator=(const ReadAheadBuffer&) = delete;
+
+protected:
+  int_type underflow() override
+  {
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    if (m_started)
+    {
+      request(m_current);
+      m_current ^= 1;
+    }
+    m_started = true;
+
+    int64_t size = m_pending[m_current].get();
+    if (size < 0)
+      throw IOError(std::string("Read-ahead failed: ") + std::strerror(-size));
+    if (size == 0)
+      return traits_type::eof();
+
+    char* data = m_buffers[m_current].data();
+    setg(data, data, data + size);
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+  void request(size_t i)
+  {
+    char* data = m_buffers[i].data();
+    size_t size = m_buffers[i].size();
+    uint64_t offset = m_offset;
+    int fd = m_fd;
+    m_offset += size;
+
+    m_pending[i] = ReadAheadPool::get().submit([fd, data, size, offset]() -> int64_t {
+      return pread_block(fd, data, size, offset);
+    });
+  }
+
+private:
+  int m_fd {-1};
+  uint64_t m_offset {0};
+  std::array<std::vector<char>, 2> m_buffers;
+  std::array<std::future<int64_t>, 2> m_pending;
+  size_t m_current {0};
+  bool m_started {false};
+};
+
+class ReadAheadStream : public std::istream
+{
+public:
+  ReadAheadStream(const std::string& path, uint64_t offset, size_t block_size)
+    : std::istream(nullptr), m_buffer(path, offset, block_size)
+  {
+    rdbuf(&m_buffer);
+  }
+
+private:
+  ReadAheadBuffer m_buffer;
+};
+
+// Positional reads at non-decreasing offsets, served from two blocks read in advance by
+// the ReadAheadPool, see MergeInput. A block is read again further once an offset passes
+// its end, so that an input which is not consumed can be read again.
+class ReadAheadBlocks
+{
+public:
+  ReadAheadBlocks(int fd, uint64_t offset, size_t block_size)
+    : m_fd(fd), m_next(offset)
+  {
+    for (size_t i=0; i<2; i++)
+    {
+      m_blocks[i].data.resize(block_size);
+      request(i);
+    }
+  }
+
+  ~ReadAheadBlocks()
+  {
+    for (auto& b : m_blocks)
+      if (b.pending.valid())
+        b.pending.wait();
+  }
+
+  ReadAheadBlocks(const ReadAheadBlocks&) = delete;
+  ReadAheadBlocks& operator=(const ReadAheadBlocks&) = delete;
+
+  size_t read(char* dst, size_t size, uint64_t offset)
+  {
+    size_t done = 0;
+    while (done < size)
+    {
+      const Block& b = block(offset + done);
+      if (offset + done < b.offset || offset + done >= b.offset + b.size)
+        break;
+      size_t from = offset + done - b.offset;
+      size_t n = std::min(size - done, b.size - from);
+      std::memcpy(dst + done, b.data.data() + from, n);
+      done += n;
+    }
+    return done;
+  }
+
+  size_t footprint() const
+  {
+    return m_blocks[0].data.size() + m_blocks[1].data.size();
+  }
+
+private:
+  struct Block
+  {
+    std::vector<char> data;
+    uint64_t offset {0};
+    size_t size {0};
+    std::future<int64_t> pending;
+  };
+
+  // Block holding offset, or the last one of the file.
+  const Block& block(uint64_t offset)
+  {
+    while (true)
+    {
+      Block& b = m_blocks[m_current];
+      if (b.pending.valid())
+      {
+        int64_t size = b.pending.get();
+        if (size < 0)
+          throw IOError(std::string("Read-ahead failed: ") + std::strerror(-size));
+        b.size = size;
+      }
+      if (offset < b.offset + b.data.size() || b.size < b.data.size())
+        return b;
+      request(m_current);
+      m_current ^= 1;
+    }
+  }
+
+  void request(size_t i)
+  {
+    Block& b = m_blocks[i];
+    b.offset = m_next;
+    b.size = 0;
+    m_next += b.data.size();
+    char* data = b.data.data();
+    size_t size = b.data.size();
+    uint64_t offset = b.offset;
+    int fd = m_fd;
+    b.pending = ReadAheadPool::get().submit([fd, data, size, offset]() -> int64_t {
+      return pread_block(fd, data, size, offset);
+    });
+  }
+
+private:
+  int m_fd;
+  uint64_t m_next;
+  std::array<Block, 2> m_blocks;
+  size_t m_current {0};
+};
+
+};
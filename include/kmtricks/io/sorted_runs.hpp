@@ -0,0 +1,254 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+#include <cstdio>
+
+#include <kmtricks/exceptions.hpp>
+#include <kmtricks/loser_tree.hpp>
+
+namespace km {
+
+template<typename K>
+struct KeyCount
+{
+  K key;
+  uint32_t count;
+};
+
+// Sorted runs of (key, count) records spilled to disk by partition counters which exceed
+// their memory budget. Runs are named after prefix, merged back in key order and removed.
+// Run readers share scratch, which is only used during merges and may therefore be the
+// memory of the keys once they are written. At most max_runs runs are kept, beyond that they
+// are merged into one.
+template<typename K>
+class SortedRuns
+{
+  using record_t = KeyCount<K>;
+
+  class RunReader
+  {
+  public:
+    RunReader(const std::string& path, record_t* buffer, size_t buffer_size)
+      : m_in(path, std::ios::in | std::ios::binary), m_buffer(buffer), m_capacity(buffer_size)
+    {
+      if (!m_in.good())
+        throw IOError("Unable to open " + path);
+    }
+
+    bool next()
+    {
+      if (++m_pos < m_size)
+        return true;
+      m_in.read(reinterpret_cast<char*>(m_buffer), m_capacity * sizeof(record_t));
+      m_size = m_in.gcount() / sizeof(record_t);
+      m_pos = 0;
+      return m_size;
+    }
+
+    const record_t& value() const { return m_buffer[m_pos]; }
+
+  private:
+    std::ifstream m_in;
+    record_t* m_buffer;
+    size_t m_capacity;
+    size_t m_size {0};
+    size_t m_pos {0};
+  };
+
+  class RunWriter
+  {
+  public:
+    RunWriter(const std::string& path)
+      : m_path(path), m_out(path, std::ios::out | std::ios::binary)
+    {
+      if (!m_out.good())
+        throw IOError("Unable to open " + path);
+      m_buffer.reserve(buffer_size);
+    }
+
+    void write(const K& key, uint32_t count)
+    {
+      m_buffer.push_back({key, count});
+      if (m_buffer.size() == buffer_size)
+        flush();
+    }
+
+    void close()
+    {
+      flush();
+      m_out.close();
+      if (m_out.fail())
+        throw IOError("Unable to write " + m_path);
+    }
+
+  private:
+    void flush()
+    {
+      m_out.write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size() * sizeof(record_t));
+      m_buffer.clear();
+    }
+
+  private:
+    static constexpr size_t buffer_size = (64 << 10) / sizeof(record_t);
+    std::string m_path;
+    std::ofstream m_out;
+    std::vector<record_t> m_buffer;
+  };
+
+public:
+  SortedRuns(const std::string& prefix, void* scratch, size_t scratch_bytes, size_t max_runs = 256)
+    : m_prefix(prefix), m_scratch(static_cast<record_t*>(scratch)),
+      m_scratch_size(scratch_bytes / sizeof(record_t)), m_max_runs(std::max<size_t>(max_runs, 2)) {}
+
+  ~SortedRuns()
+  {
+    for (auto& path : m_paths)
+      std::remove(path.c_str());
+  }
+
+  SortedRuns(const SortedRuns&) = delete;
+  SortedRuns& operator=(const SortedRuns&) = delete;
+
+  // Writes a run from size sorted keys, equal keys are written once with their count.
+  void add(const K* keys, size_t size)
+  {
+    if (!size)
+      return;
+
+    RunWriter out(next_path());
+    uint32_t count = 1;
+    for (size_t i=1; i<size; i++)
+    {
+      if (keys[i] == keys[i-1])
+      {
+        count++;
+        continue;
+      }
+      out.write(keys[i-1], count);
+      count = 1;
+    }
+    out.write(keys[size-1], count);
+    out.close();
+
+    if (m_paths.size() >= m_max_runs)
+      compact();
+  }
+
+  // Writes a run from size records in key order, with distinct keys.
+  void add(const KeyCount<K>* records, size_t size)
+  {
+    if (!size)
+      return;
+
+    RunWriter out(next_path());
+    for (size_t i=0; i<size; i++)
+      out.write(records[i].key, records[i].count);
+    out.close();
+
+    if (m_paths.size() >= m_max_runs)
+      compact();
+  }
+
+  size_t size() const
+  {
+    return m_paths.size();
+  }
+
+  // Calls fn(key, count) in key order, with the counts of a key summed over all runs.
+  template<typename Fn>
+  void merge(Fn&& fn)
+  {
+    if (m_paths.empty())
+      return;
+
+    size_t share = std::max<size_t>(m_scratch_size / m_paths.size(), 1);
+    if (share * m_paths.size() > m_scratch_size)
+    {
+      m_owned.resize(share * m_paths.size());
+      m_scratch = m_owned.data();
+    }
+
+    std::vector<std::unique_ptr<RunReader>> runs;
+    std::vector<bool> alive;
+    for (size_t i=0; i<m_paths.size(); i++)
+    {
+      runs.push_back(std::make_unique<RunReader>(m_paths[i], m_scratch + i * share, share));
+      alive.push_back(runs.back()->next());
+    }
+
+    auto less = [&](uint32_t a, uint32_t b) {
+      if (!alive[a] || !alive[b])
+        return alive[a] && !alive[b];
+      if (runs[a]->value().key == runs[b]->value().key)
+        return a < b;
+      return runs[a]->value().key < runs[b]->value().key;
+    };
+    LoserTree<decltype(less)> tree(runs.size(), less);
+
+    while (alive[tree.top()])
+    {
+      uint32_t s = tree.top();
+      K key = runs[s]->value().key;
+      uint64_t count = 0;
+      while (alive[s = tree.top()] && runs[s]->value().key == key)
+      {
+        count += runs[s]->value().count;
+        alive[s] = runs[s]->next();
+        tree.replay(s);
+      }
+      fn(key, static_cast<uint32_t>(std::min<uint64_t>(count, std::numeric_limits<uint32_t>::max())));
+    }
+  }
+
+private:
+  std::string next_path()
+  {
+    m_paths.push_back(m_prefix + ".run" + std::to_string(m_id++));
+    return m_paths.back();
+  }
+
+  void compact()
+  {
+    std::string path = m_prefix + ".run" + std::to_string(m_id++);
+    RunWriter out(path);
+    merge([&](const K& key, uint32_t count) { out.write(key, count); });
+    out.close();
+
+    for (auto& p : m_paths)
+      std::remove(p.c_str());
+    m_paths = {path};
+  }
+
+private:
+  std::string m_prefix;
+  record_t* m_scratch;
+  size_t m_scratch_size;
+  size_t m_max_runs;
+  size_t m_id {0};
+  std::vector<std::string> m_paths;
+  std::vector<record_t> m_owned;
+};
+
+};
@@ -0,0 +1,433 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cstring>
+#include <kmtricks/io/io_common.hpp>
+#include <kmtricks/kmer.hpp>
+#include <kmtricks/utils.hpp>
+
+namespace km {
+
+// Count or presence matrix with sparse rows. Rows are written by blocks, each block is stored
+// either dense, as in MatrixWriter/PAMatrixWriter, or sparse, whichever is smaller:
+//   [uint8 layout][uint32 rows][uint64 bytes][rows]
+// A sparse row is the key followed by the number of non-null samples, the sample ids as
+// varint deltas and, for count matrices, the counts of these samples.
+// Keys are k-mers (kmer_size > 0) or hashes (kmer_size = 0), presence matrices have
+// count_slots = 0.
+class SparseMatrixFileHeader : public KmHeader
+{
+public:
+  SparseMatrixFileHeader() {};
+
+  void serialize(std::ostream* stream)
+  {
+    _serialize(stream);
+    stream->write(reinterpret_cast<char*>(&matrix_magic), sizeof(matrix_magic));
+    stream->write(reinterpret_cast<char*>(&kmer_size), sizeof(kmer_size));
+    stream->write(reinterpret_cast<char*>(&kmer_slots), sizeof(kmer_slots));
+    stream->write(reinterpret_cast<char*>(&count_slots), sizeof(count_slots));
+    stream->write(reinterpret_cast<char*>(&nb_counts), sizeof(nb_counts));
+    stream->write(reinterpret_cast<char*>(&id), sizeof(id));
+    stream->write(reinterpret_cast<char*>(&partition), sizeof(partition));
+  }
+
+  void deserialize(std::istream* stream)
+  {
+    _deserialize(stream);
+    stream->read(reinterpret_cast<char*>(&matrix_magic), sizeof(matrix_magic));
+    stream->read(reinterpret_cast<char*>(&kmer_size), sizeof(kmer_size));
+    stream->read(reinterpret_cast<char*>(&kmer_slots), sizeof(kmer_slots));
+    stream->read(reinterpret_cast<char*>(&count_slots), sizeof(count_slots));
+    stream->read(reinterpret_cast<char*>(&nb_counts), sizeof(nb_counts));
+    stream->read(reinterpret_cast<char*>(&id), sizeof(id));
+    stream->read(reinterpret_cast<char*>(&partition), sizeof(partition));
+  }
+
+  void sanity_check()
+  {
+    _sanity_check();
+    if (matrix_magic != MAGICS.at(KM_FILE::MATRIX_SPARSE))
+      throw IOError("Invalid file format.");
+  }
+
+  bool presence() const
+  {
+    return count_slots == 0;
+  }
+
+  // Bytes of a dense row, without the key.
+  size_t dense_bytes() const
+  {
+    return presence() ? NBYTES(nb_counts) : static_cast<size_t>(nb_counts) * count_slots;
+  }
+
+public:
+  uint64_t matrix_magic {MAGICS.at(KM_FILE::MATRIX_SPARSE)};
+  uint32_t kmer_size;
+  uint32_t kmer_slots;
+  uint32_t count_slots;
+  uint32_t nb_counts;
+  uint32_t id;
+  uint32_t partition;
+};
+
+enum class SPARSE_LAYOUT : uint8_t
+{
+  DENSE,
+  SPARSE
+};
+
+template<size_t buf_size = 8192>
+class SparseMatrixWriter : public IFile<SparseMatrixFileHeader, std::ostream, buf_size>
+{
+  using ocstream = lz4_stream::basic_ostream<buf_size>;
+public:
+  static constexpr uint32_t block_rows = 256;
+
+  // count_size = 0 writes a presence matrix.
+  SparseMatrixWriter(const std::string& path,
+                     uint32_t kmer_size,
+                     uint32_t count_size,
+                     uint32_t nb_counts,
+                     uint32_t id,
+                     uint32_t partition,
+                     bool lz4)
+    : IFile<SparseMatrixFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary)
+  {
+    this->m_header.compressed = lz4;
+    this->m_header.kmer_size = kmer_size;
+    this->m_header.kmer_slots = kmer_size ? (kmer_size + 31) / 32 : 1;
+    this->m_header.count_slots = count_size;
+    this->m_header.nb_counts = nb_counts;
+    this->m_header.id = id;
+    this->m_header.partition = partition;
+
+    this->m_header.serialize(this->m_first_layer.get());
+
+    this->template set_second_layer<ocstream>(this->m_header.compressed);
+    m_bits.resize(NBYTES(nb_counts));
+  }
+
+  ~SparseMatrixWriter()
+  {
+    flush();
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  void write(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    push(kmer.get_data64(), counts);
+  }
+
+  template<size_t MAX_C>
+  void write(uint64_t hash, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    push(&hash, counts);
+  }
+
+  void flush()
+  {
+    if (!m_rows)
+      return;
+
+    bool sparse = m_sparse.size() < m_dense.size();
+    SPARSE_LAYOUT layout = sparse ? SPARSE_LAYOUT::SPARSE : SPARSE_LAYOUT::DENSE;
+    std::vector<char>& block = sparse ? m_sparse : m_dense;
+    uint64_t bytes = block.size();
+
+    this->m_second_layer->write(reinterpret_cast<char*>(&layout), sizeof(layout));
+    this->m_second_layer->write(reinterpret_cast<char*>(&m_rows), sizeof(m_rows));
+    this->m_second_layer->write(reinterpret_cast<char*>(&bytes), sizeof(bytes));
+    this->m_second_layer->write(block.data(), bytes);
+
+    m_dense.clear();
+    m_sparse.clear();
+    m_rows = 0;
+  }
+
+private:
+  template<typename count_type>
+  void push(const uint64_t* key, const std::vector<count_type>& counts)
+  {
+    const char* k = reinterpret_cast<const char*>(key);
+    size_t key_bytes = this->m_header.kmer_slots * sizeof(uint64_t);
+    m_dense.insert(m_dense.end(), k, k + key_bytes);
+    m_sparse.insert(m_sparse.end(), k, k + key_bytes);
+
+    uint32_t nnz = 0;
+    for (auto& c : counts)
+      nnz += c > 0;
+    put_varint(nnz);
+
+    uint32_t last = 0;
+    for (uint32_t i=0; i<counts.size(); i++)
+    {
+      if (counts[i])
+      {
+        put_varint(i - last);
+        last = i;
+      }
+    }
+
+    if (this->m_header.presence())
+    {
+      set_bit_vector(m_bits, counts);
+      m_dense.insert(m_dense.end(), m_bits.begin(), m_bits.end());
+    }
+    else
+    {
+      const char* c = reinterpret_cast<const char*>(counts.data());
+      m_dense.insert(m_dense.end(), c, c + counts.size() * sizeof(count_type));
+      for (auto& v : counts)
+      {
+        if (v)
+        {
+          c = reinterpret_cast<const char*>(&v);
+          m_sparse.insert(m_sparse.end(), c, c + sizeof(count_type));
+        }
+      }
+    }
+
+    if (++m_rows == block_rows)
+      flush();
+  }
+
+  void put_varint(uint32_t v)
+  {
+    while (v >= 0x80)
+    {
+      m_sparse.push_back(static_cast<char>(v | 0x80));
+      v >>= 7;
+    }
+    m_sparse.push_back(static_cast<char>(v));
+  }
+
+private:
+  std::vector<char> m_dense;
+  std::vector<char> m_sparse;
+  std::vector<uint8_t> m_bits;
+  uint32_t m_rows {0};
+};
+
+template<size_t buf_size = 8192>
+class SparseMatrixReader : public IFile<SparseMatrixFileHeader, std::istream, buf_size>
+{
+  using icstream = lz4_stream::basic_istream<buf_size>;
+public:
+  SparseMatrixReader(const std::string& path)
+    : IFile<SparseMatrixFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary)
+  {
+    this->m_header.deserialize(this->m_first_layer.get());
+    this->m_header.sanity_check();
+    this->template set_second_layer<icstream>(this->m_header.compressed);
+  }
+
+  // Reads the non-null samples of the next row, counts are set to 1 in presence matrices.
+  template<size_t MAX_K, size_t MAX_C>
+  bool read_sparse(Kmer<MAX_K>& kmer,
+                   std::vector<uint32_t>& ids,
+                   std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    if (!next_row(kmer.get_data64_unsafe()))
+      return false;
+    read_samples();
+    ids = m_ids;
+    counts.assign(m_values.begin(), m_values.end());
+    return true;
+  }
+
+  template<size_t MAX_C>
+  bool read_sparse(uint64_t& hash,
+                   std::vector<uint32_t>& ids,
+                   std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    if (!next_row(&hash))
+      return false;
+    read_samples();
+    ids = m_ids;
+    counts.assign(m_values.begin(), m_values.end());
+    return true;
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    if (!next_row(kmer.get_data64_unsafe()))
+      return false;
+    read_samples();
+    scatter(counts);
+    return true;
+  }
+
+  template<size_t MAX_C>
+  bool read(uint64_t& hash, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    if (!next_row(&hash))
+      return false;
+    read_samples();
+    scatter(counts);
+    return true;
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  void write_as_text(std::ostream& stream)
+  {
+    Kmer<MAX_K> kmer; kmer.set_k(this->m_header.kmer_size);
+    std::vector<typename selectC<MAX_C>::type> counts(this->m_header.nb_counts);
+    while (read<MAX_K, MAX_C>(kmer, counts))
+    {
+      stream << kmer.to_string();
+      write_counts(stream, counts);
+    }
+  }
+
+  template<size_t MAX_C>
+  void write_as_text(std::ostream& stream)
+  {
+    uint64_t hash;
+    std::vector<typename selectC<MAX_C>::type> counts(this->m_header.nb_counts);
+    while (read<MAX_C>(hash, counts))
+    {
+      stream << std::to_string(hash);
+      write_counts(stream, counts);
+    }
+  }
+
+private:
+  template<typename count_type>
+  void write_counts(std::ostream& stream, const std::vector<count_type>& counts)
+  {
+    for (auto& c : counts)
+      stream << " " << std::to_string(c);
+    stream << "\n";
+  }
+
+  template<typename count_type>
+  void scatter(std::vector<count_type>& counts)
+  {
+    std::fill(counts.begin(), counts.end(), 0);
+    for (size_t i=0; i<m_ids.size(); i++)
+      counts[m_ids[i]] = m_values[i];
+  }
+
+  bool next_row(uint64_t* key)
+  {
+    if (m_row == m_rows && !load_block())
+      return false;
+    m_row++;
+    size_t key_bytes = this->m_header.kmer_slots * sizeof(uint64_t);
+    std::memcpy(key, m_ptr, key_bytes);
+    m_ptr += key_bytes;
+    return true;
+  }
+
+  void read_samples()
+  {
+    m_ids.clear();
+    m_values.clear();
+    if (m_layout == SPARSE_LAYOUT::SPARSE)
+    {
+      uint32_t nnz = get_varint();
+      for (uint32_t i=0, id=0; i<nnz; i++)
+      {
+        id += get_varint();
+        m_ids.push_back(id);
+      }
+      if (this->m_header.presence())
+        m_values.resize(nnz, 1);
+      else
+        for (uint32_t i=0; i<nnz; i++)
+          m_values.push_back(get_count());
+    }
+    else if (this->m_header.presence())
+    {
+      for (uint32_t i=0; i<this->m_header.nb_counts; i++)
+      {
+        if (BITCHECK(m_ptr, i))
+        {
+          m_ids.push_back(i);
+          m_values.push_back(1);
+        }
+      }
+      m_ptr += this->m_header.dense_bytes();
+    }
+    else
+    {
+      for (uint32_t i=0; i<this->m_header.nb_counts; i++)
+      {
+        uint32_t c = get_count();
+        if (c)
+        {
+          m_ids.push_back(i);
+          m_values.push_back(c);
+        }
+      }
+    }
+  }
+
+  // Counts are stored on count_slots bytes.
+  uint32_t get_count()
+  {
+    uint32_t c = 0;
+    std::memcpy(&c, m_ptr, this->m_header.count_slots);
+    m_ptr += this->m_header.count_slots;
+    return c;
+  }
+
+  uint32_t get_varint()
+  {
+    uint32_t v = 0;
+    for (uint32_t shift=0; ; shift+=7)
+    {
+      uint8_t b = *m_ptr++;
+      v |= static_cast<uint32_t>(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+  }
+
+  bool load_block()
+  {
+    uint64_t bytes = 0;
+    this->m_second_layer->read(reinterpret_cast<char*>(&m_layout), sizeof(m_layout));
+    if (!this->m_second_layer->gcount())
+      return false;
+    this->m_second_layer->read(reinterpret_cast<char*>(&m_rows), sizeof(m_rows));
+    this->m_second_layer->read(reinterpret_cast<char*>(&bytes), sizeof(bytes));
+    m_block.resize(bytes);
+    this->m_second_layer->read(m_block.data(), bytes);
+    if (static_cast<uint64_t>(this->m_second_layer->gcount()) != bytes)
+      throw IOError(fmt::format("{}: truncated sparse matrix.", this->m_path));
+    m_ptr = reinterpret_cast<const uint8_t*>(m_block.data());
+    m_row = 0;
+    return m_rows > 0;
+  }
+
+private:
+  std::vector<char> m_block;
+  const uint8_t* m_ptr {nullptr};
+  SPARSE_LAYOUT m_layout {SPARSE_LAYOUT::DENSE};
+  uint32_t m_rows {0};
+  uint32_t m_row {0};
+  std::vector<uint32_t> m_ids;
+  std::vector<uint32_t> m_values;
+};
+
+};
@@ -0,0 +1,271 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <lz4.h>
+#include <spdlog/spdlog.h>
+
+#include <kmtricks/io/io_common.hpp>
+#include <kmtricks/exceptions.hpp>
+
+namespace km {
+
+inline std::string superk_container_path(const std::string& dir, const std::string& base)
+{
+  return fmt::format("{}/{}.container", dir, base);
+}
+
+// Layout of a super-k-mer container: the blocks of all the partitions of a sample, then an
+// index of SuperkBlockEntry, then a SuperkContainerFooter.
+struct SuperkBlockEntry
+{
+  uint64_t offset;
+  uint32_t partition;
+  uint32_t size;
+  uint32_t raw_size; // size when stored uncompressed
+  uint32_t padding {0};
+};
+
+struct SuperkContainerFooter
+{
+  uint64_t index_offset;
+  uint64_t nb_blocks;
+  uint64_t magic {MAGICS.at(KM_FILE::SUPERK)};
+  uint32_t version {KM_IO_VERSION};
+  uint32_t compressed;
+};
+
+namespace detail {
+
+inline void pwrite_all(int fd, const void* data, size_t size, uint64_t offset,
+                       const std::string& path)
+{
+  const char* ptr = static_cast<const char*>(data);
+  size_t done = 0;
+  while (done < size)
+  {
+    ssize_t n = ::pwrite(fd, ptr + done, size - done, offset + done);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw IOError("Unable to write " + path + ": " + std::strerror(errno));
+    }
+    done += n;
+  }
+}
+
+inline void pread_all(int fd, void* data, size_t size, uint64_t offset, const std::string& path)
+{
+  char* ptr = static_cast<char*>(data);
+  size_t done = 0;
+  while (done < size)
+  {
+    ssize_t n = ::pread(fd, ptr + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw IOError("Unable to read " + path + (n < 0 ? std::string(": ") + std::strerror(errno)
+                                                       : std::string(": truncated file")));
+    done += n;
+  }
+}
+
+};
+
+// Appends blocks of any partition to a container. Space is reserved under a lock and blocks
+// are written outside of it, so writers only contend on the reservation. With lz4, blocks
+// are compressed one by one, to be read back independently.
+class SuperkContainerWriter
+{
+public:
+  SuperkContainerWriter(const std::string& path, bool lz4)
+    : m_path(path), m_lz4(lz4)
+  {
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+      throw IOError("Unable to open " + path + ": " + std::strerror(errno));
+  }
+
+  // close() is expected before, errors can't be reported from here.
+  ~SuperkContainerWriter()
+  {
+    try
+    {
+      close();
+    }
+    catch (const std::exception& e)
+    {
+      spdlog::error("Unable to close {}: {}", m_path, e.what());
+    }
+  }
+
+  SuperkContainerWriter(const SuperkContainerWriter&) = delete;
+  SuperkContainerWriter& operator=(const SuperkContainerWriter&) = delete;
+
+  // Compresses a block in compressed, which is grown as needed. Returns the compressed size,
+  // 0 if the block is incompressible and must be kept as it is.
+  static uint32_t compress(const uint8_t* block, uint32_t size, std::vector<char>& compressed)
+  {
+    compressed.resize(LZ4_compressBound(size));
+    int n = LZ4_compress_default(reinterpret_cast<const char*>(block), compressed.data(),
+                                 size, compressed.size());
+    return n > 0 && static_cast<uint32_t>(n) < size ? n : 0;
+  }
+
+  void write(const uint8_t* block, uint32_t size, uint32_t partition)
+  {
+    thread_local std::vector<char> compressed;
+    uint32_t stored = m_lz4 ? compress(block, size, compressed) : 0;
+    if (stored)
+      append(compressed.data(), stored, size, partition);
+    else
+      append(block, size, size, partition);
+  }
+
+  // Appends a block already compressed by its producer, raw_size being its size before.
+  void append(const void* data, uint32_t stored, uint32_t raw_size, uint32_t partition)
+  {
+    uint64_t offset;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      offset = m_end;
+      m_end += stored;
+      m_index.push_back({offset, partition, stored, raw_size});
+    }
+    detail::pwrite_all(m_fd, data, stored, offset, m_path);
+  }
+
+  // Writes the index, blocks must not be written anymore.
+  void close()
+  {
+    if (m_fd < 0)
+      return;
+    SuperkContainerFooter footer;
+    footer.index_offset = m_end;
+    footer.nb_blocks = m_index.size();
+    footer.compressed = m_lz4;
+    size_t index_bytes = m_index.size() * sizeof(SuperkBlockEntry);
+    detail::pwrite_all(m_fd, m_index.data(), index_bytes, m_end, m_path);
+    detail::pwrite_all(m_fd, &footer, sizeof(footer), m_end + index_bytes, m_path);
+    ::close(m_fd);
+    m_fd = -1;
+    m_index = std::vector<SuperkBlockEntry>();
+  }
+
+private:
+  std::string m_path;
+  bool m_lz4;
+  int m_fd {-1};
+  std::mutex m_mutex;
+  uint64_t m_end {0};
+  std::vector<SuperkBlockEntry> m_index;
+};
+
+// Serves the blocks of one partition of a container with pread, in their write order.
+// Reads of different blocks can run concurrently.
+class SuperkContainerReader
+{
+public:
+  SuperkContainerReader(const std::string& path, size_t nb_partitions)
+    : m_path(path), m_blocks(nb_partitions)
+  {
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+      throw IOError("Unable to open " + path + ": " + std::strerror(errno));
+
+    off_t end = ::lseek(m_fd, 0, SEEK_END);
+    SuperkContainerFooter footer;
+    if (end < static_cast<off_t>(sizeof(footer)))
+      throw IOError(fmt::format("{} is not a super-k-mer container.", path));
+    detail::pread_all(m_fd, &footer, sizeof(footer), end - sizeof(footer), path);
+    if (footer.magic != MAGICS.at(KM_FILE::SUPERK) ||
+        footer.index_offset + footer.nb_blocks * sizeof(SuperkBlockEntry) + sizeof(footer)
+          != static_cast<uint64_t>(end))
+      throw IOError(fmt::format("{} is not a super-k-mer container.", path));
+
+    std::vector<SuperkBlockEntry> index(footer.nb_blocks);
+    detail::pread_all(m_fd, index.data(), index.size() * sizeof(SuperkBlockEntry),
+                      footer.index_offset, path);
+    for (auto& entry : index)
+    {
+      if (entry.partition >= m_blocks.size())
+        throw IOError(fmt::format("{}: block of unknown partition {}.", path, entry.partition));
+      m_nb_partitions += m_blocks[entry.partition].empty();
+      m_blocks[entry.partition].push_back(entry);
+    }
+  }
+
+  ~SuperkContainerReader()
+  {
+    if (m_fd >= 0)
+      ::close(m_fd);
+  }
+
+  SuperkContainerReader(const SuperkContainerReader&) = delete;
+  SuperkContainerReader& operator=(const SuperkContainerReader&) = delete;
+
+  const std::vector<SuperkBlockEntry>& blocks(uint32_t partition) const
+  {
+    return m_blocks[partition];
+  }
+
+  // Number of partitions with blocks.
+  size_t nb_partitions() const { return m_nb_partitions; }
+
+  // Reads a block in *block, grown with realloc as needed. Returns its uncompressed size.
+  unsigned int read(const SuperkBlockEntry& entry, unsigned char** block,
+                    unsigned int* max_block_size) const
+  {
+    if (entry.raw_size > *max_block_size)
+    {
+      *block = static_cast<unsigned char*>(realloc(*block, entry.raw_size));
+      *max_block_size = entry.raw_size;
+    }
+    if (entry.size == entry.raw_size)
+    {
+      detail::pread_all(m_fd, *block, entry.size, entry.offset, m_path);
+      return entry.size;
+    }
+
+    thread_local std::vector<char> compressed;
+    compressed.resize(entry.size);
+    detail::pread_all(m_fd, compressed.data(), entry.size, entry.offset, m_path);
+    int n = LZ4_decompress_safe(compressed.data(), reinterpret_cast<char*>(*block),
+                                entry.size, entry.raw_size);
+    if (n != static_cast<int>(entry.raw_size))
+      throw IOError(fmt::format("{}: corrupted block at offset {}.", m_path, entry.offset));
+    return n;
+  }
+
+private:
+  std::string m_path;
+  int m_fd {-1};
+  std::vector<std::vector<SuperkBlockEntry>> m_blocks;
+  size_t m_nb_partitions {0};
+};
+
+};
@@ -0,0 +1,149 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace km {
+
+// A block of super-k-mers, in a buffer of capacity bytes.
+struct SuperkBlock
+{
+  std::unique_ptr<uint8_t[]> data;
+  uint32_t size {0};
+  uint32_t capacity {0};
+  int file_id {0};
+  uint64_t nbk {0};
+  uint32_t raw_size {0}; // size before compression, 0 if stored as is
+  bool multiplicity {false}; // holds super-k-mers written once with their multiplicity
+};
+
+struct SuperkMemorySample;
+
+// Memory budget of the super-k-mers kept in RAM from the superk step to the count step of a
+// run, shared by all the samples, and the samples waiting for their readers.
+class SuperkMemory
+{
+public:
+  static SuperkMemory& get()
+  {
+    static SuperkMemory singleton;
+    return singleton;
+  }
+
+  void set_budget(uint64_t bytes)
+  {
+    m_available = bytes;
+  }
+
+  bool reserve(uint64_t bytes)
+  {
+    uint64_t available = m_available.load(std::memory_order_relaxed);
+    do
+    {
+      if (available < bytes)
+        return false;
+    } while (!m_available.compare_exchange_weak(available, available - bytes));
+    return true;
+  }
+
+  void release(uint64_t bytes)
+  {
+    m_available += bytes;
+  }
+
+  uint64_t available() const
+  {
+    return m_available;
+  }
+
+  void put(const std::string& prefix, std::shared_ptr<SuperkMemorySample> sample)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_samples[prefix] = std::move(sample);
+  }
+
+  std::shared_ptr<SuperkMemorySample> take(const std::string& prefix)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_samples.find(prefix);
+    if (it == m_samples.end())
+      return nullptr;
+    auto sample = std::move(it->second);
+    m_samples.erase(it);
+    return sample;
+  }
+
+private:
+  SuperkMemory() = default;
+
+  std::atomic<uint64_t> m_available {0};
+  std::mutex m_mutex;
+  std::unordered_map<std::string, std::shared_ptr<SuperkMemorySample>> m_samples;
+};
+
+// Super-k-mers of a sample kept in RAM. A partition is either entirely in memory or entirely
+// on disk. Partitions can be released concurrently.
+struct SuperkMemorySample
+{
+  SuperkMemorySample(size_t nb_partitions)
+    : blocks(nb_partitions), bytes(nb_partitions, 0), in_memory(nb_partitions, false) {}
+
+  ~SuperkMemorySample()
+  {
+    for (size_t p = 0; p < blocks.size(); p++)
+      release(p);
+  }
+
+  bool keep(SuperkBlock&& block)
+  {
+    // blocks flushed before being full are shrunk to their size
+    if (block.size < block.capacity / 2)
+    {
+      std::unique_ptr<uint8_t[]> data(new uint8_t[block.size]);
+      std::memcpy(data.get(), block.data.get(), block.size);
+      block.data = std::move(data);
+      block.capacity = block.size;
+    }
+    if (!SuperkMemory::get().reserve(block.capacity))
+      return false;
+    bytes[block.file_id] += block.capacity;
+    blocks[block.file_id].push_back(std::move(block));
+    return true;
+  }
+
+  void release(size_t partition)
+  {
+    SuperkMemory::get().release(bytes[partition]);
+    bytes[partition] = 0;
+    blocks[partition] = std::vector<SuperkBlock>();
+  }
+
+  std::vector<std::vector<SuperkBlock>> blocks;
+  std::vector<uint64_t> bytes;
+  std::vector<bool> in_memory;
+};
+
+};
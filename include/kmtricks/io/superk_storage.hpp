@@ -21,7 +21,19 @@
 #include <vector>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <cstring>
+#include <limits>
+#include <xxhash.h>
 #include <kmtricks/io/superk_file.hpp>
+#include <kmtricks/io/superk_container.hpp>
+#include <kmtricks/io/superk_memory.hpp>
+#include <kmtricks/mpsc_queue.hpp>
+#include <spdlog/spdlog.h>
 #include <gatb/gatb_core.hpp>
 #include <gatb/system/api/IThread.hpp>
 #include <unordered_set>
@@ -30,6 +42,8 @@ namespace fs = std::filesystem;
 
 namespace km {
 
+// Reads the super-k-mers of a sample, from one file per partition or from a container, and
+// from memory for the partitions its writer kept there.
 class SuperKStorageReader
 {
 public:
@@ -54,6 +68,20 @@ public:
       std::getline(info, line); m_nbk_per_file[i] = std::stoll(line);
       std::getline(info, line); m_file_size[i] = std::stoll(line);
     }
+
+    // optional records, one per line: a key and its value
+    m_multiplicity.resize(m_nb_files, false);
+    std::string key, value;
+    while (info >> key >> value)
+    {
+      if (key == "container")
+        m_is_container = value == "1";
+      else if (key == "multiplicity" && value.size() == m_multiplicity.size())
+        for (size_t i=0; i<value.size(); i++)
+          m_multiplicity[i] = value[i] == '1';
+    }
+    m_cursors.resize(m_nb_files, 0);
+    m_memory = SuperkMemory::get().take(prefix);
   }
 
   ~SuperKStorageReader()
@@ -61,6 +89,12 @@ public:
     closeFiles();
   }
 
+  // Whether fileId has super-k-mers written once with their multiplicity, see SuperKBuffer.
+  bool hasMultiplicity(int fileId) const
+  {
+    return static_cast<size_t>(fileId) < m_multiplicity.size() && m_multiplicity[fileId];
+  }
+
   void flushFile(int fileId)
   {
     m_files[fileId]->flush();
@@ -81,6 +115,8 @@ public:
   void eraseFile(int fileId)
   {
     closeFile(fileId);
+    if (m_is_container || in_memory(fileId))
+      return;
     std::remove(fmt::format("{}/{}.{}", m_path, m_base, fileId).c_str());
   }
 
@@ -93,8 +129,24 @@ public:
 
   void openFile(int fileId)
   {
-    std::string path = fmt::format("{}/{}.{}", m_path, m_base, fileId);
-    m_files[fileId] = std::make_shared<SuperkReader<8192>>(path);
+    if (in_memory(fileId))
+    {
+      m_cursors[fileId] = 0;
+    }
+    else if (m_is_container)
+    {
+      // opened on first use, readers of all the samples are created at once
+      std::lock_guard<std::mutex> lock(m_container_mutex);
+      if (!m_container)
+        m_container = std::make_unique<SuperkContainerReader>(
+          superk_container_path(m_path, m_base), m_nb_files);
+      m_cursors[fileId] = 0;
+    }
+    else
+    {
+      std::string path = fmt::format("{}/{}.{}", m_path, m_base, fileId);
+      m_files[fileId] = std::make_shared<SuperkReader<8192>>(path);
+    }
     m_synchros[fileId] = gatb::core::system::impl::System::thread().newSynchronizer();
     m_synchros[fileId]->use();
   }
@@ -107,6 +159,15 @@ public:
 
   void closeFile(int fileId)
   {
+    if (m_is_container || in_memory(fileId))
+    {
+      if (m_synchros[fileId])
+      {
+        m_synchros[fileId]->forget();
+        m_synchros[fileId] = nullptr;
+      }
+      return;
+    }
     if (!m_files.empty())
     {
       if (m_files[fileId])
@@ -123,6 +184,11 @@ public:
                 unsigned int* nb_bytes_read,
                 int file_id)
   {
+    if (in_memory(file_id))
+      return readMemoryBlock(block, max_block_size, nb_bytes_read, file_id);
+    if (m_is_container)
+      return readContainerBlock(block, max_block_size, nb_bytes_read, file_id);
+
     m_synchros[file_id]->lock();
     int nbr = m_files[file_id]->read_size(nb_bytes_read);
 
@@ -142,6 +208,32 @@ public:
     return *nb_bytes_read;
   }
 
+  // Closes a partition that is not read anymore and erases its super-k-mers in the
+  // background. A container is erased once all its partitions are released.
+  void releaseFile(int fileId)
+  {
+    closeFile(fileId);
+    if (in_memory(fileId))
+    {
+      m_memory->release(fileId);
+      return;
+    }
+    if (!m_is_container)
+    {
+      Eraser::get().erase(getFileName(fileId));
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_container_mutex);
+    if (!m_container || m_container->blocks(fileId).empty())
+      return;
+    if (++m_released == m_container->nb_partitions())
+    {
+      m_container.reset();
+      Eraser::get().erase(superk_container_path(m_path, m_base));
+    }
+  }
+
   int nbFiles() const { return m_nb_files; }
 
   std::string getFileName(int fileId) const
@@ -159,77 +251,122 @@ public:
     return m_file_size[fileId];
   }
 
+private:
+  bool in_memory(int fileId) const
+  {
+    return m_memory && m_memory->in_memory[fileId];
+  }
+
+  int readMemoryBlock(unsigned char** block,
+                      unsigned int* max_block_size,
+                      unsigned int* nb_bytes_read,
+                      int file_id)
+  {
+    const std::vector<SuperkBlock>& blocks = m_memory->blocks[file_id];
+    m_synchros[file_id]->lock();
+    size_t i = m_cursors[file_id];
+    if (i < blocks.size())
+      m_cursors[file_id]++;
+    m_synchros[file_id]->unlock();
+
+    if (i == blocks.size())
+      return 0;
+    if (blocks[i].size > *max_block_size)
+    {
+      *block = (unsigned char*) realloc(*block, blocks[i].size);
+      *max_block_size = blocks[i].size;
+    }
+    std::memcpy(*block, blocks[i].data.get(), blocks[i].size);
+    *nb_bytes_read = blocks[i].size;
+    return *nb_bytes_read;
+  }
+
+  int readContainerBlock(unsigned char** block,
+                         unsigned int* max_block_size,
+                         unsigned int* nb_bytes_read,
+                         int file_id)
+  {
+    const std::vector<SuperkBlockEntry>& blocks = m_container->blocks(file_id);
+    m_synchros[file_id]->lock();
+    size_t i = m_cursors[file_id];
+    if (i < blocks.size())
+      m_cursors[file_id]++;
+    m_synchros[file_id]->unlock();
+
+    if (i == blocks.size())
+      return 0;
+    *nb_bytes_read = m_container->read(blocks[i], block, max_block_size);
+    return *nb_bytes_read;
+  }
+
 private:
   std::string m_base;
   std::string m_path;
   std::vector<uint64_t> m_nbk_per_file;
   std::vector<uint64_t> m_file_size;
+  std::vector<bool> m_multiplicity;
   std::vector<skr_t<8192>> m_files;
   std::vector<gatb::core::system::ISynchronizer*> m_synchros;
   int m_nb_files;
+
+  bool m_is_container {false};
+  std::unique_ptr<SuperkContainerReader> m_container;
+  std::mutex m_container_mutex;
+  std::vector<size_t> m_cursors;
+  size_t m_released {0};
+  std::shared_ptr<SuperkMemorySample> m_memory;
 };
 
 using sk_storage_t = std::shared_ptr<SuperKStorageReader>;
 
+// Writes one file per partition, or a single container for all of them when container is set.
+// With in_memory, blocks are kept in RAM within the budget of SuperkMemory, and handed to the
+// reader of the sample. A partition which does not fit anymore is moved to disk.
+// Blocks are pushed by any number of threads into a lock-free queue, and written by a thread
+// of the writer, so that producers neither wait on disk nor on each other. Pending bytes and
+// queued blocks are atomic counters, the mutex is only taken to sleep or to wake a sleeper:
+// producers wait when more than max_pending bytes are queued, i.e. when the disk can't keep
+// up, and the writer when the queue is empty. Blocks of a compressed container are
+// compressed by their producers, the writer only stores them.
 class SuperKStorageWriter
 {
+  static constexpr uint64_t max_pending = 64 << 20;
+  static constexpr size_t max_block_size = 32768;
+  // holds the largest super-k-mer
+  static constexpr size_t min_block_size = 4096;
+
 public:
   SuperKStorageWriter(const std::string& prefix, const std::string& name,
-                      size_t nb_files, bool lz4, std::unordered_set<int> restricted)
-    : m_path(prefix), m_base(name), m_nb_files(nb_files), m_lz4(lz4), m_restricted(restricted)
+                      size_t nb_files, bool lz4, std::unordered_set<int> restricted,
+                      bool container = false, bool in_memory = false, size_t dedup = 0)
+    : m_path(prefix), m_base(name), m_nb_files(nb_files), m_lz4(lz4), m_restricted(restricted),
+      m_is_container(container), m_dedup(dedup)
   {
     m_nbk_per_file.resize(m_nb_files, 0);
     m_file_size.resize(m_nb_files, 0);
+    m_multiplicity.resize(m_nb_files, false);
     m_files.resize(m_nb_files, nullptr);
-    m_synchros.resize(m_nb_files, nullptr);
-    openFiles();
-
-    m_capacity = 32768;
-    m_max_superk_size = 255;
-    m_buffers.resize(m_nb_files);
-    m_buffers_idx.resize(m_nb_files, 0);
-    for (unsigned int ii=0; ii<m_buffers.size(); ii++)
+    if (in_memory)
     {
-      m_buffers[ii] = reinterpret_cast<uint8_t*>(MALLOC(sizeof(uint8_t) * m_capacity));
-    }
-  }
-
-  void flushAllCache()
-  {
-    for (unsigned int ii=0; ii<m_buffers.size(); ii++)
-    {
-      flushCache(ii);
+      m_memory = std::make_shared<SuperkMemorySample>(m_nb_files);
+      for (int p : m_restricted)
+        m_memory->in_memory[p] = true;
     }
+    openFiles();
   }
 
-  void flushCache(int file_id)
+  // closeFiles() is expected before, errors can't be reported from here.
+  ~SuperKStorageWriter()
   {
-    if (m_buffers_idx[file_id] != 0)
+    stop(false);
+    try
     {
-      writeBlock(m_buffers[file_id], m_buffers_idx[file_id], file_id, m_nbk_per_file[file_id]);
-      m_buffers_idx[file_id] = 0;
-      m_nbk_per_file[file_id] = 0;
+      closeFiles();
     }
-  }
-
-  void insertSuperkmer(uint8_t* superk, int nb_bytes, uint8_t nbk, int file_id)
-  {
-    if ( (m_buffers_idx[file_id]+nb_bytes+1) > static_cast<int>(m_capacity))
+    catch (const std::exception& e)
     {
-      flushCache(file_id);
+      spdlog::error("Unable to close the super-k-mers of {}: {}", m_path, e.what());
     }
-    m_buffers[file_id][m_buffers_idx[file_id]++] = nbk;
-    memcpy(m_buffers[file_id] + m_buffers_idx[file_id], superk, nb_bytes);
-    m_buffers_idx[file_id] += nb_bytes;
-    m_nbk_per_file[file_id] += nbk;
-  }
-
-  ~SuperKStorageWriter()
-  {
-    flushAllCache();
-    for (unsigned int ii=0; ii<m_buffers.size(); ii++)
-      FREE(m_buffers[ii]);
-    closeFiles();
   }
 
   void flushFile(int fileId)
@@ -251,6 +388,9 @@ public:
 
   void eraseFile(int fileId)
   {
+    // blocks of a container are only erased with all the others
+    if (m_is_container)
+      return;
     closeFile(fileId);
     std::remove(fmt::format("{}/{}.{}", m_path, m_base, fileId).c_str());
   }
@@ -258,27 +398,43 @@ public:
   void openFiles()
   {
     fs::create_directory(m_path);
+    // in memory, the container is only created for the partitions moved to disk
+    if (m_is_container && !m_memory)
+      openContainer();
     for (int i=0; i<m_nb_files; i++)
       openFile(i);
+    if (!m_writer.joinable())
+    {
+      m_stop = false;
+      m_writer = std::thread(&SuperKStorageWriter::writer, this);
+    }
   }
 
   void openFile(int fileId)
   {
-    if (!m_restricted.count(fileId))
+    // partitions in memory are opened once moved to disk
+    if (!m_restricted.count(fileId) || m_is_container || (m_memory && m_memory->in_memory[fileId]))
       return;
 
     std::string path = fmt::format("{}/{}.{}", m_path, m_base, fileId);
     m_files[fileId] = std::make_shared<SuperkWriter<8192>>(path,
                                                            fileId,
                                                            m_lz4);
-    m_synchros[fileId] = gatb::core::system::impl::System::thread().newSynchronizer();
-    m_synchros[fileId]->use();
   }
 
+  // Writes the pending blocks and closes the files, blocks must not be pushed anymore. The
+  // blocks kept in memory are then available to the reader of the sample.
   void closeFiles()
   {
+    stop(true);
     for (int i=0; i<m_nb_files; i++)
       closeFile(i);
+    // closed here for its errors to be thrown
+    if (m_container)
+      m_container->close();
+    m_container.reset();
+    if (m_memory)
+      SuperkMemory::get().put(m_path, std::move(m_memory));
   }
 
   void closeFile(int fileId)
@@ -289,27 +445,56 @@ public:
         return;
       m_files[fileId]->close();
       m_files[fileId] = nullptr;
-      m_synchros[fileId]->forget();
     }
   }
 
-  void writeBlock(unsigned char* block,
-                unsigned int block_size,
-                int file_id,
-                int nbkmers)
+  void pushBlock(SuperkBlock&& block)
   {
-    if (!m_restricted.count(file_id))
+    if (!m_restricted.count(block.file_id))
       return;
-    m_synchros[file_id]->lock();
-    m_nbk_per_file[file_id] += nbkmers;
-    m_file_size[file_id] += block_size + sizeof(block_size);
-    m_files[file_id]->write_size(block_size);
-    m_files[file_id]->write_block(block, block_size);
-    m_synchros[file_id]->unlock();
+    if (m_is_container && m_lz4 && !m_memory)
+      compressBlock(block);
+    if (m_pending > max_pending)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_waiting++;
+      m_space.wait(lock, [this] { return m_pending <= max_pending; });
+      m_waiting--;
+    }
+    m_pending += block.size;
+    m_queue.push(std::move(block));
+    m_queued++;
+    // the writer checks m_queued after setting m_sleeping, one of them sees the other
+    if (m_sleeping)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_work.notify_one();
+    }
   }
 
   int nbFiles() const { return m_nb_files; }
 
+  // Number of buffers filling this writer. Each one has a block per kept partition, blocks
+  // shrink as buffers are added so that their memory does not grow with the threads.
+  void setNbBuffers(size_t nb_buffers)
+  {
+    m_block_size = std::clamp<size_t>(max_block_size / std::max<size_t>(nb_buffers, 1),
+                                      min_block_size, max_block_size);
+  }
+
+  size_t blockSize() const { return m_block_size; }
+
+  // Super-k-mers cached per partition by each buffer to collapse repeated ones, 0 to disable.
+  size_t dedupSlots() const { return m_dedup; }
+
+  size_t nbKept() const { return m_restricted.size(); }
+
+  // Whether blocks of fileId are written.
+  bool keeps(int fileId) const
+  {
+    return m_restricted.count(fileId);
+  }
+
   std::string getFileName(int fileId) const
   {
     return fmt::format("{}.{}", m_base, fileId);
@@ -337,22 +522,317 @@ public:
       info << m_nbk_per_file[i] << "\n";
       info << m_file_size[i] << "\n";
     }
+    info << "container " << m_is_container << "\n";
+    if (m_dedup)
+    {
+      info << "multiplicity ";
+      for (int i=0; i<m_nb_files; i++)
+        info << (m_multiplicity[i] ? '1' : '0');
+      info << "\n";
+    }
   }
+
+private:
+  void writer()
+  {
+    SuperkBlock block;
+    while (true)
+    {
+      if (!m_queued)
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sleeping = true;
+        m_work.wait(lock, [this] { return m_queued || m_stop; });
+        m_sleeping = false;
+        // producers are done once stop is set, their blocks are all queued
+        if (!m_queued)
+          return;
+      }
+      m_queued--;
+      // blocks are counted once pushed, the pop can't fail
+      m_queue.pop(block);
+      // after a failure, blocks are only drained to release the producers
+      if (!m_error)
+      {
+        try
+        {
+          writeBlock(block);
+        }
+        catch (...)
+        {
+          m_error = std::current_exception();
+        }
+      }
+      // producers check m_pending after counting themselves in m_waiting
+      m_pending -= block.size;
+      if (m_waiting)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_space.notify_all();
+      }
+      block.data.reset();
+    }
+  }
+
+  // Compresses a block of a container, in place of its data if it is smaller.
+  void compressBlock(SuperkBlock& block)
+  {
+    thread_local std::vector<char> compressed;
+    uint32_t stored = SuperkContainerWriter::compress(block.data.get(), block.size, compressed);
+    if (!stored)
+      return;
+    block.raw_size = block.size;
+    block.data.reset(new uint8_t[stored]);
+    std::memcpy(block.data.get(), compressed.data(), stored);
+    block.size = stored;
+    block.capacity = stored;
+  }
+
+  void writeBlock(SuperkBlock& block)
+  {
+    int file_id = block.file_id;
+    m_nbk_per_file[file_id] += block.nbk;
+    if (block.multiplicity)
+      m_multiplicity[file_id] = true;
+    if (block.raw_size)
+    {
+      m_file_size[file_id] += block.raw_size;
+      if (!m_container)
+        openContainer();
+      m_container->append(block.data.get(), block.size, block.raw_size, file_id);
+      return;
+    }
+    m_file_size[file_id] += block.size + (m_is_container ? 0 : sizeof(block.size));
+    if (m_memory && m_memory->in_memory[file_id])
+    {
+      if (m_memory->keep(std::move(block)))
+        return;
+      spill(file_id);
+    }
+    store(block.data.get(), block.size, file_id);
+  }
+
+  void store(unsigned char* block, unsigned int block_size, int file_id)
+  {
+    if (m_is_container)
+    {
+      if (!m_container)
+        openContainer();
+      m_container->write(block, block_size, file_id);
+      return;
+    }
+    m_files[file_id]->write_size(block_size);
+    m_files[file_id]->write_block(block, block_size);
+  }
+
+  void openContainer()
+  {
+    m_container = std::make_unique<SuperkContainerWriter>(
+      superk_container_path(m_path, m_base), m_lz4);
+  }
+
+  void spill(int file_id)
+  {
+    spdlog::debug("[superk] - {} - P={} does not fit in memory, moved to disk.", m_path, file_id);
+    m_memory->in_memory[file_id] = false;
+    openFile(file_id);
+    for (auto& block : m_memory->blocks[file_id])
+      store(block.data.get(), block.size, file_id);
+    m_memory->release(file_id);
+  }
+
+  void stop(bool rethrow)
+  {
+    if (m_writer.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_work.notify_one();
+      m_writer.join();
+    }
+    std::exception_ptr error = std::exchange(m_error, nullptr);
+    if (rethrow && error)
+      std::rethrow_exception(error);
+  }
+
 private:
   std::string m_base;
   std::string m_path;
   std::vector<uint64_t> m_nbk_per_file;
   std::vector<uint64_t> m_file_size;
+  std::vector<bool> m_multiplicity;
   std::vector<skw_t<8192>> m_files;
-  std::vector<gatb::core::system::ISynchronizer*> m_synchros;
   std::unordered_set<int> m_restricted;
   int m_nb_files;
   bool m_lz4;
+  bool m_is_container;
+  size_t m_dedup;
+  size_t m_block_size {max_block_size};
+  std::unique_ptr<SuperkContainerWriter> m_container;
+  std::shared_ptr<SuperkMemorySample> m_memory;
+
+  MPSCQueue<SuperkBlock> m_queue;
+  std::atomic<uint64_t> m_pending {0};
+  std::atomic<size_t> m_queued {0};
+  // only taken to sleep: producers wait for space and the writer for blocks
+  std::mutex m_mutex;
+  std::condition_variable m_space;
+  std::condition_variable m_work;
+  std::atomic<size_t> m_waiting {0};
+  std::atomic<bool> m_sleeping {false};
+  bool m_stop {false};
+  std::exception_ptr m_error;
+  std::thread m_writer;
+};
+
+// Blocks of super-k-mers filled by one thread, each pushed to a SuperKStorageWriter once
+// full. Blocks are only allocated for the partitions the writer keeps. With dedup, recent
+// super-k-mers of each partition are kept in a direct-mapped cache and only written when
+// evicted, once with their number of occurrences. Cache slots hold their super-k-mer, their
+// number is bounded by cache_bytes per buffer over all the kept partitions.
+class SuperKBuffer
+{
+  static constexpr size_t cache_bytes = 16 << 20;
+
+  struct CachedSuperk
+  {
+    // 256 nucleotides, longer super-k-mers are not cached
+    static constexpr size_t max_bytes = 64;
+
+    uint64_t hash {0};
+    uint32_t count {0};
+    uint8_t nbk {0};
+    uint8_t size {0};
+    uint8_t bytes[max_bytes];
+  };
+
+public:
+  SuperKBuffer(SuperKStorageWriter* writer)
+    : m_writer(writer), m_capacity(writer->blockSize()), m_blocks(writer->nbFiles()),
+      m_sizes(writer->nbFiles(), 0), m_nbk(writer->nbFiles(), 0), m_keep(writer->nbFiles()),
+      m_multiplicity(writer->nbFiles(), false), m_cache(writer->nbFiles())
+  {
+    for (int i = 0; i < writer->nbFiles(); i++)
+      m_keep[i] = writer->keeps(i);
+    size_t slots = std::min<size_t>(
+      writer->dedupSlots(),
+      cache_bytes / (sizeof(CachedSuperk) * std::max<size_t>(writer->nbKept(), 1)));
+    // a power of two, rounded down to stay within the budget
+    if (slots > 1)
+    {
+      m_cache_mask = 1;
+      while ((m_cache_mask << 1) <= slots)
+        m_cache_mask <<= 1;
+      m_cache_mask--;
+    }
+  }
+
+  SuperKBuffer(const SuperKBuffer&) = delete;
+  SuperKBuffer& operator=(const SuperKBuffer&) = delete;
 
-  size_t m_max_superk_size;
+  ~SuperKBuffer()
+  {
+    flush();
+  }
+
+  void insertSuperkmer(uint8_t* superk, int nb_bytes, uint8_t nbk, int file_id)
+  {
+    if (!m_keep[file_id])
+      return;
+    m_nbk[file_id] += nbk;
+    if (!m_cache_mask || nb_bytes > static_cast<int>(CachedSuperk::max_bytes))
+    {
+      write(superk, nb_bytes, nbk, 1, file_id);
+      return;
+    }
+
+    // caches are allocated on first use, as blocks
+    std::vector<CachedSuperk>& cache = m_cache[file_id];
+    if (cache.empty())
+      cache.resize(m_cache_mask + 1);
+    uint64_t hash = XXH64(superk, nb_bytes, nbk);
+    CachedSuperk& cached = cache[hash & m_cache_mask];
+    if (cached.count && cached.hash == hash && cached.nbk == nbk && cached.size == nb_bytes &&
+        !std::memcmp(cached.bytes, superk, nb_bytes))
+    {
+      if (++cached.count == std::numeric_limits<uint32_t>::max())
+        evict(cached, file_id);
+      return;
+    }
+    evict(cached, file_id);
+    cached.hash = hash;
+    cached.count = 1;
+    cached.nbk = nbk;
+    cached.size = nb_bytes;
+    std::memcpy(cached.bytes, superk, nb_bytes);
+  }
+
+  void flush()
+  {
+    for (size_t i = 0; i < m_blocks.size(); i++)
+    {
+      for (auto& cached : m_cache[i])
+        evict(cached, i);
+      flush(i);
+    }
+  }
+
+private:
+  void evict(CachedSuperk& cached, int file_id)
+  {
+    if (!cached.count)
+      return;
+    write(cached.bytes, cached.size, cached.nbk, cached.count, file_id);
+    cached.count = 0;
+  }
+
+  // Repeated super-k-mers are preceded by a null byte and their multiplicity.
+  void write(const uint8_t* superk, size_t nb_bytes, uint8_t nbk, uint32_t count, int file_id)
+  {
+    size_t header = count > 1 ? 2 + sizeof(count) : 1;
+    if (m_sizes[file_id] + nb_bytes + header > m_capacity)
+      flush(file_id);
+    // the previous block belongs to the writer once pushed
+    if (!m_blocks[file_id])
+      m_blocks[file_id].reset(new uint8_t[m_capacity]);
+
+    uint8_t* block = m_blocks[file_id].get();
+    if (count > 1)
+    {
+      m_multiplicity[file_id] = true;
+      block[m_sizes[file_id]++] = 0;
+      std::memcpy(block + m_sizes[file_id], &count, sizeof(count));
+      m_sizes[file_id] += sizeof(count);
+    }
+    block[m_sizes[file_id]++] = nbk;
+    std::memcpy(block + m_sizes[file_id], superk, nb_bytes);
+    m_sizes[file_id] += nb_bytes;
+  }
+
+  void flush(int file_id)
+  {
+    if (!m_sizes[file_id])
+      return;
+    m_writer->pushBlock({std::move(m_blocks[file_id]), static_cast<uint32_t>(m_sizes[file_id]),
+                         static_cast<uint32_t>(m_capacity), file_id, m_nbk[file_id], 0,
+                         m_multiplicity[file_id]});
+    m_sizes[file_id] = 0;
+    m_nbk[file_id] = 0;
+    m_multiplicity[file_id] = false;
+  }
+
+private:
+  SuperKStorageWriter* m_writer;
   size_t m_capacity;
-  std::vector<uint8_t*> m_buffers;
-  std::vector<int> m_buffers_idx;
+  std::vector<std::unique_ptr<uint8_t[]>> m_blocks;
+  std::vector<size_t> m_sizes;
+  std::vector<uint64_t> m_nbk;
+  std::vector<bool> m_keep;
+  std::vector<bool> m_multiplicity;
+  std::vector<std::vector<CachedSuperk>> m_cache;
+  size_t m_cache_mask {0};
 };
 
 };
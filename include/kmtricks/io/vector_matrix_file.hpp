@@ -17,6 +17,11 @@
  *****************************************************************************/
 
 #pragma once
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <kmtricks/io/io_common.hpp>
 #include <kmtricks/utils.hpp>
 #include <kmtricks/bitmatrix.hpp>
@@ -53,10 +58,16 @@ public:
   void sanity_check()
   {
     _sanity_check();
-    if (matrix_magic != MAGICS.at(KM_FILE::BITMATRIX))
+    if (matrix_magic != MAGICS.at(KM_FILE::BITMATRIX) &&
+        matrix_magic != MAGICS.at(KM_FILE::BITMATRIX_RLE))
       throw IOError("Invalid file format.");
   }
 
+  bool rle() const
+  {
+    return matrix_magic == MAGICS.at(KM_FILE::BITMATRIX_RLE);
+  }
+
 public:
   uint64_t matrix_magic {MAGICS.at(KM_FILE::BITMATRIX)};
   uint32_t bits;
@@ -66,10 +77,17 @@ public:
   uint64_t window;
 };
 
+// In run-length mode, rows are stored as records: a uint64_t holding the number of empty
+// rows before the next row, with the top bit set when that row follows the record.
+constexpr uint64_t VM_RLE_ROW = uint64_t{1} << 63;
+
 template<size_t buf_size = 8192>
 class VectorMatrixWriter : public IFile<VectorMatrixFileHeader, std::ostream, buf_size>
 {
   using ocstream = lz4_stream::basic_ostream<buf_size>;
+
+  // Uncompressed runs of empty rows larger than this are left as holes.
+  static constexpr uint64_t hole_min = 1 << 16;
 public:
   VectorMatrixWriter(const std::string& path,
                    uint32_t bits,
@@ -77,9 +95,13 @@ public:
                    uint32_t partition,
                    uint64_t first,
                    uint64_t window,
-                   bool lz4)
-    : IFile<VectorMatrixFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary)
+                   bool lz4,
+                   bool rle = false)
+    : IFile<VectorMatrixFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary),
+      m_row_bytes(NBYTES(bits)), m_rle(rle)
   {
+    if (m_rle)
+      this->m_header.matrix_magic = MAGICS.at(KM_FILE::BITMATRIX_RLE);
     this->m_header.compressed = lz4;
     this->m_header.bits = bits;
     this->m_header.first = first;
@@ -92,16 +114,257 @@ public:
     this->template set_second_layer<ocstream>(this->m_header.compressed);
   }
 
+  ~VectorMatrixWriter()
+  {
+    close();
+  }
+
   void write(std::vector<uint8_t>& bits)
   {
+    if (m_rle)
+    {
+      uint64_t record = m_empty | VM_RLE_ROW;
+      this->m_second_layer->write(reinterpret_cast<char*>(&record), sizeof(record));
+      m_empty = 0;
+    }
+    else
+    {
+      write_zeros();
+    }
     this->m_second_layer->write(reinterpret_cast<char*>(bits.data()), bits.size()*sizeof(uint8_t));
   }
 
+  // Writes n empty rows, which are only counted until the next row or close().
+  void write_empty(uint64_t n)
+  {
+    m_empty += n;
+  }
+
   void dump(BitMatrix& bit_matrix)
   {
     this->m_second_layer->write(reinterpret_cast<char*>(bit_matrix.matrix),
                                 bit_matrix.get_size_in_byte());
   }
+
+  void close()
+  {
+    if (!m_empty || !this->m_second_layer)
+      return;
+
+    if (m_rle)
+    {
+      this->m_second_layer->write(reinterpret_cast<char*>(&m_empty), sizeof(m_empty));
+      m_empty = 0;
+    }
+    else if (!this->m_header.compressed && m_empty * m_row_bytes >= hole_min)
+    {
+      // a trailing hole is made by extending the file
+      this->m_second_layer->flush();
+      uint64_t size = static_cast<uint64_t>(this->m_second_layer->tellp()) + m_empty * m_row_bytes;
+      m_empty = 0;
+      fs::resize_file(this->m_path, size);
+    }
+    else
+    {
+      write_zeros();
+    }
+  }
+
+private:
+  void write_zeros()
+  {
+    if (!m_empty)
+      return;
+
+    uint64_t bytes = m_empty * m_row_bytes;
+    m_empty = 0;
+
+    if (!this->m_header.compressed && bytes >= hole_min)
+    {
+      this->m_second_layer->seekp(bytes, std::ios::cur);
+      return;
+    }
+
+    static const std::array<char, 1 << 16> zeros {};
+    while (bytes)
+    {
+      size_t n = std::min<uint64_t>(bytes, zeros.size());
+      this->m_second_layer->write(zeros.data(), n);
+      bytes -= n;
+    }
+  }
+
+private:
+  uint64_t m_row_bytes;
+  bool m_rle;
+  uint64_t m_empty {0};
+};
+
+// Writes the transpose of a vector matrix, one row per sample, from rows given in order.
+// Rows are buffered by bands, each band is transposed by tiles and written at its final
+// offset, so only one band is held instead of the whole matrix. Bands without any bit set
+// are skipped. Compressed outputs cannot be written out of order and are kept in memory
+// until close().
+template<size_t buf_size = 8192>
+class TransposedVectorMatrixWriter
+{
+public:
+  TransposedVectorMatrixWriter(const std::string& path,
+                               uint32_t bits,
+                               uint32_t id,
+                               uint32_t partition,
+                               uint64_t first,
+                               uint64_t window,
+                               bool lz4,
+                               size_t nb_threads = 1,
+                               size_t band_bytes = 64 << 20)
+    : m_path(path), m_bits(bits), m_id(id), m_partition(partition), m_first(first),
+      m_window(window), m_lz4(lz4), m_nb_threads(nb_threads)
+  {
+    m_row_bytes = NBYTES(bits);
+    m_nb_rows = ROUND_UP(window, 8);
+    m_out_row_bytes = m_nb_rows / 8;
+    m_band_rows = std::clamp<size_t>(band_bytes / std::max<size_t>(m_row_bytes, 1) / 64 * 64,
+                                     512, 32768);
+    m_band.resize(m_band_rows * m_row_bytes, 0);
+    m_band_out.resize(m_row_bytes * 8 * (m_band_rows / 8));
+
+    if (m_lz4)
+    {
+      m_full.resize(m_row_bytes * 8 * m_out_row_bytes, 0);
+    }
+    else
+    {
+      {
+        VectorMatrixWriter<buf_size> vmw(path, bits, id, partition, first, window, false);
+      }
+      m_fd = ::open(path.c_str(), O_WRONLY);
+      if (m_fd < 0)
+        throw IOError("Unable to open " + path + ": " + std::strerror(errno));
+      m_offset = get_header_size<VectorMatrixFileHeader>();
+      if (::ftruncate(m_fd, m_offset + m_row_bytes * 8 * m_out_row_bytes) < 0)
+        throw IOError("Unable to resize " + path + ": " + std::strerror(errno));
+    }
+  }
+
+  ~TransposedVectorMatrixWriter()
+  {
+    close();
+  }
+
+  TransposedVectorMatrixWriter(const TransposedVectorMatrixWriter&) = delete;
+  TransposedVectorMatrixWriter& operator=(const TransposedVectorMatrixWriter&) = delete;
+
+  void write(const std::vector<uint8_t>& bits)
+  {
+    std::memcpy(&m_band[m_fill * m_row_bytes], bits.data(), m_row_bytes);
+    m_dirty = true;
+    if (++m_fill == m_band_rows)
+      flush_band();
+  }
+
+  void write_empty(uint64_t n)
+  {
+    while (n)
+    {
+      size_t take = std::min<uint64_t>(n, m_band_rows - m_fill);
+      m_fill += take;
+      n -= take;
+      if (m_fill == m_band_rows)
+        flush_band();
+    }
+  }
+
+  void close()
+  {
+    if (m_closed)
+      return;
+    m_closed = true;
+    if (m_fill)
+      flush_band();
+
+    if (m_lz4)
+    {
+      VectorMatrixWriter<buf_size> vmw(m_path, m_bits, m_id, m_partition, m_first, m_window, true);
+      vmw.write(m_full);
+      m_full = std::vector<uint8_t>();
+    }
+    else if (m_fd >= 0)
+    {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+  }
+
+private:
+  void flush_band()
+  {
+    uint64_t start = m_band_start;
+    m_band_start += m_band_rows;
+    m_fill = 0;
+    if (!m_dirty || start >= m_nb_rows)
+      return;
+    size_t rows = std::min<uint64_t>(m_band_rows, m_nb_rows - start);
+
+    size_t band_out_bytes = m_band_rows / 8;
+    __tiled_trans(m_band.data(), m_row_bytes, m_band_out.data(), band_out_bytes,
+                  rows, m_row_bytes * 8, m_nb_threads,
+                  [&](size_t first, size_t last) {
+                    for (size_t c=first; c<last; c++)
+                      write_chunk(c, start / 8, &m_band_out[c * band_out_bytes], rows / 8);
+                  });
+
+    std::fill(m_band.begin(), m_band.end(), 0);
+    m_dirty = false;
+  }
+
+  void write_chunk(size_t row, uint64_t offset, const uint8_t* data, size_t size)
+  {
+    uint64_t pos = row * m_out_row_bytes + offset;
+    if (m_lz4)
+    {
+      std::memcpy(&m_full[pos], data, size);
+      return;
+    }
+    size_t done = 0;
+    while (done < size)
+    {
+      ssize_t n = ::pwrite(m_fd, data + done, size - done, m_offset + pos + done);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw IOError("Unable to write " + m_path + ": " + std::strerror(errno));
+      }
+      done += n;
+    }
+  }
+
+private:
+  std::string m_path;
+  uint32_t m_bits;
+  uint32_t m_id;
+  uint32_t m_partition;
+  uint64_t m_first;
+  uint64_t m_window;
+  bool m_lz4;
+  size_t m_nb_threads;
+
+  size_t m_row_bytes {0};
+  uint64_t m_nb_rows {0};
+  uint64_t m_out_row_bytes {0};
+  size_t m_band_rows {0};
+
+  std::vector<uint8_t> m_band;
+  std::vector<uint8_t> m_band_out;
+  std::vector<uint8_t> m_full;
+  uint64_t m_band_start {0};
+  size_t m_fill {0};
+  bool m_dirty {false};
+  bool m_closed {false};
+
+  int m_fd {-1};
+  uint64_t m_offset {0};
 };
 
 template<size_t buf_size = 8192>
@@ -121,58 +384,88 @@ public:
 
   bool read(std::vector<uint8_t>& bits)
   {
-    if (this->m_header.compressed)
-    {
-      this->m_second_layer->read(reinterpret_cast<char*>(bits.data()), bits.size()*sizeof(uint8_t));
-      if (!this->m_second_layer->gcount())
-        return false;
-    }
-    else
-    {
-      this->m_first_layer->read(reinterpret_cast<char*>(bits.data()), bits.size()*sizeof(uint8_t));
-      if (!this->m_first_layer->gcount())
-        return false;
-    }
-    return true;
+    return read(reinterpret_cast<char*>(bits.data()), bits.size()*sizeof(uint8_t));
   }
 
   bool read(char* bits, size_t size)
   {
-    if (this->m_header.compressed)
-    {
-      this->m_second_layer->read(bits, size);
-      if (!this->m_second_layer->gcount())
-        return false;
-    }
-    else
-    {
-      this->m_first_layer->read(bits, size);
-      if (!this->m_first_layer->gcount())
-        return false;
-    }
+    if (this->m_header.rle())
+      return read_rle(bits, size);
+
+    std::istream* stream = this->m_header.compressed ? this->m_second_layer.get()
+                                                     : this->m_first_layer.get();
+    stream->read(bits, size);
+    if (!stream->gcount())
+      return false;
     return true;
   }
 
   void load(BitMatrix& bit_matrix)
   {
-    if (this->m_header.compressed)
-    {
-      this->m_second_layer->read(reinterpret_cast<char*>(bit_matrix.matrix),
-                                 bit_matrix.get_size_in_byte());
-    }
-    else
-    {
-      this->m_first_layer->read(reinterpret_cast<char*>(bit_matrix.matrix),
-                                bit_matrix.get_size_in_byte());
-    }
+    read(reinterpret_cast<char*>(bit_matrix.matrix), bit_matrix.get_size_in_byte());
   }
 
   void seekg(uint32_t partition)
   {
-    if (this->m_header.compressed)
+    if (this->m_header.compressed || this->m_header.rle())
       throw IOError("VectorMatrixReader::seekg() only available on uncompressed stream.");
     this->m_first_layer->seekg(49 + (partition * (this->m_header.window / 8)));
   }
+
+private:
+  // Expands the records written by VectorMatrixWriter in run-length mode.
+  bool read_rle(char* bits, size_t size)
+  {
+    std::istream* stream = this->m_header.compressed ? this->m_second_layer.get()
+                                                     : this->m_first_layer.get();
+    if (m_row.empty())
+    {
+      m_row.resize(NBYTES(this->m_header.bits));
+      m_pos = m_row.size();
+    }
+
+    size_t done = 0;
+    while (done < size)
+    {
+      if (m_pos == m_row.size())
+      {
+        if (m_empty)
+        {
+          std::fill(m_row.begin(), m_row.end(), 0);
+          m_empty--;
+        }
+        else if (m_has_row)
+        {
+          stream->read(reinterpret_cast<char*>(m_row.data()), m_row.size());
+          m_has_row = false;
+          if (static_cast<size_t>(stream->gcount()) != m_row.size())
+            break;
+        }
+        else
+        {
+          uint64_t record = 0;
+          stream->read(reinterpret_cast<char*>(&record), sizeof(record));
+          if (stream->gcount() != sizeof(record))
+            break;
+          m_empty = record & ~VM_RLE_ROW;
+          m_has_row = record & VM_RLE_ROW;
+          continue;
+        }
+        m_pos = 0;
+      }
+      size_t n = std::min(size - done, m_row.size() - m_pos);
+      std::memcpy(bits + done, &m_row[m_pos], n);
+      m_pos += n;
+      done += n;
+    }
+    return done;
+  }
+
+private:
+  std::vector<uint8_t> m_row;
+  size_t m_pos {0};
+  uint64_t m_empty {0};
+  bool m_has_row {false};
 };
 
 template<size_t buf_size = 8192>
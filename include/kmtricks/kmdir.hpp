@@ -123,11 +123,17 @@ public:
       ext = "cmbf";
     else if (MODE::BFC == mode)
       ext = "cmbf";
+    else if (MODE::BFT == mode)
+      ext = "cmbf";
 
     if (FORMAT::TEXT == format)
       ext += ".txt";
+    else if (FORMAT::BLOCK == format)
+      ext += ".blk";
+    else if (FORMAT::SPARSE == format)
+      ext += ".sparse";
 
-    if (compressed && format != FORMAT::TEXT)
+    if (compressed && (format == FORMAT::BIN || format == FORMAT::SPARSE))
       ext += ".lz4";
 
     return fmt::format(m_matrix_template, m_matrix_storage, part_id, ext);
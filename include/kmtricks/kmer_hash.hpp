@@ -18,6 +18,7 @@
 
 #pragma once
 #include <kmtricks/kmer.hpp>
+#include <kmtricks/nthash.hpp>
 
 #ifdef WITH_XXHASH
 #include <xxhash.h>
@@ -329,6 +330,47 @@ private:
 
 #endif
 
+// Canonical ntHash, the WinHasher gives the hashes of the hash modes of runs built with
+// --hasher nthash.
+template<>
+struct KmerHashers<2>
+{
+  static std::string name() { return "KmerHashers<2> - ntHash"; }
+  template<size_t MAX_K>
+  struct Hasher : public IKHasher<MAX_K>
+  {
+    static std::string name()
+    {
+      return "KmerHashers<2>::Hasher<MAX_K=" + std::to_string(MAX_K) + ">";
+    }
+
+    uint64_t operator()(const Kmer<MAX_K>& kmer, uint64_t seed = 0) const final
+    {
+      return NtHash::hash(kmer.m_kmer_size, kmer.get_data64(), seed);
+    }
+  };
+
+  template<size_t MAX_K>
+  struct WinHasher : public IKHasher<MAX_K>
+  {
+    WinHasher(uint64_t p, uint64_t w) : p(p), w(w) {}
+    static std::string name()
+    {
+      return "KmerHashers<2>::WinHasher<MAX_K=" + std::to_string(MAX_K) + ">";
+    }
+
+    uint64_t operator()(const Kmer<MAX_K>& kmer, uint64_t seed = 0) const final
+    {
+      uint64_t h = NtHash::hash(kmer.m_kmer_size, kmer.get_data64(), seed);
+      return NtHash::reduce(h, w) + (w * p);
+    }
+
+  private:
+    uint64_t p {0};
+    uint64_t w {0};
+  };
+};
+
 };
 
 
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+namespace km {
+
+// Tournament tree of losers over N sources, used by k-way merges.
+// Less is a callable (uint32_t a, uint32_t b) -> bool giving a strict total order
+// on source indices, exhausted sources comparing greater than any other.
+// After the head of the winning source changes, replay() restores the tree in O(log N).
+// A tree over no source is empty and has no top.
+template<typename Less>
+class LoserTree
+{
+public:
+  LoserTree() = default;
+
+  LoserTree(uint32_t size, Less less)
+    : m_size(size), m_less(less)
+  {
+    build();
+  }
+
+  void build()
+  {
+    m_tree.assign(m_size, 0);
+    if (m_size < 2)
+      return;
+
+    std::vector<uint32_t> winners(2 * m_size);
+    for (uint32_t i=0; i<m_size; i++)
+      winners[m_size + i] = i;
+
+    for (uint32_t n=m_size-1; n>0; n--)
+    {
+      uint32_t l = winners[2*n];
+      uint32_t r = winners[2*n+1];
+      if (m_less(r, l))
+        std::swap(l, r);
+      winners[n] = l;
+      m_tree[n] = r;
+    }
+    m_tree[0] = winners[1];
+  }
+
+  bool empty() const
+  {
+    return m_size == 0;
+  }
+
+  uint32_t top() const
+  {
+    assert(!empty());
+    return m_tree[0];
+  }
+
+  void replay(uint32_t s)
+  {
+    uint32_t winner = s;
+    for (uint32_t n=(s + m_size) / 2; n>0; n/=2)
+    {
+      if (m_less(m_tree[n], winner))
+        std::swap(m_tree[n], winner);
+    }
+    m_tree[0] = winner;
+  }
+
+  uint32_t size() const
+  {
+    return m_size;
+  }
+
+private:
+  uint32_t m_size {0};
+  Less m_less;
+  std::vector<uint32_t> m_tree;
+};
+
+};
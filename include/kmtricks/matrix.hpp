@@ -446,6 +446,7 @@ class MatrixMerger
         std::size_t pos;
         std::size_t n;
         input_stream_type stream;
+        std::unique_ptr<MatrixBlockReader<buf_size>> block;
         bool is_set {false};
 
 
@@ -455,14 +456,23 @@ class MatrixMerger
           bool is_kmer = (
             fs::path(path).filename().string().find("kmer") != std::string::npos
           );
-          if constexpr(mode == mmode::kmer && MAX_C != 1)
-            stream = std::make_unique<typename input_stream_type::element_type>(path, is_kmer);
-          else
-            stream = std::make_unique<typename input_stream_type::element_type>(path);
+          if constexpr(MAX_C != 1)
+          {
+            if (!is_kmer && get_km_file_type(path) == KM_FILE::MATRIX_BLOCK)
+              block = std::make_unique<MatrixBlockReader<buf_size>>(path);
+          }
+
+          if (!block)
+          {
+            if constexpr(mode == mmode::kmer && MAX_C != 1)
+              stream = std::make_unique<typename input_stream_type::element_type>(path, is_kmer);
+            else
+              stream = std::make_unique<typename input_stream_type::element_type>(path);
+          }
 
           if constexpr(MAX_C != 1)
           {
-            n = stream->infos().nb_counts;
+            n = block ? block->infos().nb_counts : stream->infos().nb_counts;
             data.resize(n);
           }
           else
@@ -472,13 +482,25 @@ class MatrixMerger
           }
 
           if constexpr(mode == mmode::kmer)
-            value.set_k(stream->infos().kmer_size);
+            value.set_k(block ? block->infos().kmer_size : stream->infos().kmer_size);
 
           load();
         }
 
         void load()
         {
+          if constexpr(MAX_C != 1)
+          {
+            if (block)
+            {
+              if constexpr(mode == mmode::kmer)
+                is_set = block->template read<MAX_K, MAX_C>(value, data);
+              else
+                is_set = block->template read<MAX_C>(value, data);
+              return;
+            }
+          }
+
           if constexpr(mode == mmode::kmer)
           {
             if constexpr(MAX_C != 1)
@@ -627,10 +649,13 @@ class MatrixMerger
 
         void write_k_c(const std::string& path, bool cpr)
         {
-          auto& i = m_elements.back()->stream->infos();
-          auto out = std::make_unique<typename output_stream_type::element_type>(
-            path, i.kmer_size, i.count_slots, get_ns(), i.id, i.partition, cpr
-          );
+          auto open = [&](auto& i) {
+            return std::make_unique<typename output_stream_type::element_type>(
+              path, i.kmer_size, i.count_slots, get_ns(), i.id, i.partition, cpr
+            );
+          };
+          auto& e = m_elements.back();
+          auto out = e->block ? open(e->block->infos()) : open(e->stream->infos());
 
           while (next())
             out->template write<MAX_K, MAX_C>(m_current_kmer, m_current_data);
@@ -649,10 +674,13 @@ class MatrixMerger
 
         void write_h_c(const std::string& path, bool cpr)
         {
-          auto& i = m_elements.back()->stream->infos();
-          auto out = std::make_unique<typename output_stream_type::element_type>(
-            path, i.count_slots, get_ns(), i.id, i.partition, cpr
-          );
+          auto open = [&](auto& i) {
+            return std::make_unique<typename output_stream_type::element_type>(
+              path, i.count_slots, get_ns(), i.id, i.partition, cpr
+            );
+          };
+          auto& e = m_elements.back();
+          auto out = e->block ? open(e->block->infos()) : open(e->stream->infos());
 
           while (next())
             out->template write<MAX_C>(m_current_kmer, m_current_data);
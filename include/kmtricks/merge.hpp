@@ -18,14 +18,19 @@
 
 #pragma once
 #include <vector>
+#include <atomic>
+#include <algorithm>
 #include <kmtricks/kmer.hpp>
 #include <kmtricks/utils.hpp>
 #include <kmtricks/io/matrix_file.hpp>
 #include <kmtricks/io/pa_matrix_file.hpp>
+#include <kmtricks/io/sparse_matrix_file.hpp>
 #include <kmtricks/io/kmer_file.hpp>
 #include <kmtricks/io/hash_file.hpp>
 #include <kmtricks/io/vector_matrix_file.hpp>
 #include <kmtricks/packc.hpp>
+#include <kmtricks/loser_tree.hpp>
+#include <kmtricks/task_pool.hpp>
 
 #ifdef WITH_PLUGIN
 #include <kmtricks/plugin_manager.hpp>
@@ -82,6 +87,19 @@ public:
     }
   }
 
+  void merge(const MergeStatistics<MAX_C>& other)
+  {
+    for (size_t i=0; i<m_nb_files; i++)
+    {
+      m_non_solid[i] += other.m_non_solid[i];
+      m_rescued[i] += other.m_rescued[i];
+      m_uniq_wo_rescue[i] += other.m_uniq_wo_rescue[i];
+      m_uniq_w_rescue[i] += other.m_uniq_w_rescue[i];
+      m_total_wo_rescue[i] += other.m_total_wo_rescue[i];
+      m_total_w_rescue[i] += other.m_total_w_rescue[i];
+    }
+  }
+
   const std::vector<uint64_t>& get_non_solid() const { return m_non_solid; }
   const std::vector<uint64_t>& get_rescued() const { return m_rescued; }
   const std::vector<uint64_t>& get_unique_wo_rescue() const { return m_uniq_wo_rescue; }
@@ -99,6 +117,215 @@ private:
   std::vector<uint64_t> m_total_w_rescue;
 };
 
+#ifdef WITH_PLUGIN
+// Rows buffered by a merger for a batched plugin, see IMergePlugin::batch_size.
+class PluginBatch
+{
+  using count_type = MergeBatch::count_type;
+public:
+  void init(size_t capacity, size_t nb_samples, size_t key_words, bool column_major)
+  {
+    m_keys.resize(capacity * key_words);
+    m_counts.resize(capacity * nb_samples);
+    m_keep.resize((capacity + 63) / 64);
+    m_batch.capacity = capacity;
+    m_batch.nb_samples = nb_samples;
+    m_batch.key_words = key_words;
+    m_batch.column_major = column_major;
+    m_batch.keys = m_keys.data();
+    m_batch.counts = m_counts.data();
+    m_batch.keep = m_keep.data();
+    clear();
+  }
+
+  bool enabled() const { return m_batch.capacity > 0; }
+  bool full() const { return m_batch.size == m_batch.capacity; }
+  bool consumed() const { return m_pos == m_batch.size; }
+  MergeBatch& get() { return m_batch; }
+
+  void clear()
+  {
+    m_batch.size = 0;
+    m_pos = 0;
+    std::fill(m_keep.begin(), m_keep.end(), 0);
+  }
+
+  void push(const uint64_t* key, const std::vector<count_type>& counts, bool keep)
+  {
+    size_t i = m_batch.size++;
+    std::copy(key, key + m_batch.key_words, m_keys.data() + i * m_batch.key_words);
+    if (m_batch.column_major)
+      for (size_t s=0; s<counts.size(); s++)
+        m_counts[s * m_batch.capacity + i] = counts[s];
+    else
+      std::copy(counts.begin(), counts.end(), m_counts.data() + i * m_batch.nb_samples);
+    if (keep)
+      m_batch.set_keep(i, true);
+  }
+
+  // Pops the next row, returns its key.
+  const uint64_t* pop(std::vector<count_type>& counts, bool& keep)
+  {
+    size_t i = m_pos++;
+    if (m_batch.column_major)
+      for (size_t s=0; s<counts.size(); s++)
+        counts[s] = m_counts[s * m_batch.capacity + i];
+    else
+      std::copy_n(m_counts.data() + i * m_batch.nb_samples, counts.size(), counts.begin());
+    keep = m_batch.kept(i);
+    return m_batch.key(i);
+  }
+
+private:
+  MergeBatch m_batch;
+  std::vector<uint64_t> m_keys;
+  std::vector<count_type> m_counts;
+  std::vector<uint64_t> m_keep;
+  size_t m_pos {0};
+};
+#endif
+
+// Half-open key range [lower, upper) restricting a merge, unbounded sides are flagged off.
+template<typename Key>
+struct MergeRange
+{
+  Key lower {};
+  Key upper {};
+  bool has_lower {false};
+  bool has_upper {false};
+  uint32_t id {0};
+};
+
+// Picks nb_ranges-1 distinct splitters from sorted samples, fewer if the samples are not diverse enough.
+template<typename Key>
+std::vector<Key> pick_splitters(std::vector<Key>& samples, uint32_t nb_ranges)
+{
+  std::vector<Key> splitters;
+  std::sort(samples.begin(), samples.end());
+  samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+  if (nb_ranges < 2 || samples.size() < nb_ranges)
+    return splitters;
+
+  for (size_t j=1; j<nb_ranges; j++)
+  {
+    const Key& s = samples[(j * samples.size()) / nb_ranges];
+    if (splitters.empty() || splitters.back() < s)
+      splitters.push_back(s);
+  }
+  return splitters;
+}
+
+// Number of sub-ranges per partition, so that nb_parts concurrent merges keep nb_threads busy.
+inline uint32_t get_merge_splits(uint32_t nb_threads, size_t nb_parts)
+{
+  if (nb_parts == 0 || nb_parts >= nb_threads)
+    return 1;
+  return nb_threads / nb_parts;
+}
+
+// Runs fn(range, path) on the sub-ranges delimited by splitters, concurrently on the idle
+// workers of the pool that can be leased. The first sub-range writes to path, the others to
+// temporary files which are appended to path without their headers, so the result is a single
+// file as if written by one merger.
+template<typename Key, typename Fn>
+void split_merge(const std::string& path,
+                 const std::vector<Key>& splitters,
+                 size_t header_size,
+                 Fn&& fn)
+{
+  size_t nb_ranges = splitters.size() + 1;
+  std::vector<MergeRange<Key>> ranges(nb_ranges);
+  std::vector<std::string> parts;
+
+  for (size_t r=0; r<nb_ranges; r++)
+  {
+    MergeRange<Key>& range = ranges[r];
+    range.id = r;
+    if (r > 0)
+    {
+      range.lower = splitters[r-1];
+      range.has_lower = true;
+    }
+    if (r < nb_ranges - 1)
+    {
+      range.upper = splitters[r];
+      range.has_upper = true;
+    }
+    parts.push_back(r == 0 ? path : fmt::format("{}.part{}", path, r));
+  }
+
+  // threads pick sub-ranges one by one
+  std::atomic<size_t> next {0};
+  IdleWorkers::Lease lease(nb_ranges - 1);
+  lease.run([&](size_t, size_t) {
+    for (size_t r = next++; r < nb_ranges; r = next++)
+      fn(ranges[r], parts[r]);
+  });
+
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::app);
+  check_fstream_good(path, out);
+  for (size_t r=1; r<nb_ranges; r++)
+  {
+    {
+      std::ifstream in(parts[r], std::ios::in | std::ios::binary);
+      check_fstream_good(parts[r], in);
+      in.seekg(header_size);
+      out << in.rdbuf();
+    }
+    std::remove(parts[r].c_str());
+  }
+}
+
+// Largest number of inputs a merge may open at once, given the open file limit, raised to
+// the hard limit beforehand, and the memory budget (in MB, 0 = unlimited) shared by
+// nb_concurrent merges.
+inline uint32_t get_merge_group_size(size_t nb_concurrent, size_t stream_bytes, size_t memory_mb)
+{
+  nb_concurrent = std::max<size_t>(nb_concurrent, 1);
+  int64_t soft = raise_nofile_limit();
+  int64_t fds = soft < 0 ? std::numeric_limits<int32_t>::max() : soft;
+  size_t group_size = std::max<int64_t>(fds - 64, 0) / nb_concurrent;
+  if (group_size > 0)
+    group_size--;
+  if (memory_mb && stream_bytes)
+    group_size = std::min(group_size, (memory_mb << 20) / nb_concurrent / stream_bytes);
+  return std::clamp<size_t>(group_size, 2, std::numeric_limits<uint32_t>::max());
+}
+
+// Merges inputs by groups of group_size into intermediate matrices holding the raw counts of
+// each group, level after level, until at most group_size files remain. Merging the returned
+// files gives the same result as merging the inputs. Intermediate files are named after prefix,
+// fn(group, thresholds, path) writes the raw count matrix of a group with a merger.
+template<typename Fn>
+std::vector<std::string> reduce_merge_inputs(const std::vector<std::string>& paths,
+                                             uint32_t group_size,
+                                             const std::string& prefix,
+                                             Fn&& fn)
+{
+  std::vector<std::string> current = paths;
+  std::vector<uint32_t> no_threshold(paths.size(), 0);
+  group_size = std::max<uint32_t>(group_size, 2);
+
+  for (uint32_t level=0; current.size() > group_size; level++)
+  {
+    std::vector<std::string> next;
+    for (size_t first=0; first<current.size(); first+=group_size)
+    {
+      size_t last = std::min<size_t>(first + group_size, current.size());
+      std::vector<std::string> group(current.begin() + first, current.begin() + last);
+      std::string path = fmt::format("{}.level{}.{}", prefix, level, next.size());
+      fn(group, no_threshold, path);
+      if (level > 0)
+        for (auto& f : group)
+          std::remove(f.c_str());
+      next.push_back(path);
+    }
+    spdlog::debug("Merge level {}: {} -> {} files", level, current.size(), next.size());
+    current = std::move(next);
+  }
+  return current;
+}
+
 template<size_t MAX_K, size_t MAX_C>
 class KmerMerger
 {
@@ -107,18 +334,37 @@ public:
   struct element
   {
     Kmer<MAX_K> value;
-    count_type count {0};
+    uint32_t offset {0};
+    uint32_t width {1};
     bool is_set {false};
   };
 
+  struct element_less
+  {
+    const std::vector<element>* elements {nullptr};
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+      const element& ea = (*elements)[a];
+      const element& eb = (*elements)[b];
+      if (!ea.is_set || !eb.is_set)
+        return ea.is_set || (!eb.is_set && a < b);
+      if (ea.value == eb.value)
+        return a < b;
+      return ea.value < eb.value;
+    }
+  };
+
 public:
   KmerMerger(std::vector<std::string>& paths,
          std::vector<uint32_t>& abundance_min_vec,
          uint32_t kmer_size,
          uint32_t recurrence_min,
-         uint32_t save_if)
+         uint32_t save_if,
+         const MergeRange<Kmer<MAX_K>>& range = {},
+         size_t read_ahead = 0)
     : m_paths(paths), m_a_min_vec(abundance_min_vec), m_kmer_size(kmer_size),
-      m_r_min(recurrence_min), m_save_if(save_if)
+      m_r_min(recurrence_min), m_save_if(save_if), m_range(range), m_read_ahead(read_ahead)
   {
     init_stream();
     init_state();
@@ -139,30 +385,98 @@ public:
     return m_infos.get();
   }
 
+  // Samples the keys of a few input files to split the partition into nb_ranges
+  // sub-ranges of similar sizes, see split_merge.
+  static std::vector<Kmer<MAX_K>> sample_splitters(const std::vector<std::string>& paths,
+                                                   uint32_t nb_ranges,
+                                                   uint32_t nb_files = 4,
+                                                   uint32_t stride = 64)
+  {
+    std::vector<Kmer<MAX_K>> samples;
+    size_t step = std::max<size_t>(1, paths.size() / nb_files);
+    for (size_t f=0, used=0; f<paths.size() && used<nb_files; f+=step, used++)
+    {
+      KmerMergeReader reader(paths[f]);
+      Kmer<MAX_K> kmer; kmer.set_k(reader.infos().kmer_size);
+      count_type count = 0;
+      for (size_t n=0; reader.template read<MAX_K, MAX_C>(kmer, count); n++)
+      {
+        if (n % stride == 0)
+          samples.push_back(kmer);
+      }
+    }
+    return pick_splitters(samples, nb_ranges);
+  }
+
+  // Memory used by one input stream, the staging buffers of the MergeBufferPool are
+  // shared by all merges.
+  static size_t stream_footprint(bool lz4)
+  {
+    return KmerMergeReader::stream_footprint(lz4) + sizeof(element) + sizeof(count_type);
+  }
+
+  // Memory used by the input streams of this merge, LZ4F contexts are counted at their
+  // peak since they are released when a stream is exhausted.
+  size_t footprint() const
+  {
+    size_t bytes = m_elements.capacity() * sizeof(element) + m_size * (2 * sizeof(count_type) + sizeof(uint32_t));
+    for (size_t i=0; i<m_nb_streams; i++)
+    {
+      if (m_input_streams[i])
+        bytes += m_input_streams[i]->peak_footprint();
+      else
+        bytes += sizeof(MatrixReader<8192>) + BUFSIZ
+          + (m_block_streams[i]->infos().compressed ? lz4_context_footprint() + 8192 : 0);
+    }
+    return bytes;
+  }
+
   void init_stream()
   {
+    uint32_t offset = 0;
     for (auto& path: m_paths)
-      m_input_streams.push_back(std::make_shared<KmerReader<8192>>(path));
-    m_size = m_paths.size();
-    m_kmer_size = m_input_streams[0]->infos().kmer_size;
+    {
+      element e;
+      e.offset = offset;
+      if (get_km_file_type(path) == KM_FILE::MATRIX)
+      {
+        auto reader = std::make_shared<MatrixReader<8192>>(path, false, m_read_ahead);
+        e.width = reader->infos().nb_counts;
+        m_kmer_size = reader->infos().kmer_size;
+        m_partition = reader->infos().partition;
+        m_block_streams.push_back(reader);
+        m_input_streams.push_back(nullptr);
+      }
+      else
+      {
+        auto reader = std::make_shared<KmerMergeReader>(path, m_read_ahead);
+        m_kmer_size = reader->infos().kmer_size;
+        m_partition = reader->infos().partition;
+        m_input_streams.push_back(reader);
+        m_block_streams.push_back(nullptr);
+      }
+      offset += e.width;
+      m_elements.push_back(e);
+    }
+    m_nb_streams = m_paths.size();
+    m_size = offset;
+    m_raw.resize(m_size, 0);
   }
 
   void init_state()
   {
-    for (size_t i=0; i<m_size; i++)
+    for (size_t i=0; i<m_nb_streams; i++)
     {
-      m_elements.push_back(element{});
       m_elements[i].value.set_k(m_kmer_size);
 
       if (read_next(i))
         m_elements[i].is_set = true;
 
-      if ( (!m_current_set || m_elements[i].value < m_current) && m_elements[i].is_set )
-      {
-        m_current = m_next = m_elements[i].value;
-        m_current_set = true;
-      }
+      while (m_range.has_lower && m_elements[i].is_set && m_elements[i].value < m_range.lower)
+        m_elements[i].is_set = read_next(i);
     }
+    m_current.set_k(m_kmer_size);
+    m_tree = LoserTree<element_less>(m_nb_streams, element_less{&m_elements});
     m_counts.resize(m_size, 0);
     m_infos = std::make_unique<MergeStatistics<MAX_C>>(m_size);
   }
@@ -171,7 +485,11 @@ public:
 #ifdef WITH_PLUGIN
   void set_plugin(IMergePlugin* plugin)
   {
+    static_assert(std::is_same<count_type, MergeBatch::count_type>::value,
+                  "plugins take counts of DMAX_C");
     m_plugin = plugin;
+    if (m_plugin->batch_size())
+      m_batch.init(m_plugin->batch_size(), m_size, (MAX_K + 31) / 32, m_plugin->column_major());
   }
 #endif
 
@@ -181,21 +499,58 @@ public:
   }
 
   bool next()
+  {
+#ifdef WITH_PLUGIN
+    // mergers of other count types are never given a plugin
+    if constexpr (std::is_same<count_type, MergeBatch::count_type>::value)
+    {
+      if (m_batch.enabled())
+        return next_batched();
+      if (m_plugin)
+      {
+        // the plugin may have written any count of the previous row
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_touched.clear();
+        if (!merge_next())
+          return false;
+        m_keep = m_plugin->process_kmer(m_current.get_data64(), m_counts);
+        return true;
+      }
+    }
+#endif
+    return merge_next();
+  }
+
+private:
+  bool merge_next()
   {
     m_keep = false;
-    m_finish = true;
-    m_next_set = false;
+
+    for (auto& i : m_touched)
+      m_counts[i] = 0;
+    m_touched.clear();
+    m_need_check.clear();
+
+    if (m_tree.empty())
+      return false;
+    uint32_t w = m_tree.top();
+    if (!m_elements[w].is_set)
+      return false;
 
     uint32_t recurrence = 0;
     uint32_t solid_in = 0;
-    m_current = m_next;
-    m_need_check.clear();
-    for (size_t i=0; i<m_size; i++)
+    m_current = m_elements[w].value;
+
+    while (m_elements[w].is_set && m_elements[w].value == m_current)
     {
-      if (m_elements[i].is_set && m_elements[i].value == m_current)
+      const element& e = m_elements[w];
+      for (uint32_t i=e.offset; i<e.offset+e.width; i++)
       {
-        m_finish = false;
-        m_counts[i] = m_elements[i].count;
+        // a null count in an intermediate matrix means absent from this sample
+        if (!m_raw[i])
+          continue;
+        m_touched.push_back(i);
+        m_counts[i] = m_raw[i];
         if (m_counts[i] >= m_a_min_vec[i])
         {
           recurrence++;
@@ -216,19 +571,12 @@ public:
           else
             m_counts[i] = 0;
         }
-        if (!read_next(i))
-          m_elements[i].is_set = false;
-      }
-      else
-      {
-        m_counts[i] = 0;
       }
+      if (!read_next(w))
+        m_elements[w].is_set = false;
 
-      if (m_elements[i].is_set && (!m_next_set || m_elements[i].value < m_next))
-      {
-        m_next = m_elements[i].value;
-        m_next_set = true;
-      }
+      m_tree.replay(w);
+      w = m_tree.top();
     }
 
     for (auto& f : m_need_check)
@@ -249,16 +597,31 @@ public:
     if (recurrence >= m_r_min)
       m_keep = true;
 
+    return true;
+  }
+
 #ifdef WITH_PLUGIN
-    if (m_plugin)
+  bool next_batched()
+  {
+    if (m_batch.consumed())
     {
-      m_keep = m_plugin->process_kmer(m_current.get_data64(), m_counts);
+      // m_counts was overwritten by the rows of the previous batch
+      std::fill(m_counts.begin(), m_counts.end(), 0);
+      m_touched.clear();
+
+      m_batch.clear();
+      while (!m_batch.full() && merge_next())
+        m_batch.push(m_current.get_data64(), m_counts, m_keep);
+      if (m_batch.consumed())
+        return false;
+      m_plugin->process_kmer_batch(m_batch.get());
     }
-#endif
-
-    return !m_finish;
+    m_current.set64_p(m_batch.pop(m_counts, m_keep));
+    return true;
   }
+#endif
 
+public:
   void write_as_bin(const std::string& path, bool compressed)
   {
     MatrixWriter mw(path, m_kmer_size, 1, m_size, 0, m_partition, compressed);
@@ -271,6 +634,31 @@ public:
     }
   }
 
+  void write_as_block(const std::string& path)
+  {
+    MatrixBlockWriter mbw(path, m_kmer_size, sizeof(count_type), m_size, 0, m_partition);
+    while (next())
+    {
+      if (m_keep)
+      {
+        mbw.template write<MAX_K, MAX_C>(m_current, m_counts);
+      }
+    }
+  }
+
+  void write_as_sparse(const std::string& path, bool compressed, bool presence)
+  {
+    SparseMatrixWriter smw(path, m_kmer_size, presence ? 0 : sizeof(count_type), m_size, 0,
+                           m_partition, compressed);
+    while (next())
+    {
+      if (m_keep)
+      {
+        smw.template write<MAX_K, MAX_C>(m_current, m_counts);
+      }
+    }
+  }
+
   void write_as_pa(const std::string& path, bool compressed)
   {
     PAMatrixWriter pw(path, m_kmer_size, m_size, 0, m_partition, compressed);
@@ -325,8 +713,13 @@ public:
 private:
   bool read_next(size_t i)
   {
-    return m_input_streams[i]->template read<MAX_K, MAX_C>(m_elements[i].value,
-                                                           m_elements[i].count);
+    element& e = m_elements[i];
+    bool ret = false;
+    if (m_block_streams[i])
+      ret = m_block_streams[i]->template read<MAX_K, MAX_C>(e.value, &m_raw[e.offset], e.width);
+    else
+      ret = m_input_streams[i]->template read<MAX_K, MAX_C>(e.value, m_raw[e.offset]);
+    return ret && (!m_range.has_upper || e.value < m_range.upper);
   }
 
 private:
@@ -334,33 +727,37 @@ private:
   uint32_t m_a_min;
   uint32_t m_r_min;
   uint32_t m_save_if;
-  uint32_t m_partition;
+  uint32_t m_partition {0};
+  MergeRange<Kmer<MAX_K>> m_range;
+  size_t m_read_ahead {0};
 
-  std::vector<kr_t<8192>> m_input_streams;
+  std::vector<kmr_t> m_input_streams;
+  std::vector<mr_t<8192>> m_block_streams;
   std::vector<element> m_elements;
+  std::vector<count_type> m_raw;
   std::vector<size_t> m_need_check;
+  std::vector<uint32_t> m_touched;
+  LoserTree<element_less> m_tree;
 
+  uint32_t m_nb_streams;
   uint32_t m_size;
   uint32_t m_kmer_size;
   std::vector<uint32_t>& m_a_min_vec;
 
-  Kmer<MAX_K> m_next;
   Kmer<MAX_K> m_current;
-  bool m_next_set {false};
-  bool m_current_set {false};
   std::vector<count_type> m_counts;
 
   bool m_keep {false};
-  bool m_finish {false};
 
   std::unique_ptr<MergeStatistics<MAX_C>> m_infos {nullptr};
 
 #ifdef WITH_PLUGIN
   IMergePlugin* m_plugin {nullptr};
+  PluginBatch m_batch;
 #endif
 };
 
-template<size_t MAX_C, size_t buf_size = 8192, typename Reader = HashReader<buf_size>>
+template<size_t MAX_C, size_t buf_size = 8192, typename Reader = HashMergeReader<MAX_C>>
 class HashMerger
 {
   using count_type = typename selectC<MAX_C>::type;
@@ -368,17 +765,36 @@ public:
   struct element
   {
     uint64_t value;
-    count_type count {0};
+    uint32_t offset {0};
+    uint32_t width {1};
     bool is_set {false};
   };
 
+  struct element_less
+  {
+    const std::vector<element>* elements {nullptr};
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+      const element& ea = (*elements)[a];
+      const element& eb = (*elements)[b];
+      if (!ea.is_set || !eb.is_set)
+        return ea.is_set || (!eb.is_set && a < b);
+      if (ea.value == eb.value)
+        return a < b;
+      return ea.value < eb.value;
+    }
+  };
+
 public:
   HashMerger(std::vector<std::string>& paths,
          std::vector<uint32_t>& abundance_min_vec,
          uint32_t recurrence_min,
-         uint32_t save_if)
+         uint32_t save_if,
+         const MergeRange<uint64_t>& range = {},
+         size_t read_ahead = 0)
     : m_paths(paths), m_a_min_vec(abundance_min_vec),
-      m_r_min(recurrence_min), m_save_if(save_if)
+      m_r_min(recurrence_min), m_save_if(save_if), m_range(range), m_read_ahead(read_ahead)
   {
     init_stream();
     init_state();
@@ -399,29 +815,90 @@ public:
     return m_infos.get();
   }
 
+  // Samples the keys of a few input files to split the partition into nb_ranges
+  // sub-ranges of similar sizes, see split_merge.
+  static std::vector<uint64_t> sample_splitters(const std::vector<std::string>& paths,
+                                                uint32_t nb_ranges,
+                                                uint32_t nb_files = 4,
+                                                uint32_t stride = 64)
+  {
+    std::vector<uint64_t> samples;
+    size_t step = std::max<size_t>(1, paths.size() / nb_files);
+    for (size_t f=0, used=0; f<paths.size() && used<nb_files; f+=step, used++)
+    {
+      Reader reader(paths[f]);
+      uint64_t hash = 0;
+      count_type count = 0;
+      for (size_t n=0; read_from(reader, hash, count); n++)
+      {
+        if (n % stride == 0)
+          samples.push_back(hash);
+      }
+    }
+    return pick_splitters(samples, nb_ranges);
+  }
+
+  // Memory used by one input stream, see KmerMerger::stream_footprint.
+  static size_t stream_footprint()
+  {
+    return Reader::stream_footprint() + sizeof(element) + sizeof(count_type);
+  }
+
+  size_t footprint() const
+  {
+    size_t bytes = m_elements.capacity() * sizeof(element) + m_size * (2 * sizeof(count_type) + sizeof(uint32_t));
+    for (size_t i=0; i<m_nb_streams; i++)
+    {
+      if (m_input_streams[i])
+        bytes += m_input_streams[i]->peak_footprint();
+      else
+        bytes += sizeof(MatrixHashReader<8192>) + BUFSIZ
+          + (m_block_streams[i]->infos().compressed ? lz4_context_footprint() + 8192 : 0);
+    }
+    return bytes;
+  }
+
   void init_stream()
   {
+    uint32_t offset = 0;
     for (auto& path: m_paths)
-      m_input_streams.push_back(std::make_shared<Reader>(path));
-    m_size = m_paths.size();
-    m_partition = m_input_streams[0]->infos().partition;
+    {
+      element e;
+      e.offset = offset;
+      if (get_km_file_type(path) == KM_FILE::MATRIX_HASH)
+      {
+        auto reader = std::make_shared<MatrixHashReader<8192>>(path, m_read_ahead);
+        e.width = reader->infos().nb_counts;
+        m_partition = reader->infos().partition;
+        m_block_streams.push_back(reader);
+        m_input_streams.push_back(nullptr);
+      }
+      else
+      {
+        auto reader = std::make_shared<Reader>(path, m_read_ahead);
+        m_partition = reader->infos().partition;
+        m_input_streams.push_back(reader);
+        m_block_streams.push_back(nullptr);
+      }
+      offset += e.width;
+      m_elements.push_back(e);
+    }
+    m_nb_streams = m_paths.size();
+    m_size = offset;
+    m_raw.resize(m_size, 0);
   }
 
   void init_state()
   {
-    for (size_t i=0; i<m_size; i++)
+    for (size_t i=0; i<m_nb_streams; i++)
     {
-      m_elements.push_back(element{});
-
       if (read_next(i))
         m_elements[i].is_set = true;
 
-      if ( (!m_current_set || m_elements[i].value < m_current) && m_elements[i].is_set )
-      {
-        m_current = m_next = m_elements[i].value;
-        m_current_set = true;
-      }
+      while (m_range.has_lower && m_elements[i].is_set && m_elements[i].value < m_range.lower)
+        m_elements[i].is_set = read_next(i);
     }
+    m_tree = LoserTree<element_less>(m_nb_streams, element_less{&m_elements});
     m_counts.resize(m_size, 0);
     m_infos = std::make_unique<MergeStatistics<MAX_C>>(m_size);
   }
@@ -429,7 +906,11 @@ public:
 #ifdef WITH_PLUGIN
   void set_plugin(IMergePlugin* plugin)
   {
+    static_assert(std::is_same<count_type, MergeBatch::count_type>::value,
+                  "plugins take counts of DMAX_C");
     m_plugin = plugin;
+    if (m_plugin->batch_size())
+      m_batch.init(m_plugin->batch_size(), m_size, 1, m_plugin->column_major());
   }
 #endif
 
@@ -439,22 +920,58 @@ public:
   }
 
   bool next()
+  {
+#ifdef WITH_PLUGIN
+    // mergers of other count types are never given a plugin
+    if constexpr (std::is_same<count_type, MergeBatch::count_type>::value)
+    {
+      if (m_batch.enabled())
+        return next_batched();
+      if (m_plugin)
+      {
+        // the plugin may have written any count of the previous row
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_touched.clear();
+        if (!merge_next())
+          return false;
+        m_keep = m_plugin->process_hash(m_current, m_counts);
+        return true;
+      }
+    }
+#endif
+    return merge_next();
+  }
+
+private:
+  bool merge_next()
   {
     m_keep = false;
-    m_finish = true;
-    m_next_set = false;
+
+    for (auto& i : m_touched)
+      m_counts[i] = 0;
+    m_touched.clear();
+    m_need_check.clear();
+
+    if (m_tree.empty())
+      return false;
+    uint32_t w = m_tree.top();
+    if (!m_elements[w].is_set)
+      return false;
 
     uint32_t recurrence = 0;
     uint32_t solid_in = 0;
-    m_need_check.clear();
-    m_current = m_next;
-    for (size_t i=0; i<m_size; i++)
+    m_current = m_elements[w].value;
+
+    while (m_elements[w].is_set && m_elements[w].value == m_current)
     {
-      if (m_elements[i].is_set && m_elements[i].value == m_current)
+      const element& e = m_elements[w];
+      for (uint32_t i=e.offset; i<e.offset+e.width; i++)
       {
-        m_finish = false;
-        m_counts[i] = m_elements[i].count;
-
+        // a null count in an intermediate matrix means absent from this sample
+        if (!m_raw[i])
+          continue;
+        m_touched.push_back(i);
+        m_counts[i] = m_raw[i];
         if (m_counts[i] >= m_a_min_vec[i])
         {
           recurrence++;
@@ -475,20 +992,14 @@ public:
           else
             m_counts[i] = 0;
         }
-        if (!read_next(i))
-          m_elements[i].is_set = false;
-      }
-      else
-      {
-        m_counts[i] = 0;
       }
+      if (!read_next(w))
+        m_elements[w].is_set = false;
 
-      if (m_elements[i].is_set && (!m_next_set || m_elements[i].value < m_next))
-      {
-        m_next = m_elements[i].value;
-        m_next_set = true;
-      }
+      m_tree.replay(w);
+      w = m_tree.top();
     }
+
     for (auto& f : m_need_check)
     {
       if (!(solid_in >= m_save_if))
@@ -503,19 +1014,35 @@ public:
         }
       }
     }
+
     if (recurrence >= m_r_min)
       m_keep = true;
 
+    return true;
+  }
+
 #ifdef WITH_PLUGIN
-    if (m_plugin)
+  bool next_batched()
+  {
+    if (m_batch.consumed())
     {
-      m_keep = m_plugin->process_hash(m_current, m_counts);
+      // m_counts was overwritten by the rows of the previous batch
+      std::fill(m_counts.begin(), m_counts.end(), 0);
+      m_touched.clear();
+
+      m_batch.clear();
+      while (!m_batch.full() && merge_next())
+        m_batch.push(&m_current, m_counts, m_keep);
+      if (m_batch.consumed())
+        return false;
+      m_plugin->process_hash_batch(m_batch.get());
     }
-#endif
-
-    return !m_finish;
+    m_current = *m_batch.pop(m_counts, m_keep);
+    return true;
   }
+#endif
 
+public:
   void write_as_bin(const std::string& path, bool compressed)
   {
     MatrixHashWriter<8192> mhw(path, sizeof(m_counts[0]), m_size, 0, m_partition, compressed);
@@ -528,6 +1055,18 @@ public:
     }
   }
 
+  void write_as_block(const std::string& path)
+  {
+    MatrixBlockWriter mbw(path, 0, sizeof(count_type), m_size, 0, m_partition);
+    while (next())
+    {
+      if (m_keep)
+      {
+        mbw.template write<MAX_C>(m_current, m_counts);
+      }
+    }
+  }
+
   void write_as_text(const std::string& path)
   {
     std::ofstream out(path, std::ios::out); check_fstream_good(path, out);
@@ -543,6 +1082,19 @@ public:
     }
   }
 
+  void write_as_sparse(const std::string& path, bool compressed, bool presence)
+  {
+    SparseMatrixWriter smw(path, 0, presence ? 0 : sizeof(count_type), m_size, 0,
+                           m_partition, compressed);
+    while (next())
+    {
+      if (m_keep)
+      {
+        smw.template write<MAX_C>(m_current, m_counts);
+      }
+    }
+  }
+
   void write_as_pa(const std::string& path, bool compressed)
   {
     PAHashMatrixWriter<8192> phw(path, m_size, 0, m_partition, compressed);
@@ -572,86 +1124,90 @@ public:
     }
   }
 
-  void write_as_bf(const std::string& path, uint64_t lower, uint64_t upper, bool compressed)
+  void write_as_bf(const std::string& path, uint64_t lower, uint64_t upper, bool compressed,
+                   bool rle = false)
   {
     std::vector<uint8_t> bit_vec(NBYTES(m_size), 0);
-    std::vector<uint8_t> empty_vec(NBYTES(m_size), 0);
-    uint64_t current = lower;
-    VectorMatrixWriter<8192> vmw(path, m_size, 0, m_partition, lower, upper-lower+1, compressed);
+    uint64_t current = m_range.has_lower ? std::max(lower, m_range.lower) : lower;
+    uint64_t last = m_range.has_upper ? std::min(upper, m_range.upper - 1) : upper;
+    VectorMatrixWriter<8192> vmw(path, m_size, 0, m_partition, lower, upper-lower+1, compressed, rle);
     while (next())
     {
-      while (m_current > current)
-      {
-        vmw.write(empty_vec);
-        current++;
-      }
       if (m_keep)
       {
+        vmw.write_empty(m_current - current);
         set_bit_vector(bit_vec, m_counts);
         vmw.write(bit_vec);
         current = m_current + 1;
       }
     }
-    while (current <= upper)
-    {
-      vmw.write(empty_vec);
-      current++;
-    }
+    if (current <= last)
+      vmw.write_empty(last - current + 1);
   }
 
-  void write_as_bfc(const std::string& path, uint64_t lower, uint64_t upper, int w, bool compressed)
+  void write_as_bfc(const std::string& path, uint64_t lower, uint64_t upper, int w, bool compressed,
+                    bool rle = false)
   {
     std::vector<uint8_t> cbit_vec(byte_count_pack(m_size, w), 0);
-    std::vector<uint8_t> empty_vec(byte_count_pack(m_size, w), 0);
-    uint64_t current = lower;
+    uint64_t current = m_range.has_lower ? std::max(lower, m_range.lower) : lower;
+    uint64_t last = m_range.has_upper ? std::min(upper, m_range.upper - 1) : upper;
 
-    VectorMatrixWriter<8192> vmw(path, m_size * w, 0, m_partition, lower, upper-lower+1, compressed);
+    VectorMatrixWriter<8192> vmw(path, m_size * w, 0, m_partition, lower, upper-lower+1, compressed, rle);
 
     while (next())
     {
-      while (m_current > current)
-      {
-        vmw.write(empty_vec);
-        current++;
-      }
       if (m_keep)
       {
+        vmw.write_empty(m_current - current);
         pack_v(m_counts, cbit_vec, w);
         vmw.write(cbit_vec);
         current = m_current + 1;
       }
     }
-    while (current <= upper)
-    {
-      vmw.write(empty_vec);
-      current++;
-    }
+    if (current <= last)
+      vmw.write_empty(last - current + 1);
   }
 
-  void write_as_bft(const std::string& path, uint64_t lower, uint64_t upper, bool compressed)
+  // Sample-major bit matrix, rows are transposed by bands while merging, see
+  // TransposedVectorMatrixWriter. Not available on sub-ranges.
+  void write_as_bft(const std::string& path, uint64_t lower, uint64_t upper, bool compressed,
+                    size_t nb_threads = 1)
   {
-    write_as_bf(path+".tmp", lower, upper, compressed);
-    BitMatrix mat(ROUND_UP(upper-lower+1, 8), ROUND_UP(m_size, 8)/8, true);
+    std::vector<uint8_t> bit_vec(NBYTES(m_size), 0);
+    uint64_t current = lower;
+    TransposedVectorMatrixWriter<8192> tvmw(path, m_size, 0, m_partition, lower, upper-lower+1,
+                                            compressed, nb_threads);
+    while (next())
     {
-      VectorMatrixReader vmr(path+".tmp");
-      vmr.load(mat);
+      if (m_keep)
+      {
+        tvmw.write_empty(m_current - current);
+        set_bit_vector(bit_vec, m_counts);
+        tvmw.write(bit_vec);
+        current = m_current + 1;
+      }
     }
-    std::remove(std::string(path+".tmp").c_str());
-    BitMatrix *trp = mat.transpose();
-    VectorMatrixWriter<8192> vmw(path, m_size, 0, m_partition, lower, upper-lower+1, compressed);
-    vmw.dump(*trp);
-    delete trp;
+    tvmw.close();
   }
 
 private:
-  bool read_next(size_t i)
+  static bool read_from(Reader& reader, uint64_t& hash, count_type& count)
   {
     if constexpr(std::is_same_v<Reader, HashReader<buf_size>>)
-      return m_input_streams[i]->template read<MAX_C>(m_elements[i].value,
-                                                      m_elements[i].count);
+      return reader.template read<MAX_C>(hash, count);
+    else
+      return reader.read(hash, count);
+  }
+
+  bool read_next(size_t i)
+  {
+    element& e = m_elements[i];
+    bool ret = false;
+    if (m_block_streams[i])
+      ret = m_block_streams[i]->template read<MAX_C>(e.value, &m_raw[e.offset], e.width);
     else
-      return m_input_streams[i]->read(m_elements[i].value,
-                                      m_elements[i].count);
+      ret = read_from(*m_input_streams[i], e.value, m_raw[e.offset]);
+    return ret && (!m_range.has_upper || e.value < m_range.upper);
   }
 
 private:
@@ -659,28 +1215,32 @@ private:
   uint32_t m_a_min;
   uint32_t m_r_min;
   uint32_t m_save_if;
-  uint32_t m_partition;
+  uint32_t m_partition {0};
+  MergeRange<uint64_t> m_range;
+  size_t m_read_ahead {0};
 
   std::vector<std::shared_ptr<Reader>> m_input_streams;
+  std::vector<mhr_t<8192>> m_block_streams;
   std::vector<element> m_elements;
+  std::vector<count_type> m_raw;
   std::vector<size_t> m_need_check;
+  std::vector<uint32_t> m_touched;
+  LoserTree<element_less> m_tree;
 
+  uint32_t m_nb_streams;
   uint32_t m_size;
   std::vector<uint32_t>& m_a_min_vec;
 
-  uint64_t m_next;
-  uint64_t m_current;
-  bool m_next_set {false};
-  bool m_current_set {false};
+  uint64_t m_current {0};
   std::vector<count_type> m_counts;
 
   bool m_keep {false};
-  bool m_finish {false};
 
   std::unique_ptr<MergeStatistics<MAX_C>> m_infos {nullptr};
 
 #ifdef WITH_PLUGIN
   IMergePlugin* m_plugin {nullptr};
+  PluginBatch m_batch;
 #endif
 };
 };
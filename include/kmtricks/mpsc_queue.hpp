@@ -0,0 +1,75 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <utility>
+
+namespace km {
+
+// Unbounded multi-producer single-consumer queue, a linked list where producers swap the
+// head and link the previous one (D. Vyukov). push never waits on other producers, pop is
+// called by a single thread and may miss a push which is not linked yet.
+template<typename T>
+class MPSCQueue
+{
+  struct Node
+  {
+    std::atomic<Node*> next {nullptr};
+    T value;
+  };
+
+public:
+  MPSCQueue() : m_head(new Node()), m_tail(m_head.load()) {}
+
+  ~MPSCQueue()
+  {
+    T value;
+    while (pop(value)) {}
+    delete m_tail;
+  }
+
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  void push(T value)
+  {
+    Node* node = new Node();
+    node->value = std::move(value);
+    Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  bool pop(T& value)
+  {
+    Node* tail = m_tail;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (!next)
+      return false;
+    value = std::move(next->value);
+    m_tail = next;
+    delete tail;
+    return true;
+  }
+
+private:
+  alignas(64) std::atomic<Node*> m_head;
+  alignas(64) Node* m_tail;
+};
+
+};
@@ -0,0 +1,157 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace km {
+
+// Canonical rolling hash of k-mers, after ntHash (Mohamadi et al., 2016). Nucleotides are
+// 2-bit encoded (A=0, C=1, T=2, G=3, complement is nt ^ 2) and k-mers are packed in 64-bit
+// words, the last nucleotide in the low bits, as gatb and km::Kmer do. The forward and
+// reverse-complement values are updated in constant time when the window moves by one
+// nucleotide, the canonical value is their sum, finalized so that its high bits can be
+// reduced to a window offset. Values only depend on the k-mer, so a k-mer hashed alone gives
+// the same value as when it is reached by rolling.
+class NtHash
+{
+  static constexpr uint64_t seeds[4] = {
+    0x3c8bfbb395c60474ULL, // A
+    0x3193c18562a02b4cULL, // C
+    0x295549f54be24456ULL, // T
+    0x20323ed082572324ULL  // G
+  };
+
+public:
+  NtHash(size_t kmer_size)
+    : m_kmer_size(kmer_size), m_pair_fw(16 * ((kmer_size + 1) / 2)), m_pair_rv(m_pair_fw.size())
+  {
+    for (uint8_t n = 0; n < 4; n++)
+    {
+      m_out_fw[n] = rol(seeds[n], kmer_size);
+      m_out_rv[n] = ror(seeds[n ^ 2], 1);
+      m_in_rv[n] = rol(seeds[n ^ 2], kmer_size - 1);
+    }
+
+    // terms of the nucleotides j and j + 1 from the end, by the 4 bits holding them
+    for (size_t j = 0; j < kmer_size; j += 2)
+    {
+      for (uint8_t v = 0; v < 16; v++)
+      {
+        uint64_t fw = fw_term(v & 3, j), rv = rv_term(v & 3, j, kmer_size);
+        if (j + 1 < kmer_size)
+        {
+          fw ^= fw_term(v >> 2, j + 1);
+          rv ^= rv_term(v >> 2, j + 1, kmer_size);
+        }
+        m_pair_fw[8 * j + v] = fw;
+        m_pair_rv[8 * j + v] = rv;
+      }
+    }
+  }
+
+  // Starts from the k-mer packed in words.
+  void init(const uint64_t* words)
+  {
+    const uint64_t* pair_fw = m_pair_fw.data();
+    const uint64_t* pair_rv = m_pair_rv.data();
+    uint64_t fw = 0, rv = 0;
+    for (size_t j = 0; j < m_kmer_size; j += 2)
+    {
+      uint8_t v = (words[j >> 5] >> (2 * (j & 31))) & 15;
+      fw ^= pair_fw[8 * j + v];
+      rv ^= pair_rv[8 * j + v];
+    }
+    m_fw = fw; m_rv = rv;
+  }
+
+  // Drops the first nucleotide out and appends in.
+  void roll(uint8_t out, uint8_t in)
+  {
+    m_fw = rol(m_fw, 1) ^ m_out_fw[out] ^ seeds[in];
+    m_rv = ror(m_rv, 1) ^ m_out_rv[out] ^ m_in_rv[in];
+  }
+
+  uint64_t value(uint64_t seed = 0) const
+  {
+    return finalize((m_fw + m_rv) ^ seed);
+  }
+
+  // Same value as init(words) then value(seed), without tables.
+  static uint64_t hash(size_t kmer_size, const uint64_t* words, uint64_t seed = 0)
+  {
+    uint64_t fw = 0, rv = 0;
+    for (size_t j = 0; j < kmer_size; j++)
+    {
+      uint8_t n = (words[j >> 5] >> (2 * (j & 31))) & 3;
+      fw ^= fw_term(n, j);
+      rv ^= rv_term(n, j, kmer_size);
+    }
+    return finalize((fw + rv) ^ seed);
+  }
+
+  // Maps a hash to [0, w) by multiplication instead of division.
+  static uint64_t reduce(uint64_t h, uint64_t w)
+  {
+    return static_cast<uint64_t>((static_cast<__uint128_t>(h) * w) >> 64);
+  }
+
+private:
+  // j is the position from the end of the k-mer
+  static uint64_t fw_term(uint8_t n, size_t j)
+  {
+    return rol(seeds[n], j);
+  }
+
+  static uint64_t rv_term(uint8_t n, size_t j, size_t kmer_size)
+  {
+    return rol(seeds[n ^ 2], kmer_size - 1 - j);
+  }
+
+  static uint64_t rol(uint64_t x, size_t r)
+  {
+    r &= 63;
+    return r ? (x << r) | (x >> (64 - r)) : x;
+  }
+
+  static uint64_t ror(uint64_t x, size_t r)
+  {
+    r &= 63;
+    return r ? (x >> r) | (x << (64 - r)) : x;
+  }
+
+  // the high bits are the well mixed ones, which reduce() keeps
+  static uint64_t finalize(uint64_t x)
+  {
+    return x * 0x9e3779b97f4a7c15ULL;
+  }
+
+private:
+  size_t m_kmer_size;
+  uint64_t m_fw {0};
+  uint64_t m_rv {0};
+  uint64_t m_out_fw[4];
+  uint64_t m_out_rv[4];
+  uint64_t m_in_rv[4];
+  std::vector<uint64_t> m_pair_fw;
+  std::vector<uint64_t> m_pair_rv;
+};
+
+};
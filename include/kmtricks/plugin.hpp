@@ -9,9 +9,53 @@
 
 namespace km {
 
+// A block of merged rows, in key order, given to IMergePlugin::process_kmer_batch and
+// IMergePlugin::process_hash_batch.
+// - keys: kmer_words uint64_t per row for k-mers (see Kmer::get_data64), one hash per row otherwise.
+// - counts: row-major (counts[i * nb_samples + s]) or, if the plugin asks for it with
+//   column_major(), column-major (counts[s * capacity + i]). Counts can be modified.
+// - keep: one bit per row, set when the row passes the merge thresholds.
+struct MergeBatch
+{
+  using count_type = typename selectC<DMAX_C>::type;
+
+  size_t size {0};
+  size_t capacity {0};
+  size_t nb_samples {0};
+  size_t key_words {1};
+  bool column_major {false};
+  const uint64_t* keys {nullptr};
+  count_type* counts {nullptr};
+  uint64_t* keep {nullptr};
+
+  const uint64_t* key(size_t i) const { return keys + i * key_words; }
+
+  count_type& count(size_t i, size_t s)
+  {
+    return column_major ? counts[s * capacity + i] : counts[i * nb_samples + s];
+  }
+
+  // Counts of sample s, only contiguous in column-major batches.
+  count_type* column(size_t s) { return counts + s * capacity; }
+
+  bool kept(size_t i) const { return (keep[i / 64] >> (i % 64)) & 1; }
+
+  void set_keep(size_t i, bool value)
+  {
+    if (value)
+      keep[i / 64] |= uint64_t{1} << (i % 64);
+    else
+      keep[i / 64] &= ~(uint64_t{1} << (i % 64));
+  }
+};
+
 class IMergePlugin
 {
 public:
+  // Version of this interface, plugins export it with plugin_api_version(). Bumped when
+  // the virtual methods or the members change.
+  static constexpr int api_version = 2;
+
   IMergePlugin() = default;
   virtual ~IMergePlugin() {}
   virtual void set_out_dir(const std::string& s) final { m_output_directory = s; }
@@ -23,10 +67,49 @@ public:
   virtual bool process_kmer(const uint64_t* kmer_data, std::vector<typename selectC<DMAX_C>::type>& count_vector) { return true; }
   virtual bool process_hash(uint64_t h, std::vector<typename selectC<DMAX_C>::type>& count_vector) { return true; }
 
+  // Added in version 2, after the methods of version 1 so that their slots do not move.
+  virtual void set_split(size_t s) final { m_split = s; }
+
+  // Batched interface: when batch_size() > 0, rows are given by blocks of at most batch_size()
+  // rows to process_*_batch instead of process_kmer/process_hash.
+  virtual size_t batch_size() const { return 0; }
+  virtual bool column_major() const { return false; }
+
+  virtual void process_kmer_batch(MergeBatch& batch)
+  {
+    std::vector<typename selectC<DMAX_C>::type> count_vector(batch.nb_samples);
+    for (size_t i=0; i<batch.size; i++)
+      process_row(batch, i, count_vector, [&]{ return process_kmer(batch.key(i), count_vector); });
+  }
+
+  virtual void process_hash_batch(MergeBatch& batch)
+  {
+    std::vector<typename selectC<DMAX_C>::type> count_vector(batch.nb_samples);
+    for (size_t i=0; i<batch.size; i++)
+      process_row(batch, i, count_vector, [&]{ return process_hash(*batch.key(i), count_vector); });
+  }
+
+  // Return true if several instances can run at the same time on sub-ranges of a partition.
+  // Each merge thread then gets its own instance, set_split gives the sub-range index.
+  virtual bool concurrent() const { return false; }
+
+private:
+  template<typename Fn>
+  void process_row(MergeBatch& batch, size_t i,
+                   std::vector<typename selectC<DMAX_C>::type>& count_vector, Fn&& fn)
+  {
+    for (size_t s=0; s<batch.nb_samples; s++)
+      count_vector[s] = batch.count(i, s);
+    batch.set_keep(i, fn());
+    for (size_t s=0; s<batch.nb_samples; s++)
+      batch.count(i, s) = count_vector[s];
+  }
+
 protected:
   std::string m_output_directory;
   size_t m_kmer_size;
   size_t m_partition;
+  size_t m_split {0};
 };
 
 }
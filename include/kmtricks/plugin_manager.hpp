@@ -34,6 +34,12 @@ public:
     return m_enable;
   }
 
+  // True if the plugin supports one instance per merge thread.
+  bool concurrent() const
+  {
+    return m_concurrent;
+  }
+
 private:
   void load()
   {
@@ -44,6 +50,8 @@ private:
       throw PluginError(fmt::format("Unable to load shared lib. dlerror: {}", dlerror()));
     }
 
+    load_api_version();
+
     int (*use_template)();
     use_template = reinterpret_cast<int(*)()>(dlsym(m_handle, "use_template"));
     const char* dlsym_error = dlerror();
@@ -58,10 +66,28 @@ private:
 
     load_name();
 
+    P* p = get_plugin();
+    m_concurrent = p->concurrent();
+    destroy_plugin(p);
+
     spdlog::info("Plugin '{}' loaded.", m_plugin_name);
     m_enable = true;
   }
 
+  // Plugins built against another layout of P are refused rather than called through
+  // a wrong vtable.
+  void load_api_version()
+  {
+    dlerror();
+    int (*api_version)();
+    api_version = reinterpret_cast<int(*)()>(dlsym(m_handle, "plugin_api_version"));
+    int version = dlerror() ? 1 : api_version();
+    if (version != P::api_version)
+      throw PluginError(fmt::format(
+        "{} uses plugin API version {}, this kmtricks uses version {}. Rebuild the plugin.",
+        m_lib_path, version, P::api_version));
+  }
+
   void load_create(size_t max_size)
   {
     m_load_plugin = reinterpret_cast<P*(*)()>(dlsym(m_handle, fmt::format("create{}", max_size).c_str()));
@@ -117,6 +143,7 @@ public:
 
 private:
     bool m_enable {false};
+    bool m_concurrent {false};
     size_t m_max_size;
     std::string m_config;
     std::string m_lib_path;
@@ -0,0 +1,154 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+namespace km {
+
+// Below this size, std::sort beats the histogram and scatter passes.
+constexpr size_t radix_sort_threshold = 1024;
+
+// Above this key width, std::sort beats one pass per byte.
+constexpr size_t radix_sort_max_bytes = 16;
+
+// LSD radix sort on the key_bytes low-order bytes of little-endian integer types (uint64_t,
+// GATB LargeInt). Passes on bytes shared by all values are skipped. buffer holds at least
+// size values, the result ends up in data.
+template<typename T>
+void lsd_radix_sort(T* data, size_t size, T* buffer, size_t key_bytes = sizeof(T))
+{
+  if (size < radix_sort_threshold)
+  {
+    std::sort(data, data + size);
+    return;
+  }
+
+  key_bytes = std::min(key_bytes, sizeof(T));
+  std::vector<std::array<uint64_t, 256>> hist(key_bytes);
+  for (size_t i=0; i<size; i++)
+  {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(data + i);
+    for (size_t j=0; j<key_bytes; j++)
+      hist[j][b[j]]++;
+  }
+
+  T* src = data;
+  T* dst = buffer;
+  for (size_t j=0; j<key_bytes; j++)
+  {
+    auto& h = hist[j];
+    if (h[reinterpret_cast<const uint8_t*>(src)[j]] == size)
+      continue;
+
+    uint64_t sum = 0;
+    for (auto& c : h)
+    {
+      uint64_t n = c; c = sum; sum += n;
+    }
+    for (size_t i=0; i<size; i++)
+      dst[h[reinterpret_cast<const uint8_t*>(src + i)[j]]++] = src[i];
+    std::swap(src, dst);
+  }
+
+  if (src != data)
+    std::memcpy(data, src, size * sizeof(T));
+}
+
+// Runs fn(0, 1) on this thread only.
+struct SerialRun
+{
+  template<typename Fn>
+  void operator()(Fn&& fn) const { fn(0, 1); }
+};
+
+// Sorts hashes with lsd_radix_sort, on the bytes where min and max differ. Large arrays are
+// first spread over 256 buckets of their range by an in-place pass, so that buffer only needs
+// to hold a bucket. Buckets larger than buffer_size are sorted with std::sort. With nb_threads,
+// buckets are sorted concurrently and each thread uses its share of the buffer: run(fn) calls
+// fn(t, n) for the n threads t it has, e.g. on leased pool workers.
+template<typename Run = SerialRun>
+inline void radix_sort_hashes(uint64_t* data, size_t size, uint64_t* buffer, size_t buffer_size,
+                              Run&& run = Run())
+{
+  if (size < radix_sort_threshold || buffer_size < radix_sort_threshold)
+  {
+    std::sort(data, data + size);
+    return;
+  }
+
+  auto [min, max] = std::minmax_element(data, data + size);
+  uint64_t lower = *min;
+  uint64_t diff = *min ^ *max;
+  if (!diff)
+    return;
+
+  size_t key_bytes = (71 - __builtin_clzll(diff)) / 8;
+  if (size <= buffer_size && size < 256 * radix_sort_threshold)
+  {
+    lsd_radix_sort(data, size, buffer, key_bytes);
+    return;
+  }
+
+  int bits = 64 - __builtin_clzll(*max - lower);
+  int shift = bits > 8 ? bits - 8 : 0;
+
+  std::array<uint64_t, 257> start {};
+  for (size_t i=0; i<size; i++)
+    start[((data[i] - lower) >> shift) + 1]++;
+  for (size_t b=1; b<257; b++)
+    start[b] += start[b-1];
+
+  std::array<uint64_t, 256> next;
+  std::copy(start.begin(), start.end() - 1, next.begin());
+  for (size_t b=0; b<256; b++)
+  {
+    while (next[b] < start[b+1])
+    {
+      uint64_t v = data[next[b]];
+      size_t d = (v - lower) >> shift;
+      while (d != b)
+      {
+        std::swap(v, data[next[d]++]);
+        d = (v - lower) >> shift;
+      }
+      data[next[b]++] = v;
+    }
+  }
+
+  // threads pick buckets one by one, each with its share of the buffer
+  std::atomic<size_t> bucket {0};
+  run([&](size_t t, size_t nb_threads) {
+    size_t share = buffer_size / nb_threads;
+    for (size_t b = bucket++; b < 256; b = bucket++)
+    {
+      size_t n = start[b+1] - start[b];
+      if (n <= share)
+        lsd_radix_sort(data + start[b], n, buffer + t * share, key_bytes);
+      else
+        std::sort(data + start[b], data + start[b+1]);
+    }
+  });
+}
+
+};
@@ -0,0 +1,150 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include <kmtricks/count_table.hpp>
+
+namespace km {
+
+// Sketch of 2-bit counters saturating at 2, over memory owned by the caller. A key has three
+// counters in a block of one cache line, they are only incremented when equal to their
+// minimum (conservative update), so the minimum is never below min(count, 2). Keys seen at
+// least twice are always reported as repeated, a few keys seen once are too.
+class SingletonFilter
+{
+  static constexpr size_t block_words = 8;
+
+public:
+  static constexpr size_t block_bytes = block_words * sizeof(uint64_t);
+
+  SingletonFilter() = default;
+
+  // memory is aligned on block_bytes.
+  SingletonFilter(void* memory, size_t bytes)
+    : m_words(static_cast<uint64_t*>(memory)), m_nb_blocks(bytes / block_bytes)
+  {
+    std::memset(m_words, 0, m_nb_blocks * block_bytes);
+  }
+
+  operator bool() const { return m_nb_blocks; }
+
+  // Keys are given by their hash, probes can then be prefetched ahead.
+  template<typename K>
+  static uint64_t hash(const K& key)
+  {
+    return mix_key(key);
+  }
+
+  void prefetch(uint64_t h) const
+  {
+    __builtin_prefetch(block(h));
+  }
+
+  void add(uint64_t h)
+  {
+    uint64_t* b = block(h);
+    size_t pos[3];
+    positions(h, pos);
+    uint64_t c[3];
+    for (size_t i = 0; i < 3; i++)
+      c[i] = get(b, pos[i]);
+    uint64_t m = std::min({c[0], c[1], c[2]});
+    if (m == 2)
+      return;
+    // set rather than incremented, positions may repeat
+    for (size_t i = 0; i < 3; i++)
+      if (c[i] == m)
+        set(b, pos[i], m + 1);
+  }
+
+  bool repeated(uint64_t h) const
+  {
+    const uint64_t* b = block(h);
+    size_t pos[3];
+    positions(h, pos);
+    return get(b, pos[0]) == 2 && get(b, pos[1]) == 2 && get(b, pos[2]) == 2;
+  }
+
+private:
+  uint64_t* block(uint64_t h) const
+  {
+    return m_words + block_words * static_cast<uint64_t>((static_cast<__uint128_t>(h) * m_nb_blocks) >> 64);
+  }
+
+  // from other bits than those of the block
+  static void positions(uint64_t h, size_t* pos)
+  {
+    uint64_t g = (h ^ (h >> 32)) * 0xff51afd7ed558ccdULL;
+    pos[0] = g >> 56;
+    pos[1] = (g >> 48) & 255;
+    pos[2] = (g >> 40) & 255;
+  }
+
+  static uint64_t get(const uint64_t* block, size_t pos)
+  {
+    return (block[pos >> 5] >> (2 * (pos & 31))) & 3;
+  }
+
+  static void set(uint64_t* block, size_t pos, uint64_t value)
+  {
+    size_t shift = 2 * (pos & 31);
+    block[pos >> 5] = (block[pos >> 5] & ~(uint64_t{3} << shift)) | (value << shift);
+  }
+
+private:
+  uint64_t* m_words {nullptr};
+  size_t m_nb_blocks {0};
+};
+
+// Keys seen and dropped by the singleton filters of a run.
+class SingletonStats
+{
+public:
+  static SingletonStats& get()
+  {
+    static SingletonStats singleton;
+    return singleton;
+  }
+
+  void add(uint64_t seen, uint64_t removed)
+  {
+    m_seen += seen;
+    m_removed += removed;
+  }
+
+  void report() const
+  {
+    if (m_seen)
+      spdlog::info("Singleton filter removed {} of {} k-mers ({:.2f}%).",
+                   m_removed.load(), m_seen.load(), 100.0 * m_removed / m_seen);
+  }
+
+private:
+  SingletonStats() = default;
+
+  std::atomic<uint64_t> m_seen {0};
+  std::atomic<uint64_t> m_removed {0};
+};
+
+};
@@ -31,6 +31,7 @@
 #include <kmtricks/kmdir.hpp>
 #include <kmtricks/gatb/count_processor.hpp>
 #include <kmtricks/gatb/sorting_count.hpp>
+#include <kmtricks/arena.hpp>
 #include <kmtricks/gatb/fill_partitions.hpp>
 #include <kmtricks/merge.hpp>
 #include <kmtricks/hash.hpp>
@@ -87,10 +88,11 @@ class ConfigTask : public ITask
 public:
   ConfigTask(const std::string& path, IProperties* props, uint64_t bloom_size,
              uint32_t partitions, const std::string& bam_exclude_refs = "",
-             uint32_t bam_include_flags = 0, uint32_t bam_exclude_flags = 0)
+             uint32_t bam_include_flags = 0, uint32_t bam_exclude_flags = 0,
+             HASHER hasher = HASHER::XXHASH)
     : ITask(0), m_path(path), m_props(props), m_bloom_size(bloom_size), m_nb_partitions(partitions),
       m_bam_exclude_refs(bam_exclude_refs), m_bam_include_flags(bam_include_flags),
-      m_bam_exclude_flags(bam_exclude_flags)
+      m_bam_exclude_flags(bam_exclude_flags), m_hasher(hasher)
   {}
 
   void preprocess() {}
@@ -117,7 +119,7 @@ public:
     spdlog::info("Use {} partitions.", config._nb_partitions);
 
     config.save(config_storage->getGroup("gatb"));
-    HashWindow hw(m_bloom_size, config._nb_partitions, config._minim_size);
+    HashWindow hw(m_bloom_size, config._nb_partitions, config._minim_size, m_hasher);
     hw.serialize(KmDir::get().m_hash_win);
 
     spdlog::debug("[done] - ConfigTask");
@@ -131,6 +133,7 @@ private:
   std::string m_bam_exclude_refs;
   uint32_t m_bam_include_flags;
   uint32_t m_bam_exclude_flags;
+  HASHER m_hasher;
 };
 
 void check_repart_compatibility(Configuration& c1, Configuration& c2,
@@ -240,8 +243,12 @@ template<size_t span>
 class SuperKTask : public ITask
 {
 public:
-  SuperKTask(const std::string& sample_id, bool lz4, std::vector<uint32_t>& partitions)
-    : ITask(2), m_sample_id(sample_id), m_lz4(lz4), m_partitions(partitions) {}
+  SuperKTask(const std::string& sample_id, bool lz4, std::vector<uint32_t>& partitions,
+             size_t nb_threads = 1, bool container = false, bool in_memory = false,
+             size_t dedup = 0)
+    : ITask(2), m_sample_id(sample_id), m_lz4(lz4), m_partitions(partitions),
+      m_nb_threads(std::max<size_t>(nb_threads, 1)), m_container(container),
+      m_in_memory(in_memory), m_dedup(dedup) {}
 
   void preprocess() {}
 
@@ -257,7 +264,6 @@ public:
     spdlog::debug("[exec] - SuperKTask - S={}", m_sample_id);
     this->m_running = true;
 
-    IBank* bank = Bank::open(KmDir::get().m_fof.get_files(m_sample_id)); LOCAL(bank);
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
     Storage* repart_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_repart_storage);
     LOCAL(config_storage); LOCAL(repart_storage);
@@ -273,7 +279,8 @@ public:
       pset.insert(p);
     }
     SuperKStorageWriter* superk_storage = new SuperKStorageWriter(
-      KmDir::get().get_superk_path(m_sample_id), "skp", config._nb_partitions, m_lz4, pset);
+      KmDir::get().get_superk_path(m_sample_id), "skp", config._nb_partitions, m_lz4, pset,
+      m_container, m_in_memory, m_dedup);
 
     typedef typename ::Kmer<span>::ModelCanonical ModelCanonical;
     typedef typename ::Kmer<span>::template ModelMinimizer <ModelCanonical> Model;
@@ -282,7 +289,7 @@ public:
     Model model(config._kmerSize, config._minim_size,
                 typename ::Kmer<span>::ComparatorMinimizerFrequencyOrLex(), freq_order);
 
-    Iterator<Sequence>* itSeq = bank->iterator(); LOCAL(itSeq);
+    SampleSequences sequences(KmDir::get().m_fof.get_paths(m_sample_id));
     BankStats bank_stats;
     PartiInfo<5> pinfo (config._nb_partitions, config._minim_size);
 
@@ -292,26 +299,40 @@ public:
     LOCAL(progress);
     progress->init();
     {
-      auto fill_partitions = KmFillPartitions<span>(model,
-                                                        1,
-                                                        0,
-                                                        config._nb_partitions,
-                                                        config._nb_cached_items_per_core_per_part,
-                                                        progress,
-                                                        bank_stats,
-                                                        nullptr,
-                                                        repartitor,
-                                                        pinfo,
-                                                        superk_storage);
-
-      for (itSeq->first(); !itSeq->isDone(); itSeq->next())
-      {
-        fill_partitions(itSeq->item());
-      }
-      itSeq->finalize();
+      // one filler per thread, with its own partition infos and blocks
+      std::mutex mutex;
+      auto fill = [&](size_t t) {
+        auto fill_partitions = std::make_unique<KmFillPartitions<span>>(model,
+                                                                        1,
+                                                                        0,
+                                                                        config._nb_partitions,
+                                                                        config._nb_cached_items_per_core_per_part,
+                                                                        progress,
+                                                                        bank_stats,
+                                                                        nullptr,
+                                                                        repartitor,
+                                                                        pinfo,
+                                                                        superk_storage);
+        std::vector<Sequence> seqs;
+        size_t cursor = t % sequences.size();
+        while (sequences.next(seqs, cursor))
+          for (auto& seq : seqs)
+            (*fill_partitions)(seq);
+
+        // bank stats are merged without lock on destruction
+        std::lock_guard<std::mutex> lock(mutex);
+        fill_partitions.reset();
+      };
+
+      // fillers run on the idle workers of the pool, blocks shrink as they are more. The
+      // writer thread of the storage is one of the threads of the task.
+      IdleWorkers::Lease lease(m_nb_threads > 2 ? m_nb_threads - 2 : 0);
+      superk_storage->setNbBuffers(lease.size() + 1);
+      lease.run([&](size_t t, size_t) { fill(t); });
     }
 
     progress->finish();
+    superk_storage->closeFiles();
     superk_storage->SaveInfoFile(KmDir::get().get_superk_path(m_sample_id));
     delete superk_storage;
     pinfo.saveInfoFile(KmDir::get().get_superk_path(m_sample_id));
@@ -323,8 +344,75 @@ private:
   std::string m_sample_id;
   bool m_lz4;
   std::vector<uint32_t>& m_partitions;
+  size_t m_nb_threads;
+  bool m_container;
+  bool m_in_memory;
+  size_t m_dedup;
+};
+
+// How a partition is counted: sorted in memory, sorted by runs spilled to disk when it
+// exceeds the memory budget, or in a table when it has few distinct keys for its size.
+// Singletons can be dropped beforehand, with a filter of filter bytes.
+struct CountPlan
+{
+  uint64_t memory {0};
+  uint64_t filter {0};
+  bool spill {false};
+  bool table {false};
+
+  template<typename Counter>
+  void apply(Counter& counter, const std::string& prefix) const
+  {
+    if (filter)
+      counter.drop_singletons(filter);
+    if (table)
+      counter.count_in_table(prefix);
+    else if (spill)
+      counter.spill_to(prefix);
+  }
 };
 
+// Large partitions are counted in a table of keys K when their estimated number of distinct
+// k-mers gives a table of less than half the memory of the sort, req_mem. Partitions with
+// multiplicity records are always counted in a table, which adds their counts instead of
+// expanding them. The singleton filter has four counters per k-mer, up to a quarter of the
+// budget, on top of the memory of the count. Filtered keys are not kx-mers and are sorted by
+// runs, which only hold half the keys of the pool: without a budget, singletons are left to
+// the processor and the partition keeps the kx-mer sort.
+template<size_t span, typename K, typename Storage>
+CountPlan plan_count(Storage* superk_storage, uint32_t part, size_t kmer_size, uint64_t nb_kmers,
+                     uint64_t req_mem, uint64_t budget, bool drop_singletons = false)
+{
+  CountPlan plan;
+  if (drop_singletons && nb_kmers && budget)
+  {
+    plan.filter = std::min<uint64_t>(nb_kmers, budget / 4);
+    budget -= plan.filter;
+  }
+
+  bool multiplicity = false;
+  if constexpr(std::is_same_v<Storage, SuperKStorageReader>)
+    multiplicity = superk_storage->hasMultiplicity(part);
+
+  if (nb_kmers >= (1 << 20) || multiplicity)
+  {
+    uint64_t distinct = nb_kmers >= (1 << 20)
+      ? estimate_distinct<Storage, span>(superk_storage, part, kmer_size, nb_kmers)
+      : nb_kmers;
+    uint64_t table_mem = CountTable<K>::memory(distinct + distinct / 4);
+    if (table_mem < req_mem / 2 || multiplicity)
+    {
+      spdlog::debug("[table] - P={}, ~{} distinct k-mers of {}", part, distinct, nb_kmers);
+      plan.table = true;
+      plan.memory = (budget ? std::min(table_mem, budget) : table_mem) + plan.filter;
+      return plan;
+    }
+  }
+  plan.spill = (budget && req_mem > budget) || plan.filter;
+  plan.memory = (budget ? std::min(req_mem, budget) : req_mem) + plan.filter;
+  return plan;
+}
+
 template<size_t span, size_t MAX_C, typename Storage>
 class CountTask : public ITask
 {
@@ -336,7 +424,8 @@ public:
             parti_info_t pinfo,
             uint32_t part_id, uint32_t sample_id,
             uint32_t kmer_size, uint32_t abundance_min, bool lz4,
-            hist_t hist = nullptr, bool clear = false)
+            hist_t hist = nullptr, bool clear = false,
+            uint64_t memory = 0, bool drop_singletons = false)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -347,7 +436,9 @@ public:
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
       m_lz4(lz4),
-      m_hist(hist)
+      m_hist(hist),
+      m_memory(memory),
+      m_drop_singletons(drop_singletons)
    {
    }
 
@@ -356,9 +447,7 @@ public:
   {
     if (this->m_clear)
     {
-      m_superk_storage->closeFile(m_part_id);
-      //m_superk_storage->eraseFile(m_part_id);
-      Eraser::get().erase(m_superk_storage->getFileName(m_part_id));
+      m_superk_storage->releaseFile(m_part_id);
     }
     this->m_finish = true;
     this->exec_callback();
@@ -368,8 +457,13 @@ public:
   {
     spdlog::debug("[exec] - CountTask - S={}, P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
 
-    MemAllocator pool(1);
-    pool.reserve(get_required_memory<span>(m_pinfo->getNbKmer(m_part_id)));
+    uint64_t nbk = m_pinfo->getNbKmer(m_part_id);
+    CountPlan plan = plan_count<span, typename ::Kmer<span>::Type>(
+      m_superk_storage.get(), m_part_id, m_kmer_size, nbk, get_required_memory<span>(nbk), m_memory,
+      m_drop_singletons && m_ab_min >= 2 && !m_hist);
+
+    CountArena& pool = CountArena::local();
+    pool.reserve(plan.memory);
     kw_t<8192> writer = std::make_shared<KmerWriter<8192>>(m_path,
                                                            m_kmer_size,
                                                            requiredC<MAX_C>::value/8,
@@ -384,6 +478,7 @@ public:
 
     KmerPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id,
                                                      m_kmer_size, pool, m_superk_storage.get());
+    plan.apply(partition_counter, m_path);
 
     partition_counter.execute();
     pool.free_all();
@@ -403,6 +498,8 @@ private:
   uint32_t m_ab_min;
   bool m_lz4;
   hist_t m_hist;
+  uint64_t m_memory;
+  bool m_drop_singletons;
 };
 
 template<size_t span, size_t MAX_C, typename Storage>
@@ -416,7 +513,9 @@ public:
                 parti_info_t pinfo,
                 uint32_t part_id, uint32_t sample_id, uint64_t window,
                 uint32_t kmer_size, uint32_t abundance_min, bool lz4,
-                hist_t hist = nullptr, bool clear = false)
+                hist_t hist = nullptr, bool clear = false,
+                uint64_t memory = 0, HASHER hasher = HASHER::XXHASH,
+                bool drop_singletons = false)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -428,7 +527,10 @@ public:
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
       m_lz4(lz4),
-      m_hist(hist)
+      m_hist(hist),
+      m_memory(memory),
+      m_hasher(hasher),
+      m_drop_singletons(drop_singletons)
    {
    }
 
@@ -437,8 +539,7 @@ public:
   {
     if (this->m_clear)
     {
-      m_superk_storage->closeFile(m_part_id);
-      Eraser::get().erase(m_superk_storage->getFileName(m_part_id));
+      m_superk_storage->releaseFile(m_part_id);
     }
     this->m_finish = true;
     this->exec_callback();
@@ -450,8 +551,6 @@ public:
 
     size_t nbk = m_pinfo->getNbKmer(m_part_id);
 
-    uint64_t req_mem = get_required_memory_hash<span>(nbk);
-
     hw_t<MAX_C, 32768> writer = std::make_shared<HashWriter<MAX_C, 32768>>(m_path,
                                                                              requiredC<MAX_C>::value/8,
                                                                              m_sample_id,
@@ -465,11 +564,15 @@ public:
 
     if (nbk > 0)
     {
-      MemAllocator pool(1);
-      pool.reserve(req_mem);
+      CountPlan plan = plan_count<span, uint64_t>(
+        m_superk_storage.get(), m_part_id, m_kmer_size, nbk, get_required_memory_hash<span>(nbk), m_memory,
+        m_drop_singletons && m_ab_min >= 2 && !m_hist);
+      CountArena& pool = CountArena::local();
+      pool.reserve(plan.memory);
 
       HashPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
-                                                       pool, m_superk_storage.get(), m_window);
+                                                       pool, m_superk_storage.get(), m_window, m_hasher);
+      plan.apply(partition_counter, m_path);
 
       partition_counter.execute();
       pool.free_all();
@@ -492,6 +595,9 @@ private:
   uint32_t m_ab_min;
   hist_t m_hist;
   bool m_lz4;
+  uint64_t m_memory;
+  HASHER m_hasher;
+  bool m_drop_singletons;
 };
 
 template<size_t span, size_t MAX_C, typename Storage>
@@ -505,7 +611,9 @@ public:
                 parti_info_t pinfo,
                 uint32_t part_id, uint32_t sample_id, uint64_t window,
                 uint32_t kmer_size, uint32_t abundance_min, bool lz4,
-                hist_t hist = nullptr, bool clear = false)
+                hist_t hist = nullptr, bool clear = false,
+                uint64_t memory = 0, HASHER hasher = HASHER::XXHASH,
+                bool drop_singletons = false)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -517,7 +625,10 @@ public:
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
       m_lz4(lz4),
-      m_hist(hist)
+      m_hist(hist),
+      m_memory(memory),
+      m_hasher(hasher),
+      m_drop_singletons(drop_singletons)
    {
    }
 
@@ -526,9 +637,7 @@ public:
   {
     if (this->m_clear)
     {
-      m_superk_storage->closeFile(m_part_id);
-      //m_superk_storage->eraseFile(m_part_id);
-      Eraser::get().erase(m_superk_storage->getFileName(m_part_id));
+      m_superk_storage->releaseFile(m_part_id);
     }
     this->m_finish = true;
     this->exec_callback();
@@ -552,13 +661,29 @@ public:
                                                                  m_hist,
                                                                  m_window));
 
-    if (nbk > 0)
+    uint64_t bit_memory = HashBitCounter<Storage, span>::required_memory(m_window, m_ab_min);
+    if (nbk > 0 && m_ab_min <= 2 && !m_hist && (!m_memory || bit_memory <= m_memory))
+    {
+      // presence only, bits are set while decoding
+      CountArena& pool = CountArena::local();
+      pool.reserve(bit_memory);
+      HashBitCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
+                                                      pool, m_superk_storage.get(), m_window, m_ab_min,
+                                                      m_hasher);
+      partition_counter.execute();
+      pool.free_all();
+    }
+    else if (nbk > 0)
     {
-      MemAllocator pool(1);
-      pool.reserve(get_required_memory_hash<span>(nbk));
+      CountPlan plan = plan_count<span, uint64_t>(
+        m_superk_storage.get(), m_part_id, m_kmer_size, nbk, get_required_memory_hash<span>(nbk), m_memory,
+        m_drop_singletons && m_ab_min >= 2 && !m_hist);
+      CountArena& pool = CountArena::local();
+      pool.reserve(plan.memory);
 
       HashPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
-                                            pool, m_superk_storage.get(), m_window);
+                                            pool, m_superk_storage.get(), m_window, m_hasher);
+      plan.apply(partition_counter, m_path);
 
       partition_counter.execute();
       pool.free_all();
@@ -581,6 +706,9 @@ private:
   uint32_t m_ab_min;
   bool m_lz4;
   hist_t m_hist;
+  uint64_t m_memory;
+  HASHER m_hasher;
+  bool m_drop_singletons;
 };
 
 template<size_t span, size_t MAX_C, typename Storage>
@@ -594,7 +722,8 @@ public:
             parti_info_t pinfo,
             uint32_t part_id, uint32_t sample_id,
             uint32_t kmer_size, uint32_t abundance_min,
-            hist_t hist = nullptr, bool clear = false)
+            hist_t hist = nullptr, bool clear = false,
+            uint64_t memory = 0, bool drop_singletons = false)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -604,7 +733,9 @@ public:
       m_sample_id(sample_id),
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
-      m_hist(hist)
+      m_hist(hist),
+      m_memory(memory),
+      m_drop_singletons(drop_singletons)
    {
    }
 
@@ -613,9 +744,7 @@ public:
   {
     if (this->m_clear)
     {
-      m_superk_storage->closeFile(m_part_id);
-      //m_superk_storage->eraseFile(m_part_id);
-      Eraser::get().erase(m_superk_storage->getFileName(m_part_id));
+      m_superk_storage->releaseFile(m_part_id);
     }
     this->m_finish = true;
     this->exec_callback();
@@ -625,8 +754,13 @@ public:
   {
     spdlog::debug("[exec] - KffCountTask - S={}, P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
 
-    MemAllocator pool(1);
-    pool.reserve(get_required_memory<span>(m_pinfo->getNbKmer(m_part_id)));
+    uint64_t nbk = m_pinfo->getNbKmer(m_part_id);
+    CountPlan plan = plan_count<span, typename ::Kmer<span>::Type>(
+      m_superk_storage.get(), m_part_id, m_kmer_size, nbk, get_required_memory<span>(nbk), m_memory,
+      m_drop_singletons && m_ab_min >= 2 && !m_hist);
+
+    CountArena& pool = CountArena::local();
+    pool.reserve(plan.memory);
     kff_w_t<DMAX_C> writer = std::make_shared<KffWriter<MAX_C>>(m_path, m_kmer_size);
 
     KffCountProcessor<span, DMAX_C>* processor(new KffCountProcessor<span, MAX_C>(m_kmer_size,
@@ -636,6 +770,7 @@ public:
 
     KmerPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
                                                      pool, m_superk_storage.get());
+    plan.apply(partition_counter, m_path);
 
     partition_counter.execute();
     pool.free_all();
@@ -653,6 +788,8 @@ private:
   uint32_t m_kmer_size;
   uint32_t m_ab_min;
   hist_t m_hist;
+  uint64_t m_memory;
+  bool m_drop_singletons;
 };
 
 template<size_t span, size_t MAX_C>
@@ -667,9 +804,13 @@ public:
                 bool lz4,
                 MODE mode,
                 FORMAT format,
-                bool clear = false)
+                bool clear = false,
+                uint32_t nb_splits = 1,
+                size_t read_ahead = 0,
+                uint32_t group_size = 0)
     : ITask(4, clear), m_part_id(partition_id), m_ab_vec(ab_vec), m_kmer_size(kmer_size),
-      m_rec_min(recurrence_min), m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format)
+      m_rec_min(recurrence_min), m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format),
+      m_nb_splits(nb_splits), m_read_ahead(read_ahead), m_group_size(group_size)
   {}
 
   void preprocess() {}
@@ -696,27 +837,106 @@ public:
                                                                      KM_FILE::KMER);
     std::string out_path = KmDir::get().get_matrix_path(m_part_id, m_mode, m_format,
                                                         COUNT_FORMAT::KMER, m_lz4);
-    KmerMerger<span, MAX_C> merger(paths, m_ab_vec, m_kmer_size, m_rec_min, m_save_if);
+
+    // block matrices end with an index and can't be concatenated
+    std::vector<Kmer<span>> splitters;
+    if (m_nb_splits > 1 && can_split() && m_format != FORMAT::BLOCK)
+      splitters = KmerMerger<span, MAX_C>::sample_splitters(paths, m_nb_splits);
+
+    std::vector<std::string> inputs = paths;
+    if (m_group_size && paths.size() > m_group_size)
+    {
+      spdlog::debug("[reduce] - KmerMergeTask - P={}, groups of {}", m_part_id, m_group_size);
+      inputs = reduce_merge_inputs(paths, m_group_size, out_path,
+        [this](std::vector<std::string>& group, std::vector<uint32_t>& th, const std::string& path) {
+          KmerMerger<span, MAX_C> merger(group, th, m_kmer_size, 0, 0, {}, m_read_ahead);
+          merger.write_as_bin(path, true);
+        });
+    }
+
+    if (!splitters.empty())
+      merge_split(inputs, splitters, out_path);
+    else
+      merge_all(inputs, out_path);
+
+    if (inputs != paths)
+      for (auto& f : inputs)
+        std::remove(f.c_str());
+
+    spdlog::debug("[done] - KmerMergeTask - P={}", m_part_id);
+  }
+
+private:
+  void merge_split(std::vector<std::string>& paths,
+                   const std::vector<Kmer<span>>& splitters,
+                   const std::string& out_path)
+  {
+    spdlog::debug("[split] - KmerMergeTask - P={}, {} sub-ranges", m_part_id, splitters.size() + 1);
+    MergeStatistics<MAX_C> infos(m_ab_vec.size());
+    std::mutex infos_mutex;
+    split_merge(out_path, splitters, header_size(),
+      [&](const MergeRange<Kmer<span>>& range, const std::string& path) {
+        KmerMerger<span, MAX_C> merger(paths, m_ab_vec, m_kmer_size, m_rec_min, m_save_if,
+                                       range, m_read_ahead);
+#ifdef WITH_PLUGIN
+        IMergePlugin* plugin = nullptr;
+        if (PluginManager<IMergePlugin>::get().use_plugin())
+          merger.set_plugin(plugin = make_plugin(range.id));
+#endif
+        write(merger, path);
+#ifdef WITH_PLUGIN
+        if (plugin)
+          PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+#endif
+        std::unique_lock<std::mutex> lock(infos_mutex);
+        infos.merge(*merger.get_infos());
+      });
+    infos.serialize(KmDir::get().get_merge_info_path(m_part_id));
+  }
+
+  void merge_all(std::vector<std::string>& paths, const std::string& out_path)
+  {
+    KmerMerger<span, MAX_C> merger(paths, m_ab_vec, m_kmer_size, m_rec_min, m_save_if,
+                                   {}, m_read_ahead);
 
 #ifdef WITH_PLUGIN
     IMergePlugin* plugin = nullptr;
 
     if (PluginManager<IMergePlugin>::get().use_plugin())
     {
-      plugin = PluginManager<IMergePlugin>::get().get_plugin();
-      plugin->set_out_dir(KmDir::get().m_plugin_storage);
-      plugin->set_kmer_size(m_kmer_size);
-      plugin->set_partition(m_part_id);
+      plugin = make_plugin(0);
       merger.set_plugin(plugin);
     }
 #endif
 
+    write(merger, out_path);
+
+#ifdef WITH_PLUGIN
+    if (PluginManager<IMergePlugin>::get().use_plugin())
+    {
+      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+    }
+    else
+    {
+      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    }
+#endif
+
+    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+  }
+
+  void write(KmerMerger<span, MAX_C>& merger, const std::string& out_path)
+  {
     if (m_mode == MODE::COUNT)
     {
       if (m_format == FORMAT::TEXT)
         merger.write_as_text(out_path);
       else if (m_format == FORMAT::BIN)
         merger.write_as_bin(out_path, m_lz4);
+      else if (m_format == FORMAT::BLOCK)
+        merger.write_as_block(out_path);
+      else if (m_format == FORMAT::SPARSE)
+        merger.write_as_sparse(out_path, m_lz4, false);
     }
     else if (m_mode == MODE::PA)
     {
@@ -724,23 +944,46 @@ public:
         merger.write_as_pa_text(out_path);
       else if (m_format == FORMAT::BIN)
         merger.write_as_pa(out_path, m_lz4);
+      else if (m_format == FORMAT::SPARSE)
+        merger.write_as_sparse(out_path, m_lz4, true);
     }
+    spdlog::debug("[footprint] - KmerMergeTask - P={}, {} KB of input buffers",
+                  m_part_id, merger.footprint() >> 10);
+  }
+
+  size_t header_size() const
+  {
+    if (m_format == FORMAT::TEXT)
+      return 0;
+    if (m_format == FORMAT::SPARSE)
+      return get_header_size<SparseMatrixFileHeader>();
+    if (m_mode == MODE::COUNT)
+      return get_header_size<MatrixFileHeader>();
+    return get_header_size<PAMatrixFileHeader>();
+  }
 
+  // Sub-range merges need one plugin instance per thread.
+  bool can_split() const
+  {
 #ifdef WITH_PLUGIN
-    if (PluginManager<IMergePlugin>::get().use_plugin())
-    {
-      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
-    }
-    else
-    {
-      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
-    }
+    auto& pm = PluginManager<IMergePlugin>::get();
+    return !pm.use_plugin() || pm.concurrent();
+#else
+    return true;
 #endif
+  }
 
-    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
-
-    spdlog::debug("[done] - KmerMergeTask - P={}", m_part_id);
+#ifdef WITH_PLUGIN
+  IMergePlugin* make_plugin(uint32_t split) const
+  {
+    IMergePlugin* plugin = PluginManager<IMergePlugin>::get().get_plugin();
+    plugin->set_out_dir(KmDir::get().m_plugin_storage);
+    plugin->set_kmer_size(m_kmer_size);
+    plugin->set_partition(m_part_id);
+    plugin->set_split(split);
+    return plugin;
   }
+#endif
 
 private:
   uint32_t m_part_id;
@@ -751,6 +994,9 @@ private:
   bool m_lz4;
   MODE m_mode;
   FORMAT m_format;
+  uint32_t m_nb_splits;
+  size_t m_read_ahead;
+  uint32_t m_group_size;
 };
 
 template<size_t MAX_C>
@@ -766,9 +1012,14 @@ public:
                 FORMAT format,
                 HashWindow& win,
                 bool clear,
-                int32_t bw)
+                int32_t bw,
+                uint32_t nb_splits = 1,
+                size_t read_ahead = 0,
+                uint32_t group_size = 0,
+                bool rle = false)
   : ITask(4, clear), m_part_id(partition_id), m_ab_vec(ab_vec), m_rec_min(recurrence_min),
-    m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format), m_win(win), m_bw(bw) {}
+    m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format), m_win(win), m_bw(bw),
+    m_nb_splits(nb_splits), m_read_ahead(read_ahead), m_group_size(group_size), m_rle(rle) {}
 
   void preprocess() {}
   void postprocess()
@@ -794,27 +1045,111 @@ public:
     std::string out_path = KmDir::get().get_matrix_path(m_part_id, m_mode, m_format,
                                                         COUNT_FORMAT::HASH, false);
 
-    HashMerger<MAX_C, 32768, HashReader<MAX_C, 32768>> merger(paths, m_ab_vec, m_rec_min, m_save_if);
+    // bft rows are transposed as a whole, its threads go to the transpose instead
+    // block matrices end with an index and can't be concatenated
+    std::vector<uint64_t> splitters;
+    if (m_nb_splits > 1 && can_split() && m_mode != MODE::BFT && m_format != FORMAT::BLOCK)
+      splitters = merger_t::sample_splitters(paths, m_nb_splits);
+
+    std::vector<std::string> inputs = paths;
+    if (m_group_size && paths.size() > m_group_size)
+    {
+      spdlog::debug("[reduce] - HashMergeTask - P={}, groups of {}", m_part_id, m_group_size);
+      inputs = reduce_merge_inputs(paths, m_group_size, out_path,
+        [this](std::vector<std::string>& group, std::vector<uint32_t>& th, const std::string& path) {
+          merger_t merger(group, th, 0, 0, {}, m_read_ahead);
+          merger.write_as_bin(path, true);
+        });
+    }
+
+    if (!splitters.empty())
+      merge_split(inputs, splitters, out_path);
+    else
+      merge_all(inputs, out_path);
+
+    if (inputs != paths)
+      for (auto& f : inputs)
+        std::remove(f.c_str());
+
+    spdlog::debug("[done] - HashMergeTask - P={}", m_part_id);
+  }
+
+private:
+  using merger_t = HashMerger<MAX_C, 32768, HashMergeReader<MAX_C>>;
+
+  void merge_split(std::vector<std::string>& paths,
+                   const std::vector<uint64_t>& splitters,
+                   const std::string& out_path)
+  {
+    spdlog::debug("[split] - HashMergeTask - P={}, {} sub-ranges", m_part_id, splitters.size() + 1);
+    MergeStatistics<MAX_C> infos(m_ab_vec.size());
+    std::mutex infos_mutex;
+    split_merge(out_path, splitters, header_size(),
+      [&](const MergeRange<uint64_t>& range, const std::string& path) {
+        merger_t merger(paths, m_ab_vec, m_rec_min, m_save_if, range, m_read_ahead);
+#ifdef WITH_PLUGIN
+        IMergePlugin* plugin = nullptr;
+        if (PluginManager<IMergePlugin>::get().use_plugin())
+          merger.set_plugin(plugin = make_plugin(range.id));
+#endif
+        write(merger, path);
+#ifdef WITH_PLUGIN
+        if (plugin)
+          PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+#endif
+        std::unique_lock<std::mutex> lock(infos_mutex);
+        infos.merge(*merger.get_infos());
+      });
+    infos.serialize(KmDir::get().get_merge_info_path(m_part_id));
+    if (m_mode == MODE::BF || m_mode == MODE::BFT)
+      write_fpr(infos);
+  }
+
+  void merge_all(std::vector<std::string>& paths, const std::string& out_path)
+  {
+    merger_t merger(paths, m_ab_vec, m_rec_min, m_save_if, {}, m_read_ahead);
 
 #ifdef WITH_PLUGIN
     IMergePlugin* plugin = nullptr;
 
     if (PluginManager<IMergePlugin>::get().use_plugin())
     {
-      plugin = PluginManager<IMergePlugin>::get().get_plugin();
-      plugin->set_out_dir(KmDir::get().m_plugin_storage);
-      plugin->set_kmer_size(0);
-      plugin->set_partition(m_part_id);
+      plugin = make_plugin(0);
       merger.set_plugin(plugin);
     }
 #endif
 
+    write(merger, out_path);
+
+#ifdef WITH_PLUGIN
+    if (PluginManager<IMergePlugin>::get().use_plugin())
+    {
+      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+    }
+    else
+    {
+      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    }
+#endif
+    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+
+    if (m_mode == MODE::BF || m_mode == MODE::BFT)
+      write_fpr(*merger.get_infos());
+  }
+
+
+  void write(merger_t& merger, const std::string& out_path)
+  {
     if (m_mode == MODE::COUNT)
     {
       if (m_format == FORMAT::TEXT)
         merger.write_as_text(out_path);
       else if (m_format == FORMAT::BIN)
         merger.write_as_bin(out_path, m_lz4);
+      else if (m_format == FORMAT::BLOCK)
+        merger.write_as_block(out_path);
+      else if (m_format == FORMAT::SPARSE)
+        merger.write_as_sparse(out_path, m_lz4, false);
     }
     else if (m_mode == MODE::PA)
     {
@@ -822,45 +1157,76 @@ public:
         merger.write_as_pa_text(out_path);
       else if (m_format == FORMAT::BIN)
         merger.write_as_pa(out_path, m_lz4);
+      else if (m_format == FORMAT::SPARSE)
+        merger.write_as_sparse(out_path, m_lz4, true);
     }
     else if (m_mode == MODE::BF)
     {
         merger.write_as_bf(out_path, m_win.get_lower(m_part_id),
-                           m_win.get_upper(m_part_id), false);
+                           m_win.get_upper(m_part_id), false, m_rle);
     }
     else if (m_mode == MODE::BFC)
     {
         merger.write_as_bfc(out_path, m_win.get_lower(m_part_id),
-                            m_win.get_upper(m_part_id), m_bw, false);
+                            m_win.get_upper(m_part_id), m_bw, false, m_rle);
     }
-
-#ifdef WITH_PLUGIN
-    if (PluginManager<IMergePlugin>::get().use_plugin())
+    else if (m_mode == MODE::BFT)
     {
-      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+        merger.write_as_bft(out_path, m_win.get_lower(m_part_id),
+                            m_win.get_upper(m_part_id), false, m_nb_splits);
     }
-    else
+    spdlog::debug("[footprint] - HashMergeTask - P={}, {} KB of input buffers",
+                  m_part_id, merger.footprint() >> 10);
+  }
+
+  void write_fpr(const MergeStatistics<MAX_C>& infos)
+  {
+    std::string fpr_path = fmt::format("{}/{}", KmDir::get().m_fpr_storage, fmt::format("partition_{}.txt", m_part_id));
+    std::ofstream fp(fpr_path, std::ios::out); check_fstream_good(fpr_path, fp);
+
+    size_t m = m_win.get_window_size_bits();
+    for (auto& n : infos.get_unique_w_rescue())
     {
-      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+      double fpr = bloom_fp(m, n);
+      fp << std::fixed << fpr << "\n";
     }
-#endif
-    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+  }
 
-    if (m_mode == MODE::BF)
-    {
-      std::string fpr_path = fmt::format("{}/{}", KmDir::get().m_fpr_storage, fmt::format("partition_{}.txt", m_part_id));
-      std::ofstream fp(fpr_path, std::ios::out); check_fstream_good(fpr_path, fp);
+  size_t header_size() const
+  {
+    if (m_mode == MODE::BF || m_mode == MODE::BFC)
+      return get_header_size<VectorMatrixFileHeader>();
+    if (m_format == FORMAT::TEXT)
+      return 0;
+    if (m_format == FORMAT::SPARSE)
+      return get_header_size<SparseMatrixFileHeader>();
+    if (m_mode == MODE::COUNT)
+      return get_header_size<MatrixHashFileHeader>();
+    return get_header_size<PAHashMatrixFileHeader>();
+  }
 
-      size_t m = m_win.get_window_size_bits();
-      for (auto& n : merger.get_infos()->get_unique_w_rescue())
-      {
-        double fpr = bloom_fp(m, n);
-        fp << std::fixed << fpr << "\n";
-      }
-    }
+  // Sub-range merges need one plugin instance per thread.
+  bool can_split() const
+  {
+#ifdef WITH_PLUGIN
+    auto& pm = PluginManager<IMergePlugin>::get();
+    return !pm.use_plugin() || pm.concurrent();
+#else
+    return true;
+#endif
+  }
 
-    spdlog::debug("[done] - HashMergeTask - P={}", m_part_id);
+#ifdef WITH_PLUGIN
+  IMergePlugin* make_plugin(uint32_t split) const
+  {
+    IMergePlugin* plugin = PluginManager<IMergePlugin>::get().get_plugin();
+    plugin->set_out_dir(KmDir::get().m_plugin_storage);
+    plugin->set_kmer_size(0);
+    plugin->set_partition(m_part_id);
+    plugin->set_split(split);
+    return plugin;
   }
+#endif
 
 private:
   uint32_t m_part_id;
@@ -872,6 +1238,10 @@ private:
   FORMAT m_format;
   HashWindow& m_win;
   uint32_t m_bw;
+  uint32_t m_nb_splits;
+  size_t m_read_ahead;
+  uint32_t m_group_size;
+  bool m_rle;
 };
 
 
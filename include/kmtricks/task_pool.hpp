@@ -27,12 +27,158 @@
 #include <string>
 #include <thread>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <vector>
+#include <algorithm>
 
 #include <kmtricks/itask.hpp>
 
 namespace km
 {
+// Workers of the task pools which have nothing to run. A running task may borrow them
+// to spread its own work, e.g. the last partitions of a large sample. Its slices then run
+// as jobs on the borrowed workers, which take no task before, so that the pools never run
+// more threads than they have workers. Pools share the mutex and the condition of this
+// registry, jobs being served by the workers of any pool.
+class IdleWorkers
+{
+public:
+  // Borrows up to n idle workers, for a single run().
+  class Lease
+  {
+  public:
+    Lease(size_t n) : m_size(n ? IdleWorkers::get().borrow(n) : 0) {}
+    ~Lease() { IdleWorkers::get().give_back(m_size); }
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    size_t size() const { return m_size; }
+
+    // Runs fn(t, n) with n = size() + 1, slice 0 on this thread and the others on the
+    // borrowed workers. Returns once all the slices are done, rethrows their exceptions.
+    template<typename Fn>
+    void run(Fn&& fn)
+    {
+      size_t n = m_size + 1;
+      std::vector<std::future<void>> futures;
+      for (size_t t = 1; t < n; t++)
+      {
+        auto job = std::make_shared<std::packaged_task<void()>>([&fn, t, n]() { fn(t, n); });
+        futures.push_back(job->get_future());
+        IdleWorkers::get().post([job]() { (*job)(); });
+      }
+      // the jobs give the borrowed workers back
+      m_size = 0;
+
+      std::exception_ptr error;
+      try { fn(0, n); } catch (...) { error = std::current_exception(); }
+      for (auto& f : futures)
+      {
+        try { f.get(); } catch (...) { if (!error) error = std::current_exception(); }
+      }
+      if (error)
+        std::rethrow_exception(error);
+    }
+
+  private:
+    size_t m_size;
+  };
+
+  static IdleWorkers& get()
+  {
+    static IdleWorkers singleton;
+    return singleton;
+  }
+
+  // Workers of the pools, the most a task can borrow.
+  size_t workers()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_workers;
+  }
+
+  // Runs job on an idle worker which is borrowed until it is done, without waiting for it.
+  // Returns false, without running job, when no worker is idle.
+  bool try_post(std::function<void()> job)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!free())
+        return false;
+      m_lent++;
+      m_jobs.push(std::move(job));
+    }
+    m_condition.notify_all();
+    return true;
+  }
+
+private:
+  friend class TaskPool;
+
+  size_t borrow(size_t n)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    size_t available = m_idle > m_lent ? m_idle - m_lent : 0;
+    n = std::min(n, available);
+    m_lent += n;
+    return n;
+  }
+
+  void give_back(size_t n)
+  {
+    if (!n)
+      return;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_lent -= std::min(n, m_lent);
+    }
+    m_condition.notify_all();
+  }
+
+  void post(std::function<void()> job)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobs.push(std::move(job));
+    }
+    m_condition.notify_all();
+  }
+
+  // The following are called with the mutex held.
+
+  // Whether an idle worker may take a task, the others being lent.
+  bool free() const
+  {
+    return m_idle > m_lent;
+  }
+
+  // Takes a job and the borrowed worker which runs it.
+  bool take_job(std::function<void()>& job)
+  {
+    if (m_jobs.empty())
+      return false;
+    job = std::move(m_jobs.front());
+    m_jobs.pop();
+    m_idle--;
+    m_lent -= std::min<size_t>(1, m_lent);
+    return true;
+  }
+
+  bool has_job() const
+  {
+    return !m_jobs.empty();
+  }
+
+  size_t m_workers {0};
+  size_t m_idle {0};
+  size_t m_lent {0};
+  std::queue<std::function<void()>> m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+};
+
 class TaskPool
 {
   using size_type = std::result_of<decltype (&std::thread::hardware_concurrency)()>::type;
@@ -41,6 +187,12 @@ class TaskPool
   TaskPool(size_type threads)
   {
     if (threads < m_n) m_n = threads;
+    {
+      // workers are idle from now, so that they can be leased before they start
+      std::unique_lock<std::mutex> lock(IdleWorkers::get().m_mutex);
+      IdleWorkers::get().m_workers += m_n;
+      IdleWorkers::get().m_idle += m_n;
+    }
     for (size_t i = 0; i < m_n; i++)
     {
       m_pool.push_back(std::thread(&TaskPool::worker, this, i));
@@ -49,13 +201,7 @@ class TaskPool
 
   ~TaskPool()
   {
-    {
-      std::unique_lock<std::mutex> lock(m_queue_mutex);
-      m_stop = true;
-    }
-    m_condition.notify_all();
-    for (std::thread& t : m_pool)
-      if (t.joinable()) t.join();
+    join_all();
   }
 
   TaskPool() = delete;
@@ -67,12 +213,20 @@ class TaskPool
 
   void join_all()
   {
+    IdleWorkers& idle = IdleWorkers::get();
     {
-      std::unique_lock<std::mutex> lock(m_queue_mutex);
+      std::unique_lock<std::mutex> lock(idle.m_mutex);
       m_stop = true;
     }
-    m_condition.notify_all();
-    for (std::thread& t : m_pool) t.join();
+    idle.m_condition.notify_all();
+    for (std::thread& t : m_pool)
+      if (t.joinable()) t.join();
+    if (!m_joined)
+    {
+      std::unique_lock<std::mutex> lock(idle.m_mutex);
+      idle.m_workers -= m_pool.size();
+      m_joined = true;
+    }
   }
 
   void join(int i)
@@ -83,30 +237,61 @@ class TaskPool
   void add_task(task_t task)
   {
     {
-      std::unique_lock<std::mutex> lock(m_queue_mutex);
+      std::unique_lock<std::mutex> lock(IdleWorkers::get().m_mutex);
       task->in();
       m_queue.push(task);
     }
-    m_condition.notify_one();
+    // workers of other pools wait on the same condition
+    IdleWorkers::get().m_condition.notify_all();
   }
 
  private:
+  // A worker is idle while it waits. It serves jobs first, then tasks when it is not lent.
+  // Once stopped, it only exits when no task of the pool runs anymore, to lend itself to
+  // the last ones, and when it is not lent.
   void worker(int i)
   {
+    IdleWorkers& idle = IdleWorkers::get();
+    std::unique_lock<std::mutex> lock(idle.m_mutex);
     while (true)
     {
-      task_t task;
+      idle.m_condition.wait(lock, [&] {
+        return idle.has_job() || (!m_queue.empty() && idle.free()) ||
+               (m_stop && m_queue.empty() && !m_running && idle.free());
+      });
+
+      std::function<void()> job;
+      if (idle.take_job(job))
       {
-        std::unique_lock<std::mutex> lock(this->m_queue_mutex);
-        this->m_condition.wait(lock, [this] { return this->m_stop || !this->m_queue.empty(); });
-        if (this->m_stop && this->m_queue.empty()) return;
-        task = this->m_queue.top();
-        this->m_queue.pop();
+        lock.unlock();
+        job();
+        lock.lock();
+        idle.m_idle++;
+        continue;
       }
-      task->preprocess();
-      task->exec();
-      task->postprocess();
-      task->out();
+
+      if (!m_queue.empty())
+      {
+        task_t task = m_queue.top();
+        m_queue.pop();
+        idle.m_idle--;
+        m_running++;
+        lock.unlock();
+        task->preprocess();
+        task->exec();
+        task->postprocess();
+        task->out();
+        lock.lock();
+        idle.m_idle++;
+        if (--m_running == 0 && m_stop)
+          idle.m_condition.notify_all();
+        continue;
+      }
+
+      idle.m_idle--;
+      // a worker waiting to exit may now be free to
+      idle.m_condition.notify_all();
+      return;
     }
   }
 
@@ -114,9 +299,9 @@ class TaskPool
   size_type m_n{std::thread::hardware_concurrency()};
   std::vector<std::thread> m_pool;
   std::priority_queue<task_t> m_queue;
-  std::mutex m_queue_mutex;
-  std::condition_variable m_condition;
+  size_t m_running {0};
   bool m_stop{false};
+  bool m_joined{false};
 };
 
 };
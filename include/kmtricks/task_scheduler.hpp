@@ -91,7 +91,8 @@ public:
                                                m_opt->nb_parts,
                                                m_opt->max_memory);
     ConfigTask<MAX_K> config_task(m_opt->fof, props, m_opt->bloom_size, m_opt->nb_parts,
-                                   m_opt->bam_exclude_refs, m_opt->bam_include_flags, m_opt->bam_exclude_flags);
+                                   m_opt->bam_exclude_refs, m_opt->bam_include_flags, m_opt->bam_exclude_flags,
+                                   str_to_hasher(m_opt->hasher));
     config_task.exec();
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
     LOCAL(config_storage);
@@ -161,6 +162,12 @@ public:
     init_progress2(m_config._nb_partitions);
   }
 
+  // Threads given to each super-k-mer task when nb_tasks of them share the pool.
+  size_t superk_task_threads(size_t nb_tasks) const
+  {
+    return std::max<size_t>(1, m_opt->nb_threads / std::max<size_t>(nb_tasks, 1));
+  }
+
   void exec_superk()
   {
     if (m_is_info)
@@ -169,12 +176,17 @@ public:
     }
 
     TaskPool pool(m_opt->nb_threads);
+    size_t superk_threads = superk_task_threads(KmDir::get().m_fof.size());
 
     for (auto id : KmDir::get().m_fof)
     {
       task_t task = std::make_shared<SuperKTask<MAX_K>>(std::get<0>(id),
                                                         m_opt->lz4,
-                                                        m_opt->restrict_to_list);
+                                                        m_opt->restrict_to_list,
+                                                        superk_threads,
+                                                        m_opt->superk_container,
+                                                        false,
+                                                        m_opt->superk_dedup);
       if (m_is_info) task->set_callback([this](){ this->m_dyn[0].tick(); });
 
       spdlog::debug("[push] - SuperKTask - S={}", std::get<0>(id));
@@ -189,6 +201,8 @@ public:
     if (m_is_info) { m_dyn.push_back(*m_progress[3]); m_dyn[1].set_progress(0); }
 
     TaskPool pool(m_opt->nb_threads);
+    uint64_t count_memory = get_count_task_memory(m_opt->count_memory, m_opt->nb_threads);
+    CountArena::set_pages(str_to_pages(m_opt->huge_pages));
 
     for (auto id : KmDir::get().m_fof)
     {
@@ -210,7 +224,8 @@ public:
               sid, p, m_opt->lz4, KM_FILE::KMER);
             task = std::make_shared<CountTask<MAX_K, MAX_C, SuperKStorageReader>>(
               path, m_config, sk_storage, pinfos, p, iid, m_config._kmerSize,
-              a_min, m_opt->lz4, get_hist_clone(m_hists[iid]), !m_opt->keep_tmp);
+              a_min, m_opt->lz4, get_hist_clone(m_hists[iid]), !m_opt->keep_tmp, count_memory,
+              m_opt->drop_singletons);
           }
           else if (m_opt->kff)
           {
@@ -219,7 +234,8 @@ public:
               sid, p, m_opt->lz4, KM_FILE::KFF);
             task = std::make_shared<KffCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
               path, m_config, sk_storage, pinfos, p, iid,
-              m_config._kmerSize, a_min, get_hist_clone(m_hists[iid]), !m_opt->keep_tmp);
+              m_config._kmerSize, a_min, get_hist_clone(m_hists[iid]), !m_opt->keep_tmp, count_memory,
+              m_opt->drop_singletons);
           }
         }
         else
@@ -230,7 +246,8 @@ public:
           task = std::make_shared<HashCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
               path, m_config, sk_storage, pinfos, p, iid,
               m_hw.get_window_size_bits(), m_config._kmerSize, a_min, m_opt->lz4,
-              get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp);
+              get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp, count_memory,
+              m_hw.hasher(), m_opt->drop_singletons);
         }
         if (m_is_info) task->set_callback([this](){ this->m_dyn[1].tick(); });
 
@@ -256,15 +273,27 @@ public:
       m_dyn.push_back(*m_progress[3]); m_dyn[1].set_progress(0);
     }
     TaskPool pool(m_opt->nb_threads);
+    uint64_t count_memory = get_count_task_memory(m_opt->count_memory, m_opt->nb_threads);
+    CountArena::set_pages(str_to_pages(m_opt->huge_pages));
 
     int max_running = std::floor(m_opt->nb_threads * m_opt->focus) > 0 ? m_opt->nb_threads * m_opt->focus : 1;
+    size_t superk_threads = superk_task_threads(
+      std::min<size_t>(KmDir::get().m_fof.size(), max_running));
+
+    // super-k-mers are read back by the count tasks of this run only
+    bool superk_in_memory = m_opt->superk_memory && !m_opt->keep_tmp;
+    SuperkMemory::get().set_budget(superk_in_memory ? uint64_t{m_opt->superk_memory} << 20 : 0);
 
     for (auto id : KmDir::get().m_fof)
     {
       task_t task = std::make_shared<SuperKTask<MAX_K>>(std::get<0>(id),
                                                         m_opt->lz4,
-                                                        m_opt->restrict_to_list);
-      task->set_callback([this, id, &pool](){
+                                                        m_opt->restrict_to_list,
+                                                        superk_threads,
+                                                        m_opt->superk_container,
+                                                        superk_in_memory,
+                                                        m_opt->superk_dedup);
+      task->set_callback([this, id, &pool, count_memory](){
         if (this->m_is_info)
           this->m_dyn[0].tick();
         uint32_t a_min = std::get<2>(id) == 0 ? this->m_opt->c_ab_min : std::get<2>(id);
@@ -286,7 +315,8 @@ public:
               task = std::make_shared<CountTask<MAX_K, MAX_C, SuperKStorageReader>>(
                 path, this->m_config, sk_storage, pinfos, p, iid,
                 this->m_config._kmerSize, a_min, m_opt->lz4, get_hist_clone(this->m_hists[iid]),
-                !this->m_opt->keep_tmp);
+                !this->m_opt->keep_tmp, count_memory,
+                this->m_opt->drop_singletons);
             }
             else if (m_opt->kff)
             {
@@ -295,7 +325,8 @@ public:
                 sid, p, this->m_opt->lz4, KM_FILE::KFF);
               task = std::make_shared<KffCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
                 path, this->m_config, sk_storage, pinfos, p, iid,
-                this->m_config._kmerSize, a_min, get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp);
+                this->m_config._kmerSize, a_min, get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp, count_memory,
+                this->m_opt->drop_singletons);
             }
           }
           else
@@ -306,7 +337,8 @@ public:
             task = std::make_shared<HashCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
                 path, m_config, sk_storage, pinfos, p, iid,
                 m_hw.get_window_size_bits(), m_config._kmerSize, a_min, m_opt->lz4,
-                get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp);
+                get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp, count_memory,
+                m_hw.hasher(), this->m_opt->drop_singletons);
           }
           if (m_is_info)
           {
@@ -391,6 +423,17 @@ public:
                                                      KmDir::get().get_merge_th_path());
     }
     TaskPool pool(m_opt->nb_threads);
+    uint32_t nb_splits = get_merge_splits(m_opt->nb_threads, m_opt->restrict_to_list.size());
+    size_t nb_concurrent = std::min<size_t>(m_opt->nb_threads, m_opt->restrict_to_list.size()) * nb_splits;
+    size_t stream_bytes = m_opt->count_format == COUNT_FORMAT::KMER ?
+      KmerMerger<MAX_K, MAX_C>::stream_footprint(m_opt->lz4) :
+      HashMerger<MAX_C, 32768, HashMergeReader<MAX_C>>::stream_footprint();
+    // two read-ahead blocks per input, see MergeInput
+    stream_bytes += 2 * m_opt->read_ahead * 1024;
+    uint32_t group_size = get_merge_group_size(nb_concurrent, stream_bytes, m_opt->merge_memory);
+    MergeBufferPool::get().set_capacity(nb_concurrent);
+    spdlog::debug("Merge inputs: {} per merge, ~{} KB per stream, {} concurrent merges",
+                  group_size, stream_bytes >> 10, nb_concurrent);
     for (auto& p : m_opt->restrict_to_list)
     {
       task_t task = nullptr;
@@ -399,14 +442,16 @@ public:
         spdlog::debug("[push] - KmerMergeTask - P={}", p);
         task = std::make_shared<KmerMergeTask<MAX_K, MAX_C>>(
           p, m_opt->m_ab_min_vec, m_config._kmerSize, m_opt->r_min, m_opt->save_if,
-          m_opt->lz4, m_opt->mode, m_opt->format, !m_opt->keep_tmp);
+          m_opt->lz4, m_opt->mode, m_opt->format, !m_opt->keep_tmp, nb_splits,
+          m_opt->read_ahead * 1024, group_size);
       }
       else if (m_opt->count_format == COUNT_FORMAT::HASH)
       {
         spdlog::debug("[push] - HashMergeTask - P={}", p);
         task = std::make_shared<HashMergeTask<MAX_C>>(
           p, m_opt->m_ab_min_vec, m_opt->r_min, m_opt->save_if, m_opt->lz4, m_opt->mode,
-          m_opt->format, m_hw, !m_opt->keep_tmp, m_opt->bwidth);
+          m_opt->format, m_hw, !m_opt->keep_tmp, m_opt->bwidth, nb_splits,
+          m_opt->read_ahead * 1024, group_size, m_opt->bf_rle);
       }
       if (m_is_info) task->set_callback([this](){ this->m_dyn[2].tick(); });
       pool.add_task(task);
@@ -446,6 +491,7 @@ public:
     }
 
     end:
+      SingletonStats::get().report();
       spdlog::info("Done in {} - Peak RSS -> {:.2f} MB.",
                    whole_time.formatted(),
                    get_peak_rss() * 0.0009765625);
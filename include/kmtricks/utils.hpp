@@ -26,6 +26,7 @@
 #include <condition_variable>
 #include <queue>
 #include <vector>
+#include <algorithm>
 #include <unistd.h>
 #include <functional>
 #include <filesystem>
@@ -115,16 +116,32 @@ void set_bit_vector(std::vector<uint8_t>& bit_vec, const std::vector<T>& count_v
   }
 }
 
+// Scatter buffer of the partition radix sorts: whole partitions up to 256K values, then
+// buckets of up to 1/64 of the partition. Larger buckets are sorted with std::sort.
+inline uint64_t get_sort_memory(size_t nb_kmers, size_t value_size)
+{
+  return std::max<size_t>(nb_kmers / 64, std::min<size_t>(nb_kmers, 256 << 10)) * value_size;
+}
+
 template<size_t MAX_K>
 uint64_t get_required_memory(size_t nb_kmers)
 {
-  return nb_kmers * (((MAX_K + 31) / 32) * 8) + 8192;
+  return get_sort_memory(nb_kmers, ((MAX_K + 31) / 32) * 8) + nb_kmers * (((MAX_K + 31) / 32) * 8) + 8192;
 }
 
 template<size_t MAX_K>
 uint64_t get_required_memory_hash(size_t nb_kmers)
 {
-  return nb_kmers * (sizeof(uint64_t)) + 8192;
+  return get_sort_memory(nb_kmers, sizeof(uint64_t)) + nb_kmers * (sizeof(uint64_t)) + 8192;
+}
+
+// Memory budget of each of nb_tasks concurrent count tasks, in bytes, from a budget in MB
+// shared by all of them (0 = unlimited). Partitions above it are spilled to disk.
+inline uint64_t get_count_task_memory(size_t memory_mb, size_t nb_tasks)
+{
+  if (!memory_mb)
+    return 0;
+  return std::max<uint64_t>((uint64_t{memory_mb} << 20) / std::max<size_t>(nb_tasks, 1), 16 << 20);
 }
 
 inline std::string get_uname_sr()
@@ -236,6 +253,23 @@ inline std::tuple<int64_t, int64_t> get_prlimit_nofile()
   return std::make_tuple(rlim.rlim_cur, rlim.rlim_max);
 }
 
+// Raises the soft limit of open files to the hard limit, returns the soft limit then in use.
+inline int64_t raise_nofile_limit()
+{
+  struct rlimit rlim;
+  if (getrlimit(RLIMIT_NOFILE, &rlim) != 0)
+    return -1;
+  if (rlim.rlim_cur != rlim.rlim_max)
+  {
+    rlim_t soft = rlim.rlim_cur;
+    rlim.rlim_cur = rlim.rlim_max;
+    // an unlimited hard limit may be refused, the soft one stays
+    if (setrlimit(RLIMIT_NOFILE, &rlim) != 0)
+      rlim.rlim_cur = soft;
+  }
+  return rlim.rlim_cur == RLIM_INFINITY ? -1 : static_cast<int64_t>(rlim.rlim_cur);
+}
+
 inline double bloom_fp(size_t m, size_t n, size_t k = 1)
 {
   static double e = std::exp(1.0);
@@ -326,4 +360,7 @@ template<> struct select_ <32> {typedef uint32_t type;};
 template<size_t C>
 struct selectC : select_<requiredC<C>::value> {};
 
+// Passes a type to a generic lambda.
+template<typename T> struct type_tag {typedef T type;};
+
 };
@@ -34,6 +34,7 @@ public:
 
 // Make the plugin loadable
 extern "C" std::string plugin_name() { return "BasicEx"; }
+extern "C" int plugin_api_version() { return km::IMergePlugin::api_version; }
 extern "C" int use_template() { return 0; }
 extern "C" km::IMergePlugin* create0() { return new BasicEx(); }
 extern "C" void destroy(km::IMergePlugin* p) { delete p; }
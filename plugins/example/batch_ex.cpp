@@ -0,0 +1,55 @@
+#include <kmtricks/plugin.hpp>
+
+// Same as BasicEx, with the batched interface
+using count_type = typename km::selectC<DMAX_C>::type;
+
+
+class BatchEx : public km::IMergePlugin
+{
+public:
+  BatchEx() = default;
+private:
+  unsigned int m_threshold {0};
+
+public:
+  // Rows are given by blocks of 4096 rows
+  size_t batch_size() const override { return 4096; }
+
+  // Counts are given sample by sample, each column is a contiguous span
+  bool column_major() const override { return true; }
+
+  // Instances don't share state, each merge thread can use its own
+  bool concurrent() const override { return true; }
+
+  // Discard lines which contain abundances less than a threshold
+  // The inner loop runs over contiguous counts and can be vectorized
+  void process_kmer_batch(km::MergeBatch& batch) override
+  {
+    std::vector<uint8_t> keep(batch.size, 1);
+    for (size_t s=0; s<batch.nb_samples; s++)
+    {
+      const count_type* column = batch.column(s);
+      for (size_t i=0; i<batch.size; i++)
+        keep[i] &= column[i] >= m_threshold;
+    }
+    for (size_t i=0; i<batch.size; i++)
+      batch.set_keep(i, keep[i]);
+  }
+
+  void process_hash_batch(km::MergeBatch& batch) override
+  {
+    process_kmer_batch(batch);
+  }
+
+  void configure(const std::string& s) override
+  {
+    m_threshold = std::stoll(s);
+  }
+};
+
+// Make the plugin loadable
+extern "C" std::string plugin_name() { return "BatchEx"; }
+extern "C" int plugin_api_version() { return km::IMergePlugin::api_version; }
+extern "C" int use_template() { return 0; }
+extern "C" km::IMergePlugin* create0() { return new BatchEx(); }
+extern "C" void destroy(km::IMergePlugin* p) { delete p; }
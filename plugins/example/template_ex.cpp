@@ -48,6 +48,7 @@ public:
 
 // Make the plugin loadable
 extern "C" std::string plugin_name() { return "TemplateEx"; }
+extern "C" int plugin_api_version() { return km::IMergePlugin::api_version; }
 extern "C" int use_template() { return 1; }
 extern "C" km::IMergePlugin* create32() { return new TemplateEx<32>(); } // call if --kmer-size < 32
 extern "C" km::IMergePlugin* create64() { return new TemplateEx<64>(); } // call if --kmer-size < 64
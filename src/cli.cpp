@@ -150,12 +150,18 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
   auto mode_checker = [](const std::string& p, const std::string& v) -> bc::check::checker_ret_t {
     std::string available = "kmer:pa:text|"
                             "kmer:pa:bin|"
+                            "kmer:pa:sparse|"
                             "kmer:count:text|"
                             "kmer:count:bin|"
+                            "kmer:count:block|"
+                            "kmer:count:sparse|"
                             "hash:count:text|"
                             "hash:count:bin|"
+                            "hash:count:block|"
+                            "hash:count:sparse|"
                             "hash:pa:text|"
                             "hash:pa:bin|"
+                            "hash:pa:sparse|"
                             "hash:bf:bin|"
                             "hash:bft:bin|"
                             "hash:bfc:bin";
@@ -171,7 +177,13 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     format = s[1];
     out = s[2];
 
-    if (out != "text" && out != "bin")
+    if (out != "text" && out != "bin" && out != "block" && out != "sparse")
+      goto fail;
+
+    if (out == "block" && format != "count")
+      goto fail;
+
+    if (out == "sparse" && format != "count" && format != "pa")
       goto fail;
 
     if (format != "count" && format != "pa" && format != "bf" && format != "bft" && format != "bfc")
@@ -259,6 +271,50 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->checker(bc::check::is_number)
     ->setter(options->save_if);
 
+  all_cmd->add_param("--read-ahead", "read-ahead window of merge inputs, in KB (0 = disabled).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->read_ahead);
+
+  all_cmd->add_param("--count-memory", "memory budget of partition counting, in MB (0 = unlimited).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->count_memory);
+
+  all_cmd->add_param("--superk-memory", "memory budget to keep super-k-mers in RAM until they are counted, in MB (0 = on disk, ignored with --keep-tmp).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->superk_memory);
+
+  all_cmd->add_param("--superk-dedup", "super-k-mers cached per partition to write repeated ones once with their multiplicity, for high-coverage samples, up to 16 MB per thread (0 = off).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::f::range(0, 65536))
+    ->setter(options->superk_dedup);
+
+  all_cmd->add_param("--huge-pages", "huge pages for counting memory. [none|thp|hugetlb]")
+    ->meta("STR")
+    ->def("none")
+    ->checker(bc::check::f::in("none|thp|hugetlb"))
+    ->setter(options->huge_pages);
+
+  all_cmd->add_param("--drop-singletons", "drop k-mers seen once before counting, with --hard-min > 1, no --hist and a --count-memory budget.")
+    ->as_flag()
+    ->setter(options->drop_singletons);
+
+  all_cmd->add_param("--merge-memory", "memory budget of merge input buffers, in MB (0 = unlimited).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->merge_memory);
+
+  all_cmd->add_param("--bf-rle", "run-length encode empty rows of hash:bf|bfc matrices.")
+    ->as_flag()
+    ->setter(options->bf_rle);
+
 
   all_cmd->add_group("pipeline control", "");
 
@@ -329,6 +385,10 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->as_flag()
     ->setter(options->lz4);
 
+  all_cmd->add_param("--superk-container", "store the super-k-mers of a sample in a single indexed file.")
+    ->as_flag()
+    ->setter(options->superk_container);
+
   all_cmd->add_group("hash mode configuration", "");
 
   all_cmd->add_param("--bloom-size", "bloom filter size")
@@ -337,6 +397,12 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->checker(bc::check::is_number)
     ->setter(options->bloom_size);
 
+  all_cmd->add_param("--hasher", "hash function of hash modes. [xxhash|nthash]")
+    ->meta("STR")
+    ->def("xxhash")
+    ->checker(bc::check::f::in("xxhash|nthash"))
+    ->setter(options->hasher);
+
   auto format_setter = [options](const std::string& v) {
     options->out_format = str_to_format(v);
   };
@@ -438,6 +504,12 @@ km_options_t repart_cli(std::shared_ptr<bc::Parser<1>> cli, repart_options_t opt
     ->checker(bc::check::is_number)
     ->setter(options->bloom_size);
 
+  repart_cmd->add_param("--hasher", "hash function of hash modes. [xxhash|nthash]")
+    ->meta("STR")
+    ->def("xxhash")
+    ->checker(bc::check::f::in("xxhash|nthash"))
+    ->setter(options->hasher);
+
   add_bam_options(repart_cmd, options);
 
   add_common(repart_cmd, options);
@@ -472,6 +544,16 @@ km_options_t superk_cli(std::shared_ptr<bc::Parser<1>> cli, superk_options_t opt
     ->as_flag()
     ->setter(options->lz4);
 
+  superk_cmd->add_param("--superk-container", "store the super-k-mers in a single indexed file.")
+    ->as_flag()
+    ->setter(options->superk_container);
+
+  superk_cmd->add_param("--superk-dedup", "super-k-mers cached per partition to write repeated ones once with their multiplicity, up to 16 MB per thread (0 = off).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::f::range(0, 65536))
+    ->setter(options->superk_dedup);
+
   add_common(superk_cmd, options);
 
   return options;
@@ -519,6 +601,22 @@ km_options_t count_cli(std::shared_ptr<bc::Parser<1>> cli, count_options_t optio
     ->as_flag()
     ->setter(options->lz4);
 
+  count_cmd->add_param("--count-memory", "memory budget of partition counting, in MB (0 = unlimited).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->count_memory);
+
+  count_cmd->add_param("--huge-pages", "huge pages for counting memory. [none|thp|hugetlb]")
+    ->meta("STR")
+    ->def("none")
+    ->checker(bc::check::f::in("none|thp|hugetlb"))
+    ->setter(options->huge_pages);
+
+  count_cmd->add_param("--drop-singletons", "drop k-mers seen once before counting, with --hard-min > 1, no --hist and a --count-memory budget.")
+    ->as_flag()
+    ->setter(options->drop_singletons);
+
   add_common(count_cmd, options);
   return options;
 }
@@ -582,12 +680,18 @@ km_options_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_options_t optio
   auto mode_checker = [](const std::string& p, const std::string& v) -> bc::check::checker_ret_t {
     std::string available = "kmer:pa:text|"
                             "kmer:pa:bin|"
+                            "kmer:pa:sparse|"
                             "kmer:count:text|"
                             "kmer:count:bin|"
+                            "kmer:count:block|"
+                            "kmer:count:sparse|"
                             "hash:count:text|"
                             "hash:count:bin|"
+                            "hash:count:block|"
+                            "hash:count:sparse|"
                             "hash:pa:text|"
                             "hash:pa:bin|"
+                            "hash:pa:sparse|"
                             "hash:bf:bin|";
     auto s = bc::utils::split(v, ':');
     std::string mode;
@@ -615,6 +719,12 @@ km_options_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_options_t optio
     if ((format == "bf" || format == "bft") && out == "text")
       goto fail;
 
+    if (out == "block" && format != "count")
+      goto fail;
+
+    if (out == "sparse" && format != "count" && format != "pa")
+      goto fail;
+
     goto success;
 
     fail:
@@ -639,6 +749,22 @@ km_options_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_options_t optio
     ->as_flag()
     ->setter(options->lz4);
 
+  merge_cmd->add_param("--read-ahead", "read-ahead window of merge inputs, in KB (0 = disabled).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->read_ahead);
+
+  merge_cmd->add_param("--merge-memory", "memory budget of merge input buffers, in MB (0 = unlimited).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->merge_memory);
+
+  merge_cmd->add_param("--bf-rle", "run-length encode empty rows of hash:bf|bfc matrices.")
+    ->as_flag()
+    ->setter(options->bf_rle);
+
   add_common(merge_cmd, options);
   return options;
 }
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include <kmtricks/arena.hpp>
+
+#include <cstring>
+
+using namespace km;
+
+TEST(arena, reserve_remaps_on_growth)
+{
+  CountArena arena;
+  arena.reserve(1 << 20);
+  char* p = arena.pool_malloc(64);
+  std::memset(p, 0xAB, 64);
+
+  // smaller, or larger but within the mapped huge pages: same memory
+  for (uint64_t size : {uint64_t{512} << 10, uint64_t{3} << 19})
+  {
+    arena.reserve(size);
+    EXPECT_EQ(arena.getCapacity(), size + 1024);
+    EXPECT_EQ(arena.getUsedSpace(), 0);
+    char* q = arena.pool_malloc(64);
+    EXPECT_EQ(q, p);
+    EXPECT_EQ(static_cast<unsigned char>(q[63]), 0xAB);
+  }
+
+  // past the mapping, a fresh one is zeroed
+  arena.reserve(3 << 20);
+  EXPECT_EQ(arena.getCapacity(), (3 << 20) + 1024);
+  char* q = arena.pool_malloc(3 << 20);
+  EXPECT_EQ(q[0], 0);
+  EXPECT_EQ(q[63], 0);
+  q[(3 << 20) - 1] = 1;
+}
+
+TEST(arena, pool_malloc_throws_past_capacity)
+{
+  CountArena arena;
+  arena.reserve(4096);
+  uint64_t capacity = arena.getCapacity();
+  arena.pool_malloc(capacity - 100);
+  EXPECT_THROW(arena.pool_malloc(101, "test"), MemoryError);
+  // a failed allocation takes nothing
+  EXPECT_EQ(arena.getUsedSpace(), capacity - 100);
+  arena.pool_malloc(100);
+  EXPECT_EQ(arena.getUsedSpace(), capacity);
+  EXPECT_THROW(arena.pool_malloc(1), MemoryError);
+
+  arena.free_all();
+  EXPECT_EQ(arena.getUsedSpace(), 0);
+  EXPECT_EQ(arena.high_water(), capacity);
+  EXPECT_THROW(arena.pool_malloc(capacity + 1), MemoryError);
+}
+
+TEST(arena, align)
+{
+  CountArena arena;
+  arena.reserve(4096);
+  arena.pool_malloc(3);
+  arena.align(64);
+  char* p = arena.pool_malloc(8);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 64, 0);
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <kmtricks/loser_tree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace {
+
+using runs_t = std::vector<std::vector<uint64_t>>;
+
+runs_t make_runs(uint32_t n, size_t total)
+{
+  std::mt19937_64 rng(n);
+  runs_t runs(n);
+  for (size_t i = 0; i < total; i++)
+    runs[rng() % n].push_back(rng());
+  for (auto& run : runs)
+    std::sort(run.begin(), run.end());
+  return runs;
+}
+
+// The former merge core: every pop scans the heads of all the runs.
+uint64_t scan_merge(const runs_t& runs)
+{
+  std::vector<size_t> heads(runs.size(), 0);
+  uint64_t sum = 0;
+  while (true)
+  {
+    size_t best = runs.size();
+    for (size_t i = 0; i < runs.size(); i++)
+      if (heads[i] < runs[i].size() &&
+          (best == runs.size() || runs[i][heads[i]] < runs[best][heads[best]]))
+        best = i;
+    if (best == runs.size())
+      return sum;
+    sum += runs[best][heads[best]++];
+  }
+}
+
+uint64_t tree_merge(const runs_t& runs)
+{
+  std::vector<size_t> heads(runs.size(), 0);
+  auto less = [&](uint32_t a, uint32_t b) {
+    bool ea = heads[a] == runs[a].size();
+    bool eb = heads[b] == runs[b].size();
+    if (ea || eb)
+      return !ea && eb;
+    return runs[a][heads[a]] < runs[b][heads[b]] ||
+           (runs[a][heads[a]] == runs[b][heads[b]] && a < b);
+  };
+  km::LoserTree<decltype(less)> tree(runs.size(), less);
+  uint64_t sum = 0;
+  while (!tree.empty())
+  {
+    uint32_t w = tree.top();
+    if (heads[w] == runs[w].size())
+      break;
+    sum += runs[w][heads[w]++];
+    tree.replay(w);
+  }
+  return sum;
+}
+
+template<typename F>
+double ns_per_item(F&& f, const runs_t& runs, size_t total, uint64_t& sum)
+{
+  auto start = std::chrono::steady_clock::now();
+  sum = f(runs);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / total;
+}
+
+};
+
+TEST(bench_merge, loser_tree_vs_scan)
+{
+  for (uint32_t n : {10, 1000, 10000})
+  {
+    size_t total = std::max<size_t>(n * 20, 200000);
+    runs_t runs = make_runs(n, total);
+    uint64_t s1, s2;
+    double scan = ns_per_item(scan_merge, runs, total, s1);
+    double tree = ns_per_item(tree_merge, runs, total, s2);
+    EXPECT_EQ(s1, s2);
+    std::cout << "N=" << n << " scan " << scan << " ns/item, loser tree " << tree
+              << " ns/item, x" << scan / tree << std::endl;
+  }
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <kmtricks/radix_sort.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace {
+
+std::vector<uint64_t> random_values(size_t size, uint64_t mask)
+{
+  std::mt19937_64 rng(size);
+  std::vector<uint64_t> values(size);
+  for (auto& v : values)
+    v = rng() & mask;
+  return values;
+}
+
+template<typename F>
+double ns_per_item(F&& f, std::vector<uint64_t> values, const std::vector<uint64_t>& expected)
+{
+  auto start = std::chrono::steady_clock::now();
+  f(values);
+  auto end = std::chrono::steady_clock::now();
+  EXPECT_EQ(values, expected);
+  return std::chrono::duration<double, std::nano>(end - start).count() / values.size();
+}
+
+};
+
+TEST(bench_radix_sort, lsd_vs_std_sort)
+{
+  // full 64-bit keys, and k-mers of a partition sharing their high bytes
+  for (uint64_t mask : {~0ULL, 0xFFFFFFFFFFULL})
+  {
+    for (size_t size : {10000, 1000000, 10000000})
+    {
+      std::vector<uint64_t> values = random_values(size, mask);
+      std::vector<uint64_t> expected = values;
+      std::sort(expected.begin(), expected.end());
+      std::vector<uint64_t> buffer(size);
+      double std_sort = ns_per_item([](auto& v) { std::sort(v.begin(), v.end()); },
+                                    values, expected);
+      double radix = ns_per_item([&](auto& v) {
+        km::lsd_radix_sort(v.data(), v.size(), buffer.data());
+      }, values, expected);
+      std::cout << "mask=" << std::hex << mask << std::dec << " N=" << size
+                << " std::sort " << std_sort << " ns/item, radix " << radix
+                << " ns/item, x" << std_sort / radix << std::endl;
+    }
+  }
+}
+
+TEST(bench_radix_sort, hashes_vs_std_sort)
+{
+  // a buffer of an eighth of the hashes, as with a bounded count memory
+  for (size_t size : {1000000, 10000000})
+  {
+    std::vector<uint64_t> values = random_values(size, ~0ULL);
+    std::vector<uint64_t> expected = values;
+    std::sort(expected.begin(), expected.end());
+    std::vector<uint64_t> buffer(size / 8);
+    double std_sort = ns_per_item([](auto& v) { std::sort(v.begin(), v.end()); },
+                                  values, expected);
+    double radix = ns_per_item([&](auto& v) {
+      km::radix_sort_hashes(v.data(), v.size(), buffer.data(), buffer.size());
+    }, values, expected);
+    std::cout << "N=" << size << " std::sort " << std_sort << " ns/item, radix_sort_hashes "
+              << radix << " ns/item, x" << std_sort / radix << std::endl;
+  }
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <kmtricks/gatb/superk_decoder.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// A block of random super-k-mers as written in .skp files.
+std::vector<uint8_t> random_block(size_t kmer_size, size_t nb)
+{
+  std::mt19937 rng(kmer_size);
+  std::vector<uint8_t> block;
+  for (size_t s = 0; s < nb; s++)
+  {
+    size_t nbk = 1 + rng() % (64 - kmer_size % 32);
+    block.push_back(nbk);
+    for (size_t i = 0; i < (kmer_size + nbk - 1 + 3) / 4; i++)
+      block.push_back(rng());
+  }
+  return block;
+}
+
+template<size_t span>
+using kmers_t = std::vector<typename ::Kmer<span>::Type>;
+
+// The former decoding loop, one nucleotide at a time on the gatb Type. Canonical k-mers are
+// stored, as counting does, and the number of k-mers is returned.
+template<size_t span>
+size_t nucleotide_loop(const std::vector<uint8_t>& block, size_t kmer_size, kmers_t<span>& out)
+{
+  using Type = typename ::Kmer<span>::Type;
+  Type un; un.setVal(1);
+  Type mask = (un << (kmer_size * 2)) - un;
+  size_t shift = 2 * (kmer_size - 1);
+  size_t nb_kmers = 0;
+  const uint8_t* ptr = block.data();
+  while (ptr < block.data() + block.size())
+  {
+    uint8_t nbk = *ptr++;
+    int rem_size = kmer_size;
+    Type seed, byte;
+    seed.setVal(0);
+    int nbr = 0;
+    uint8_t newbyte = 0;
+    while (rem_size >= 4)
+    {
+      newbyte = *ptr++;
+      byte.setVal(newbyte);
+      seed = seed | (byte << (8 * nbr));
+      rem_size -= 4;
+      nbr++;
+    }
+    int uid = 4;
+    if (rem_size > 0)
+    {
+      newbyte = *ptr++;
+      byte.setVal(newbyte);
+      seed = seed | (byte << (8 * nbr));
+      uid = rem_size;
+    }
+    Type fw = seed & mask;
+    Type rv = revcomp(fw, kmer_size);
+    for (int rem = nbk; rem > 0; rem--)
+    {
+      out[nb_kmers++] = fw < rv ? fw : rv;
+      if (rem < 2)
+        break;
+      if (uid >= 4)
+      {
+        newbyte = *ptr++;
+        uid = 0;
+      }
+      Type nt;
+      nt.setVal((newbyte >> (2 * uid)) & 3);
+      uid++;
+      fw = ((fw << 2) | nt) & mask;
+      nt.setVal(comp_NT[nt.getVal()]);
+      rv = ((rv >> 2) | (nt << shift)) & mask;
+    }
+  }
+  return nb_kmers;
+}
+
+template<size_t span>
+size_t decoder_loop(const std::vector<uint8_t>& block, size_t kmer_size, kmers_t<span>& out)
+{
+  km::SuperkDecoder<span> decoder(kmer_size);
+  size_t nb_kmers = 0;
+  const uint8_t* ptr = block.data();
+  while (ptr < block.data() + block.size())
+  {
+    ptr = decoder.decode(ptr);
+    for (size_t i = 0; i < decoder.size(); i++)
+      out[nb_kmers++] = decoder.canonical()[i];
+  }
+  return nb_kmers;
+}
+
+template<typename F>
+double best_ns_per_kmer(F&& f)
+{
+  double best = 0;
+  for (size_t run = 0; run < 5; run++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    size_t nb_kmers = f();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / nb_kmers;
+    best = run ? std::min(best, ns) : ns;
+  }
+  return best;
+}
+
+template<size_t span>
+void compare(size_t kmer_size)
+{
+  std::vector<uint8_t> block = random_block(kmer_size, 200000);
+  // at most 64 k-mers per super-k-mer
+  kmers_t<span> k1(200000 * 64), k2(200000 * 64);
+  size_t n1 = 0, n2 = 0;
+  double loop = best_ns_per_kmer([&]() { return n1 = nucleotide_loop<span>(block, kmer_size, k1); });
+  double decoder = best_ns_per_kmer([&]() { return n2 = decoder_loop<span>(block, kmer_size, k2); });
+  ASSERT_EQ(n1, n2);
+  for (size_t i = 0; i < n1; i++)
+    ASSERT_TRUE(k1[i] == k2[i]);
+  std::cout << "k=" << kmer_size << " span=" << span << " nucleotide loop " << loop
+            << " ns/k-mer, SuperkDecoder " << decoder << " ns/k-mer, x" << loop / decoder
+            << std::endl;
+}
+
+};
+
+TEST(bench_superk_decoder, decoder_vs_nucleotide_loop)
+{
+  compare<32>(31);
+  compare<64>(61);
+  compare<96>(81);
+}
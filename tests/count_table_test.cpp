@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <gatb/gatb_core.hpp>
+#include <kmtricks/count_table.hpp>
+
+#include <map>
+#include <random>
+
+using namespace km;
+
+namespace {
+
+template<typename K>
+std::map<K, uint32_t> drain(CountTable<K>& table)
+{
+  std::map<K, uint32_t> out;
+  const KeyCount<K>* records = table.sort();
+  for (size_t i = 0; i < table.size(); i++)
+  {
+    EXPECT_TRUE(i == 0 || records[i-1].key < records[i].key);
+    out[records[i].key] = records[i].count;
+  }
+  table.clear();
+  return out;
+}
+
+};
+
+TEST(count_table, counts)
+{
+  std::mt19937_64 rng(3);
+  std::vector<KeyCount<uint64_t>> memory(1000);
+  CountTable<uint64_t> table(memory.data(), memory.size() * sizeof(KeyCount<uint64_t>));
+  EXPECT_EQ(table.capacity(), 512);
+
+  std::map<uint64_t, uint32_t> expected;
+  for (size_t i = 0; i < 5000; i++)
+  {
+    // 300 distinct keys for 384 slots before the table is full
+    uint64_t key = (rng() % 150) * 4 + (uint64_t{1} << 60) * (i & 1);
+    uint32_t count = i % 7 ? 1 : 5;
+    ASSERT_TRUE(table.add(key, count));
+    expected[key] += count;
+  }
+  EXPECT_EQ(table.size(), expected.size());
+  EXPECT_EQ(drain(table), expected);
+
+  // cleared tables are reused
+  EXPECT_EQ(table.size(), 0);
+  EXPECT_TRUE(table.add(0, 2));
+  EXPECT_TRUE(table.add(0));
+  EXPECT_EQ(drain(table), (std::map<uint64_t, uint32_t>{{0, 3}}));
+}
+
+TEST(count_table, full)
+{
+  std::vector<KeyCount<uint64_t>> memory(64);
+  CountTable<uint64_t> table(memory.data(), memory.size() * sizeof(KeyCount<uint64_t>));
+  ASSERT_EQ(table.capacity(), 64);
+
+  uint64_t key = 1;
+  while (table.add(key))
+    key++;
+  EXPECT_EQ(table.size(), 48);
+  EXPECT_EQ(key, 49);
+  // known keys are still counted
+  EXPECT_TRUE(table.add(1, 4));
+  EXPECT_FALSE(table.add(key));
+  EXPECT_EQ(table.size(), 48);
+
+  auto records = drain(table);
+  EXPECT_EQ(records.size(), 48);
+  EXPECT_EQ(records[1], 5);
+  EXPECT_EQ(records[48], 1);
+
+  // memory() is enough for the distinct keys of a partition
+  for (uint64_t distinct : {1, 47, 48, 49, 1000})
+  {
+    std::vector<char> bytes(CountTable<uint64_t>::memory(distinct));
+    CountTable<uint64_t> sized(bytes.data(), bytes.size());
+    for (uint64_t k = 0; k < distinct; k++)
+      ASSERT_TRUE(sized.add(k * 977)) << distinct;
+  }
+}
+
+TEST(count_table, saturation)
+{
+  constexpr uint32_t max = std::numeric_limits<uint32_t>::max();
+  std::vector<KeyCount<uint64_t>> memory(16);
+  CountTable<uint64_t> table(memory.data(), memory.size() * sizeof(KeyCount<uint64_t>));
+  EXPECT_TRUE(table.add(7, max - 2));
+  EXPECT_TRUE(table.add(7, 5));
+  EXPECT_TRUE(table.add(7));
+  EXPECT_TRUE(table.add(8, max));
+  EXPECT_TRUE(table.add(8, max));
+  EXPECT_EQ(drain(table), (std::map<uint64_t, uint32_t>{{7, max}, {8, max}}));
+}
+
+TEST(count_table, gatb_kmers)
+{
+  typedef typename ::Kmer<64>::Type Type;
+  std::mt19937_64 rng(5);
+  std::vector<KeyCount<Type>> memory(256);
+  CountTable<Type> table(memory.data(), memory.size() * sizeof(KeyCount<Type>));
+
+  // keys only differing in their high word
+  std::map<Type, uint32_t> expected;
+  for (size_t i = 0; i < 1000; i++)
+  {
+    Type key; key.setVal(rng() % 50);
+    key = (key << 64) + static_cast<uint64_t>(i % 2);
+    ASSERT_TRUE(table.add(key));
+    expected[key]++;
+  }
+  EXPECT_EQ(drain(table), expected);
+}
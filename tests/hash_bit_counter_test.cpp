@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <kmtricks/gatb/sorting_count.hpp>
+#include <kmtricks/io/superk_storage.hpp>
+
+#include <random>
+
+using namespace km;
+
+namespace {
+
+constexpr size_t kmer_size = 31;
+constexpr uint64_t window = 4000;
+
+// Writes two partitions of random super-k-mers in blocks of about 2KB, the second one with
+// multiplicity records. Returns the number of k-mers of each partition.
+std::vector<uint64_t> write_partitions(const std::string& dir)
+{
+  std::mt19937 rng(23);
+  std::vector<uint64_t> nb_kmers(2, 0);
+  // multiplicity flags are only saved with dedup
+  SuperKStorageWriter writer(dir, "skp", 2, false, {0, 1}, false, false, 1);
+  for (int p : {0, 1})
+  {
+    std::vector<uint8_t> block;
+    auto push = [&]() {
+      std::unique_ptr<uint8_t[]> data(new uint8_t[block.size()]);
+      std::copy(block.begin(), block.end(), data.get());
+      SuperkBlock b {std::move(data), static_cast<uint32_t>(block.size()),
+                     static_cast<uint32_t>(block.size()), p, 1};
+      b.multiplicity = p == 1;
+      writer.pushBlock(std::move(b));
+      block.clear();
+    };
+    for (size_t s = 0; s < 600; s++)
+    {
+      if (p == 1 && s % 4 == 0)
+      {
+        uint32_t count = 2 + rng() % 3;
+        block.push_back(0);
+        block.insert(block.end(), reinterpret_cast<uint8_t*>(&count),
+                     reinterpret_cast<uint8_t*>(&count) + sizeof(count));
+      }
+      size_t nbk = 1 + rng() % 20;
+      nb_kmers[p] += nbk;
+      block.push_back(nbk);
+      for (size_t i = 0; i < (kmer_size + nbk - 1 + 3) / 4; i++)
+        block.push_back(rng());
+      if (block.size() > 2048)
+        push();
+    }
+    if (!block.empty())
+      push();
+  }
+  writer.closeFiles();
+  writer.SaveInfoFile(dir);
+  return nb_kmers;
+}
+
+std::vector<uint8_t> reference_bits(SuperKStorageReader& storage, int part, uint64_t nb_kmers,
+                                    uint32_t abundance_min)
+{
+  PartiInfo<5> pinfo(2, 10);
+  pinfo.incKmer(part, nb_kmers);
+  auto writer = std::make_shared<BitVectorWriter<8192>>(
+    fmt::format("./tests_tmp/hash_bit_ref_{}", part), window, 0, part, false);
+  HashVecProcessor<32> processor(kmer_size, abundance_min, writer, nullptr, window);
+  CountArena& pool = CountArena::local();
+  pool.reserve(CountTable<uint64_t>::memory(nb_kmers) + get_required_memory_hash<32>(nb_kmers));
+  HashPartCounter<SuperKStorageReader, 32> counter(&processor, &pinfo, part, kmer_size, pool,
+                                                   &storage, window);
+  // multiplicity records are only counted in a table
+  if (storage.hasMultiplicity(part))
+    counter.count_in_table("./tests_tmp/hash_bit_ref");
+  counter.execute();
+  pool.free_all();
+  return processor.bits();
+}
+
+std::vector<uint8_t> presence_bits(SuperKStorageReader& storage, int part, uint64_t nb_kmers,
+                                   uint32_t abundance_min)
+{
+  PartiInfo<5> pinfo(2, 10);
+  pinfo.incKmer(part, nb_kmers);
+  auto writer = std::make_shared<BitVectorWriter<8192>>(
+    fmt::format("./tests_tmp/hash_bit_{}", part), window, 0, part, false);
+  HashVecProcessor<32> processor(kmer_size, abundance_min, writer, nullptr, window);
+  CountArena& pool = CountArena::local();
+  // bits left by a previous task are cleared
+  pool.reserve(HashBitCounter<SuperKStorageReader, 32>::required_memory(window, abundance_min));
+  std::memset(pool.pool_malloc(pool.getCapacity()), 0xFF, pool.getCapacity());
+  pool.free_all();
+  HashBitCounter<SuperKStorageReader, 32> counter(&processor, &pinfo, part, kmer_size, pool,
+                                                  &storage, window, abundance_min);
+  counter.execute();
+  EXPECT_EQ(pool.getUsedSpace(),
+            (HashBitCounter<SuperKStorageReader, 32>::required_memory(window, abundance_min)));
+  pool.free_all();
+  return processor.bits();
+}
+
+size_t popcount(const std::vector<uint8_t>& bits)
+{
+  size_t n = 0;
+  for (auto b : bits)
+    n += __builtin_popcount(b);
+  return n;
+}
+
+};
+
+TEST(hash_bit_counter, same_bits_as_sort)
+{
+  std::string dir = "./tests_tmp/hash_bit_counter";
+  fs::remove_all(dir);
+  std::vector<uint64_t> nb_kmers = write_partitions(dir);
+
+  SuperKStorageReader storage(dir);
+  EXPECT_FALSE(storage.hasMultiplicity(0));
+  EXPECT_TRUE(storage.hasMultiplicity(1));
+  for (int part : {0, 1})
+  {
+    for (uint32_t abundance_min : {1, 2})
+    {
+      std::vector<uint8_t> expected = reference_bits(storage, part, nb_kmers[part], abundance_min);
+      // some hashes are seen once, some several times
+      EXPECT_GT(popcount(expected), 0);
+      if (abundance_min == 2)
+        EXPECT_LT(popcount(expected), popcount(reference_bits(storage, part, nb_kmers[part], 1)));
+
+      EXPECT_EQ(presence_bits(storage, part, nb_kmers[part], abundance_min), expected)
+        << "P=" << part << " a=" << abundance_min;
+
+      // large partitions are read by idle workers, which set the bits concurrently
+      TaskPool pool(3);
+      EXPECT_EQ(presence_bits(storage, part, 1 << 20, abundance_min), expected)
+        << "P=" << part << " a=" << abundance_min << " concurrent";
+    }
+  }
+}
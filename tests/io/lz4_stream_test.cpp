@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/lz4_stream.hpp>
+
+#include <random>
+#include <sstream>
+
+namespace {
+
+std::string sample_data(size_t size)
+{
+  std::mt19937 rng(7);
+  std::string data(size, 0);
+  for (auto& c : data)
+    c = "ACGT"[rng() % 4];
+  return data;
+}
+
+};
+
+TEST(lz4_stream, round_trip)
+{
+  std::string data = sample_data(1 << 20);
+  std::stringstream sink;
+  {
+    lz4_stream::basic_ostream<> out(sink);
+    out.write(data.data(), data.size());
+  }
+  lz4_stream::basic_istream<> in(sink);
+  std::string decoded((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  EXPECT_EQ(decoded, data);
+}
+
+TEST(lz4_stream, sync_writes_blocks_in_flight)
+{
+  // full blocks only, all submitted once written
+  std::string data = sample_data(64 * (64 << 10));
+  std::stringstream sink;
+  lz4_stream::basic_ostream<> out(sink);
+  out.write(data.data(), data.size());
+  out.flush();
+  size_t flushed = sink.str().size();
+  out.close();
+  // only the end mark is left
+  EXPECT_EQ(sink.str().size(), flushed + 4);
+}
+
+TEST(lz4_stream, many_streams_on_idle_workers)
+{
+  // more streams than the pool bound allows in flight, blocks of the others are compressed
+  // by their producer
+  km::TaskPool pool(2);
+  std::string data = sample_data(8 * (64 << 10) + 123);
+  std::vector<std::stringstream> sinks(64);
+  {
+    std::vector<std::unique_ptr<lz4_stream::basic_ostream<>>> outs;
+    for (auto& sink : sinks)
+      outs.push_back(std::make_unique<lz4_stream::basic_ostream<>>(sink));
+    for (size_t pos = 0; pos < data.size(); pos += 10000)
+      for (auto& out : outs)
+        out->write(data.data() + pos, std::min<size_t>(10000, data.size() - pos));
+  }
+  pool.join_all();
+  for (auto& sink : sinks)
+  {
+    lz4_stream::basic_istream<> in(sink);
+    std::string decoded((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(decoded, data);
+  }
+}
@@ -2,6 +2,9 @@
 #include <kmtricks/io/matrix_file.hpp>
 #include <kmtricks/utils.hpp>
 
+#include <algorithm>
+#include <random>
+
 using namespace km;
 
 TEST(matrix_file, MatrixWriter)
@@ -113,4 +116,123 @@ TEST(matrix_file, MatrixHashWriteRead)
       EXPECT_TRUE(std::equal(c.begin(), c.end(), counts[i].begin()));
     }
   }
-}
\ No newline at end of file
+}
+
+namespace {
+
+// Sorted distinct k-mers and counts with empty, dense and mostly null columns.
+template<size_t MAX_K, typename count_type>
+void block_rows(size_t nb, size_t kmer_size, size_t nb_counts,
+                std::vector<Kmer<MAX_K>>& kmers, std::vector<std::vector<count_type>>& counts)
+{
+  std::mt19937 rng(kmer_size);
+  for (size_t i=0; i<nb; i++)
+    kmers.emplace_back(random_dna_seq(kmer_size));
+  std::sort(kmers.begin(), kmers.end());
+  kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+  counts.assign(kmers.size(), std::vector<count_type>(nb_counts, 0));
+  for (auto& row : counts)
+    for (size_t s=1; s<nb_counts; s++)
+      if (s % 3 != 2 || rng() % 20 == 0)
+        row[s] = 1 + rng() % std::min<uint64_t>(std::numeric_limits<count_type>::max(), 100000);
+}
+
+};
+
+TEST(matrix_file, MatrixBlockWriteRead)
+{
+  std::vector<Kmer<32>> kmers;
+  std::vector<std::vector<uint8_t>> counts;
+  block_rows(1000, 21, 12, kmers, counts);
+  {
+    // blocks of 64 rows, the last one partial
+    MatrixBlockWriter mw("tests_tmp/m3.block_matrix", 21, 1, 12, 1, 2, 64);
+    for (size_t i=0; i<kmers.size(); i++)
+      mw.write<32, 255>(kmers[i], counts[i]);
+  }
+  MatrixBlockReader mr("tests_tmp/m3.block_matrix");
+  EXPECT_EQ(mr.infos().block_rows, 64);
+  EXPECT_EQ(mr.nb_blocks(), (kmers.size() + 63) / 64);
+  Kmer<32> kmer; kmer.set_k(21);
+  std::vector<uint8_t> c(12);
+  for (size_t i=0; i<kmers.size(); i++)
+  {
+    ASSERT_TRUE((mr.read<32, 255>(kmer, c)));
+    EXPECT_EQ(kmer, kmers[i]);
+    EXPECT_EQ(c, counts[i]);
+  }
+  EXPECT_FALSE((mr.read<32, 255>(kmer, c)));
+
+  // to a k-mer of the matrix, then to the first one after a missing k-mer
+  mr.seek(kmers[700]);
+  ASSERT_TRUE((mr.read<32, 255>(kmer, c)));
+  EXPECT_EQ(kmer, kmers[700]);
+  EXPECT_EQ(c, counts[700]);
+  Kmer<32> missing = kmers[300];
+  missing.set64(kmers[300].get64() + 1);
+  if (missing != kmers[301])
+  {
+    mr.seek(missing);
+    ASSERT_TRUE((mr.read<32, 255>(kmer, c)));
+    EXPECT_EQ(kmer, kmers[301]);
+  }
+  mr.seek_block(2);
+  ASSERT_TRUE((mr.read<32, 255>(kmer, c)));
+  EXPECT_EQ(kmer, kmers[128]);
+}
+
+TEST(matrix_file, MatrixBlockWideKmers)
+{
+  std::vector<Kmer<64>> kmers;
+  std::vector<std::vector<uint16_t>> counts;
+  block_rows(500, 41, 5, kmers, counts);
+  {
+    MatrixBlockWriter mw("tests_tmp/m4.block_matrix", 41, 2, 5, 1, 2, 64);
+    for (size_t i=0; i<kmers.size(); i++)
+      mw.write<64, 65535>(kmers[i], counts[i]);
+  }
+  MatrixBlockReader mr("tests_tmp/m4.block_matrix");
+  Kmer<64> kmer; kmer.set_k(41);
+  std::vector<uint16_t> c(5);
+  for (size_t i=0; i<kmers.size(); i++)
+  {
+    ASSERT_TRUE((mr.read<64, 65535>(kmer, c)));
+    EXPECT_EQ(kmer.to_string(), kmers[i].to_string());
+    EXPECT_EQ(c, counts[i]);
+  }
+  EXPECT_FALSE((mr.read<64, 65535>(kmer, c)));
+  mr.seek(kmers[250]);
+  ASSERT_TRUE((mr.read<64, 65535>(kmer, c)));
+  EXPECT_EQ(kmer.to_string(), kmers[250].to_string());
+}
+
+TEST(matrix_file, MatrixBlockHashes)
+{
+  std::vector<uint64_t> hashes;
+  std::vector<std::vector<uint32_t>> counts;
+  std::mt19937_64 rng(5);
+  for (size_t i=0; i<700; i++)
+    hashes.push_back(rng() >> 20);
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+  for (size_t i=0; i<hashes.size(); i++)
+    counts.push_back({0, static_cast<uint32_t>(rng()), i % 10 == 0 ? 70000u : 0u});
+  {
+    MatrixBlockWriter mw("tests_tmp/m5.block_matrix", 0, 4, 3, 1, 2, 128);
+    for (size_t i=0; i<hashes.size(); i++)
+      mw.write<0xFFFFFFFF>(hashes[i], counts[i]);
+  }
+  MatrixBlockReader mr("tests_tmp/m5.block_matrix");
+  uint64_t hash;
+  std::vector<uint32_t> c(3);
+  for (size_t i=0; i<hashes.size(); i++)
+  {
+    ASSERT_TRUE(mr.read<0xFFFFFFFF>(hash, c));
+    EXPECT_EQ(hash, hashes[i]);
+    EXPECT_EQ(c, counts[i]);
+  }
+  EXPECT_FALSE(mr.read<0xFFFFFFFF>(hash, c));
+  mr.seek(hashes[400] - 1);
+  ASSERT_TRUE(mr.read<0xFFFFFFFF>(hash, c));
+  EXPECT_EQ(hash, hashes[400 - (hashes[399] == hashes[400] - 1)]);
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/read_ahead.hpp>
+#include <kmtricks/io/kmer_file.hpp>
+#include <kmtricks/utils.hpp>
+#include <fstream>
+#include <iterator>
+
+using namespace km;
+
+namespace {
+
+std::string write_bytes(const std::string& path, size_t size)
+{
+  std::string bytes(size, 0);
+  for (size_t i=0; i<size; i++)
+    bytes[i] = static_cast<char>((i * 131 + i / 251) % 256);
+  std::ofstream out(path, std::ios::binary);
+  out.write(bytes.data(), bytes.size());
+  return bytes;
+}
+
+std::vector<std::string> write_kmers(const std::string& path, bool compressed, size_t n)
+{
+  std::vector<std::string> kmers(n);
+  KmerWriter kw(path, 21, 1, 1, 2, compressed);
+  for (size_t i=0; i<n; i++)
+  {
+    kmers[i] = random_dna_seq(21);
+    Kmer<32> kmer(kmers[i]);
+    kw.write<32, 255>(kmer, i % 255);
+  }
+  return kmers;
+}
+
+size_t file_size(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  return in.tellg();
+}
+
+};
+
+TEST(read_ahead, ReadAheadStream)
+{
+  std::string bytes = write_bytes("tests_tmp/read_ahead.bin", 10007);
+
+  for (size_t offset : {0, 13, 10007})
+  {
+    // blocks of one byte, smaller than a read, and larger than the file
+    for (size_t block_size : {1, 3, 64, 4096, 1 << 16})
+    {
+      {
+        ReadAheadStream in("tests_tmp/read_ahead.bin", offset, block_size);
+        std::string read((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(read, bytes.substr(offset)) << offset << " " << block_size;
+      }
+      {
+        // reads which span several blocks, or stop inside one
+        ReadAheadStream in("tests_tmp/read_ahead.bin", offset, block_size);
+        std::string read;
+        char chunk[37];
+        while (in.read(chunk, sizeof(chunk)) || in.gcount())
+          read.append(chunk, in.gcount());
+        EXPECT_EQ(read, bytes.substr(offset)) << offset << " " << block_size;
+      }
+    }
+  }
+
+  EXPECT_THROW(ReadAheadStream("tests_tmp/read_ahead.missing", 0, 64), IOError);
+}
+
+TEST(read_ahead, ReadAheadStreamHeader)
+{
+  write_kmers("tests_tmp/read_ahead_header.kmer", false, 10);
+  size_t header_size = get_header_size<KmerFileHeader>();
+  std::ifstream raw("tests_tmp/read_ahead_header.kmer", std::ios::binary);
+  std::string file((std::istreambuf_iterator<char>(raw)), std::istreambuf_iterator<char>());
+  ASSERT_EQ(file.size(), header_size + 10 * 9);
+
+  for (size_t block_size : {size_t{3}, header_size - 1, header_size, size_t{1} << 20})
+  {
+    ReadAheadStream in("tests_tmp/read_ahead_header.kmer", 0, block_size);
+    KmerFileHeader header;
+    header.deserialize(&in);
+    EXPECT_NO_THROW(header.sanity_check()) << block_size;
+    EXPECT_EQ(header.kmer_size, 21);
+    EXPECT_EQ(header.id, 1);
+    EXPECT_EQ(header.partition, 2);
+    // the records follow in the same block or in the next ones
+    std::string rest((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(rest, file.substr(header_size)) << block_size;
+  }
+}
+
+TEST(read_ahead, KmerReader)
+{
+  for (bool compressed : {false, true})
+  {
+    std::string path = compressed ? "tests_tmp/read_ahead.kmer.lz4" : "tests_tmp/read_ahead.kmer";
+    std::vector<std::string> kmers = write_kmers(path, compressed, 10000);
+    size_t size = file_size(path);
+    size_t record = 8 + 1;
+    ASSERT_GT(size, get_header_size<KmerFileHeader>());
+
+    // smaller than the header, smaller than one record, larger than the file
+    for (size_t read_ahead : {size_t{3}, record - 1, size_t{4096}, size + 1})
+    {
+      KmerReader kr(path, read_ahead);
+      EXPECT_EQ(kr.infos().compressed, compressed);
+      Kmer<32> kmer; kmer.set_k(kr.infos().kmer_size);
+      uint8_t c = 0;
+      for (size_t i=0; i<kmers.size(); i++)
+      {
+        ASSERT_TRUE((kr.read<32, 255>(kmer, c))) << read_ahead << " " << i;
+        ASSERT_EQ(kmer.to_string(), kmers[i]) << read_ahead << " " << i;
+        ASSERT_EQ(c, i % 255);
+      }
+      EXPECT_FALSE((kr.read<32, 255>(kmer, c))) << read_ahead;
+    }
+  }
+}
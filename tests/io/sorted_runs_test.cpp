@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/sorted_runs.hpp>
+#include <kmtricks/utils.hpp>
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+using namespace km;
+
+namespace {
+
+std::map<uint64_t, uint32_t> merged(SortedRuns<uint64_t>& runs)
+{
+  std::map<uint64_t, uint32_t> out;
+  uint64_t last = 0;
+  runs.merge([&](uint64_t key, uint32_t count) {
+    EXPECT_TRUE(out.empty() || key > last);
+    last = key;
+    out[key] = count;
+  });
+  return out;
+}
+
+size_t run_files(const std::string& prefix)
+{
+  size_t n = 0;
+  for (auto& e : fs::directory_iterator(fs::path(prefix).parent_path()))
+    n += e.path().filename().string().rfind(fs::path(prefix).filename().string() + ".run", 0) == 0;
+  return n;
+}
+
+};
+
+TEST(sorted_runs, merge)
+{
+  std::mt19937_64 rng(7);
+  std::vector<uint64_t> scratch(64);
+  std::map<uint64_t, uint32_t> expected;
+  {
+    SortedRuns<uint64_t> runs("./tests_tmp/sr_merge", scratch.data(), scratch.size() * 8);
+    for (size_t r = 0; r < 9; r++)
+    {
+      std::vector<uint64_t> keys(rng() % 3000);
+      for (auto& k : keys)
+      {
+        k = rng() % 2000;
+        expected[k]++;
+      }
+      std::sort(keys.begin(), keys.end());
+      runs.add(keys.data(), keys.size());
+    }
+    // a run of records, its counts are summed with the others
+    std::vector<KeyCount<uint64_t>> records {{3, 10}, {1999, 5}, {5000, 1}};
+    for (auto& r : records)
+      expected[r.key] += r.count;
+    runs.add(records.data(), records.size());
+    runs.add(records.data(), 0);
+
+    EXPECT_LE(runs.size(), 10);
+    EXPECT_EQ(merged(runs), expected);
+    EXPECT_EQ(run_files("./tests_tmp/sr_merge"), runs.size());
+  }
+  EXPECT_EQ(run_files("./tests_tmp/sr_merge"), 0);
+}
+
+TEST(sorted_runs, compaction)
+{
+  std::vector<uint64_t> scratch(4);
+  std::map<uint64_t, uint32_t> expected;
+  {
+    // two records of scratch, less than one per run when they are compacted
+    SortedRuns<uint64_t> runs("./tests_tmp/sr_compact", scratch.data(), scratch.size() * 8, 3);
+    for (uint64_t r = 0; r < 20; r++)
+    {
+      std::vector<uint64_t> keys;
+      for (uint64_t k = r; k < 100; k += r % 4 + 1)
+      {
+        keys.push_back(k);
+        keys.push_back(k);
+        expected[k] += 2;
+      }
+      runs.add(keys.data(), keys.size());
+      EXPECT_LT(runs.size(), 3);
+      EXPECT_EQ(run_files("./tests_tmp/sr_compact"), runs.size());
+    }
+    EXPECT_EQ(merged(runs), expected);
+  }
+  EXPECT_EQ(run_files("./tests_tmp/sr_compact"), 0);
+}
+
+TEST(sorted_runs, saturation)
+{
+  constexpr uint32_t max = std::numeric_limits<uint32_t>::max();
+  std::vector<uint64_t> scratch(64);
+  SortedRuns<uint64_t> runs("./tests_tmp/sr_sat", scratch.data(), scratch.size() * 8, 2);
+  std::vector<KeyCount<uint64_t>> a {{1, max - 1}, {2, max}, {3, 7}};
+  std::vector<KeyCount<uint64_t>> b {{1, 1}, {2, 1}, {4, max}};
+  std::vector<KeyCount<uint64_t>> c {{1, 1}, {2, max}, {3, 1}};
+
+  // each run is compacted with the previous ones, counts saturate there and in merge()
+  runs.add(a.data(), a.size());
+  runs.add(b.data(), b.size());
+  EXPECT_EQ(runs.size(), 1);
+  runs.add(c.data(), c.size());
+  EXPECT_EQ(runs.size(), 1);
+
+  std::map<uint64_t, uint32_t> expected {{1, max}, {2, max}, {3, 8}, {4, max}};
+  EXPECT_EQ(merged(runs), expected);
+}
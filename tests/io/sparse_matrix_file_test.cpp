@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/sparse_matrix_file.hpp>
+#include <kmtricks/utils.hpp>
+
+#include <random>
+
+using namespace km;
+
+namespace {
+
+// Rows alternate between blocks of mostly null rows and blocks of full rows, so that both
+// layouts are written.
+template<typename count_type>
+std::vector<std::vector<count_type>> sparse_counts(size_t nb, size_t nb_counts)
+{
+  std::mt19937 rng(nb);
+  std::vector<std::vector<count_type>> counts(nb, std::vector<count_type>(nb_counts, 0));
+  for (size_t i=0; i<nb; i++)
+  {
+    bool dense = (i / SparseMatrixWriter<>::block_rows) % 2;
+    for (size_t s=0; s<nb_counts; s++)
+      if (dense || rng() % 50 == 0)
+        counts[i][s] = 1 + rng() % std::numeric_limits<count_type>::max();
+  }
+  // ids far apart need several varint bytes
+  counts[3].back() = 7;
+  return counts;
+}
+
+};
+
+TEST(sparse_matrix_file, SparseMatrixWriteRead)
+{
+  size_t nb = 1000, nb_counts = 300;
+  std::vector<std::string> kmers(nb);
+  auto counts = sparse_counts<uint16_t>(nb, nb_counts);
+  for (bool lz4 : {false, true})
+  {
+    std::string path = lz4 ? "tests_tmp/s1.sparse.lz4" : "tests_tmp/s1.sparse";
+    {
+      SparseMatrixWriter sw(path, 31, 2, nb_counts, 1, 2, lz4);
+      for (size_t i=0; i<nb; i++)
+      {
+        if (!lz4)
+          kmers[i] = random_dna_seq(31);
+        Kmer<32> kmer(kmers[i]);
+        sw.write<32, 65535>(kmer, counts[i]);
+      }
+    }
+    SparseMatrixReader sr(path);
+    EXPECT_EQ(sr.infos().nb_counts, nb_counts);
+    EXPECT_FALSE(sr.infos().presence());
+    Kmer<32> kmer; kmer.set_k(31);
+    std::vector<uint16_t> c(nb_counts);
+    for (size_t i=0; i<nb; i++)
+    {
+      ASSERT_TRUE((sr.read<32, 65535>(kmer, c)));
+      EXPECT_EQ(kmer.to_string(), kmers[i]);
+      EXPECT_EQ(c, counts[i]);
+    }
+    EXPECT_FALSE((sr.read<32, 65535>(kmer, c)));
+  }
+
+  // non-null samples only
+  SparseMatrixReader sr("tests_tmp/s1.sparse");
+  Kmer<32> kmer; kmer.set_k(31);
+  std::vector<uint32_t> ids;
+  std::vector<uint16_t> values;
+  for (size_t i=0; i<nb; i++)
+  {
+    ASSERT_TRUE((sr.read_sparse<32, 65535>(kmer, ids, values)));
+    ASSERT_EQ(ids.size(), values.size());
+    std::vector<uint16_t> row(nb_counts, 0);
+    for (size_t j=0; j<ids.size(); j++)
+    {
+      EXPECT_NE(values[j], 0);
+      row[ids[j]] = values[j];
+    }
+    EXPECT_EQ(row, counts[i]);
+  }
+}
+
+TEST(sparse_matrix_file, SparsePresenceHashes)
+{
+  size_t nb = 700, nb_counts = 70;
+  auto counts = sparse_counts<uint8_t>(nb, nb_counts);
+  {
+    SparseMatrixWriter sw("tests_tmp/s2.sparse", 0, 0, nb_counts, 1, 2, false);
+    for (uint64_t i=0; i<nb; i++)
+      sw.write<255>(i * 31, counts[i]);
+  }
+  SparseMatrixReader sr("tests_tmp/s2.sparse");
+  EXPECT_TRUE(sr.infos().presence());
+  uint64_t hash;
+  std::vector<uint8_t> c(nb_counts);
+  for (uint64_t i=0; i<nb; i++)
+  {
+    ASSERT_TRUE(sr.read<255>(hash, c));
+    EXPECT_EQ(hash, i * 31);
+    for (size_t s=0; s<nb_counts; s++)
+      EXPECT_EQ(c[s], counts[i][s] > 0);
+  }
+  EXPECT_FALSE(sr.read<255>(hash, c));
+}
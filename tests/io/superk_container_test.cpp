@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/superk_storage.hpp>
+
+#include <random>
+
+using namespace km;
+
+namespace {
+
+// Blocks of each partition, compressible or not.
+std::vector<std::vector<std::vector<uint8_t>>> sample_blocks(size_t nb_parts)
+{
+  std::mt19937 rng(11);
+  std::vector<std::vector<std::vector<uint8_t>>> blocks(nb_parts);
+  for (size_t p = 0; p < nb_parts; p++)
+  {
+    for (size_t b = 0; b < 5; b++)
+    {
+      std::vector<uint8_t> block(1000 + rng() % 4000);
+      bool random = (p + b) % 2;
+      for (size_t i = 0; i < block.size(); i++)
+        block[i] = random ? rng() : i % 7;
+      blocks[p].push_back(block);
+    }
+  }
+  return blocks;
+}
+
+std::vector<uint8_t> read_block(SuperkContainerReader& reader, const SuperkBlockEntry& entry)
+{
+  unsigned char* buffer = nullptr;
+  unsigned int buffer_size = 0;
+  unsigned int n = reader.read(entry, &buffer, &buffer_size);
+  std::vector<uint8_t> block(buffer, buffer + n);
+  free(buffer);
+  return block;
+}
+
+};
+
+TEST(superk_container, round_trip)
+{
+  auto blocks = sample_blocks(3);
+  for (bool lz4 : {false, true})
+  {
+    std::string path = "./tests_tmp/superk.container";
+    {
+      SuperkContainerWriter writer(path, lz4);
+      // partitions are interleaved
+      for (size_t b = 0; b < 5; b++)
+        for (size_t p = 0; p < blocks.size(); p++)
+          writer.write(blocks[p][b].data(), blocks[p][b].size(), p);
+      writer.close();
+    }
+
+    SuperkContainerReader reader(path, blocks.size());
+    EXPECT_EQ(reader.nb_partitions(), blocks.size());
+    size_t compressed = 0;
+    for (size_t p = 0; p < blocks.size(); p++)
+    {
+      ASSERT_EQ(reader.blocks(p).size(), blocks[p].size());
+      for (size_t b = 0; b < blocks[p].size(); b++)
+      {
+        const SuperkBlockEntry& entry = reader.blocks(p)[b];
+        compressed += entry.size < entry.raw_size;
+        EXPECT_EQ(read_block(reader, entry), blocks[p][b]);
+      }
+    }
+    // random blocks are stored as they are
+    if (lz4)
+      EXPECT_EQ(compressed, 8);
+    else
+      EXPECT_EQ(compressed, 0);
+  }
+}
+
+TEST(superk_container, storage_round_trip)
+{
+  auto blocks = sample_blocks(4);
+  for (bool container : {false, true})
+  {
+    for (bool lz4 : {false, true})
+    {
+      std::string dir = "./tests_tmp/superk_storage";
+      fs::remove_all(dir);
+      {
+        // partition 2 is not kept
+        SuperKStorageWriter writer(dir, "skp", blocks.size(), lz4, {0, 1, 3}, container);
+        for (size_t b = 0; b < 5; b++)
+        {
+          for (size_t p = 0; p < blocks.size(); p++)
+          {
+            std::unique_ptr<uint8_t[]> data(new uint8_t[blocks[p][b].size()]);
+            std::copy(blocks[p][b].begin(), blocks[p][b].end(), data.get());
+            writer.pushBlock({std::move(data), static_cast<uint32_t>(blocks[p][b].size()),
+                              static_cast<uint32_t>(blocks[p][b].size()), static_cast<int>(p), 1});
+          }
+        }
+        writer.closeFiles();
+        writer.SaveInfoFile(dir);
+      }
+      EXPECT_EQ(fs::exists(superk_container_path(dir, "skp")), container);
+
+      SuperKStorageReader reader(dir);
+      for (int p : {0, 1, 3})
+      {
+        EXPECT_EQ(reader.getNbItems(p), 5);
+        reader.openFile(p);
+        unsigned char* buffer = nullptr;
+        unsigned int buffer_size = 0, n = 0;
+        for (size_t b = 0; b < 5; b++)
+        {
+          ASSERT_TRUE(reader.readBlock(&buffer, &buffer_size, &n, p));
+          EXPECT_EQ(std::vector<uint8_t>(buffer, buffer + n), blocks[p][b]);
+        }
+        EXPECT_FALSE(reader.readBlock(&buffer, &buffer_size, &n, p));
+        free(buffer);
+        reader.closeFile(p);
+      }
+      EXPECT_EQ(reader.getNbItems(2), 0);
+    }
+  }
+}
+
+TEST(superk_container, concurrent_producers)
+{
+  // each thread fills its own partitions, blocks of a partition keep their order
+  constexpr size_t nb_threads = 4;
+  constexpr size_t nb_blocks = 200;
+  auto blocks = sample_blocks(nb_threads * 2);
+  for (bool container : {false, true})
+  {
+    std::string dir = "./tests_tmp/superk_concurrent";
+    fs::remove_all(dir);
+    std::unordered_set<int> kept;
+    for (size_t p = 0; p < blocks.size(); p++)
+      kept.insert(p);
+    {
+      SuperKStorageWriter writer(dir, "skp", blocks.size(), false, kept, container);
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < nb_threads; t++)
+        threads.emplace_back([&, t]() {
+          for (size_t b = 0; b < nb_blocks; b++)
+          {
+            size_t p = 2 * t + b % 2;
+            const std::vector<uint8_t>& src = blocks[p][b / 2 % 5];
+            std::unique_ptr<uint8_t[]> data(new uint8_t[src.size()]);
+            std::copy(src.begin(), src.end(), data.get());
+            writer.pushBlock({std::move(data), static_cast<uint32_t>(src.size()),
+                              static_cast<uint32_t>(src.size()), static_cast<int>(p), 1});
+          }
+        });
+      for (auto& t : threads)
+        t.join();
+      writer.closeFiles();
+      writer.SaveInfoFile(dir);
+    }
+
+    SuperKStorageReader reader(dir);
+    unsigned char* buffer = nullptr;
+    unsigned int buffer_size = 0, n = 0;
+    for (size_t p = 0; p < blocks.size(); p++)
+    {
+      EXPECT_EQ(reader.getNbItems(p), nb_blocks / 2);
+      reader.openFile(p);
+      for (size_t b = 0; b < nb_blocks / 2; b++)
+      {
+        ASSERT_TRUE(reader.readBlock(&buffer, &buffer_size, &n, p));
+        EXPECT_EQ(std::vector<uint8_t>(buffer, buffer + n), blocks[p][b % 5]);
+      }
+      EXPECT_FALSE(reader.readBlock(&buffer, &buffer_size, &n, p));
+      reader.closeFile(p);
+    }
+    free(buffer);
+  }
+}
+
+TEST(superk_container, in_memory_budget)
+{
+  // partitions 0 and 1 fit in the budget, partition 2 is moved to disk once it exceeds it
+  auto blocks = sample_blocks(3);
+  for (size_t i = 0; i < 8; i++)
+    for (size_t b = 0; b < 5; b++)
+      blocks[2].push_back(blocks[2][b]);
+  uint64_t kept = 0;
+  for (int p : {0, 1})
+    for (auto& block : blocks[p])
+      kept += block.size();
+  uint64_t budget = kept + 10000;
+
+  for (bool container : {false, true})
+  {
+    std::string dir = "./tests_tmp/superk_memory";
+    fs::remove_all(dir);
+    SuperkMemory::get().set_budget(budget);
+    {
+      SuperKStorageWriter writer(dir, "skp", blocks.size(), false, {0, 1, 2}, container, true);
+      for (size_t p = 0; p < blocks.size(); p++)
+      {
+        for (auto& block : blocks[p])
+        {
+          std::unique_ptr<uint8_t[]> data(new uint8_t[block.size()]);
+          std::copy(block.begin(), block.end(), data.get());
+          writer.pushBlock({std::move(data), static_cast<uint32_t>(block.size()),
+                            static_cast<uint32_t>(block.size()), static_cast<int>(p), 1});
+        }
+      }
+      writer.closeFiles();
+      writer.SaveInfoFile(dir);
+    }
+    // only the spilled partition is on disk
+    EXPECT_EQ(SuperkMemory::get().available(), budget - kept);
+    if (container)
+    {
+      EXPECT_TRUE(fs::exists(superk_container_path(dir, "skp")));
+    }
+    else
+    {
+      EXPECT_FALSE(fs::exists(dir + "/skp.0"));
+      EXPECT_FALSE(fs::exists(dir + "/skp.1"));
+      EXPECT_TRUE(fs::exists(dir + "/skp.2"));
+    }
+
+    {
+      SuperKStorageReader reader(dir);
+      for (size_t p = 0; p < blocks.size(); p++)
+      {
+        EXPECT_EQ(reader.getNbItems(p), blocks[p].size());
+        reader.openFile(p);
+        unsigned char* buffer = nullptr;
+        unsigned int buffer_size = 0, n = 0;
+        for (auto& block : blocks[p])
+        {
+          ASSERT_TRUE(reader.readBlock(&buffer, &buffer_size, &n, p));
+          EXPECT_EQ(std::vector<uint8_t>(buffer, buffer + n), block);
+        }
+        EXPECT_FALSE(reader.readBlock(&buffer, &buffer_size, &n, p));
+        free(buffer);
+        // the spilled partition would be erased by the Eraser thread
+        if (p < 2)
+          reader.releaseFile(p);
+        else
+          reader.closeFile(p);
+      }
+      EXPECT_EQ(SuperkMemory::get().available(), budget);
+    }
+  }
+  SuperkMemory::get().set_budget(0);
+}
@@ -2,6 +2,10 @@
 #include <kmtricks/io/vector_file.hpp>
 #include <kmtricks/io/vector_matrix_file.hpp>
 #include <kmtricks/utils.hpp>
+#include <kmtricks/task_pool.hpp>
+
+#include <fstream>
+#include <sstream>
 
 using namespace km;
 
@@ -42,4 +46,144 @@ TEST(vector_file, BitVecReadWrite)
     bvr2.read(tmp);
     EXPECT_TRUE(std::equal(bits.begin(), bits.end(), tmp.begin()));
   }
-}
\ No newline at end of file
+}
+
+TEST(vector_file, VecMatrixEmptyRows)
+{
+  // rows between runs of empty rows, the long runs being holes in uncompressed plain files
+  uint32_t bits = 100;
+  size_t row_bytes = NBYTES(bits);
+  std::vector<uint64_t> runs {0, 3, 0, 10000, 1, 0, 70000};
+  std::vector<std::vector<uint8_t>> rows;
+  std::vector<uint8_t> expected;
+  for (size_t i = 0; i < runs.size(); i++)
+  {
+    expected.resize(expected.size() + runs[i] * row_bytes, 0);
+    if (i + 1 == runs.size())
+      break;
+    rows.emplace_back(row_bytes);
+    for (size_t j = 0; j < rows.back().size(); j++)
+      rows.back()[j] = static_cast<uint8_t>(i * 31 + j + 1);
+    rows.back().back() &= 0x0F;
+    expected.insert(expected.end(), rows.back().begin(), rows.back().end());
+  }
+  uint64_t nb_rows = expected.size() / row_bytes;
+
+  std::vector<uint64_t> sizes;
+  for (bool rle : {false, true})
+  {
+    for (bool lz4 : {false, true})
+    {
+      std::string path = fmt::format("./tests_tmp/m_rle{}_lz4{}.vec", rle, lz4);
+      {
+        VectorMatrixWriter<8192> vmw(path, bits, 2, 3, 0, nb_rows, lz4, rle);
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+          vmw.write_empty(runs[i]);
+          vmw.write(rows[i]);
+        }
+        vmw.write_empty(runs.back());
+      }
+      sizes.push_back(fs::file_size(path));
+
+      VectorMatrixReader<8192> vmr(path);
+      EXPECT_EQ(vmr.infos().rle(), rle);
+      EXPECT_EQ(vmr.infos().compressed, lz4);
+      EXPECT_EQ(vmr.infos().bits, bits);
+      EXPECT_EQ(vmr.infos().window, nb_rows);
+
+      // rows are read in chunks which do not match their size
+      std::vector<uint8_t> tmp(expected.size() + 8, 0xFF);
+      size_t done = 0;
+      for (size_t chunk = 7; done < expected.size(); chunk = chunk * 3 % 1000 + 1)
+      {
+        chunk = std::min(chunk, expected.size() - done);
+        ASSERT_TRUE(vmr.read(reinterpret_cast<char*>(&tmp[done]), chunk));
+        done += chunk;
+      }
+      EXPECT_TRUE(std::equal(expected.begin(), expected.end(), tmp.begin()))
+        << "rle=" << rle << " lz4=" << lz4;
+      EXPECT_FALSE(vmr.read(reinterpret_cast<char*>(&tmp[done]), 8));
+    }
+  }
+  // plain file: header and rows; run-length: one record per row plus the trailing one
+  uint64_t header = sizes[0] - expected.size();
+  EXPECT_EQ(sizes[2], header + rows.size() * (8 + row_bytes) + 8);
+  EXPECT_LT(sizes[3], sizes[1]);
+}
+
+namespace {
+
+std::string file_bytes(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+};
+
+TEST(vector_file, TransposedVecMatrix)
+{
+  // 75 samples and a window which is not a multiple of 8, bands of 512 rows
+  uint32_t bits = 75;
+  uint64_t window = 3001;
+  size_t row_bytes = NBYTES(bits);
+  // (empty rows before, rows), the second gap covers a whole band
+  std::vector<std::pair<uint64_t, uint64_t>> runs {{0, 300}, {5, 200}, {1100, 400}, {1, 900}};
+  std::vector<std::vector<uint8_t>> rows;
+  uint32_t state = 1;
+  for (auto& [gap, n] : runs)
+  {
+    for (uint64_t i = 0; i < n; i++)
+    {
+      rows.emplace_back(row_bytes);
+      for (auto& b : rows.back())
+        b = (state = state * 1103515245 + 12345) >> 24;
+      rows.back().back() &= 0x07;
+    }
+  }
+
+  auto write_rows = [&](auto& writer) {
+    size_t r = 0;
+    for (auto& [gap, n] : runs)
+    {
+      writer.write_empty(gap);
+      for (uint64_t i = 0; i < n; i++)
+        writer.write(rows[r++]);
+    }
+  };
+
+  // rows written as bf, loaded and transposed in memory
+  {
+    VectorMatrixWriter<8192> vmw("./tests_tmp/bft.tmp", bits, 0, 4, 100, window, false);
+    write_rows(vmw);
+  }
+  BitMatrix mat(ROUND_UP(window, 8), ROUND_UP(bits, 8) / 8, true);
+  {
+    VectorMatrixReader<8192> vmr("./tests_tmp/bft.tmp");
+    vmr.load(mat);
+  }
+  BitMatrix* trp = mat.transpose();
+  for (bool lz4 : {false, true})
+  {
+    std::string expected = fmt::format("./tests_tmp/bft_{}.expected", lz4);
+    {
+      VectorMatrixWriter<8192> vmw(expected, bits, 0, 4, 100, window, lz4);
+      vmw.dump(*trp);
+    }
+
+    km::TaskPool pool(3);
+    for (size_t nb_threads : {1, 3})
+    {
+      std::string path = fmt::format("./tests_tmp/bft_{}_{}", lz4, nb_threads);
+      {
+        TransposedVectorMatrixWriter<8192> tvmw(path, bits, 0, 4, 100, window, lz4, nb_threads, 1);
+        write_rows(tvmw);
+      }
+      EXPECT_EQ(file_bytes(path), file_bytes(expected)) << "lz4=" << lz4 << " threads=" << nb_threads;
+    }
+  }
+  delete trp;
+}
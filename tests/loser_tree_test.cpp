@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <kmtricks/loser_tree.hpp>
+#include <kmtricks/merge.hpp>
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+// Merges sorted runs with a loser tree, exhausted runs being greater than any other.
+std::vector<std::pair<int, uint32_t>> tree_merge(const std::vector<std::vector<int>>& runs)
+{
+  std::vector<size_t> heads(runs.size(), 0);
+  auto less = [&](uint32_t a, uint32_t b) {
+    bool ea = heads[a] == runs[a].size();
+    bool eb = heads[b] == runs[b].size();
+    if (ea || eb)
+      return !ea && eb;
+    if (runs[a][heads[a]] != runs[b][heads[b]])
+      return runs[a][heads[a]] < runs[b][heads[b]];
+    return a < b;
+  };
+  km::LoserTree<decltype(less)> tree(runs.size(), less);
+  std::vector<std::pair<int, uint32_t>> out;
+  while (!tree.empty())
+  {
+    uint32_t w = tree.top();
+    if (heads[w] == runs[w].size())
+      break;
+    out.emplace_back(runs[w][heads[w]++], w);
+    tree.replay(w);
+  }
+  return out;
+}
+
+};
+
+TEST(loser_tree, empty)
+{
+  auto less = [](uint32_t a, uint32_t b) { return a < b; };
+  km::LoserTree<decltype(less)> tree(0, less);
+  EXPECT_TRUE(tree.empty());
+  EXPECT_EQ(tree.size(), 0);
+  EXPECT_TRUE(tree_merge({}).empty());
+}
+
+TEST(loser_tree, single)
+{
+  std::vector<std::vector<int>> runs {{1, 3, 3, 7}};
+  auto out = tree_merge(runs);
+  ASSERT_EQ(out.size(), 4);
+  for (size_t i = 0; i < out.size(); i++)
+  {
+    EXPECT_EQ(out[i].first, runs[0][i]);
+    EXPECT_EQ(out[i].second, 0);
+  }
+  EXPECT_TRUE(tree_merge({{}}).empty());
+}
+
+TEST(loser_tree, ties)
+{
+  // equal keys come out by source index
+  std::vector<std::vector<int>> runs {{2, 5}, {}, {2, 2, 5}, {5}, {2}};
+  auto out = tree_merge(runs);
+  std::vector<std::pair<int, uint32_t>> expected {
+    {2, 0}, {2, 2}, {2, 2}, {2, 4}, {5, 0}, {5, 2}, {5, 3}
+  };
+  EXPECT_EQ(out, expected);
+}
+
+TEST(loser_tree, random)
+{
+  std::mt19937 rng(42);
+  for (uint32_t n : {2, 3, 7, 16, 33, 100})
+  {
+    std::vector<std::vector<int>> runs(n);
+    std::vector<std::pair<int, uint32_t>> expected;
+    for (uint32_t i = 0; i < n; i++)
+    {
+      runs[i].resize(rng() % 50);
+      for (auto& v : runs[i])
+        v = rng() % 100;
+      std::sort(runs[i].begin(), runs[i].end());
+      for (auto& v : runs[i])
+        expected.emplace_back(v, i);
+    }
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(tree_merge(runs), expected);
+  }
+}
+
+TEST(loser_tree, merger_without_input)
+{
+  std::vector<std::string> paths;
+  std::vector<uint32_t> a;
+  km::HashMerger<255, 32768, km::HashReader<255>> m(paths, a, 1, 1);
+  EXPECT_FALSE(m.next());
+}
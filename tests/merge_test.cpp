@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include <kmtricks/merge.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
 
 TEST(merge, hash_merge)
@@ -76,4 +79,314 @@ TEST(merge, kmer_merge)
     while (m.next()) { count++; }
     EXPECT_EQ(count, 82);
   }
-}
\ No newline at end of file
+}
+namespace {
+
+std::string file_bytes(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+std::string matrix_text(const std::string& path)
+{
+  km::MatrixReader reader(path);
+  std::stringstream ss;
+  reader.write_as_text<32, std::numeric_limits<uint32_t>::max()>(ss);
+  return ss.str();
+}
+
+};
+
+TEST(merge, split_merge_same_output)
+{
+  constexpr size_t MC = std::numeric_limits<uint32_t>::max();
+  std::vector<std::string> paths {
+    "./data/partitions/kmers/partition_3/D1.kmer",
+    "./data/partitions/kmers/partition_3/D2.kmer",
+  };
+  std::vector<uint32_t> a {1, 1};
+  auto splitters = km::KmerMerger<32, MC>::sample_splitters(paths, 3, 4, 1);
+  ASSERT_EQ(splitters.size(), 2);
+
+  // sub-ranges run on the idle workers of a pool
+  km::TaskPool pool(2);
+  for (bool lz4 : {false, true})
+  {
+    std::string whole = "./tests_tmp/merge_whole.mat";
+    std::string split = "./tests_tmp/merge_split.mat";
+    {
+      km::KmerMerger<32, MC> m(paths, a, 31, 1, 1);
+      m.write_as_bin(whole, lz4);
+    }
+    km::split_merge(split, splitters, km::get_header_size<km::MatrixFileHeader>(),
+      [&](const km::MergeRange<km::Kmer<32>>& range, const std::string& path) {
+        km::KmerMerger<32, MC> m(paths, a, 31, 1, 1, range);
+        m.write_as_bin(path, lz4);
+      });
+
+    // lz4 frames of the sub-ranges are concatenated, the decoded rows are the same
+    std::string rows = matrix_text(split);
+    EXPECT_EQ(std::count(rows.begin(), rows.end(), '\n'), 82);
+    if (lz4)
+      EXPECT_EQ(rows, matrix_text(whole));
+    else
+      EXPECT_EQ(file_bytes(split), file_bytes(whole));
+  }
+}
+
+TEST(merge, hierarchical_same_output)
+{
+  constexpr size_t MC = std::numeric_limits<uint32_t>::max();
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < 7; i++)
+    paths.push_back("./data/partitions/kmers/partition_2/D" + std::to_string(i % 2 + 1) + ".kmer");
+  std::vector<uint32_t> a {1, 2, 1, 3, 1, 1, 2};
+
+  std::string flat = "./tests_tmp/merge_flat.mat";
+  {
+    km::KmerMerger<32, MC> m(paths, a, 31, 2, 1);
+    m.write_as_bin(flat, false);
+  }
+
+  // groups of 2 give two levels of intermediate matrices
+  std::string reduced = "./tests_tmp/merge_reduced.mat";
+  std::vector<std::string> inputs = km::reduce_merge_inputs(paths, 2, reduced,
+    [](std::vector<std::string>& group, std::vector<uint32_t>& th, const std::string& path) {
+      km::KmerMerger<32, MC> m(group, th, 31, 0, 0);
+      m.write_as_bin(path, true);
+    });
+  EXPECT_LE(inputs.size(), 2);
+  {
+    km::KmerMerger<32, MC> m(inputs, a, 31, 2, 1);
+    m.write_as_bin(reduced, false);
+  }
+  EXPECT_EQ(file_bytes(reduced), file_bytes(flat));
+  EXPECT_GT(matrix_text(flat).size(), 0);
+}
+
+TEST(merge, read_ahead_same_output)
+{
+  constexpr size_t MC = std::numeric_limits<uint32_t>::max();
+  std::vector<std::string> plain, compressed;
+  for (size_t i = 1; i <= 2; i++)
+  {
+    std::string path = "./data/partitions/kmers/partition_3/D" + std::to_string(i) + ".kmer";
+    std::string copy = "./tests_tmp/read_ahead_D" + std::to_string(i) + ".kmer";
+    {
+      km::KmerReader<8192> in(path);
+      km::KmerWriter<8192> out(copy, 31, 1, i - 1, 3, true);
+      km::Kmer<32> kmer; kmer.set_k(31); uint8_t count;
+      while (in.read<32, 255>(kmer, count))
+        out.write<32, 255>(kmer, count);
+    }
+    plain.push_back(path);
+    compressed.push_back(copy);
+  }
+  std::vector<uint32_t> a {1, 1};
+
+  for (std::vector<std::string> paths : {plain, compressed})
+  {
+    std::string ref = "./tests_tmp/read_ahead_ref.mat";
+    {
+      km::KmerMerger<32, MC> m(paths, a, 31, 1, 1);
+      m.write_as_bin(ref, false);
+    }
+    // blocks smaller than the files, so that reads span two blocks
+    for (size_t read_ahead : {7, 64, 4096})
+    {
+      std::string path = "./tests_tmp/read_ahead.mat";
+      {
+        km::KmerMerger<32, MC> m(paths, a, 31, 1, 1, {}, read_ahead);
+        m.write_as_bin(path, false);
+      }
+      EXPECT_EQ(file_bytes(path), file_bytes(ref)) << read_ahead;
+    }
+    std::string rows = matrix_text(ref);
+    EXPECT_EQ(std::count(rows.begin(), rows.end(), '\n'), 82);
+  }
+}
+
+#ifdef WITH_PLUGIN
+#include <dlfcn.h>
+
+namespace {
+
+using plugin_count_t = km::MergeBatch::count_type;
+
+// Drops some rows and rewrites the counts of the others, the same way per row and by batch.
+class BatchPlugin : public km::IMergePlugin
+{
+public:
+  // PER_ROW uses process_kmer/process_hash, FALLBACK the default process_*_batch.
+  enum Mode { PER_ROW, FALLBACK, ROW_MAJOR, COLUMN_MAJOR };
+
+  BatchPlugin(Mode mode, size_t batch) : m_mode(mode), m_batch(mode == PER_ROW ? 0 : batch) {}
+
+  size_t batch_size() const override { return m_batch; }
+  bool column_major() const override { return m_mode == COLUMN_MAJOR; }
+
+  bool process_kmer(const uint64_t* kmer_data, std::vector<plugin_count_t>& counts) override
+  {
+    return process_hash(kmer_data[0], counts);
+  }
+
+  bool process_hash(uint64_t h, std::vector<plugin_count_t>& counts) override
+  {
+    bool k = keep(h, [&](size_t s) { return counts[s]; }, counts.size());
+    for (size_t s=0; s<counts.size(); s++)
+      counts[s] = rewrite(counts[s], s);
+    return k;
+  }
+
+  void process_kmer_batch(km::MergeBatch& batch) override { process_batch(batch, false); }
+  void process_hash_batch(km::MergeBatch& batch) override { process_batch(batch, true); }
+
+  size_t batches {0};
+  size_t rows {0};
+  size_t last_size {0};
+
+private:
+  template<typename Count>
+  static bool keep(uint64_t key, Count&& count, size_t nb_samples)
+  {
+    uint64_t sum = 0;
+    for (size_t s=0; s<nb_samples; s++)
+      sum += count(s);
+    return key % 3 != 0 || sum > 2;
+  }
+
+  static plugin_count_t rewrite(plugin_count_t c, size_t s) { return c * 2 + s; }
+
+  void process_batch(km::MergeBatch& batch, bool hash)
+  {
+    EXPECT_GT(batch.size, 0);
+    EXPECT_LE(batch.size, m_batch);
+    EXPECT_EQ(batch.column_major, m_mode == COLUMN_MAJOR);
+    batches++;
+    rows += batch.size;
+    last_size = batch.size;
+
+    if (m_mode == FALLBACK)
+    {
+      if (hash)
+        IMergePlugin::process_hash_batch(batch);
+      else
+        IMergePlugin::process_kmer_batch(batch);
+      return;
+    }
+
+    for (size_t i=0; i<batch.size; i++)
+      batch.set_keep(i, keep(*batch.key(i), [&](size_t s) { return batch.count(i, s); }, batch.nb_samples));
+
+    if (m_mode == COLUMN_MAJOR)
+    {
+      for (size_t s=0; s<batch.nb_samples; s++)
+      {
+        plugin_count_t* column = batch.column(s);
+        for (size_t i=0; i<batch.size; i++)
+          column[i] = rewrite(column[i], s);
+      }
+    }
+    else
+    {
+      for (size_t i=0; i<batch.size; i++)
+        for (size_t s=0; s<batch.nb_samples; s++)
+          batch.count(i, s) = rewrite(batch.count(i, s), s);
+    }
+  }
+
+  Mode m_mode;
+  size_t m_batch;
+};
+
+template<typename Merger, typename Make>
+void check_batched_plugin(Make&& make, size_t nb_rows)
+{
+  std::string ref = "./tests_tmp/plugin_per_row.mat";
+  {
+    BatchPlugin plugin(BatchPlugin::PER_ROW, 0);
+    Merger m = make();
+    m.set_plugin(&plugin);
+    m.write_as_bin(ref, false);
+    EXPECT_EQ(plugin.batches, 0);
+  }
+  // some rows are dropped by the plugin, the others are kept
+  size_t kept = 0;
+  {
+    BatchPlugin plugin(BatchPlugin::PER_ROW, 0);
+    Merger m = make();
+    m.set_plugin(&plugin);
+    while (m.next())
+      kept += m.keep();
+  }
+  EXPECT_GT(kept, 0);
+  EXPECT_LT(kept, nb_rows);
+
+  for (auto mode : {BatchPlugin::FALLBACK, BatchPlugin::ROW_MAJOR, BatchPlugin::COLUMN_MAJOR})
+  {
+    // 5 and 64 do not divide the partition, 1000 is larger than it
+    for (size_t batch : {1, 5, 64, 1000})
+    {
+      std::string path = "./tests_tmp/plugin_batched.mat";
+      BatchPlugin plugin(mode, batch);
+      {
+        Merger m = make();
+        m.set_plugin(&plugin);
+        m.write_as_bin(path, false);
+      }
+      EXPECT_EQ(file_bytes(path), file_bytes(ref)) << mode << " " << batch;
+      EXPECT_EQ(plugin.rows, nb_rows);
+      EXPECT_EQ(plugin.batches, (nb_rows + batch - 1) / batch);
+      EXPECT_EQ(plugin.last_size, nb_rows - (plugin.batches - 1) * batch);
+    }
+  }
+}
+
+};
+
+TEST(merge, batched_plugin_kmer)
+{
+  constexpr size_t MC = DMAX_C;
+  using merger_t = km::KmerMerger<32, MC>;
+  std::vector<std::string> paths {
+    "./data/partitions/kmers/partition_3/D1.kmer",
+    "./data/partitions/kmers/partition_3/D2.kmer",
+  };
+  std::vector<uint32_t> a {1, 1};
+  ASSERT_NE(82 % 5, 0);
+  check_batched_plugin<merger_t>([&]() { return merger_t(paths, a, 31, 1, 1); }, 82);
+}
+
+TEST(merge, batched_plugin_hash)
+{
+  constexpr size_t MC = DMAX_C;
+  using merger_t = km::HashMerger<MC, 32768, km::HashMergeReader<MC>>;
+  std::vector<std::string> paths {
+    "./data/partitions/hashes/partition_3/D1.hash",
+    "./data/partitions/hashes/partition_3/D2.hash",
+  };
+  std::vector<uint32_t> a {1, 1};
+  check_batched_plugin<merger_t>([&]() { return merger_t(paths, a, 1, 1); }, 82);
+}
+
+TEST(merge, plugin_api_version_refused)
+{
+  // any shared library without plugin_api_version, here the one which provides dlopen
+  Dl_info info;
+  ASSERT_NE(dladdr(reinterpret_cast<void*>(&dlopen), &info), 0);
+  std::string lib = info.dli_fname;
+
+  auto& manager = km::PluginManager<km::IMergePlugin>::get();
+  try
+  {
+    manager.init(lib, "", 32);
+    FAIL() << lib << " was loaded";
+  }
+  catch (const km::PluginError& e)
+  {
+    EXPECT_NE(e.get_msg().find("plugin API version 1,"), std::string::npos) << e.get_msg();
+  }
+  EXPECT_FALSE(manager.use_plugin());
+}
+#endif
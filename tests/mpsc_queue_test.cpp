@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <kmtricks/mpsc_queue.hpp>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST(mpsc_queue, single_thread)
+{
+  km::MPSCQueue<int> queue;
+  int value = 0;
+  EXPECT_FALSE(queue.pop(value));
+  for (int i = 0; i < 10; i++)
+    queue.push(i);
+  for (int i = 0; i < 10; i++)
+  {
+    ASSERT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(queue.pop(value));
+}
+
+TEST(mpsc_queue, producers)
+{
+  // (producer, sequence number), popped while the producers push
+  constexpr size_t nb_producers = 4;
+  constexpr size_t per_producer = 100000;
+  km::MPSCQueue<std::pair<size_t, size_t>> queue;
+
+  std::vector<std::thread> producers;
+  for (size_t p = 0; p < nb_producers; p++)
+    producers.emplace_back([&queue, p]() {
+      for (size_t i = 0; i < per_producer; i++)
+        queue.push({p, i});
+    });
+
+  std::vector<size_t> next(nb_producers, 0);
+  size_t popped = 0;
+  std::pair<size_t, size_t> value;
+  while (popped < nb_producers * per_producer)
+  {
+    if (!queue.pop(value))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_LT(value.first, nb_producers);
+    // neither lost nor duplicated, in the order of each producer
+    ASSERT_EQ(value.second, next[value.first]);
+    next[value.first]++;
+    popped++;
+  }
+  for (auto& t : producers)
+    t.join();
+  EXPECT_FALSE(queue.pop(value));
+  for (size_t p = 0; p < nb_producers; p++)
+    EXPECT_EQ(next[p], per_producer);
+}
+
+TEST(mpsc_queue, destroyed_with_values)
+{
+  auto value = std::make_shared<int>(1);
+  {
+    km::MPSCQueue<std::shared_ptr<int>> queue;
+    queue.push(value);
+    queue.push(value);
+    EXPECT_EQ(value.use_count(), 3);
+  }
+  EXPECT_EQ(value.use_count(), 1);
+}
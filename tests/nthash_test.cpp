@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <kmtricks/kmer_hash.hpp>
+#include <kmtricks/nthash.hpp>
+
+#include <random>
+
+using namespace km;
+
+namespace {
+
+// Packs seq[first, first + k), the last nucleotide in the low bits.
+std::vector<uint64_t> pack(const std::vector<uint8_t>& seq, size_t first, size_t k)
+{
+  std::vector<uint64_t> words((k + 31) / 32, 0);
+  for (size_t j = 0; j < k; j++)
+    words[j >> 5] |= static_cast<uint64_t>(seq[first + k - 1 - j]) << (2 * (j & 31));
+  return words;
+}
+
+std::vector<uint8_t> rev_comp(const std::vector<uint8_t>& seq)
+{
+  std::vector<uint8_t> rc(seq.rbegin(), seq.rend());
+  for (auto& n : rc)
+    n ^= 2;
+  return rc;
+}
+
+};
+
+TEST(nthash, roll_vs_recompute)
+{
+  std::mt19937 rng(17);
+  for (size_t k : {1, 2, 5, 31, 32, 33, 63, 64, 65, 95})
+  {
+    std::vector<uint8_t> seq(k + 300);
+    for (auto& n : seq)
+      n = rng() & 3;
+    std::vector<uint8_t> rc = rev_comp(seq);
+
+    size_t n = seq.size() - k + 1;
+    std::vector<uint64_t> hashes;
+    NtHash rolled(k);
+    rolled.init(pack(seq, 0, k).data());
+    for (size_t i = 0; i < n; i++)
+    {
+      if (i)
+        rolled.roll(seq[i - 1], seq[i + k - 1]);
+      uint64_t h = NtHash::hash(k, pack(seq, i, k).data(), 42);
+      ASSERT_EQ(rolled.value(42), h) << "k=" << k << " i=" << i;
+
+      NtHash scratch(k);
+      scratch.init(pack(seq, i, k).data());
+      ASSERT_EQ(scratch.value(42), h);
+      hashes.push_back(h);
+    }
+
+    // the reverse complement gives the same canonical values, in reverse order
+    rolled.init(pack(rc, 0, k).data());
+    for (size_t i = 0; i < n; i++)
+    {
+      if (i)
+        rolled.roll(rc[i - 1], rc[i + k - 1]);
+      ASSERT_EQ(rolled.value(42), hashes[n - 1 - i]) << "k=" << k << " i=" << i;
+      ASSERT_EQ(NtHash::hash(k, pack(rc, i, k).data(), 42), hashes[n - 1 - i]);
+    }
+  }
+}
+
+TEST(nthash, kmer_hashers)
+{
+  std::string s = "ACGTTGCAAGCTTACGGATCCAGTACGATTAGCCATGACTGACGTACAGT";
+  for (size_t k : {21, 31, 45})
+  {
+    Kmer<64> kmer(s.substr(0, k));
+    Kmer<64> rc = kmer.rev_comp();
+    KmerHashers<2>::Hasher<64> hasher;
+    EXPECT_EQ(hasher(kmer), hasher(rc));
+    EXPECT_NE(hasher(kmer, 1), hasher(kmer));
+
+    uint64_t w = 1000;
+    KmerHashers<2>::WinHasher<64> win(3, w);
+    EXPECT_EQ(win(kmer), NtHash::reduce(hasher(kmer), w) + 3 * w);
+    EXPECT_GE(win(kmer), 3 * w);
+    EXPECT_LT(win(kmer), 4 * w);
+  }
+}
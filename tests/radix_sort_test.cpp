@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <kmtricks/radix_sort.hpp>
+#include <kmtricks/task_pool.hpp>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+
+namespace {
+
+std::vector<uint64_t> random_values(size_t size, uint64_t mask, uint64_t seed)
+{
+  std::mt19937_64 rng(seed);
+  std::vector<uint64_t> values(size);
+  for (auto& v : values)
+    v = rng() & mask;
+  return values;
+}
+
+template<typename T>
+void check_lsd(std::vector<T> values, size_t key_bytes = sizeof(T))
+{
+  std::vector<T> expected = values;
+  std::sort(expected.begin(), expected.end());
+  std::vector<T> buffer(values.size());
+  km::lsd_radix_sort(values.data(), values.size(), buffer.data(), key_bytes);
+  EXPECT_TRUE(values == expected);
+}
+
+void check_hashes(std::vector<uint64_t> values, size_t buffer_size)
+{
+  std::vector<uint64_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  std::vector<uint64_t> buffer(buffer_size);
+  km::radix_sort_hashes(values.data(), values.size(), buffer.data(), buffer_size);
+  EXPECT_EQ(values, expected);
+}
+
+// Runs the slices on n threads.
+struct ThreadRun
+{
+  size_t n;
+
+  template<typename Fn>
+  void operator()(Fn&& fn) const
+  {
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < n; t++)
+      threads.emplace_back([&fn, t, this]() { fn(t, n); });
+    fn(0, n);
+    for (auto& t : threads)
+      t.join();
+  }
+};
+
+};
+
+TEST(radix_sort, below_threshold)
+{
+  check_lsd(random_values(km::radix_sort_threshold - 1, ~0ULL, 1));
+  check_lsd(std::vector<uint64_t>{});
+  check_hashes(random_values(100, ~0ULL, 2), 1 << 16);
+}
+
+TEST(radix_sort, lsd_full_keys)
+{
+  check_lsd(random_values(100000, ~0ULL, 3));
+}
+
+TEST(radix_sort, lsd_skips_uniform_bytes)
+{
+  // high bytes all 0
+  check_lsd(random_values(50000, 0xFFFFF, 4));
+  // a middle byte shared by all values
+  std::vector<uint64_t> values = random_values(50000, 0xFFFF00FFFFULL, 5);
+  for (auto& v : values)
+    v |= 0xAB0000ULL;
+  check_lsd(values);
+  // an odd number of passes leaves the result in the buffer first
+  check_lsd(random_values(50000, 0xFF00FF00FFULL, 6));
+}
+
+TEST(radix_sort, lsd_key_bytes)
+{
+  check_lsd(random_values(30000, 0xFFFFFF, 7), 3);
+}
+
+TEST(radix_sort, lsd_duplicates)
+{
+  check_lsd(random_values(40000, 0xF, 8));
+  check_lsd(std::vector<uint64_t>(40000, 42));
+}
+
+TEST(radix_sort, lsd_wide_keys)
+{
+  std::vector<unsigned __int128> values(20000);
+  std::mt19937_64 rng(9);
+  for (auto& v : values)
+    v = (static_cast<unsigned __int128>(rng() & 0xFFFF) << 64) | rng();
+  check_lsd(values);
+}
+
+TEST(radix_sort, hashes_small_range)
+{
+  check_hashes(random_values(100000, 0xFFFFF, 10), 1 << 17);
+}
+
+TEST(radix_sort, hashes_buckets)
+{
+  // larger than the buffer and than 256 thresholds, spread over buckets first
+  check_hashes(random_values(600000, ~0ULL, 11), 1 << 16);
+  check_hashes(random_values(600000, 0xFFFFFFF, 12), 1 << 12);
+}
+
+TEST(radix_sort, hashes_skewed_buckets)
+{
+  // half of the values in a single bucket larger than the buffer, sorted with std::sort
+  std::vector<uint64_t> values = random_values(600000, 0xFFFFFFFFFF, 13);
+  for (size_t i = 0; i < values.size(); i += 2)
+    values[i] &= 0xFFFFFFF;
+  check_hashes(values, 1 << 16);
+}
+
+TEST(radix_sort, hashes_duplicates)
+{
+  check_hashes(random_values(600000, 0xFF, 14), 1 << 16);
+  check_hashes(std::vector<uint64_t>(600000, 7), 1 << 16);
+  std::vector<uint64_t> two(600000, 7);
+  two.back() = ~0ULL;
+  check_hashes(two, 1 << 16);
+}
+
+TEST(radix_sort, hashes_threads)
+{
+  for (size_t n : {2, 3, 8})
+  {
+    std::vector<uint64_t> values = random_values(800000, ~0ULL, 15 + n);
+    std::vector<uint64_t> expected = values;
+    std::sort(expected.begin(), expected.end());
+    std::vector<uint64_t> buffer(1 << 16);
+    km::radix_sort_hashes(values.data(), values.size(), buffer.data(), buffer.size(),
+                          ThreadRun{n});
+    EXPECT_EQ(values, expected) << n;
+  }
+}
+
+TEST(radix_sort, hashes_leased_workers)
+{
+  km::TaskPool pool(3);
+  std::vector<uint64_t> values = random_values(800000, ~0ULL, 20);
+  std::vector<uint64_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  std::vector<uint64_t> buffer(1 << 16);
+  km::IdleWorkers::Lease lease(2);
+  km::radix_sort_hashes(values.data(), values.size(), buffer.data(), buffer.size(),
+                        [&](auto&& fn) { lease.run(fn); });
+  EXPECT_EQ(values, expected);
+}
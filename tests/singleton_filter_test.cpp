@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <kmtricks/singleton_filter.hpp>
+
+#include <random>
+#include <unordered_map>
+
+using namespace km;
+
+namespace {
+
+struct alignas(SingletonFilter::block_bytes) Block
+{
+  char bytes[SingletonFilter::block_bytes];
+};
+
+};
+
+TEST(singleton_filter, disabled)
+{
+  SingletonFilter none;
+  EXPECT_FALSE(none);
+  std::vector<Block> memory(1);
+  EXPECT_FALSE(SingletonFilter(memory.data(), SingletonFilter::block_bytes - 1));
+  EXPECT_TRUE(SingletonFilter(memory.data(), SingletonFilter::block_bytes));
+}
+
+TEST(singleton_filter, repeated_keys_are_kept)
+{
+  std::mt19937_64 rng(11);
+  // from a lightly loaded filter to one with more keys than counters
+  for (size_t nb_blocks : {4096, 256, 16})
+  {
+    std::vector<Block> memory(nb_blocks);
+    SingletonFilter filter(memory.data(), memory.size() * sizeof(Block));
+
+    std::vector<uint64_t> stream;
+    std::unordered_map<uint64_t, size_t> counts;
+    for (size_t i = 0; i < 20000; i++)
+    {
+      uint64_t key = rng() % 30000;
+      stream.push_back(key);
+      counts[key]++;
+    }
+    for (auto key : stream)
+      filter.add(SingletonFilter::hash(key));
+
+    size_t singletons = 0, kept = 0;
+    for (auto& [key, count] : counts)
+    {
+      bool repeated = filter.repeated(SingletonFilter::hash(key));
+      if (count > 1)
+        ASSERT_TRUE(repeated) << key << " seen " << count << " times, " << nb_blocks << " blocks";
+      else
+      {
+        singletons++;
+        kept += repeated;
+      }
+    }
+    // singletons are dropped as long as the filter is not overloaded
+    if (nb_blocks == 4096)
+      EXPECT_LT(kept, singletons / 100);
+  }
+}
+
+TEST(singleton_filter, adding_twice)
+{
+  std::vector<Block> memory(64);
+  SingletonFilter filter(memory.data(), memory.size() * sizeof(Block));
+  for (uint64_t key = 0; key < 100; key++)
+  {
+    uint64_t h = SingletonFilter::hash(key);
+    EXPECT_FALSE(filter.repeated(h)) << key;
+    filter.add(h);
+    if (key % 2)
+      filter.add(h);
+  }
+  for (uint64_t key = 1; key < 100; key += 2)
+    EXPECT_TRUE(filter.repeated(SingletonFilter::hash(key)));
+
+  // a cleared filter forgets its keys
+  SingletonFilter cleared(memory.data(), memory.size() * sizeof(Block));
+  for (uint64_t key = 0; key < 100; key++)
+    EXPECT_FALSE(cleared.repeated(SingletonFilter::hash(key)));
+}
@@ -0,0 +1,241 @@
+#include <gtest/gtest.h>
+#include <kmtricks/gatb/superk_decoder.hpp>
+#include <kmtricks/io/superk_storage.hpp>
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+// Random super-k-mers: their number of k-mers, then the packed nucleotides. Some are preceded
+// by a null byte and a multiplicity.
+std::vector<uint8_t> random_superks(size_t kmer_size, size_t nb, bool multiplicity, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> stream;
+  for (size_t s = 0; s < nb; s++)
+  {
+    if (multiplicity && s % 3 == 0)
+    {
+      uint32_t count = 2 + rng() % 1000;
+      stream.push_back(0);
+      stream.insert(stream.end(), reinterpret_cast<uint8_t*>(&count),
+                    reinterpret_cast<uint8_t*>(&count) + sizeof(count));
+    }
+    // single k-mers, full ones and the ones between
+    size_t nbk = s % 5 == 0 ? 1 : s % 7 == 0 ? 255 : 1 + rng() % 255;
+    stream.push_back(nbk);
+    for (size_t i = 0; i < (kmer_size + nbk - 1 + 3) / 4; i++)
+      stream.push_back(rng());
+  }
+  return stream;
+}
+
+// The former decoding loop, one nucleotide at a time on the gatb Type.
+template<size_t span>
+struct ReferenceSuperk
+{
+  using Type = typename ::Kmer<span>::Type;
+
+  uint32_t count {1};
+  std::vector<Type> forward, reverse;
+
+  const uint8_t* decode(const uint8_t* ptr, size_t kmer_size)
+  {
+    count = 1;
+    if (*ptr == 0)
+    {
+      std::memcpy(&count, ptr + 1, sizeof(count));
+      ptr += 1 + sizeof(count);
+    }
+    forward.clear(); reverse.clear();
+    Type un; un.setVal(1);
+    Type mask = (un << (kmer_size * 2)) - un;
+    size_t shift = 2 * (kmer_size - 1);
+
+    uint8_t nbk = *ptr++;
+    int rem_size = kmer_size;
+    Type seed, byte;
+    seed.setVal(0);
+    int nbr = 0;
+    uint8_t newbyte = 0;
+    while (rem_size >= 4)
+    {
+      newbyte = *ptr++;
+      byte.setVal(newbyte);
+      seed = seed | (byte << (8 * nbr));
+      rem_size -= 4;
+      nbr++;
+    }
+    int uid = 4;
+    if (rem_size > 0)
+    {
+      newbyte = *ptr++;
+      byte.setVal(newbyte);
+      seed = seed | (byte << (8 * nbr));
+      uid = rem_size;
+    }
+    Type fw = seed & mask;
+    Type rv = revcomp(fw, kmer_size);
+    for (int rem = nbk; rem > 0; rem--)
+    {
+      forward.push_back(fw);
+      reverse.push_back(rv);
+      if (rem < 2)
+        break;
+      if (uid >= 4)
+      {
+        newbyte = *ptr++;
+        uid = 0;
+      }
+      Type nt;
+      nt.setVal((newbyte >> (2 * uid)) & 3);
+      uid++;
+      fw = ((fw << 2) | nt) & mask;
+      nt.setVal(comp_NT[nt.getVal()]);
+      rv = ((rv >> 2) | (nt << shift)) & mask;
+    }
+    return ptr;
+  }
+};
+
+template<size_t span, bool oriented>
+void check_decoder(size_t kmer_size, bool multiplicity)
+{
+  std::vector<uint8_t> stream = random_superks(kmer_size, 200, multiplicity, kmer_size);
+  km::SuperkDecoder<span, oriented> decoder(kmer_size);
+  ReferenceSuperk<span> reference;
+  const uint8_t* ptr = stream.data();
+  const uint8_t* ref = stream.data();
+  size_t nb = 0;
+  while (ref < stream.data() + stream.size())
+  {
+    ref = reference.decode(ref, kmer_size);
+    ptr = decoder.decode(ptr);
+    ASSERT_EQ(ptr, ref) << "k=" << kmer_size << " super-k-mer " << nb;
+    ASSERT_EQ(decoder.size(), reference.forward.size());
+    EXPECT_EQ(decoder.count(), reference.count);
+    for (size_t i = 0; i < decoder.size(); i++)
+    {
+      const auto& fw = reference.forward[i];
+      const auto& rv = reference.reverse[i];
+      EXPECT_TRUE(decoder.canonical()[i] == (fw < rv ? fw : rv)) << "k=" << kmer_size;
+      if constexpr (oriented)
+      {
+        EXPECT_TRUE(decoder.forward()[i] == fw) << "k=" << kmer_size;
+        EXPECT_TRUE(decoder.reverse()[i] == rv) << "k=" << kmer_size;
+      }
+    }
+    nb++;
+  }
+  EXPECT_EQ(nb, 200);
+}
+
+template<size_t span>
+void check_span(std::initializer_list<size_t> kmer_sizes)
+{
+  for (size_t k : kmer_sizes)
+  {
+    check_decoder<span, false>(k, false);
+    check_decoder<span, true>(k, false);
+  }
+}
+
+};
+
+TEST(superk_decoder, one_word)
+{
+  check_span<32>({5, 8, 17, 30, 31});
+}
+
+TEST(superk_decoder, two_words)
+{
+  check_span<64>({32, 33, 47, 60, 63});
+}
+
+TEST(superk_decoder, large_span)
+{
+  check_span<96>({64, 65, 81, 95});
+}
+
+TEST(superk_decoder, multiplicity_header)
+{
+  check_decoder<32, false>(31, true);
+  check_decoder<64, true>(61, true);
+  check_decoder<96, false>(81, true);
+}
+
+TEST(superk_decoder, dedup_writes_multiplicity)
+{
+  std::string dir = "./tests_tmp/superk_dedup";
+  fs::remove_all(dir);
+  size_t kmer_size = 31;
+  std::vector<uint8_t> superks = random_superks(kmer_size, 4, false, 3);
+  std::vector<std::pair<const uint8_t*, size_t>> items;
+  for (const uint8_t* ptr = superks.data(); ptr < superks.data() + superks.size(); )
+  {
+    size_t size = (kmer_size + *ptr - 1 + 3) / 4;
+    items.emplace_back(ptr, size);
+    ptr += 1 + size;
+  }
+  {
+    km::SuperKStorageWriter writer(dir, "skp", 2, false, {0, 1}, false, false, 256);
+    {
+      km::SuperKBuffer buffer(&writer);
+      // the first super-k-mer three times in partition 0, the others once in partition 1
+      for (size_t i = 0; i < 3; i++)
+        buffer.insertSuperkmer(const_cast<uint8_t*>(items[0].first + 1), items[0].second,
+                               *items[0].first, 0);
+      for (size_t i = 1; i < items.size(); i++)
+        buffer.insertSuperkmer(const_cast<uint8_t*>(items[i].first + 1), items[i].second,
+                               *items[i].first, 1);
+    }
+    writer.closeFiles();
+    writer.SaveInfoFile(dir);
+  }
+
+  km::SuperKStorageReader reader(dir);
+  EXPECT_TRUE(reader.hasMultiplicity(0));
+  EXPECT_FALSE(reader.hasMultiplicity(1));
+  EXPECT_EQ(reader.getNbItems(0), 3 * *items[0].first);
+
+  // evictions do not keep the insertion order, super-k-mers are matched by content
+  km::SuperkDecoder<32> decoder(kmer_size);
+  std::vector<bool> found(items.size(), false);
+  for (int p : {0, 1})
+  {
+    reader.openFile(p);
+    unsigned char* buffer = nullptr;
+    unsigned int buffer_size = 0, n = 0;
+    size_t nb = 0;
+    while (reader.readBlock(&buffer, &buffer_size, &n, p))
+    {
+      for (const uint8_t* ptr = buffer; ptr < buffer + n; nb++)
+      {
+        ptr = decoder.decode(ptr);
+        EXPECT_EQ(decoder.count(), p == 0 ? 3 : 1);
+        for (size_t item = p == 0 ? 0 : 1; item < (p == 0 ? 1 : items.size()); item++)
+        {
+          ReferenceSuperk<32> reference;
+          reference.decode(items[item].first, kmer_size);
+          if (found[item] || decoder.size() != reference.forward.size())
+            continue;
+          bool same = true;
+          for (size_t i = 0; i < decoder.size(); i++)
+          {
+            const auto& fw = reference.forward[i];
+            const auto& rv = reference.reverse[i];
+            same &= decoder.canonical()[i] == (fw < rv ? fw : rv);
+          }
+          found[item] = same;
+          if (same)
+            break;
+        }
+      }
+    }
+    free(buffer);
+    reader.closeFile(p);
+    EXPECT_EQ(nb, p == 0 ? 1 : items.size() - 1);
+  }
+  EXPECT_EQ(std::count(found.begin(), found.end(), true), items.size());
+}
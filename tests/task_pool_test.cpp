@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <kmtricks/task_pool.hpp>
+
+#include <atomic>
+#include <chrono>
+
+namespace {
+
+// Counts the threads running a task or a slice, and the most seen at once.
+struct Activity
+{
+  std::atomic<size_t> active {0};
+  std::atomic<size_t> peak {0};
+  std::atomic<size_t> slices {0};
+
+  void work()
+  {
+    size_t now = ++active;
+    size_t p = peak;
+    while (now > p && !peak.compare_exchange_weak(p, now));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    --active;
+  }
+};
+
+class LeasingTask : public km::ITask
+{
+public:
+  LeasingTask(Activity& activity) : ITask(0), m_activity(activity) {}
+
+  void preprocess() {}
+  void postprocess() {}
+  void exec()
+  {
+    m_activity.work();
+    km::IdleWorkers::Lease lease(km::IdleWorkers::get().workers());
+    EXPECT_LT(lease.size(), km::IdleWorkers::get().workers());
+    lease.run([&](size_t t, size_t n) {
+      EXPECT_LT(t, n);
+      m_activity.slices++;
+      m_activity.work();
+    });
+  }
+
+private:
+  Activity& m_activity;
+};
+
+};
+
+TEST(task_pool, lease_without_pool)
+{
+  km::IdleWorkers::Lease lease(8);
+  EXPECT_EQ(lease.size(), 0);
+  size_t calls = 0;
+  lease.run([&](size_t t, size_t n) { EXPECT_EQ(t, 0); EXPECT_EQ(n, 1); calls++; });
+  EXPECT_EQ(calls, 1);
+}
+
+TEST(task_pool, leases_stay_within_pool)
+{
+  Activity activity;
+  size_t nb_tasks = 32;
+  {
+    km::TaskPool pool(3);
+    for (size_t i = 0; i < nb_tasks; i++)
+      pool.add_task(std::make_shared<LeasingTask>(activity));
+    pool.join_all();
+  }
+  EXPECT_LE(activity.peak, 3);
+  EXPECT_GE(activity.slices, nb_tasks);
+  EXPECT_EQ(km::IdleWorkers::get().workers(), 0);
+}
+
+TEST(task_pool, lease_rethrows)
+{
+  km::TaskPool pool(2);
+  km::IdleWorkers::Lease lease(1);
+  EXPECT_EQ(lease.size(), 1);
+  EXPECT_THROW(lease.run([](size_t t, size_t) { if (t == 1) throw std::runtime_error("slice"); }),
+               std::runtime_error);
+}